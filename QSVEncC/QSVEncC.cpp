@@ -242,11 +242,18 @@ static tstring help() {
 #endif
 #if ENABLE_AVISYNTH_READER
         _T("   --avs                        set input as avs format\n")
+        _T("   --avs-prefetch <int>         prefetch frames from avs ahead of encoding\n")
+        _T("                                  default: 0 (off)\n")
+        _T("   --avs-prefetch-threads <int> set num of threads for avs prefetch\n")
+        _T("                                  default: 1, >1 requires MT-safe script\n")
 #endif
 #if ENABLE_VAPOURSYNTH_READER
         _T("   --vpy                        set input as vpy format\n")
         _T("   --vpy-mt                     set input as vpy format in multi-thread\n")
 #endif
+#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+        _T("   --sm                         set input as shared memory ring buffer\n")
+#endif
 #if ENABLE_AVSW_READER
         _T("   --avhw                       set input to use avcodec + qsv\n")
         _T("   --avsw                       set input to use avcodec + sw decoder\n")
@@ -361,7 +368,11 @@ static tstring help() {
         _T("-m,--mux-option <string1>:<string2>\n")
         _T("                                set muxer option name and value.\n")
         _T("                                 these could be only used with\n")
-        _T("                                 avqsv reader and avcodec muxer.\n"),
+        _T("                                 avqsv reader and avcodec muxer.\n")
+        _T("   --mp4-fragment [<int>]       output fragmented mp4, playable while writing\n")
+        _T("                                 and no rewrite of the file at the end.\n")
+        _T("                                 fragments are cut at keyframes (GOP),\n")
+        _T("                                 after at least <int> ms (default: 0).\n"),
         QSV_DEFAULT_AUDIO_IGNORE_DECODE_ERROR
 #endif
     );
@@ -539,13 +550,17 @@ static tstring help() {
         //_T("   --sw                         use software encoding, instead of QSV (hw)\n")
         _T("   --input-buf <int>            buffer size for input in frames (%d-%d)\n")
         _T("                                 default   hw: %d,  sw: %d\n")
-        _T("                                 cannot be used with avqsv reader.\n"),
+        _T("                                 cannot be used with avqsv reader.\n")
+        _T("   --input-batch <int>          frames read at once into the input buffer\n")
+        _T("                                 (1-input-buf), default: 0 (auto = input-buf/4)\n"),
         QSV_INPUT_BUF_MIN, QSV_INPUT_BUF_MAX,
         QSV_DEFAULT_INPUT_BUF_HW, QSV_DEFAULT_INPUT_BUF_SW
         );
     str += strsprintf(_T("")
         _T("   --output-buf <int>           buffer size for output in MByte\n")
-        _T("                                 default %d MB (0-%d)\n"),
+        _T("                                 default %d MB (0-%d)\n")
+        _T("   --output-async               write output file on a separate thread\n")
+        _T("                                 using double buffered blocks of output-buf.\n"),
         QSV_DEFAULT_OUTPUT_BUF_MB, RGY_OUTPUT_BUF_MB_MAX
         );
     str += strsprintf(_T("")
@@ -564,6 +579,7 @@ static tstring help() {
 #if 0
         _T("   --audio-thread <int>         set audio thread num, available only with output thread\n")
         _T("                                 -1: auto (= default)\n")
+        _T("                                     use one thread if 2 or more audio tracks are transcoded\n")
         _T("                                  0: disable (slow, but less memory usage)\n")
         _T("                                  1: use one thread\n")
         _T("                                  2: use two thread\n")
@@ -575,6 +591,11 @@ static tstring help() {
         _T("                                 this will cause lower performance!\n")
         _T("   --max-procfps <int>         limit processing speed to lower resource usage.\n")
         _T("                                 default:0 (no limit)\n")
+        _T("   --thread-pool <int>          set num of threads for shared thread pool\n")
+        _T("                                 used for color conversion and audio transcoding\n")
+        _T("                                 default: 0 (=auto)\n")
+        _T("   --thread-pool-affinity <int> set cpu affinity mask for shared thread pool\n")
+        _T("                                 ex. 0xff00, default: 0 (=no limit)\n")
         );
     str += strsprintf(
         _T("   --log <string>               output log to file (txt or html).\n")
@@ -611,14 +632,12 @@ static tstring help() {
         _T("                                 all          ... monitor all info\n")
         _T("                                 cpu_total    ... cpu total usage (%%)\n")
         _T("                                 cpu_kernel   ... cpu kernel usage (%%)\n")
-#if defined(_WIN32) || defined(_WIN64)
         _T("                                 cpu_main     ... cpu main thread usage (%%)\n")
         _T("                                 cpu_enc      ... cpu encode thread usage (%%)\n")
         _T("                                 cpu_in       ... cpu input thread usage (%%)\n")
         _T("                                 cpu_out      ... cpu output thread usage (%%)\n")
         _T("                                 cpu_aud_proc ... cpu aud proc thread usage (%%)\n")
         _T("                                 cpu_aud_enc  ... cpu aud enc thread usage (%%)\n")
-#endif //#if defined(_WIN32) || defined(_WIN64)
         _T("                                 cpu          ... monitor all cpu info\n")
 #if defined(_WIN32) || defined(_WIN64)
         _T("                                 gpu_load    ... gpu usage (%%)\n")
@@ -626,6 +645,8 @@ static tstring help() {
         _T("                                 gpu         ... monitor all gpu info\n")
 #endif //#if defined(_WIN32) || defined(_WIN64)
         _T("                                 queue       ... queue usage\n")
+        _T("                                 queue_write ... async write queue and speed (MB/s)\n")
+        _T("                                 surf_wait   ... time waiting for free surfaces (ms)\n")
         _T("                                 mem_private ... private memory (MB)\n")
         _T("                                 mem_virtual ... virtual memory (MB)\n")
         _T("                                 mem         ... monitor all memory info\n")
@@ -641,7 +662,10 @@ static tstring help() {
         _T("   --python <string>            set python path for --perf-monitor-plot\n")
         _T("                                 default: python\n")
         _T("   --perf-monitor-interval <int> set perf monitor check interval (millisec)\n")
-        _T("                                 default 250, must be 50 or more\n")
+        _T("                                 default 250, must be 10 or more\n")
+        _T("   --perf-telemetry <string>    output per-frame stage latencies to file\n")
+        _T("   --perf-telemetry-format <string> format of --perf-telemetry\n")
+        _T("                                 json (default), bin\n")
 #if defined(_WIN32) || defined(_WIN64)
         _T("   --(no-)timer-period-tuning   enable(disable) timer period tuning\n")
         _T("                                  default: enabled\n")
@@ -0,0 +1,848 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+#define USE_SSE2  1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+#define USE_AVX   1
+#define USE_AVX2  1
+#define USE_AVX512 1
+
+//gcc 12以降では、immintrin.h内部の_mm512_undefined_*に対して-Wmaybe-uninitializedの誤検知が大量に出るので抑制する
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#include "rgy_simd.h"
+#include <stdint.h>
+#include <string.h>
+#include "convert_csp.h"
+
+#if _MSC_VER >= 1800 && !defined(__AVX512BW__) && !defined(_DEBUG)
+static_assert(false, "do not forget to set /arch:AVX512 for this file.");
+#endif
+
+#if defined(_MSC_VER) || defined(__AVX512BW__)
+
+//端数処理用のマスク
+//AVX512では行末をマスク付きのload/storeで処理するので、行末を超えて読み書きしない
+static __forceinline __mmask64 mask_epi8(int n) {
+    return (n >= 64) ? (__mmask64)-1 : (n <= 0) ? (__mmask64)0 : (__mmask64)(((uint64_t)1 << n) - 1);
+}
+static __forceinline __mmask32 mask_epi16(int n) {
+    return (n >= 32) ? (__mmask32)-1 : (n <= 0) ? (__mmask32)0 : (__mmask32)(((uint32_t)1 << n) - 1);
+}
+
+template<bool use_stream>
+static void __forceinline avx512_memcpy(uint8_t *dst, const uint8_t *src, int size) {
+    //先頭を64byte境界に合わせる
+    const int head = (int)((64 - ((size_t)dst & 63)) & 63);
+    if (head) {
+        const __mmask64 mask = mask_epi8((head < size) ? head : size);
+        _mm512_mask_storeu_epi8(dst, mask, _mm512_maskz_loadu_epi8(mask, src));
+        if (head >= size) {
+            return;
+        }
+        dst += head;
+        src += head;
+        size -= head;
+    }
+#define _mm512_stream_switch_si512(x, zmm) ((use_stream) ? _mm512_stream_si512((x), (zmm)) : _mm512_store_si512((x), (zmm)))
+    for (; size >= 256; dst += 256, src += 256, size -= 256) {
+        __m512i z0 = _mm512_loadu_si512((const __m512i *)(src +   0));
+        __m512i z1 = _mm512_loadu_si512((const __m512i *)(src +  64));
+        __m512i z2 = _mm512_loadu_si512((const __m512i *)(src + 128));
+        __m512i z3 = _mm512_loadu_si512((const __m512i *)(src + 192));
+        _mm512_stream_switch_si512((__m512i *)(dst +   0), z0);
+        _mm512_stream_switch_si512((__m512i *)(dst +  64), z1);
+        _mm512_stream_switch_si512((__m512i *)(dst + 128), z2);
+        _mm512_stream_switch_si512((__m512i *)(dst + 192), z3);
+    }
+#undef _mm512_stream_switch_si512
+    for (; size > 0; dst += 64, src += 64, size -= 64) {
+        const __mmask64 mask = mask_epi8(size);
+        _mm512_mask_storeu_epi8(dst, mask, _mm512_maskz_loadu_epi8(mask, src));
+    }
+}
+
+//8bit x 32 -> 16bit x 32 (下位8bitに格納)
+static __forceinline __m512i load_cvtepu8_epi16(const uint8_t *ptr, int n) {
+    return _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask_epi16(n), ptr));
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4100)
+template<bool highbit_depth>
+static void __forceinline copy_nv12_to_nv12_avx512_internal(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int pixel_size = highbit_depth ? 2 : 1;
+    for (int i = 0; i < 2; i++) {
+        const auto y_range = thread_y_range(crop_up >> i, (height - crop_bottom) >> i, thread_id, thread_n);
+        const uint8_t *srcYLine = (const uint8_t *)src[i] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine = (uint8_t *)dst[i] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            avx512_memcpy<true>(dstLine, srcYLine, y_width * pixel_size);
+        }
+    }
+    _mm256_zeroupper();
+}
+
+void copy_nv12_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_nv12_to_nv12_avx512_internal<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void copy_p010_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_nv12_to_nv12_avx512_internal<true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+//YUY2 128byte (64画素) を Y 64byte と UV 64byte に分離する
+static __forceinline void separate_low_up(__m512i& z0_return_lower, __m512i& z1_return_upper) {
+    const __m512i zMaskLowByte = _mm512_set1_epi16(0x00ff);
+    //packusは128bitレーンごとに処理されるので、最後に並べなおす
+    const __m512i zPermIdx = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+    __m512i z4 = _mm512_srli_epi16(z0_return_lower, 8);
+    __m512i z5 = _mm512_srli_epi16(z1_return_upper, 8);
+
+    z0_return_lower = _mm512_and_si512(z0_return_lower, zMaskLowByte);
+    z1_return_upper = _mm512_and_si512(z1_return_upper, zMaskLowByte);
+
+    z0_return_lower = _mm512_permutexvar_epi64(zPermIdx, _mm512_packus_epi16(z0_return_lower, z1_return_upper));
+    z1_return_upper = _mm512_permutexvar_epi64(zPermIdx, _mm512_packus_epi16(z4, z5));
+}
+
+void convert_yuy2_to_nv12_avx512(void **dst_array, const void **src_array, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const void *src = src_array[0];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcLine = (uint8_t *)src + src_y_pitch_byte * y_range.start_src + crop_left;
+    uint8_t *dstYLine = (uint8_t *)dst_array[0] + dst_y_pitch_byte * y_range.start_dst;
+    uint8_t *dstCLine = (uint8_t *)dst_array[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
+    const int x_fin = width - crop_right - crop_left;
+    for (int y = 0; y < y_range.len; y += 2) {
+        uint8_t *p = srcLine;
+        uint8_t *pw = p + src_y_pitch_byte;
+        __m512i z0, z1, z3;
+        for (int x = 0; x < x_fin; x += 64, p += 128, pw += 128) {
+            const __mmask64 mask0 = mask_epi8((x_fin - x) * 2);
+            const __mmask64 mask1 = mask_epi8((x_fin - x) * 2 - 64);
+            const __mmask64 maskDst = mask_epi8(x_fin - x);
+            //-----------1行目---------------
+            z0 = _mm512_maskz_loadu_epi8(mask0, p +  0);
+            z1 = _mm512_maskz_loadu_epi8(mask1, p + 64);
+
+            separate_low_up(z0, z1);
+            z3 = z1;
+
+            _mm512_mask_storeu_epi8(dstYLine + x, maskDst, z0);
+            //-----------1行目終了---------------
+
+            //-----------2行目---------------
+            z0 = _mm512_maskz_loadu_epi8(mask0, pw +  0);
+            z1 = _mm512_maskz_loadu_epi8(mask1, pw + 64);
+
+            separate_low_up(z0, z1);
+
+            _mm512_mask_storeu_epi8(dstYLine + dst_y_pitch_byte + x, maskDst, z0);
+            //-----------2行目終了---------------
+
+            z1 = _mm512_avg_epu8(z1, z3);  //VUVUVUVUVUVUVUVU
+            _mm512_mask_storeu_epi8(dstCLine + x, maskDst, z1);
+        }
+        srcLine  += src_y_pitch_byte << 1;
+        dstYLine += dst_y_pitch_byte << 1;
+        dstCLine += dst_y_pitch_byte;
+    }
+    _mm256_zeroupper();
+}
+
+static __forceinline __m512i yuv422_to_420_i_interpolate(__m512i z_up, __m512i z_down, int i) {
+    //unpack/packはいずれも128bitレーン内で処理されるので、並べなおしは不要
+    const __m512i zWeight = _mm512_set1_epi16((i == 0) ? (short)((3 << 8) | 1) : (short)((1 << 8) | 3));
+    __m512i z0, z1;
+    z0 = _mm512_unpacklo_epi8(z_down, z_up);
+    z1 = _mm512_unpackhi_epi8(z_down, z_up);
+    z0 = _mm512_maddubs_epi16(z0, zWeight);
+    z1 = _mm512_maddubs_epi16(z1, zWeight);
+    z0 = _mm512_add_epi16(z0, _mm512_set1_epi16(2));
+    z1 = _mm512_add_epi16(z1, _mm512_set1_epi16(2));
+    z0 = _mm512_srai_epi16(z0, 2);
+    z1 = _mm512_srai_epi16(z1, 2);
+    z0 = _mm512_packus_epi16(z0, z1);
+    return z0;
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+void convert_yuy2_to_nv12_i_avx512(void **dst_array, const void **src_array, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const void *src = src_array[0];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcLine = (uint8_t *)src + src_y_pitch_byte * y_range.start_src + crop_left;
+    uint8_t *dstYLine = (uint8_t *)dst_array[0] + dst_y_pitch_byte * y_range.start_dst;
+    uint8_t *dstCLine = (uint8_t *)dst_array[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
+    const int x_fin = width - crop_right - crop_left;
+    for (int y = 0; y < y_range.len; y += 4) {
+        for (int i = 0; i < 2; i++) {
+            uint8_t *p = srcLine;
+            uint8_t *pw = p + (src_y_pitch_byte<<1);
+            __m512i z0, z1, z3;
+            for (int x = 0; x < x_fin; x += 64, p += 128, pw += 128) {
+                const __mmask64 mask0 = mask_epi8((x_fin - x) * 2);
+                const __mmask64 mask1 = mask_epi8((x_fin - x) * 2 - 64);
+                const __mmask64 maskDst = mask_epi8(x_fin - x);
+                //-----------    1+i行目   ---------------
+                z0 = _mm512_maskz_loadu_epi8(mask0, p +  0);
+                z1 = _mm512_maskz_loadu_epi8(mask1, p + 64);
+
+                separate_low_up(z0, z1);
+                z3 = z1;
+
+                _mm512_mask_storeu_epi8(dstYLine + x, maskDst, z0);
+                //-----------1+i行目終了---------------
+
+                //-----------3+i行目---------------
+                z0 = _mm512_maskz_loadu_epi8(mask0, pw +  0);
+                z1 = _mm512_maskz_loadu_epi8(mask1, pw + 64);
+
+                separate_low_up(z0, z1);
+
+                _mm512_mask_storeu_epi8(dstYLine + (dst_y_pitch_byte<<1) + x, maskDst, z0);
+                //-----------3+i行目終了---------------
+                z0 = yuv422_to_420_i_interpolate(z3, z1, i);
+
+                _mm512_mask_storeu_epi8(dstCLine + x, maskDst, z0);
+            }
+            srcLine  += src_y_pitch_byte;
+            dstYLine += dst_y_pitch_byte;
+            dstCLine += dst_y_pitch_byte;
+        }
+        srcLine  += src_y_pitch_byte << 1;
+        dstYLine += dst_y_pitch_byte << 1;
+    }
+    _mm256_zeroupper();
+}
+
+template<bool uv_only>
+static void __forceinline convert_yv12_to_nv12_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint8_t *srcYLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            avx512_memcpy<false>(dstLine, srcYLine, y_width);
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    uint8_t *srcULine = (uint8_t *)src[1] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *srcVLine = (uint8_t *)src[2] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *dstLine = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const int uv_fin = width - crop_right - crop_left; //出力するUVのbyte数
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch_byte) {
+        uint8_t *src_u_ptr = srcULine;
+        uint8_t *src_v_ptr = srcVLine;
+        uint8_t *dst_ptr = dstLine;
+        for (int x = 0; x < uv_fin; x += 128, src_u_ptr += 64, src_v_ptr += 64, dst_ptr += 128) {
+            //U | (V << 8) を16bit単位で作れば、そのままUVUV...の並びになる
+            __m512i z0 = load_cvtepu8_epi16(src_u_ptr +  0, (uv_fin - x + 1) >> 1);
+            __m512i z1 = load_cvtepu8_epi16(src_v_ptr +  0, (uv_fin - x + 1) >> 1);
+            __m512i z2 = load_cvtepu8_epi16(src_u_ptr + 32, (uv_fin - x + 1 - 64) >> 1);
+            __m512i z3 = load_cvtepu8_epi16(src_v_ptr + 32, (uv_fin - x + 1 - 64) >> 1);
+            z0 = _mm512_or_si512(z0, _mm512_slli_epi16(z1, 8));
+            z2 = _mm512_or_si512(z2, _mm512_slli_epi16(z3, 8));
+            _mm512_mask_storeu_epi8(dst_ptr +  0, mask_epi8(uv_fin - x),      z0);
+            _mm512_mask_storeu_epi8(dst_ptr + 64, mask_epi8(uv_fin - x - 64), z2);
+        }
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_nv12_avx512_base<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_uv_yv12_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_nv12_avx512_base<true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+//RGB24 16画素 (48byte) を RGB32 16画素 (64byte) に変換する
+static __forceinline __m512i convert_rgb24_to_rgb32_16pix(const uint8_t *ptr_src, int n) {
+    //各128bitレーンに12byteずつ配置してから、レーン内でshuffleする
+    const __m512i zPermIdx = _mm512_set_epi32(11, 11, 10, 9, 8, 8, 7, 6, 5, 5, 4, 3, 2, 2, 1, 0);
+    const __m512i zShuffle = _mm512_broadcast_i32x4(_mm_set_epi8(-1, 11, 10, 9, -1, 8, 7, 6, -1, 5, 4, 3, -1, 2, 1, 0));
+    __m512i z0 = _mm512_maskz_loadu_epi8(mask_epi8(n * 3), ptr_src);
+    z0 = _mm512_permutexvar_epi32(zPermIdx, z0);
+    return _mm512_shuffle_epi8(z0, zShuffle);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+template<bool reverse>
+static void __forceinline convert_rgb24_to_rgb32_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    const int src_pitch = (reverse) ? -src_y_pitch_byte : src_y_pitch_byte;
+    uint8_t *srcLine = (uint8_t *)src[0] + crop_left * 3
+        + ((reverse) ? src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) : src_y_pitch_byte * y_range.start_src);
+    uint8_t *dstLine = (uint8_t *)dst[0]
+        + ((reverse) ? dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len)) : dst_y_pitch_byte * y_range.start_dst);
+    const int x_fin = width - crop_left - crop_right;
+    for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine += src_pitch) {
+        uint8_t *ptr_src = srcLine;
+        uint8_t *ptr_dst = dstLine;
+        for (int x = 0; x < x_fin; x += 64, ptr_dst += 256, ptr_src += 192) {
+            const int remain = x_fin - x;
+            __m512i z0 = convert_rgb24_to_rgb32_16pix(ptr_src +   0, remain);
+            __m512i z1 = convert_rgb24_to_rgb32_16pix(ptr_src +  48, remain - 16);
+            __m512i z2 = convert_rgb24_to_rgb32_16pix(ptr_src +  96, remain - 32);
+            __m512i z3 = convert_rgb24_to_rgb32_16pix(ptr_src + 144, remain - 48);
+            _mm512_mask_storeu_epi8(ptr_dst +   0, mask_epi8(remain * 4),       z0);
+            _mm512_mask_storeu_epi8(ptr_dst +  64, mask_epi8(remain * 4 -  64), z1);
+            _mm512_mask_storeu_epi8(ptr_dst + 128, mask_epi8(remain * 4 - 128), z2);
+            _mm512_mask_storeu_epi8(ptr_dst + 192, mask_epi8(remain * 4 - 192), z3);
+        }
+    }
+    _mm256_zeroupper();
+}
+
+template<int pixel_byte, bool reverse>
+static void __forceinline copy_rgb_packed_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    const int src_pitch = (reverse) ? -src_y_pitch_byte : src_y_pitch_byte;
+    uint8_t *srcLine = (uint8_t *)src[0] + crop_left * pixel_byte
+        + ((reverse) ? src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) : src_y_pitch_byte * y_range.start_src);
+    uint8_t *dstLine = (uint8_t *)dst[0]
+        + ((reverse) ? dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len)) : dst_y_pitch_byte * y_range.start_dst);
+    const int y_width = width - crop_right - crop_left;
+    for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine += src_pitch) {
+        avx512_memcpy<false>(dstLine, srcLine, y_width * pixel_byte);
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_rgb24_to_rgb32_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_rgb24_to_rgb32_avx512_base<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_rgb24r_to_rgb32_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_rgb24_to_rgb32_avx512_base<true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_rgb32_to_rgb32_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_rgb_packed_avx512_base<4, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_rgb32r_to_rgb32_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_rgb_packed_avx512_base<4, true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_rgb24_to_rgb24_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_rgb_packed_avx512_base<3, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_rgb24r_to_rgb24_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_rgb_packed_avx512_base<3, true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+template<bool uv_only>
+static void __forceinline convert_yv12_to_p010_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const __m512i zOffset = _mm512_set1_epi16(2 << 6);
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint8_t *srcYLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine  = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            uint16_t *dst_ptr = (uint16_t *)dstLine;
+            uint8_t *src_ptr = srcYLine;
+            for (int x = 0; x < y_width; x += 64, dst_ptr += 64, src_ptr += 64) {
+                __m512i z0 = load_cvtepu8_epi16(src_ptr +  0, y_width - x);
+                __m512i z1 = load_cvtepu8_epi16(src_ptr + 32, y_width - x - 32);
+                z0 = _mm512_add_epi16(_mm512_slli_epi16(z0, 8), zOffset);
+                z1 = _mm512_add_epi16(_mm512_slli_epi16(z1, 8), zOffset);
+                _mm512_mask_storeu_epi16(dst_ptr +  0, mask_epi16(y_width - x),      z0);
+                _mm512_mask_storeu_epi16(dst_ptr + 32, mask_epi16(y_width - x - 32), z1);
+            }
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    uint8_t *srcULine = (uint8_t *)src[1] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *srcVLine = (uint8_t *)src[2] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *dstLine  = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const int uv_fin = width - crop_right - crop_left; //出力するUVの要素数
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch_byte) {
+        uint8_t *src_u_ptr = srcULine;
+        uint8_t *src_v_ptr = srcVLine;
+        uint16_t *dst_ptr = (uint16_t *)dstLine;
+        for (int x = 0; x < uv_fin; x += 64, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 64) {
+            //32bit単位で U | (V << 16) を作れば、そのままUVUV...の並びになる
+            const int remain = (uv_fin - x + 1) >> 1;
+            __m512i z0 = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8((__mmask16)mask_epi16(remain),      src_u_ptr +  0));
+            __m512i z1 = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8((__mmask16)mask_epi16(remain),      src_v_ptr +  0));
+            __m512i z2 = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8((__mmask16)mask_epi16(remain - 16), src_u_ptr + 16));
+            __m512i z3 = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8((__mmask16)mask_epi16(remain - 16), src_v_ptr + 16));
+            z0 = _mm512_or_si512(z0, _mm512_slli_epi32(z1, 16));
+            z2 = _mm512_or_si512(z2, _mm512_slli_epi32(z3, 16));
+            z0 = _mm512_add_epi16(_mm512_slli_epi16(z0, 8), zOffset);
+            z2 = _mm512_add_epi16(_mm512_slli_epi16(z2, 8), zOffset);
+            _mm512_mask_storeu_epi16(dst_ptr +  0, mask_epi16(uv_fin - x),      z0);
+            _mm512_mask_storeu_epi16(dst_ptr + 32, mask_epi16(uv_fin - x - 32), z2);
+        }
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_p010_avx512_base<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+template<int in_bit_depth, bool uv_only>
+static void __forceinline convert_yv12_high_to_nv12_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint16_t *srcYLine = (uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
+        uint8_t *dstLine  = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch_byte) {
+            uint8_t *dst_ptr = dstLine;
+            uint16_t *src_ptr = srcYLine;
+            for (int x = 0; x < y_width; x += 64, dst_ptr += 64, src_ptr += 64) {
+                __m512i z0 = _mm512_maskz_loadu_epi16(mask_epi16(y_width - x),      src_ptr +  0);
+                __m512i z1 = _mm512_maskz_loadu_epi16(mask_epi16(y_width - x - 32), src_ptr + 32);
+                z0 = _mm512_srli_epi16(z0, in_bit_depth - 8);
+                z1 = _mm512_srli_epi16(z1, in_bit_depth - 8);
+                //packus_epi16と同じく飽和させる (シフト後は非負なので符号なし飽和でよい)
+                _mm256_mask_storeu_epi8(dst_ptr +  0, mask_epi16(y_width - x),      _mm512_cvtusepi16_epi8(z0));
+                _mm256_mask_storeu_epi8(dst_ptr + 32, mask_epi16(y_width - x - 32), _mm512_cvtusepi16_epi8(z1));
+            }
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    const int src_uv_pitch = src_uv_pitch_byte >> 1;
+    uint16_t *srcULine = (uint16_t *)src[1] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *dstLine  = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const int uv_fin = width - crop_right - crop_left; //出力するUVのbyte数
+    const __m512i zMaskHighByte = _mm512_set1_epi16((short)0xff00);
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch_byte) {
+        uint16_t *src_u_ptr = srcULine;
+        uint16_t *src_v_ptr = srcVLine;
+        uint8_t *dst_ptr = dstLine;
+        for (int x = 0; x < uv_fin; x += 64, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 64) {
+            const __mmask32 maskSrc = mask_epi16((uv_fin - x + 1) >> 1);
+            __m512i z0 = _mm512_maskz_loadu_epi16(maskSrc, src_u_ptr);
+            __m512i z1 = _mm512_maskz_loadu_epi16(maskSrc, src_v_ptr);
+
+            z0 = _mm512_srli_epi16(z0, in_bit_depth - 8);
+            z1 = _mm512_slli_epi16(z1, 16 - in_bit_depth);
+            z1 = _mm512_and_si512(z1, zMaskHighByte);
+
+            z0 = _mm512_or_si512(z0, z1);
+
+            _mm512_mask_storeu_epi8(dst_ptr, mask_epi8(uv_fin - x), z0);
+        }
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_16_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<16, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_14_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<14, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_12_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<12, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_10_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<10, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_09_to_nv12_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_nv12_avx512_base<9, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+//16bit単位で左シフトしながらコピーする (in_bit_depth == 16 なら単純コピー)
+template<int in_bit_depth>
+static void __forceinline copy_shift_line_epi16(uint16_t *dst_ptr, const uint16_t *src_ptr, int n) {
+    if (in_bit_depth == 16) {
+        avx512_memcpy<true>((uint8_t *)dst_ptr, (const uint8_t *)src_ptr, n * (int)sizeof(uint16_t));
+    } else {
+        for (int x = 0; x < n; x += 32, dst_ptr += 32, src_ptr += 32) {
+            const __mmask32 mask = mask_epi16(n - x);
+            __m512i z0 = _mm512_maskz_loadu_epi16(mask, src_ptr);
+            z0 = _mm512_slli_epi16(z0, 16 - in_bit_depth);
+            _mm512_mask_storeu_epi16(dst_ptr, mask, z0);
+        }
+    }
+}
+
+//U, V (16bit) をシフトしながら UVUV... に並べる
+template<int in_bit_depth>
+static void __forceinline interleave_uv_line_epi16(uint16_t *dst_ptr, const uint16_t *src_u_ptr, const uint16_t *src_v_ptr, int n) {
+    for (int x = 0; x < n; x += 32, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
+        const __mmask16 maskSrc = (__mmask16)mask_epi16((n - x + 1) >> 1);
+        __m512i z0 = _mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(maskSrc, src_u_ptr));
+        __m512i z1 = _mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(maskSrc, src_v_ptr));
+        z0 = _mm512_or_si512(z0, _mm512_slli_epi32(z1, 16));
+        if (in_bit_depth < 16) {
+            z0 = _mm512_slli_epi16(z0, 16 - in_bit_depth);
+        }
+        _mm512_mask_storeu_epi16(dst_ptr, mask_epi16(n - x), z0);
+    }
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+template<int in_bit_depth, bool uv_only>
+static void __forceinline convert_yv12_high_to_p010_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint16_t *srcYLine = (uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[0] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+            copy_shift_line_epi16<in_bit_depth>(dstLine, srcYLine, y_width);
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    const int src_uv_pitch = src_uv_pitch_byte >> 1;
+    uint16_t *srcULine = (uint16_t *)src[1] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *dstLine = (uint16_t *)dst[1] + dst_y_pitch * uv_range.start_dst;
+    const int uv_fin = width - crop_right - crop_left;
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch) {
+        interleave_uv_line_epi16<in_bit_depth>(dstLine, srcULine, srcVLine, uv_fin);
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yv12_16_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<16, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_14_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<14, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_12_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<12, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_10_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<10, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_09_to_p010_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512_base<9, false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4127)
+void convert_yuv422_to_p210_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    //Y成分のコピー
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcYLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left;
+    uint16_t *dstLine = (uint16_t *)dst[0] + dst_y_pitch * y_range.start_dst;
+    const int y_width = width - crop_right - crop_left;
+    for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch) {
+        uint8_t *src_ptr = srcYLine;
+        uint16_t *dst_ptr = dstLine;
+        for (int x = 0; x < y_width; x += 32, dst_ptr += 32, src_ptr += 32) {
+            __m512i z0 = load_cvtepu8_epi16(src_ptr, y_width - x);
+            _mm512_mask_storeu_epi16(dst_ptr, mask_epi16(y_width - x), _mm512_slli_epi16(z0, 8));
+        }
+    }
+    //UV成分のコピー
+    uint8_t *srcULine = (uint8_t *)src[1] + ((src_uv_pitch_byte * y_range.start_src) + (crop_left >> 1));
+    uint8_t *srcVLine = (uint8_t *)src[2] + ((src_uv_pitch_byte * y_range.start_src) + (crop_left >> 1));
+    dstLine = (uint16_t *)dst[1] + dst_y_pitch * y_range.start_dst;
+    for (int y = 0; y < y_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch) {
+        uint8_t *src_u_ptr = srcULine;
+        uint8_t *src_v_ptr = srcVLine;
+        uint16_t *dst_ptr = dstLine;
+        for (int x = 0; x < y_width; x += 32, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
+            const __mmask16 maskSrc = (__mmask16)mask_epi16((y_width - x + 1) >> 1);
+            __m512i z0 = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(maskSrc, src_u_ptr));
+            __m512i z1 = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(maskSrc, src_v_ptr));
+            z0 = _mm512_or_si512(z0, _mm512_slli_epi32(z1, 16));
+            _mm512_mask_storeu_epi16(dst_ptr, mask_epi16(y_width - x), _mm512_slli_epi16(z0, 8));
+        }
+    }
+    _mm256_zeroupper();
+}
+
+template<int in_bit_depth>
+static void __forceinline convert_yuv422_high_to_p210_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    //Y成分のコピー
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint16_t *srcYLine = (uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
+    uint16_t *dstLine = (uint16_t *)dst[0] + dst_y_pitch * y_range.start_dst;
+    const int y_width = width - crop_right - crop_left;
+    for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+        copy_shift_line_epi16<in_bit_depth>(dstLine, srcYLine, y_width);
+    }
+    //UV成分のコピー
+    const int src_uv_pitch = src_uv_pitch_byte >> 1;
+    uint16_t *srcULine = (uint16_t *)src[1] + ((src_uv_pitch * y_range.start_src) + (crop_left >> 1));
+    uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * y_range.start_src) + (crop_left >> 1));
+    dstLine = (uint16_t *)dst[1] + dst_y_pitch * y_range.start_dst;
+    for (int y = 0; y < y_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch) {
+        interleave_uv_line_epi16<in_bit_depth>(dstLine, srcULine, srcVLine, y_width);
+    }
+    _mm256_zeroupper();
+}
+#pragma warning (pop)
+
+void convert_yuv422_16_to_p210_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_high_to_p210_avx512_base<16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_14_to_p210_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_high_to_p210_avx512_base<14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_12_to_p210_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_high_to_p210_avx512_base<12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_10_to_p210_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_high_to_p210_avx512_base<10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_09_to_p210_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_high_to_p210_avx512_base<9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void copy_yuv444_to_yuv444_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    for (int i = 0; i < 3; i++) {
+        const uint8_t *srcYLine = (const uint8_t *)src[i] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine = (uint8_t *)dst[i] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            avx512_memcpy<true>(dstLine, srcYLine, y_width);
+        }
+    }
+    _mm256_zeroupper();
+}
+
+template<int in_bit_depth>
+static void __forceinline convert_yuv444_high_to_yuv444_16_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    for (int i = 0; i < 3; i++) {
+        const uint16_t *srcYLine = (const uint16_t *)src[i] + src_y_pitch * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[i] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+            copy_shift_line_epi16<in_bit_depth>(dstLine, srcYLine, y_width);
+        }
+    }
+    _mm256_zeroupper();
+}
+
+void convert_yuv444_16_to_yuv444_16_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512_base<16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_14_to_yuv444_16_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512_base<14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_12_to_yuv444_16_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512_base<12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_10_to_yuv444_16_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512_base<10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_09_to_yuv444_16_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512_base<9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_to_yuv444_16_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    for (int i = 0; i < 3; i++) {
+        uint8_t *srcYLine = (uint8_t *)src[i] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[i] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch) {
+            uint8_t *src_ptr = srcYLine;
+            uint16_t *dst_ptr = dstLine;
+            for (int x = 0; x < y_width; x += 64, dst_ptr += 64, src_ptr += 64) {
+                __m512i z0 = load_cvtepu8_epi16(src_ptr +  0, y_width - x);
+                __m512i z1 = load_cvtepu8_epi16(src_ptr + 32, y_width - x - 32);
+                _mm512_mask_storeu_epi16(dst_ptr +  0, mask_epi16(y_width - x),      _mm512_slli_epi16(z0, 8));
+                _mm512_mask_storeu_epi16(dst_ptr + 32, mask_epi16(y_width - x - 32), _mm512_slli_epi16(z1, 8));
+            }
+        }
+    }
+    _mm256_zeroupper();
+}
+
+template<int in_bit_depth>
+static void __forceinline convert_yuv444_high_to_yuv444_avx512_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    for (int i = 0; i < 3; i++) {
+        uint16_t *srcYLine = (uint16_t *)src[i] + src_y_pitch * y_range.start_src + crop_left;
+        uint8_t *dstLine = (uint8_t *)dst[i] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch_byte) {
+            uint16_t *src_ptr = srcYLine;
+            uint8_t *dst_ptr = dstLine;
+            for (int x = 0; x < y_width; x += 32, dst_ptr += 32, src_ptr += 32) {
+                const __mmask32 mask = mask_epi16(y_width - x);
+                __m512i z0 = _mm512_maskz_loadu_epi16(mask, src_ptr);
+                z0 = _mm512_srli_epi16(z0, in_bit_depth - 8);
+                _mm256_mask_storeu_epi8(dst_ptr, mask, _mm512_cvtusepi16_epi8(z0));
+            }
+        }
+    }
+    _mm256_zeroupper();
+}
+
+void convert_yuv444_16_to_yuv444_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_avx512_base<16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_14_to_yuv444_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_avx512_base<14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_12_to_yuv444_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_avx512_base<12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_10_to_yuv444_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_avx512_base<10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_09_to_yuv444_avx512(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_avx512_base<9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+#pragma warning (pop)
+
+#endif //#if defined(_MSC_VER) || defined(__AVX512BW__)
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
@@ -432,7 +432,8 @@ static void __forceinline convert_rgb24r_to_rgb32_simd(void **dst, const void **
     const int crop_right  = crop[2];
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
-    uint8_t *srcLine = (uint8_t *)src[0] + (src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1)) + crop_left * 3;;
+    //上下反転: 出力のy_range.start_dst行目は、入力の(height - crop_bottom - 1 - y_range.start_dst)行目
+    uint8_t *srcLine = (uint8_t *)src[0] + (src_y_pitch_byte * (height - crop_bottom - 1 - y_range.start_dst)) + crop_left * 3;
     uint8_t *dstLine = (uint8_t *)dst[0] + (dst_y_pitch_byte * y_range.start_dst);
     alignas(16) const char MASK_RGB3_TO_RGB4[] = { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
     __m128i xMask = _mm_load_si128((__m128i*)MASK_RGB3_TO_RGB4);
@@ -510,8 +511,8 @@ static void __forceinline convert_rgb24_to_rgb_simd(void **dst, const void **src
             _mm_storeu_si128((__m128i *)ptr_dst1, x1);
             _mm_storeu_si128((__m128i *)ptr_dst2, x2);
         }
-        if (width & 15) {
-            int x_offset = (16 - (width & 15));
+        if ((width - crop_left - crop_right) & 15) {
+            int x_offset = (16 - ((width - crop_left - crop_right) & 15));
             ptr_src -= x_offset * 3;
             ptr_dst0 -= x_offset;
             ptr_dst1 -= x_offset;
@@ -577,8 +578,8 @@ static void __forceinline convert_rgb_to_rgb24_simd(void **dst, const void **src
             _mm_storeu_si128((__m128i *)(ptr_dst + 16), x1);
             _mm_storeu_si128((__m128i *)(ptr_dst + 32), x2);
         }
-        if (width & 15) {
-            int x_offset = (16 - (width & 15));
+        if ((width - crop_left - crop_right) & 15) {
+            int x_offset = (16 - ((width - crop_left - crop_right) & 15));
             ptr_dst -= x_offset * 3;
             ptr_srcR -= x_offset;
             ptr_srcG -= x_offset;
@@ -644,9 +645,9 @@ static void __forceinline convert_rgb32_to_rgb_simd(void **dst, const void **src
             _mm_storeu_si128((__m128i *)ptr_dst1, x1);
             _mm_storeu_si128((__m128i *)ptr_dst2, x2);
         }
-        if (width & 15) {
-            int x_offset = (16 - (width & 15));
-            ptr_src -= x_offset * 3;
+        if ((width - crop_left - crop_right) & 15) {
+            int x_offset = (16 - ((width - crop_left - crop_right) & 15));
+            ptr_src -= x_offset * 4;
             ptr_dst0 -= x_offset;
             ptr_dst1 -= x_offset;
             ptr_dst2 -= x_offset;
@@ -709,9 +710,9 @@ static void __forceinline convert_rgb_to_rgb32_simd(void **dst, const void **src
             _mm_storeu_si128((__m128i *)(ptr_dst + 32), x2);
             _mm_storeu_si128((__m128i *)(ptr_dst + 48), x3);
         }
-        if (width & 15) {
-            int x_offset = (16 - (width & 15));
-            ptr_dst -= x_offset * 3;
+        if ((width - crop_left - crop_right) & 15) {
+            int x_offset = (16 - ((width - crop_left - crop_right) & 15));
+            ptr_dst -= x_offset * 4;
             ptr_srcR -= x_offset;
             ptr_srcG -= x_offset;
             ptr_srcB -= x_offset;
@@ -818,7 +819,7 @@ static void __forceinline convert_rgb24r_to_rgb24_simd(void **dst, const void **
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * (y_range.start_src + y_range.len - 1) + crop_left * 3;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         memcpy_sse(dstLine, srcLine, y_width * 3);
@@ -880,7 +881,7 @@ static void __forceinline convert_rgb32r_to_rgb32_simd(void **dst, const void **
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * (y_range.start_src + y_range.len - 1) + crop_left * 4;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         memcpy_sse(dstLine, srcLine, y_width * 4);
@@ -1126,7 +1127,7 @@ static void __forceinline convert_yuv422_to_p210_simd(void **dst, const void **s
         uint8_t *src_v_ptr = srcVLine;
         uint16_t *dst_ptr = dstLine;
         __m128i x0, x1, x2, x3, x4;
-        for (int x = crop_left; x < x_fin; x += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
+        for (int x = crop_left; x < x_fin; x += 32, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
             x0 = _mm_loadu_si128((const __m128i *)src_u_ptr);
             x1 = _mm_loadu_si128((const __m128i *)src_v_ptr);
             x2 = _mm_unpackhi_epi8(_mm_setzero_si128(), x0);
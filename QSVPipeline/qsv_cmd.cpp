@@ -1076,6 +1076,20 @@ int ParseOneOption(const TCHAR *option_name, const TCHAR* strInput[], int& i, in
         }
         return 0;
     }
+    if (0 == _tcscmp(option_name, _T("input-batch"))) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        pParams->nInputBufBatch = (mfxU16)(std::min)(value, QSV_INPUT_BUF_MAX);
+        return 0;
+    }
     if (0 == _tcscmp(option_name, _T("output-buf"))) {
         i++;
         int value = 0;
@@ -1649,6 +1663,7 @@ tstring gen_cmd(const sInputParams *pParams, bool save_disabled_prm) {
     OPT_NUM(_T("--mfx-thread"), nSessionThreads);
 #endif //#if defined(_WIN32) || defined(_WIN64)
     OPT_NUM(_T("--input-buf"), nInputBufSize);
+    OPT_NUM(_T("--input-batch"), nInputBufBatch);
 
     cmd << gen_cmd(&pParams->ctrl, &encPrmDefault.ctrl, save_disabled_prm);
 
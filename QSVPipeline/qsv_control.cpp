@@ -41,10 +41,13 @@
 
 CEncodingThread::CEncodingThread() {
     m_nFrameBuffer = 0;
+    m_nFrameBatch = 1;
     m_bthForceAbort = FALSE;
     m_nFrameSet = 0;
     m_nFrameGet = 0;
-    m_InputBuf = NULL;
+    m_stsThread = MFX_ERR_NONE;
+    m_waitFree = { 0 };
+    m_waitLoaded = { 0 };
     m_bInit = false;
 }
 
@@ -52,21 +55,20 @@ CEncodingThread::~CEncodingThread() {
     Close();
 }
 
-mfxStatus CEncodingThread::Init(mfxU16 bufferSize) {
+mfxStatus CEncodingThread::Init(mfxU16 bufferSize, mfxU16 batch) {
     Close();
 
     m_nFrameBuffer = bufferSize;
-    if (nullptr == (m_InputBuf = (sInputBufSys *)_mm_malloc(m_nFrameBuffer * sizeof(sInputBufSys), 64)))
-        return MFX_ERR_NULL_PTR;
-
-    memset(m_InputBuf, 0, m_nFrameBuffer * sizeof(sInputBufSys));
-
-    for (mfxU32 i = 0; i < m_nFrameBuffer; i++) {
-        if (   NULL == (m_InputBuf[i].heInputDone  = CreateEvent(NULL, FALSE, FALSE, NULL))
-            || NULL == (m_InputBuf[i].heInputStart = CreateEvent(NULL, FALSE, FALSE, NULL))) {
-            return MFX_ERR_INVALID_HANDLE;
-        }
-    }
+    //読み込み側は空きフレームがある程度たまってからまとめて読み込むことで、起床の回数を減らす
+    //エンコードスレッドが読み込み済みフレームを待っている時は、すべてのフレームが空いているので
+    //m_nFrameBatch <= m_nFrameBufferであれば待機し続けることはない
+    //大きくすると起床の回数は減るが、エンコードスレッドに渡るまでの遅延が増える
+    m_nFrameBatch = (mfxU16)clamp((batch > 0) ? (int)batch : m_nFrameBuffer / 4, 1, (int)m_nFrameBuffer);
+    //どちらのキューにもm_nFrameBuffer以上のフレームが入ることはない
+    m_qFreeFrame.init(m_nFrameBuffer, m_nFrameBuffer);
+    m_qLoadedFrame.init(m_nFrameBuffer, m_nFrameBuffer);
+    m_waitFree = { 0 };
+    m_waitLoaded = { 0 };
     m_bInit = true;
     m_bthForceAbort = FALSE;
     return MFX_ERR_NONE;
@@ -93,16 +95,15 @@ mfxStatus CEncodingThread::WaitToFinish(mfxStatus sts, shared_ptr<RGYLog> pQSVLo
     if (sts != MFX_ERR_MORE_DATA) {
         pQSVLog->write(RGY_LOG_DEBUG, _T("WaitToFinish: Encode Aborted, putting abort flag on.\n"));
         m_bthForceAbort++; //m_bthForceAbort = TRUE;
-        if (m_InputBuf) {
-            pQSVLog->write(RGY_LOG_DEBUG, _T("WaitToFinish: Settings event on.\n"));
-            for (mfxU32 i = 0; i < m_nFrameBuffer; i++) {
-                SetEvent(m_InputBuf[i].heInputDone);
-            }
-        }
+        //エンコードスレッドは読み込み済みフレームの待機中も定期的にm_bthForceAbortを確認するので、通知は不要
     }
     //RunEncodeの終了を待つ
     m_thEncode.join();
     pQSVLog->write(RGY_LOG_DEBUG, _T("WaitToFinish: Encode thread shut down.\n"));
+    pQSVLog->write(RGY_LOG_DEBUG, _T("WaitToFinish: input buffer %d frames, batch %d, reader waited %d times %.3f ms, encoder waited %d times %.3f ms.\n"),
+        m_nFrameBuffer, m_nFrameBatch,
+        m_waitFree.count, m_waitFree.waitUs / 1000.0,
+        m_waitLoaded.count, m_waitLoaded.waitUs / 1000.0);
     return MFX_ERR_NONE;
 }
 
@@ -110,17 +111,10 @@ void CEncodingThread::Close() {
     if (m_thEncode.joinable()) {
         m_thEncode.join();
     }
-    if (m_InputBuf) {
-        for (mfxU32 i = 0; i < m_nFrameBuffer; i++) {
-            if (m_InputBuf[i].heInputDone)
-                CloseEvent(m_InputBuf[i].heInputDone);
-            if (m_InputBuf[i].heInputStart)
-                CloseEvent(m_InputBuf[i].heInputStart);
-        }
-        _mm_free(m_InputBuf);
-        m_InputBuf = NULL;
-    }
+    m_qFreeFrame.close();
+    m_qLoadedFrame.close();
     m_nFrameBuffer = 0;
+    m_nFrameBatch = 1;
     m_nFrameSet = 0;
     m_nFrameGet = 0;
     m_bthForceAbort = FALSE;
@@ -48,6 +48,7 @@
 #include "cpu_info.h"
 #include "gpuz_info.h"
 #include "rgy_perf_monitor.h"
+#include "rgy_queue.h"
 #include "rgy_err.h"
 
 using std::chrono::duration_cast;
@@ -61,19 +62,20 @@ const uint32_t MSDK_WAIT_INTERVAL = MSDK_DEC_WAIT_INTERVAL+3*MSDK_VPP_WAIT_INTER
 
 const uint32_t MSDK_INVALID_SURF_IDX = 0xFFFF;
 
-typedef struct {
-    RGYFrame* pFrameSurface;
-    HANDLE heInputStart;
-    HANDLE heInputDone;
-    uint8_t reserved[64-(sizeof(RGYFrame*)+sizeof(HANDLE)*2)];
-} sInputBufSys;
+//入力バッファでの待機時間の統計
+struct InputBufWaitStat {
+    int count;      //待機した回数
+    int64_t waitUs; //待機した時間の合計 (us)
+};
 
 class CEncodingThread {
 public:
     CEncodingThread();
     ~CEncodingThread();
 
-    mfxStatus Init(mfxU16 bufferSize);
+    //bufferSize … 読み込み側が先行して読み込めるフレーム数
+    //batch      … 読み込み側がまとめて読み込むフレーム数 (0なら自動 = bufferSize/4)
+    mfxStatus Init(mfxU16 bufferSize, mfxU16 batch = 0);
     void Close();
     //終了を待機する
     mfxStatus WaitToFinish(mfxStatus sts, shared_ptr<RGYLog> pQSVLog);
@@ -84,11 +86,15 @@ public:
     }
 
     std::atomic_int m_bthForceAbort;
-    sInputBufSys *m_InputBuf;
+    RGYQueueSPSPRing<RGYFrame*> m_qFreeFrame;   //読み込み先の空きフレーム (エンコードスレッド -> 読み込み側)
+    RGYQueueSPSPRing<RGYFrame*> m_qLoadedFrame; //読み込み済みのフレーム (読み込み側 -> エンコードスレッド)
+    InputBufWaitStat m_waitFree;   //読み込み側が空きフレームを待機した統計
+    InputBufWaitStat m_waitLoaded; //エンコードスレッドが読み込み済みフレームを待機した統計
     mfxU32 m_nFrameSet;
     mfxU32 m_nFrameGet;
-    mfxStatus m_stsThread;
+    std::atomic<mfxStatus> m_stsThread;
     mfxU16  m_nFrameBuffer;
+    mfxU16  m_nFrameBatch; //読み込み側はこのフレーム数以上の空きができてからまとめて読み込む
 protected:
     std::thread m_thEncode;
     bool m_bInit;
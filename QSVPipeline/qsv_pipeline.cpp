@@ -51,6 +51,7 @@
 #include "rgy_input_avcodec.h"
 #include "rgy_output_avcodec.h"
 #include "rgy_bitstream.h"
+#include "rgy_thread_pool.h"
 #include "qsv_hw_device.h"
 #include "qsv_allocator.h"
 #include "qsv_allocator_sys.h"
@@ -2165,6 +2166,7 @@ CQSVPipeline::CQSVPipeline() {
     m_heAbort.reset();
 
     m_pStatus.reset();
+    m_pPerfTelemetryEnc = nullptr;
     m_pFileWriterListAudio.clear();
 
     m_trimParam.list.clear();
@@ -2493,6 +2495,10 @@ mfxStatus CQSVPipeline::CheckParam(sInputParams *pParams) {
 
     //入力バッファサイズの範囲チェック
     pParams->nInputBufSize = (mfxU16)clamp_param_int(pParams->nInputBufSize, QSV_INPUT_BUF_MIN, QSV_INPUT_BUF_MAX, _T("input-buf"));
+    //まとめて読み込むフレーム数は入力バッファサイズ以下 (0は自動)
+    if (pParams->nInputBufBatch > 0) {
+        pParams->nInputBufBatch = (mfxU16)clamp_param_int(pParams->nInputBufBatch, 1, pParams->nInputBufSize, _T("input-batch"));
+    }
 
     return MFX_ERR_NONE;
 }
@@ -2858,12 +2864,22 @@ mfxStatus CQSVPipeline::InitPerfMonitor(const sInputParams *inputParam) {
 #if defined(_WIN32) || defined(_WIN64)
         std::unique_ptr<void, handle_deleter>(OpenThread(SYNCHRONIZE | THREAD_QUERY_INFORMATION, false, GetCurrentThreadId()), handle_deleter()),
 #else
-        nullptr,
+        std::unique_ptr<void, handle_deleter>((HANDLE)GetCurrentThread(), handle_deleter()),
 #endif
         m_pQSVLog, &perfMonitorPrm)) {
         PrintMes(RGY_LOG_WARN, _T("Failed to initialize performance monitor, disabled.\n"));
         m_pPerfMonitor.reset();
     }
+    if (inputParam->ctrl.perfTelemetryFile.length() > 0) {
+        m_pPerfTelemetry.reset(new RGYPerfTelemetry());
+        if (m_pPerfTelemetry->init(inputParam->ctrl.perfTelemetryFile, (RGYPerfTelemetryFormat)inputParam->ctrl.perfTelemetryFormat, m_pQSVLog) != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_WARN, _T("Failed to initialize perf telemetry, disabled.\n"));
+            m_pPerfTelemetry.reset();
+        } else {
+            //記録はすべてエンコードスレッドから行う
+            m_pPerfTelemetryEnc = m_pPerfTelemetry->addProducer();
+        }
+    }
     return MFX_ERR_NONE;
 }
 
@@ -2910,6 +2926,10 @@ mfxStatus CQSVPipeline::Init(sInputParams *pParams) {
     m_nMFXThreads = pParams->nSessionThreads;
     m_nAVSyncMode = pParams->common.AVSyncMode;
 
+    if (!RGYThreadPool::get().setParam(pParams->ctrl.threadPool, pParams->ctrl.threadPoolAffinity)) {
+        PrintMes(RGY_LOG_WARN, _T("thread pool is already running, --thread-pool settings are ignored.\n"));
+    }
+
     sts = InitSessionInitParam(pParams->nSessionThreads, pParams->nSessionThreadPriority);
     if (sts < MFX_ERR_NONE) return sts;
 
@@ -2921,7 +2941,7 @@ mfxStatus CQSVPipeline::Init(sInputParams *pParams) {
     sts = CheckParam(pParams);
     if (sts != MFX_ERR_NONE) return sts;
 
-    sts = m_EncThread.Init(pParams->nInputBufSize);
+    sts = m_EncThread.Init(pParams->nInputBufSize, pParams->nInputBufBatch);
     QSV_ERR_MES(sts, _T("Failed to allocate memory for thread control."));
 
     sts = InitSession(true, pParams->memType);
@@ -3023,6 +3043,10 @@ void CQSVPipeline::Close() {
     m_pStatus.reset();
 
     PrintMes(RGY_LOG_DEBUG, _T("Closing m_EncThread...\n"));
+    //スレッドをjoinする前に、パフォーマンスモニタからスレッドの登録を解除する
+    if (m_pPerfMonitor) {
+        m_pPerfMonitor->SetThreadHandles(NULL, NULL, NULL, NULL, NULL);
+    }
     m_EncThread.Close();
 
     PrintMes(RGY_LOG_DEBUG, _T("Closing Plugins...\n"));
@@ -3100,6 +3124,14 @@ void CQSVPipeline::Close() {
     PrintMes(RGY_LOG_DEBUG, _T("Closing perf monitor...\n"));
     m_pPerfMonitor.reset();
 
+    if (m_pPerfTelemetry) {
+        PrintMes(RGY_LOG_DEBUG, _T("Closing perf telemetry...\n"));
+        m_pPerfTelemetryEnc = nullptr;
+        m_pPerfTelemetry.reset();
+    }
+
+    PrintMes(RGY_LOG_DEBUG, RGYThreadPool::get().printStageInfo().c_str());
+
     m_nMFXThreads = -1;
     m_pAbortByUser = NULL;
     m_nAVSyncMode = RGY_AVSYNC_ASSUME_CFR;
@@ -3215,6 +3247,7 @@ mfxStatus CQSVPipeline::ResetMFXComponents(sInputParams* pParams) {
     PrintMes(RGY_LOG_DEBUG, _T("ResetMFXComponents: Creating task pool, poolSize %d, bufsize %d KB.\n"), m_nAsyncDepth, nEncodedDataBufferSize >> 10);
     sts = m_TaskPool.Init(&m_mfxSession, m_pMFXAllocator.get(), m_pFileWriter, m_nAsyncDepth, nEncodedDataBufferSize);
     QSV_ERR_MES(sts, _T("Failed to initialize task pool for encoding."));
+    m_TaskPool.SetPerfTelemetry(m_pPerfTelemetryEnc);
     PrintMes(RGY_LOG_DEBUG, _T("ResetMFXComponents: Created task pool.\n"));
 
     return MFX_ERR_NONE;
@@ -3240,58 +3273,54 @@ mfxStatus CQSVPipeline::AllocateSufficientBuffer(mfxBitstream *pBS) {
 }
 
 //この関数がMFX_ERR_NONE以外を返すことでRunEncodeは終了処理に入る
+//フレーム読み込みの場合のみ呼ばれる
 mfxStatus CQSVPipeline::GetNextFrame(mfxFrameSurface1 **pSurface) {
-    const int inputBufIdx = m_EncThread.m_nFrameGet % m_EncThread.m_nFrameBuffer;
-    sInputBufSys *pInputBuf = &m_EncThread.m_InputBuf[inputBufIdx];
-
-    //_ftprintf(stderr, "GetNextFrame: wait for %d\n", m_EncThread.m_nFrameGet);
-    //_ftprintf(stderr, "wait for heInputDone, %d\n", m_EncThread.m_nFrameGet);
     PrintMes(RGY_LOG_TRACE, _T("Enc Thread: Wait Done %d.\n"), m_EncThread.m_nFrameGet);
-    //HWデコードの場合、本来ここで待機する必要はなく、またここでRGY_ERR_MORE_DATAを返す必要もない
-    while (WaitForSingleObject(pInputBuf->heInputDone, (m_pFileReader->getInputCodec() == RGY_CODEC_UNKNOWN) ? INFINITE : 1) == WAIT_TIMEOUT) {
-        //ここに入るのはHWデコードの場合のみ
-        //HWデコードの時は、本来このロックはフレーム読み込みには使用しておらず、
-        //CQSVPipeline::Run()内のm_pFileReader->LoadNextFrame()による進捗管理のために行っているに過ぎない
-        //そのためCQSVPipeline::Run()が終了している、
-        //すなわちm_EncThread.m_stsThreadがMFX_ERR_MORE_DATAであれば、
-        //特に待機せずMFX_ERR_NONEを返して終了する
-        if (m_EncThread.m_stsThread == MFX_ERR_MORE_DATA) {
-            return MFX_ERR_NONE;
+    RGYFrame *pFrame = nullptr;
+    if (!m_EncThread.m_qLoadedFrame.front_copy_and_pop_no_lock(&pFrame)) {
+        //読み込み済みのフレームがない場合のみ待機する
+        const auto tmStart = std::chrono::high_resolution_clock::now();
+        while (!m_EncThread.m_qLoadedFrame.front_copy_and_pop_no_lock(&pFrame)) {
+            //エラー・中断要求などでの終了
+            if (m_EncThread.m_bthForceAbort) {
+                PrintMes(RGY_LOG_DEBUG, _T("GetNextFrame: Encode Aborted...\n"));
+                return m_EncThread.m_stsThread;
+            }
+            //読み込み完了による終了
+            //読み込み側はすべてのフレームをキューに入れてからm_stsThreadをセットするので、
+            //ここでキューが空なら、これ以上フレームはない
+            if (m_EncThread.m_stsThread == MFX_ERR_MORE_DATA && m_EncThread.m_qLoadedFrame.empty()) {
+                PrintMes(RGY_LOG_DEBUG, _T("GetNextFrame: Frame read finished.\n"));
+                return m_EncThread.m_stsThread;
+            }
+            m_EncThread.m_qLoadedFrame.wait_for_push();
         }
+        const auto waitUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tmStart).count();
+        m_EncThread.m_waitLoaded.count++;
+        m_EncThread.m_waitLoaded.waitUs += waitUs;
+        PrintMes(RGY_LOG_TRACE, _T("Enc Thread: waited %.3f ms for frame %d.\n"), waitUs / 1000.0, m_EncThread.m_nFrameGet);
     }
     //エラー・中断要求などでの終了
     if (m_EncThread.m_bthForceAbort) {
         PrintMes(RGY_LOG_DEBUG, _T("GetNextFrame: Encode Aborted...\n"));
         return m_EncThread.m_stsThread;
     }
-    //読み込み完了による終了
-    if (m_EncThread.m_stsThread == MFX_ERR_MORE_DATA && m_EncThread.m_nFrameGet == m_pStatus->m_sData.frameIn) {
-        PrintMes(RGY_LOG_DEBUG, _T("GetNextFrame: Frame read finished.\n"));
-        return m_EncThread.m_stsThread;
-    }
-    //フレーム読み込みでない場合は、フレーム関連の処理は行わない
-    if (m_pFileReader->getInputCodec() == RGY_CODEC_UNKNOWN) {
-        *pSurface = (mfxFrameSurface1 *)pInputBuf->pFrameSurface;
-        if ((m_nAVSyncMode & (RGY_AVSYNC_VFR | RGY_AVSYNC_FORCE_CFR)) == 0) {
-            (*pSurface)->Data.TimeStamp = inputBufIdx;
-        }
-        (*pSurface)->Data.Locked = FALSE;
-        m_EncThread.m_nFrameGet++;
+    *pSurface = (mfxFrameSurface1 *)pFrame;
+    if ((m_nAVSyncMode & (RGY_AVSYNC_VFR | RGY_AVSYNC_FORCE_CFR)) == 0) {
+        (*pSurface)->Data.TimeStamp = m_EncThread.m_nFrameGet % m_EncThread.m_nFrameBuffer;
     }
+    (*pSurface)->Data.Locked = FALSE;
+    m_EncThread.m_nFrameGet++;
     return MFX_ERR_NONE;
 }
 
 mfxStatus CQSVPipeline::SetNextSurface(mfxFrameSurface1 *pSurface) {
-    const int inputBufIdx = m_EncThread.m_nFrameSet % m_EncThread.m_nFrameBuffer;
-    sInputBufSys *pInputBuf = &m_EncThread.m_InputBuf[inputBufIdx];
     //フレーム読み込みでない場合は、フレーム関連の処理は行わない
     if (m_pFileReader->getInputCodec() == RGY_CODEC_UNKNOWN) {
-        //_ftprintf(stderr, "Set heInputStart: %d\n", m_EncThread.m_nFrameSet);
         pSurface->Data.Locked = TRUE;
-        //_ftprintf(stderr, "set surface %d, set event heInputStart %d\n", pSurface, m_EncThread.m_nFrameSet);
-        pInputBuf->pFrameSurface = (RGYFrame *)pSurface;
+        //空いているフレームを読み込み側に渡す
+        m_EncThread.m_qFreeFrame.push((RGYFrame *)pSurface);
     }
-    SetEvent(pInputBuf->heInputStart);
     PrintMes(RGY_LOG_TRACE, _T("Enc Thread: Set Start %d.\n"), m_EncThread.m_nFrameSet);
     m_EncThread.m_nFrameSet++;
     return MFX_ERR_NONE;
@@ -3360,39 +3389,56 @@ mfxStatus CQSVPipeline::Run(size_t SubThreadAffinityMask) {
     }
 #endif //#if ENABLE_AVSW_READER
 
-    const int bufferSize = m_EncThread.m_nFrameBuffer;
-    sInputBufSys *pArrayInputBuf = m_EncThread.m_InputBuf;
-    sInputBufSys *pInputBuf;
     //入力ループ
     if (m_pFileReader->getInputCodec() == RGY_CODEC_UNKNOWN) {
-        for (int i = 0; sts == MFX_ERR_NONE; i++) {
-            pInputBuf = &pArrayInputBuf[i % bufferSize];
-
-            //空いているフレームがセットされるのを待機
-            PrintMes(RGY_LOG_TRACE, _T("Main Thread: Wait Start %d.\n"), i);
-            while (WAIT_TIMEOUT == WaitForSingleObject(pInputBuf->heInputStart, 5000)) {
-                //エンコードスレッドが異常終了していたら、それを検知してこちらも終了
-                if (!CheckThreadAlive(m_EncThread.GetHandleEncThread())) {
-                    PrintMes(RGY_LOG_ERROR, _T("error at encode thread.\n"));
-                    sts = MFX_ERR_INVALID_HANDLE;
+        auto& qFreeFrame = m_EncThread.m_qFreeFrame;
+        auto& qLoadedFrame = m_EncThread.m_qLoadedFrame;
+        const int frameBatch = m_EncThread.m_nFrameBatch;
+        for (int i = 0; sts == MFX_ERR_NONE; ) {
+            //空いているフレームがframeBatch以上セットされるのを待機
+            if ((int)qFreeFrame.size() < frameBatch) {
+                PrintMes(RGY_LOG_TRACE, _T("Main Thread: Wait Start %d.\n"), i);
+                const auto tmStart = std::chrono::high_resolution_clock::now();
+                auto tmCheckAlive = tmStart;
+                qFreeFrame.set_keep_length(frameBatch - 1);
+                while ((int)qFreeFrame.size() < frameBatch) {
+                    qFreeFrame.wait_for_push();
+                    //エンコードスレッドが異常終了していたら、それを検知してこちらも終了
+                    const auto tmNow = std::chrono::high_resolution_clock::now();
+                    if (tmNow - tmCheckAlive > std::chrono::milliseconds(5000)) {
+                        tmCheckAlive = tmNow;
+                        if (!CheckThreadAlive(m_EncThread.GetHandleEncThread())) {
+                            PrintMes(RGY_LOG_ERROR, _T("error at encode thread.\n"));
+                            sts = MFX_ERR_INVALID_HANDLE;
+                            break;
+                        }
+                    }
                 }
+                qFreeFrame.set_keep_length(0);
+                const auto waitUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tmStart).count();
+                m_EncThread.m_waitFree.count++;
+                m_EncThread.m_waitFree.waitUs += waitUs;
+                PrintMes(RGY_LOG_TRACE, _T("Main Thread: waited %.3f ms for %d free frames.\n"), waitUs / 1000.0, (int)qFreeFrame.size());
             }
 
-            //フレームを読み込み
-            PrintMes(RGY_LOG_TRACE, _T("Main Thread: LoadNextFrame %d.\n"), i);
-            if (sts == MFX_ERR_NONE) {
-                sts = err_to_mfx(m_pFileReader->LoadNextFrame(pInputBuf->pFrameSurface));
-            }
-            if (m_pAbortByUser != nullptr && *m_pAbortByUser) {
-                PrintMes(RGY_LOG_INFO, _T("                                                                              \r"));
-                sts = MFX_ERR_ABORTED;
-            } else if (sts == MFX_ERR_MORE_DATA) {
-                m_EncThread.m_stsThread = sts;
+            //空いているフレームをまとめて読み込み、読み込んだものから順にエンコードスレッドに渡す
+            RGYFrame *pFrame = nullptr;
+            while (sts == MFX_ERR_NONE && qFreeFrame.front_copy_and_pop_no_lock(&pFrame)) {
+                PrintMes(RGY_LOG_TRACE, _T("Main Thread: LoadNextFrame %d.\n"), i);
+                sts = err_to_mfx(m_pFileReader->LoadNextFrame(pFrame));
+                if (m_pAbortByUser != nullptr && *m_pAbortByUser) {
+                    PrintMes(RGY_LOG_INFO, _T("                                                                              \r"));
+                    sts = MFX_ERR_ABORTED;
+                } else if (sts == MFX_ERR_MORE_DATA) {
+                    //読み込み済みのフレームをすべて渡してから、読み込みの終了をセットする
+                    m_EncThread.m_stsThread = sts;
+                } else if (sts == MFX_ERR_NONE) {
+                    //フレームの読み込み終了を通知
+                    qLoadedFrame.push(pFrame);
+                    PrintMes(RGY_LOG_TRACE, _T("Main Thread: Set Done %d.\n"), i);
+                    i++;
+                }
             }
-
-            //フレームの読み込み終了を通知
-            SetEvent(pInputBuf->heInputDone);
-            PrintMes(RGY_LOG_TRACE, _T("Main Thread: Set Done %d.\n"), i);
         }
     } else {
         while (sts == MFX_ERR_NONE) {
@@ -3421,9 +3467,13 @@ mfxStatus CQSVPipeline::Run(size_t SubThreadAffinityMask) {
     m_EncThread.WaitToFinish(sts, m_pQSVLog);
     PrintMes(RGY_LOG_DEBUG, _T("Main Thread: Finished Main Loop...\n"));
 
-    sts = (std::min)(sts, m_EncThread.m_stsThread);
+    sts = (std::min)(sts, m_EncThread.m_stsThread.load());
     QSV_IGNORE_STS(sts, MFX_ERR_MORE_DATA);
 
+    //スレッドをjoinする前に、パフォーマンスモニタからスレッドの登録を解除する
+    if (m_pPerfMonitor) {
+        m_pPerfMonitor->SetThreadHandles(NULL, NULL, NULL, NULL, NULL);
+    }
     m_EncThread.Close();
 
     //ここでファイル出力の完了を確認してから、結果表示(m_pStatus->WriteResults)を行う
@@ -3523,15 +3573,57 @@ mfxStatus CQSVPipeline::RunEncode() {
 
     sts = MFX_ERR_NONE;
 
+    //空きサーフェスの待機時間はperf monitorにも反映する
+    std::atomic<int64_t> *pSurfWaitUs = (m_pPerfMonitor) ? m_pPerfMonitor->GetSurfWaitUsPtr() : nullptr;
+    QSVSurfacePool poolEncSurfaces(m_pEncSurfaces.data(), m_EncResponse.NumFrameActual, pSurfWaitUs);
+    QSVSurfacePool poolVppSurfaces(m_pVppSurfaces.data(), m_VppResponse.NumFrameActual, pSurfWaitUs);
+    vector<QSVSurfacePool> poolVppPrePlugins, poolVppPostPlugins;
+    for (const auto& plugin : m_VppPrePlugins) {
+        poolVppPrePlugins.push_back(QSVSurfacePool(plugin->m_pPluginSurfaces.get(), plugin->m_PluginResponse.NumFrameActual, pSurfWaitUs));
+    }
+    for (const auto& plugin : m_VppPostPlugins) {
+        poolVppPostPlugins.push_back(QSVSurfacePool(plugin->m_pPluginSurfaces.get(), plugin->m_PluginResponse.NumFrameActual, pSurfWaitUs));
+    }
+    //--perf-telemetry: 現在のタスクに、各段階の開始・終了時刻を記録する
+    RGYPerfTelemetry::Producer *perfTelemetry = m_pPerfTelemetryEnc;
+    auto perf_stage_begin = [&](RGYPerfStage stage) {
+        if (perfTelemetry && pCurrentTask) {
+            pCurrentTask->perfTimes.setBegin(stage, perfTelemetry->now());
+        }
+    };
+    auto perf_stage_end = [&](RGYPerfStage stage) {
+        if (perfTelemetry && pCurrentTask) {
+            pCurrentTask->perfTimes.setEnd(stage, perfTelemetry->now());
+        }
+    };
+
+    //空きサーフェスがない場合は、先頭のタスクの完了を待ってサーフェスの解放を促す
+    //エンコードに投入済みのタスクがない場合は、直前のデコード/vppの非同期処理の完了を待つ
+    //(エンコードしない場合、lastSyncPはタスクのencSyncPointとして同期されるので、ここでは待たない)
+    mfxSyncPoint lastSyncPWaited = nullptr;
+    auto wait_surface_release = [&]() {
+        auto sts_wait = SynchronizeFirstTask();
+        if (sts_wait == MFX_ERR_NOT_FOUND && m_pmfxENC && lastSyncP && lastSyncP != lastSyncPWaited) {
+            lastSyncPWaited = lastSyncP;
+            sts_wait = m_mfxSession.SyncOperation(lastSyncP, MSDK_WAIT_INTERVAL);
+        }
+        return sts_wait;
+    };
+    //空きサーフェスを取得できなかった原因をログに出し、その原因をエラーとして返す
+    auto free_surface_error = [&](const QSVSurfacePool& pool, const TCHAR *name) {
+        const mfxStatus err = pool.lastError();
+        PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for %s: %s.\n"), name, get_err_mes(err));
+        return err;
+    };
+
     auto get_all_free_surface =[&](mfxFrameSurface1 *pSurfEncInput) {
         //パイプラインの後ろからたどっていく
         pSurfInputBuf = pSurfEncInput; //pSurfEncInにはパイプラインを後ろからたどった順にフレームポインタを更新していく
         pSurfVppPostFilter[m_VppPostPlugins.size()] = pSurfInputBuf; //pSurfVppPreFilterの最後はその直前のステップのフレームに出力される
         for (int i_filter = (int)m_VppPostPlugins.size()-1; i_filter >= 0; i_filter--) {
-            int freeSurfIdx = GetFreeSurface(m_VppPostPlugins[i_filter]->m_pPluginSurfaces.get(), m_VppPostPlugins[i_filter]->m_PluginResponse.NumFrameActual);
+            int freeSurfIdx = poolVppPostPlugins[i_filter].getFree(wait_surface_release);
             if (freeSurfIdx == MSDK_INVALID_SURF_IDX) {
-                PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for vpp post.\n"));
-                return MFX_ERR_MEMORY_ALLOC;
+                return free_surface_error(poolVppPostPlugins[i_filter], _T("vpp post"));
             }
             pSurfVppPostFilter[i_filter] = &m_VppPostPlugins[i_filter]->m_pPluginSurfaces[freeSurfIdx];
             pSurfInputBuf = pSurfVppPostFilter[i_filter];
@@ -3539,20 +3631,18 @@ mfxStatus CQSVPipeline::RunEncode() {
         //vppが有効ならvpp用のフレームも用意する
         if (m_pmfxVPP) {
             //空いているフレームバッファを取得、空いていない場合は待機して、空くまで待ってから取得
-            nVppSurfIdx = GetFreeSurface(m_pVppSurfaces.data(), m_VppResponse.NumFrameActual);
+            nVppSurfIdx = poolVppSurfaces.getFree(wait_surface_release);
             if (nVppSurfIdx == MSDK_INVALID_SURF_IDX) {
-                PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for vpp.\n"));
-                return MFX_ERR_MEMORY_ALLOC;
+                return free_surface_error(poolVppSurfaces, _T("vpp"));
             }
             pSurfVppIn = &m_pVppSurfaces[nVppSurfIdx];
             pSurfInputBuf = pSurfVppIn;
         }
         pSurfVppPreFilter[m_VppPrePlugins.size()] = pSurfInputBuf; //pSurfVppPreFilterの最後はその直前のステップのフレームに出力される
         for (int i_filter = (int)m_VppPrePlugins.size()-1; i_filter >= 0; i_filter--) {
-            int freeSurfIdx = GetFreeSurface(m_VppPrePlugins[i_filter]->m_pPluginSurfaces.get(), m_VppPrePlugins[i_filter]->m_PluginResponse.NumFrameActual);
+            int freeSurfIdx = poolVppPrePlugins[i_filter].getFree(wait_surface_release);
             if (freeSurfIdx == MSDK_INVALID_SURF_IDX) {
-                PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for vpp pre.\n"));
-                return MFX_ERR_MEMORY_ALLOC;
+                return free_surface_error(poolVppPrePlugins[i_filter], _T("vpp pre"));
             }
             pSurfVppPreFilter[i_filter] = &m_VppPrePlugins[i_filter]->m_pPluginSurfaces[freeSurfIdx];
             pSurfInputBuf = pSurfVppPreFilter[i_filter];
@@ -3564,7 +3654,13 @@ mfxStatus CQSVPipeline::RunEncode() {
     auto set_surface_to_input_buffer = [&]() {
         mfxStatus sts_set_buffer = MFX_ERR_NONE;
         for (int i = 0; i < m_EncThread.m_nFrameBuffer; i++) {
-            get_all_free_surface(&m_pEncSurfaces[GetFreeSurface(m_pEncSurfaces.data(), m_EncResponse.NumFrameActual)]);
+            const int freeSurfIdx = poolEncSurfaces.getFree(wait_surface_release);
+            if (freeSurfIdx == MSDK_INVALID_SURF_IDX) {
+                sts_set_buffer = free_surface_error(poolEncSurfaces, _T("enc"));
+                break;
+            }
+            if (MFX_ERR_NONE != (sts_set_buffer = get_all_free_surface(&m_pEncSurfaces[freeSurfIdx])))
+                break;
 
             //フレーム読み込みでない場合には、ここでロックする必要はない
             if (m_bExternalAlloc && m_pFileReader->getInputCodec() == RGY_CODEC_UNKNOWN) {
@@ -3578,7 +3674,9 @@ mfxStatus CQSVPipeline::RunEncode() {
     };
 
     //先読みバッファ用フレームを読み込み側に提供する
-    set_surface_to_input_buffer();
+    if (MFX_ERR_NONE != (sts = set_surface_to_input_buffer())) {
+        return sts;
+    }
     PrintMes(RGY_LOG_DEBUG, _T("Encode Thread: Set surface to input buffer...\n"));
 
     auto copy_crop_info = [](mfxFrameSurface1 *dst, const mfxFrameInfo *src) {
@@ -3887,6 +3985,9 @@ mfxStatus CQSVPipeline::RunEncode() {
     };
 
     auto encode_one_frame =[&](mfxFrameSurface1* pSurfEncIn) {
+        if (pSurfEncIn) {
+            perf_stage_end(RGY_PERF_STAGE_FILTER);
+        }
         if (m_pmfxENC == nullptr) {
             //エンコードが有効でない場合、このフレームデータを出力する
             //パイプラインの最後のSyncPointをセットする
@@ -3911,6 +4012,7 @@ mfxStatus CQSVPipeline::RunEncode() {
             pSurfEncIn->Data.TimeStamp = (uint64_t)m_outputTimestamp.check(pSurfEncIn->Data.TimeStamp);
         }
 
+        perf_stage_begin(RGY_PERF_STAGE_SUBMIT);
         bool bDeviceBusy = false;
         for (int i = 0; ; i++) {
             enc_sts = m_pmfxENC->EncodeFrameAsync(nullptr, pSurfEncIn, &pCurrentTask->mfxBS, &pCurrentTask->encSyncPoint);
@@ -3938,6 +4040,13 @@ mfxStatus CQSVPipeline::RunEncode() {
                 break;
             }
         }
+        perf_stage_end(RGY_PERF_STAGE_SUBMIT);
+        if (pCurrentTask->encSyncPoint) {
+            perf_stage_begin(RGY_PERF_STAGE_QUEUE);
+        } else if (perfTelemetry) {
+            //エンコーダがフレームを溜めていて出力がない場合、このタスクは次のフレームに再利用されるので記録を破棄する
+            pCurrentTask->perfTimes.clear();
+        }
         return enc_sts;
     };
 
@@ -3962,10 +4071,9 @@ mfxStatus CQSVPipeline::RunEncode() {
             break;
 
         //空いているフレームバッファを取得、空いていない場合は待機して、空くまで待ってから取得
-        nEncSurfIdx = GetFreeSurface(m_pEncSurfaces.data(), m_EncResponse.NumFrameActual);
+        nEncSurfIdx = poolEncSurfaces.getFree(wait_surface_release);
         if (nEncSurfIdx == MSDK_INVALID_SURF_IDX) {
-            PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for enc.\n"));
-            return MFX_ERR_MEMORY_ALLOC;
+            return free_surface_error(poolEncSurfaces, _T("enc"));
         }
 
         // point pSurf to encoder surface
@@ -3990,6 +4098,7 @@ mfxStatus CQSVPipeline::RunEncode() {
                 //    //ppNextFrame = &pSurfEncIn;
                 //}
 
+                perf_stage_begin(RGY_PERF_STAGE_DECODE);
                 if (m_pFileReader->getInputCodec() == RGY_CODEC_UNKNOWN) {
                     //読み込み側の該当フレームの読み込み終了を待機(pInputBuf->heInputDone)して、読み込んだフレームを取得
                     //この関数がRGY_ERR_NONE以外を返すことでRunEncodeは終了処理に入る
@@ -4029,11 +4138,13 @@ mfxStatus CQSVPipeline::RunEncode() {
                     continue;
                 if (sts != MFX_ERR_NONE)
                     break;
+                perf_stage_end(RGY_PERF_STAGE_DECODE);
             }
 
             if (!frame_inside_range(nInputFrameCount, m_trimParam.list).first)
                 continue;
 
+            perf_stage_begin(RGY_PERF_STAGE_FILTER);
             sts = check_pts();
             if (sts == MFX_ERR_MORE_SURFACE)
                 continue;
@@ -4052,6 +4163,7 @@ mfxStatus CQSVPipeline::RunEncode() {
             pSurfVppIn = pNextFrame;
         }
 
+        perf_stage_begin(RGY_PERF_STAGE_FILTER);
         sts = vpp_one_frame(pSurfVppIn, (m_VppPostPlugins.size()) ? pSurfVppPostFilter[0] : pSurfEncIn);
         if (bVppRequireMoreFrame)
             continue;
@@ -4096,10 +4208,9 @@ mfxStatus CQSVPipeline::RunEncode() {
                 break;
 
             //空いているフレームバッファを取得、空いていない場合は待機して、空くまで待ってから取得
-            nEncSurfIdx = GetFreeSurface(m_pEncSurfaces.data(), m_EncResponse.NumFrameActual);
+            nEncSurfIdx = poolEncSurfaces.getFree(wait_surface_release);
             if (nEncSurfIdx == MSDK_INVALID_SURF_IDX) {
-                PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for enc.\n"));
-                return MFX_ERR_MEMORY_ALLOC;
+                return free_surface_error(poolEncSurfaces, _T("enc"));
             }
 
             pSurfEncIn = &m_pEncSurfaces[nEncSurfIdx];
@@ -4109,13 +4220,16 @@ mfxStatus CQSVPipeline::RunEncode() {
                 pNextFrame = pSurfInputBuf;
 
                 if (!bCheckPtsMultipleOutput) {
+                    perf_stage_begin(RGY_PERF_STAGE_DECODE);
                     sts = decode_one_frame(false);
                     if (sts == MFX_ERR_MORE_SURFACE)
                         continue;
                     if (sts != MFX_ERR_NONE)
                         break;
+                    perf_stage_end(RGY_PERF_STAGE_DECODE);
                 }
 
+                perf_stage_begin(RGY_PERF_STAGE_FILTER);
                 sts = check_pts();
                 if (sts == MFX_ERR_MORE_SURFACE)
                     continue;
@@ -4137,6 +4251,7 @@ mfxStatus CQSVPipeline::RunEncode() {
             if (!frame_inside_range(nInputFrameCount, m_trimParam.list).first)
                 continue;
 
+            perf_stage_begin(RGY_PERF_STAGE_FILTER);
             sts = vpp_one_frame(pSurfVppIn, (m_VppPostPlugins.size()) ? pSurfVppPostFilter[0] : pSurfEncIn);
             if (bVppRequireMoreFrame)
                 continue;
@@ -4181,10 +4296,9 @@ mfxStatus CQSVPipeline::RunEncode() {
                 break;
 
             //空いているフレームバッファを取得、空いていない場合は待機して、空くまで待ってから取得
-            nEncSurfIdx = GetFreeSurface(m_pEncSurfaces.data(), m_EncResponse.NumFrameActual);
+            nEncSurfIdx = poolEncSurfaces.getFree(wait_surface_release);
             if (nEncSurfIdx == MSDK_INVALID_SURF_IDX) {
-                PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for enc.\n"));
-                return MFX_ERR_MEMORY_ALLOC;
+                return free_surface_error(poolEncSurfaces, _T("enc"));
             }
 
             pSurfEncIn = &m_pEncSurfaces[nEncSurfIdx];
@@ -4194,6 +4308,7 @@ mfxStatus CQSVPipeline::RunEncode() {
                 pNextFrame = nullptr;
                 lastSyncP = nullptr;
 
+                perf_stage_begin(RGY_PERF_STAGE_FILTER);
                 sts = check_pts();
                 if (sts == MFX_ERR_MORE_SURFACE)
                     continue;
@@ -4212,6 +4327,7 @@ mfxStatus CQSVPipeline::RunEncode() {
                 pSurfVppIn = pNextFrame;
             }
 
+            perf_stage_begin(RGY_PERF_STAGE_FILTER);
             sts = vpp_one_frame(pSurfVppIn, (m_VppPostPlugins.size()) ? pSurfVppPostFilter[0] : pSurfEncIn);
             if (bVppRequireMoreFrame)
                 continue;
@@ -4261,10 +4377,9 @@ mfxStatus CQSVPipeline::RunEncode() {
 
             pNextFrame = nullptr;
 
-            nEncSurfIdx = GetFreeSurface(m_pEncSurfaces.data(), m_EncResponse.NumFrameActual);
+            nEncSurfIdx = poolEncSurfaces.getFree(wait_surface_release);
             if (nEncSurfIdx == MSDK_INVALID_SURF_IDX) {
-                PrintMes(RGY_LOG_ERROR, _T("Failed to get free surface for enc.\n"));
-                return MFX_ERR_MEMORY_ALLOC;
+                return free_surface_error(poolEncSurfaces, _T("enc"));
             }
 
             pSurfEncIn = &m_pEncSurfaces[nEncSurfIdx];
@@ -4347,6 +4462,9 @@ mfxStatus CQSVPipeline::RunEncode() {
     m_EncThread.m_stsThread = sts;
     QSV_ERR_MES(sts, _T("Error in encoding pipeline, synchronizing pipeline."));
 
+    PrintMes(RGY_LOG_DEBUG, _T("Encode Thread: surface wait: enc %d times %.3f ms, vpp %d times %.3f ms.\n"),
+        poolEncSurfaces.waitCount(), poolEncSurfaces.waitDurationUs() / 1000.0,
+        poolVppSurfaces.waitCount(), poolVppSurfaces.waitDurationUs() / 1000.0);
     PrintMes(RGY_LOG_DEBUG, _T("Encode Thread: finished.\n"));
     return sts;
 }
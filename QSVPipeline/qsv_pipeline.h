@@ -52,6 +52,7 @@
 
 #include "vpp_plugins.h"
 #include "rgy_perf_monitor.h"
+#include "rgy_perf_telemetry.h"
 #include "qsv_plugin.h"
 #include "rgy_input.h"
 #include "rgy_output.h"
@@ -119,6 +120,8 @@ protected:
     mfxVersion m_mfxVer;
     shared_ptr<EncodeStatus> m_pStatus;
     shared_ptr<CPerfMonitor> m_pPerfMonitor;
+    unique_ptr<RGYPerfTelemetry> m_pPerfTelemetry;
+    RGYPerfTelemetry::Producer *m_pPerfTelemetryEnc; //エンコードスレッドからの記録用
     CEncodingThread m_EncThread;
 
     rgy_rational<int> m_inputFps;
@@ -129,6 +129,7 @@ sInputParams::sInputParams() :
     memType(SYSTEM_MEMORY),
 #endif
     nInputBufSize(QSV_DEFAULT_INPUT_BUF_HW),
+    nInputBufBatch(QSV_DEFAULT_INPUT_BUF_BATCH),
     nPAR(),
     bCAVLC(false),
     nInterPred(0),
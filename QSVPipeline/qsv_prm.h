@@ -216,6 +216,7 @@ struct sInputParams {
     mfxU8 memType;       //use d3d surface
 
     mfxU16 nInputBufSize; //input buf size
+    mfxU16 nInputBufBatch; //input buf batch (0 = auto)
 
     mfxI32     nPAR[2]; //PAR比
     bool       bCAVLC;  //CAVLC
@@ -688,7 +689,8 @@ const int QSV_DEFAULT_QUALITY = MFX_TARGETUSAGE_BALANCED;
 const int QSV_DEFAULT_INPUT_BUF_SW = 1;
 const int QSV_DEFAULT_INPUT_BUF_HW = 3;
 const int QSV_INPUT_BUF_MIN = 1;
-const int QSV_INPUT_BUF_MAX = 16;
+const int QSV_INPUT_BUF_MAX = 64;
+const int QSV_DEFAULT_INPUT_BUF_BATCH = 0; //auto (input-bufの1/4)
 const int QSV_DEFAULT_CONVERGENCE = 90;
 const int QSV_DEFAULT_ACCURACY = 500;
 const int QSV_DEFAULT_FORCE_GOP_LEN = 1;
@@ -1,4 +1,4 @@
-﻿// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
 // QSVEnc by rigaya
 // -----------------------------------------------------------------------------------------
 // The MIT License
@@ -44,8 +44,10 @@ QSVTask::QSVTask() :
     encSyncPoint(0),
     vppSyncPoint(),
     pWriter(),
-    pmfxAllocator(nullptr) {
+    pmfxAllocator(nullptr),
+    perfTimes() {
     RGY_MEMSET_ZERO(mfxBS);
+    perfTimes.clear();
 }
 
 mfxStatus QSVTask::Init(shared_ptr<RGYOutput> pTaskWriter, uint32_t nBufferSize, QSVAllocator *pAllocator) {
@@ -90,7 +92,9 @@ CQSVTaskControl::CQSVTaskControl() :
     m_pTasks(),
     m_nPoolSize(0),
     m_nTaskBufferStart(0),
-    m_pmfxSession(nullptr) {
+    m_nTaskBufferNext(0),
+    m_pmfxSession(nullptr),
+    m_pPerfTelemetry(nullptr) {
 }
 
 CQSVTaskControl::~CQSVTaskControl() {
@@ -117,6 +121,8 @@ mfxStatus CQSVTaskControl::Init(MFXVideoSession *pmfxSession, QSVAllocator *pAll
 
     m_pmfxSession = pmfxSession;
     m_nPoolSize = nPoolSize;
+    m_nTaskBufferStart = 0;
+    m_nTaskBufferNext = 0;
     m_pTasks.resize(m_nPoolSize);
 
     for (uint32_t i = 0; i < m_nPoolSize; i++) {
@@ -134,23 +140,34 @@ mfxStatus CQSVTaskControl::SynchronizeFirstTask() {
         return MFX_ERR_NOT_FOUND; //タスクバッファにもうタスクはない
     }
 
+    auto& perfTimes = m_pTasks[m_nTaskBufferStart].perfTimes;
+    if (m_pPerfTelemetry) {
+        perfTimes.setBegin(RGY_PERF_STAGE_SYNC, m_pPerfTelemetry->now());
+        perfTimes.setEnd(RGY_PERF_STAGE_QUEUE, perfTimes.begin[RGY_PERF_STAGE_SYNC]);
+    }
+
     mfxStatus sts = m_pmfxSession->SyncOperation(m_pTasks[m_nTaskBufferStart].encSyncPoint, MSDK_WAIT_INTERVAL);
 
     if (sts == MFX_ERR_NONE) {
+        //WriteBitstreamでDataLengthが変わる場合があるので、先に取得しておく
+        const uint32_t outputBytes = m_pTasks[m_nTaskBufferStart].mfxBS.DataLength;
+        if (m_pPerfTelemetry) {
+            const auto t = m_pPerfTelemetry->now();
+            perfTimes.setEnd(RGY_PERF_STAGE_SYNC, t);
+            perfTimes.setBegin(RGY_PERF_STAGE_WRITE, t);
+        }
         if (MFX_ERR_NONE > (sts = m_pTasks[m_nTaskBufferStart].WriteBitstream())) {
             return sts;
         }
+        if (m_pPerfTelemetry) {
+            perfTimes.setEnd(RGY_PERF_STAGE_WRITE, m_pPerfTelemetry->now());
+            m_pPerfTelemetry->push(perfTimes, outputBytes);
+        }
 
         if (MFX_ERR_NONE > (sts = m_pTasks[m_nTaskBufferStart].Clear())) {
             return sts;
         }
-
-        for (uint32_t i = 0; i < m_nPoolSize; i++) {
-            m_nTaskBufferStart = (m_nTaskBufferStart + 1) % m_nPoolSize;
-            if (m_pTasks[m_nTaskBufferStart].encSyncPoint != NULL) {
-                break;
-            }
-        }
+        AdvanceFirstTask();
     } else if (sts == MFX_ERR_ABORTED) {
         for (auto syncp : m_pTasks[m_nTaskBufferStart].vppSyncPoint) {
             auto vppsts = m_pmfxSession->SyncOperation(syncp, 0);
@@ -159,10 +176,19 @@ mfxStatus CQSVTaskControl::SynchronizeFirstTask() {
             }
         }
         m_pTasks[m_nTaskBufferStart].Clear();
+        AdvanceFirstTask();
     }
     return sts;
 }
 
+void CQSVTaskControl::AdvanceFirstTask() {
+    //最後に返したタスクまで同期した場合は、そのタスクが次に再利用されるので先頭もそこにとどめる
+    //それ以外の場合、次のタスクは投入済みか、GetFreeTaskで返して投入待ちのタスク
+    if (m_nTaskBufferStart != m_nTaskBufferNext) {
+        m_nTaskBufferStart = (m_nTaskBufferStart + 1) % m_nPoolSize;
+    }
+}
+
 void CQSVTaskControl::Close() {
     if (m_pTasks.size()) {
         for (mfxU32 i = 0; i < m_nPoolSize; i++) {
@@ -173,5 +199,6 @@ void CQSVTaskControl::Close() {
 
     m_pmfxSession = NULL;
     m_nTaskBufferStart = 0;
+    m_nTaskBufferNext = 0;
     m_nPoolSize = 0;
 }
@@ -1,4 +1,4 @@
-﻿// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
 // QSVEnc by rigaya
 // -----------------------------------------------------------------------------------------
 // The MIT License
@@ -51,29 +51,92 @@
 #include "gpuz_info.h"
 #include "qsv_allocator.h"
 #include "rgy_thread.h"
+#include "rgy_perf_telemetry.h"
 #include "qsv_control.h"
 
-static inline int GetFreeSurface(mfxFrameSurface1 *pSurfacesPool, int nPoolSize) {
-    for (mfxU32 j = 0; j < MSDK_WAIT_INTERVAL; j++) {
-        for (mfxU16 i = 0; i < nPoolSize; i++) {
-            if (0 == pSurfacesPool[i].Data.Locked)
-                return i;
+//空きサーフェスの取得を行うクラス
+//サーフェスのLockedはMedia SDK内部で非同期に増減され、解放の通知もないため、
+//解放時に更新する空きリストは持てず、Lockedを調べて探索するしかない
+//前回返したサーフェスの次から探索する(next-fit)ので、サーフェスがおおむね取得順に解放される
+//通常のパイプラインでは1回目の比較で空きが見つかるが、最悪の場合はプールサイズ分の探索になる
+//空きがない場合は待機用の関数(先頭タスクや直前の非同期処理の同期)を呼んで、その完了を待つ
+class QSVSurfacePool {
+public:
+    QSVSurfacePool() : m_pSurfaces(nullptr), m_nPoolSize(0), m_nNext(0), m_nWaitCount(0), m_nWaitDurationUs(0), m_pWaitDurationUsShared(nullptr), m_lastError(MFX_ERR_NONE) {};
+    QSVSurfacePool(mfxFrameSurface1 *pSurfaces, int nPoolSize, std::atomic<int64_t> *pWaitDurationUsShared = nullptr) :
+        m_pSurfaces(pSurfaces), m_nPoolSize(nPoolSize), m_nNext(0), m_nWaitCount(0), m_nWaitDurationUs(0), m_pWaitDurationUsShared(pWaitDurationUsShared), m_lastError(MFX_ERR_NONE) {};
+
+    //待機せずに空きサーフェスを探す
+    int getFreeNoWait() {
+        for (int i = 0, idx = m_nNext; i < m_nPoolSize; i++) {
+            if (0 == m_pSurfaces[idx].Data.Locked) {
+                m_nNext = (idx + 1 == m_nPoolSize) ? 0 : idx + 1;
+                return idx;
+            }
+            idx = (idx + 1 == m_nPoolSize) ? 0 : idx + 1;
         }
-        sleep_hybrid(j);
+        return MSDK_INVALID_SURF_IDX;
     }
-    return MSDK_INVALID_SURF_IDX;
-}
-
-static inline mfxU16 GetFreeSurfaceIndex(mfxFrameSurface1 *pSurfacesPool, mfxU16 nPoolSize, mfxU16 step) {
-    if (pSurfacesPool) {
-        for (mfxU16 i = 0; i < nPoolSize; i = (mfxU16)(i + step), pSurfacesPool += step) {
-            if (0 == pSurfacesPool[0].Data.Locked) {
-                return i;
+
+    //空きサーフェスを取得する、空きがない場合はwaitFuncを呼んで解放を待つ
+    //waitFuncは、MFX_ERR_NOT_FOUND … 待機できる同期ポイントがない
+    //                                (Media SDK内部の処理の完了を待つほかないので、1msずつsleepして再試行)
+    //           MFX_ERR_NONE未満 … エラー(MSDK_INVALID_SURF_IDXを返す)
+    //           それ以外       … 再試行
+    //MSDK_INVALID_SURF_IDXを返した場合、その原因はlastError()で取得できる
+    template<typename Func>
+    int getFree(Func waitFunc) {
+        int idx = getFreeNoWait();
+        if (idx != MSDK_INVALID_SURF_IDX) {
+            return idx;
+        }
+        m_nWaitCount++;
+        m_lastError = MFX_ERR_NONE;
+        const auto tmStart = std::chrono::high_resolution_clock::now();
+        for (mfxU32 j = 0, nPoll = 0; j < MSDK_WAIT_INTERVAL; j++) {
+            const auto sts = waitFunc();
+            if (sts == MFX_ERR_NOT_FOUND) {
+                if (nPoll++ >= SURF_POLL_MAX_MS) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            } else if (sts < MFX_ERR_NONE) {
+                m_lastError = sts;
+                break;
+            }
+            if ((idx = getFreeNoWait()) != MSDK_INVALID_SURF_IDX) {
+                break;
             }
         }
+        if (idx == MSDK_INVALID_SURF_IDX && m_lastError == MFX_ERR_NONE) {
+            m_lastError = MFX_ERR_MEMORY_ALLOC; //待機してもサーフェスが解放されなかった
+        }
+        const auto waitUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tmStart).count();
+        m_nWaitDurationUs += waitUs;
+        if (m_pWaitDurationUsShared) {
+            *m_pWaitDurationUsShared += waitUs;
+        }
+        return idx;
     }
-    return MSDK_INVALID_SURF_IDX;
-}
+    int getFree() {
+        return getFree([]() { return MFX_ERR_NOT_FOUND; });
+    }
+
+    mfxFrameSurface1 *surface(int idx) const { return &m_pSurfaces[idx]; }
+    int size() const { return m_nPoolSize; }
+    int waitCount() const { return m_nWaitCount; }
+    int64_t waitDurationUs() const { return m_nWaitDurationUs; }
+    mfxStatus lastError() const { return m_lastError; }
+private:
+    static const mfxU32 SURF_POLL_MAX_MS = 1000; //待機できる同期ポイントがない場合に、解放を待つ最大時間
+    mfxFrameSurface1 *m_pSurfaces;
+    int m_nPoolSize;
+    int m_nNext;
+    int m_nWaitCount;
+    int64_t m_nWaitDurationUs;
+    std::atomic<int64_t> *m_pWaitDurationUsShared; //perf monitorのスレッドからも参照されるためatomic
+    mfxStatus m_lastError;
+};
 
 struct QSVTask {
     mfxBitstream mfxBS;
@@ -82,6 +145,7 @@ struct QSVTask {
     vector<mfxSyncPoint> vppSyncPoint;
     shared_ptr<RGYOutput> pWriter;
     QSVAllocator *pmfxAllocator;
+    RGYPerfFrameTimes perfTimes; //--perf-telemetry用の各段階の時刻
 
     QSVTask();
 
@@ -121,6 +185,7 @@ struct QSVTask {
         mfxBS.DataLength = 0;
 
         vppSyncPoint.clear();
+        perfTimes.clear();
 
         return MFX_ERR_NONE;
     }
@@ -135,32 +200,47 @@ public:
 
     virtual mfxStatus Init(MFXVideoSession *pmfxSession, QSVAllocator *pAllocator, shared_ptr<RGYOutput> pTaskWriter, uint32_t nPoolSize, uint32_t nBufferSize);
 
+    //タスクはリングバッファとして投入順に使用し、先頭(m_nTaskBufferStart)から順に同期する
+    //使用中のタスクは常に[m_nTaskBufferStart, m_nTaskBufferNext]の連続した範囲にあるので、
+    //空きタスクは探索せずに末尾の次を調べるだけでよい
     mfxStatus GetFreeTask(QSVTask **ppTask) {
         if (ppTask == nullptr) {
             return MFX_ERR_NULL_PTR;
         }
-
-        if (m_pTasks.size()) {
-            for (uint32_t i = 0; i < m_nPoolSize; i++) {
-                auto pTask = &m_pTasks[(m_nTaskBufferStart + i) % m_nPoolSize];
-                if (NULL == pTask->encSyncPoint) {
-                    *ppTask = pTask;
-                    return MFX_ERR_NONE;
-                }
+        if (m_pTasks.size() == 0) {
+            return MFX_ERR_NOT_FOUND;
+        }
+        //前回返したタスクが投入済み(encSyncPointがセットされている)なら、次のタスクに進む
+        //投入されなかった場合(エンコーダがフレームを溜めている場合など)は、同じタスクを再利用する
+        if (m_pTasks[m_nTaskBufferNext].encSyncPoint != NULL) {
+            const uint32_t next = (m_nTaskBufferNext + 1) % m_nPoolSize;
+            if (m_pTasks[next].encSyncPoint != NULL) {
+                return MFX_ERR_NOT_FOUND; //すべてのタスクが使用中
             }
+            m_nTaskBufferNext = next;
         }
-        return MFX_ERR_NOT_FOUND;
+        *ppTask = &m_pTasks[m_nTaskBufferNext];
+        return MFX_ERR_NONE;
     }
 
     virtual mfxStatus SynchronizeFirstTask();
     virtual void Close();
 
+    //同期と出力の時刻を記録し、出力したフレームの記録を送る先 (nullptrなら記録しない)
+    void SetPerfTelemetry(RGYPerfTelemetry::Producer *pPerfTelemetry) {
+        m_pPerfTelemetry = pPerfTelemetry;
+    }
 protected:
+    //先頭のタスクを同期した後、次に同期するタスクへ進める
+    void AdvanceFirstTask();
+
     vector<QSVTask> m_pTasks;
     uint32_t m_nPoolSize;
-    uint32_t m_nTaskBufferStart;
+    uint32_t m_nTaskBufferStart; //次に同期するタスク
+    uint32_t m_nTaskBufferNext;  //最後にGetFreeTaskで返したタスク
 
     MFXVideoSession *m_pmfxSession;
+    RGYPerfTelemetry::Producer *m_pPerfTelemetry;
 };
 
 #endif //__QSV_TASK_H__
@@ -291,6 +291,29 @@ public:
         return RGY_ERR_NONE;
     }
 
+    //バッファを入れ替える (タイムスタンプ等の情報はそのまま)
+    void swapBuffer(RGYBitstream *pBitstream) {
+        std::swap(m_bitstream.Data,       pBitstream->m_bitstream.Data);
+        std::swap(m_bitstream.DataOffset, pBitstream->m_bitstream.DataOffset);
+        std::swap(m_bitstream.DataLength, pBitstream->m_bitstream.DataLength);
+        std::swap(m_bitstream.MaxLength,  pBitstream->m_bitstream.MaxLength);
+    }
+
+    //_aligned_mallocで確保したバッファの所有権を受け取る
+    void attach(uint8_t *bufptr, size_t bufsize) {
+        clear();
+        m_bitstream.Data = bufptr;
+        m_bitstream.MaxLength = (uint32_t)bufsize;
+    }
+
+    //バッファの所有権を手放す (バッファは解放しない)
+    void detach() {
+        m_bitstream.Data = nullptr;
+        m_bitstream.DataOffset = 0;
+        m_bitstream.DataLength = 0;
+        m_bitstream.MaxLength = 0;
+    }
+
     RGY_ERR changeSize(size_t nNewSize) {
         uint8_t *pData = (uint8_t *)_aligned_malloc(nNewSize, 32);
         if (pData == nullptr) {
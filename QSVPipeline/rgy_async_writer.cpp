@@ -0,0 +1,350 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#include <errno.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#include "rgy_async_writer.h"
+#include "rgy_perf_monitor.h"
+
+//ブロックの数 (1つを書き出し中に、もう1つにデータをコピーする)
+static const int ASYNC_WRITE_BLOCKS = 2;
+//ブロックの最小サイズ
+static const size_t ASYNC_WRITE_BLOCK_MIN = 256 * 1024;
+//O_DIRECTで必要なアライメント (バッファのアドレス、ファイル上の位置、サイズ)
+static const size_t ASYNC_WRITE_ALIGN = 4096;
+
+RGYAsyncFileWriter::RGYAsyncFileWriter() :
+#if defined(_WIN32) || defined(_WIN64)
+    m_fp(nullptr),
+#else
+    m_fd(-1),
+    m_directEnabled(false),
+    m_directCurrent(false),
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_blockSize(0),
+    m_blocks(),
+    m_free(),
+    m_queue(),
+    m_cur(-1),
+    m_pos(0),
+    m_fileSize(0),
+    m_thWrite(),
+    m_mtx(),
+    m_cvWrite(),
+    m_cvFree(),
+    m_abort(false),
+    m_error(false),
+    m_queueInfo(nullptr),
+    m_bytesWritten(0),
+    m_bytesWrittenDirect(0),
+    m_waitCount(0),
+    m_waitTimeUs(0) {
+}
+
+RGYAsyncFileWriter::~RGYAsyncFileWriter() {
+    close();
+}
+
+RGY_ERR RGYAsyncFileWriter::open(const TCHAR *filename, size_t bufferSize, PerfQueueInfo *queueInfo) {
+    close();
+#if defined(_WIN32) || defined(_WIN64)
+    //"movflags:faststart"などで読み込めるよう、共有モードで開く
+    m_fp = _tfsopen(filename, _T("wb+"), _SH_DENYWR);
+    if (m_fp == nullptr) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    //ブロックにまとめてから書き出すので、CRTのバッファは使用しない
+    setvbuf(m_fp, nullptr, _IONBF, 0);
+#else
+    m_fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+    m_directEnabled = m_directCurrent = (m_fd >= 0);
+    if (m_fd < 0 && errno == EINVAL) {
+        //O_DIRECTに対応していないファイルシステム
+        m_fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    }
+    if (m_fd < 0) {
+        return RGY_ERR_FILE_OPEN;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_blockSize = (std::max)(bufferSize / ASYNC_WRITE_BLOCKS, ASYNC_WRITE_BLOCK_MIN);
+    m_blockSize = (m_blockSize + ASYNC_WRITE_ALIGN - 1) & ~(ASYNC_WRITE_ALIGN - 1);
+    for (int i = 0; i < ASYNC_WRITE_BLOCKS; i++) {
+        Block block;
+        block.buf = std::unique_ptr<uint8_t, aligned_malloc_deleter>((uint8_t *)_aligned_malloc(m_blockSize, ASYNC_WRITE_ALIGN), aligned_malloc_deleter());
+        if (!block.buf) {
+            close();
+            return RGY_ERR_MEMORY_ALLOC;
+        }
+        block.size = 0;
+        block.offset = 0;
+        m_blocks.push_back(std::move(block));
+        m_free.push_back(i);
+    }
+    m_queueInfo = queueInfo;
+    m_thWrite = std::thread(&RGYAsyncFileWriter::threadFuncWrite, this);
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYAsyncFileWriter::close() {
+    RGY_ERR err = RGY_ERR_NONE;
+    if (m_thWrite.joinable()) {
+        submitCurrent();
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_abort = true;
+        }
+        m_cvWrite.notify_all();
+        m_thWrite.join();
+        err = (m_error) ? RGY_ERR_UNDEFINED_BEHAVIOR : RGY_ERR_NONE;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_fp) {
+        fclose(m_fp);
+        m_fp = nullptr;
+    }
+#else
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_directEnabled = false;
+    m_directCurrent = false;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_blocks.clear();
+    m_free.clear();
+    m_queue.clear();
+    m_cur = -1;
+    m_pos = 0;
+    m_fileSize = 0;
+    m_abort = false;
+    m_queueInfo = nullptr;
+    return err;
+}
+
+#if !(defined(_WIN32) || defined(_WIN64))
+void RGYAsyncFileWriter::setDirect(bool enable) {
+    if (enable == m_directCurrent) {
+        return;
+    }
+    const int flags = fcntl(m_fd, F_GETFL);
+    if (flags == -1 || fcntl(m_fd, F_SETFL, (enable) ? (flags | O_DIRECT) : (flags & ~O_DIRECT)) == -1) {
+        m_directEnabled = false;
+        return;
+    }
+    m_directCurrent = enable;
+}
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+
+bool RGYAsyncFileWriter::writeBlock(const Block& block) {
+#if defined(_WIN32) || defined(_WIN64)
+    if (_fseeki64(m_fp, block.offset, SEEK_SET) != 0) {
+        return false;
+    }
+    return block.size == _fwrite_nolock(block.buf.get(), 1, block.size, m_fp);
+#else
+    //O_DIRECTは位置とサイズがアラインされている場合のみ使用できる
+    //シーク後の書き込みや最後のブロックなどは、O_DIRECTを外して書き出す
+    const bool aligned = ((block.offset | block.size) & (ASYNC_WRITE_ALIGN - 1)) == 0;
+    setDirect(m_directEnabled && aligned);
+    const bool direct = m_directCurrent;
+    const uint8_t *ptr = block.buf.get();
+    size_t remain = block.size;
+    int64_t offset = block.offset;
+    while (remain > 0) {
+        const ssize_t ret = pwrite(m_fd, ptr, remain, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && m_directCurrent) {
+                //O_DIRECTでの書き込みに失敗した場合は、以降使用しない
+                m_directEnabled = false;
+                setDirect(false);
+                continue;
+            }
+            return false;
+        }
+        if (ret == 0) {
+            return false;
+        }
+        ptr += ret;
+        remain -= ret;
+        offset += ret;
+    }
+    if (direct && m_directCurrent) {
+        m_bytesWrittenDirect += block.size;
+    }
+    return true;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+void RGYAsyncFileWriter::updateQueueInfo() {
+    if (m_queueInfo) {
+        m_queueInfo->usage_write_async = m_queue.size();
+        m_queueInfo->write_async_bytes = m_bytesWritten;
+    }
+}
+
+void RGYAsyncFileWriter::threadFuncWrite() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;) {
+        m_cvWrite.wait(lock, [this]() { return m_abort || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            break; //終了時は、書き出し待ちのブロックをすべて書き出してから終了する
+        }
+        Block& block = m_blocks[m_queue.front()];
+        lock.unlock();
+        //エラーが発生した後のブロックは破棄する
+        const bool ret = !m_error && writeBlock(block);
+        lock.lock();
+        if (ret) {
+            m_bytesWritten += block.size;
+        } else {
+            m_error = true;
+        }
+        block.size = 0;
+        m_free.push_back(m_queue.front());
+        m_queue.pop_front();
+        updateQueueInfo();
+        m_cvFree.notify_all();
+    }
+}
+
+int RGYAsyncFileWriter::getFreeBlock() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    if (m_free.empty()) {
+        //書き出しが間に合っていない
+        const auto timeStart = std::chrono::high_resolution_clock::now();
+        m_cvFree.wait(lock, [this]() { return !m_free.empty(); });
+        m_waitTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - timeStart).count();
+        m_waitCount++;
+    }
+    const int idx = m_free.front();
+    m_free.pop_front();
+    return idx;
+}
+
+void RGYAsyncFileWriter::submitCurrent() {
+    if (m_cur < 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (m_blocks[m_cur].size > 0) {
+            m_queue.push_back(m_cur);
+            updateQueueInfo();
+        } else {
+            m_free.push_back(m_cur);
+        }
+    }
+    m_cvWrite.notify_one();
+    m_cur = -1;
+}
+
+size_t RGYAsyncFileWriter::write(const void *data, size_t size) {
+    if (m_error || !m_thWrite.joinable()) {
+        return 0;
+    }
+    const uint8_t *ptr = (const uint8_t *)data;
+    size_t remain = size;
+    while (remain > 0) {
+        if (m_cur < 0) {
+            m_cur = getFreeBlock();
+            m_blocks[m_cur].size = 0;
+            m_blocks[m_cur].offset = m_pos;
+        }
+        Block& block = m_blocks[m_cur];
+        //シーク後のブロックはアラインされた位置で区切り、次のブロック以降がアラインされるようにする
+        const size_t capacity = m_blockSize - (size_t)(block.offset & (ASYNC_WRITE_ALIGN - 1));
+        const size_t copySize = (std::min)(remain, capacity - block.size);
+        memcpy(block.buf.get() + block.size, ptr, copySize);
+        block.size += copySize;
+        ptr += copySize;
+        remain -= copySize;
+        m_pos += copySize;
+        if (block.size == capacity) {
+            submitCurrent();
+        }
+    }
+    m_fileSize = (std::max)(m_fileSize, m_pos);
+    return (m_error) ? 0 : size;
+}
+
+RGY_ERR RGYAsyncFileWriter::flush() {
+    submitCurrent();
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cvFree.wait(lock, [this]() { return m_queue.empty(); });
+    return (m_error) ? RGY_ERR_UNDEFINED_BEHAVIOR : RGY_ERR_NONE;
+}
+
+size_t RGYAsyncFileWriter::read(void *buf, size_t size) {
+    if (flush() != RGY_ERR_NONE) {
+        return 0;
+    }
+    //書き込みスレッドは待機中なので、ここでファイルを操作してよい
+#if defined(_WIN32) || defined(_WIN64)
+    if (_fseeki64(m_fp, m_pos, SEEK_SET) != 0) {
+        return 0;
+    }
+    const size_t ret = _fread_nolock(buf, 1, size, m_fp);
+#else
+    setDirect(false);
+    ssize_t ret = 0;
+    do {
+        ret = pread(m_fd, buf, size, m_pos);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return 0;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_pos += ret;
+    return (size_t)ret;
+}
+
+int64_t RGYAsyncFileWriter::seek(int64_t offset, int whence) {
+    int64_t pos = 0;
+    switch (whence) {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = m_pos + offset; break;
+    case SEEK_END: pos = m_fileSize + offset; break;
+    default: return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    if (pos != m_pos) {
+        //コピー中のブロックはここまでで区切り、新しい位置から次のブロックとする
+        submitCurrent();
+        m_pos = pos;
+    }
+    return pos;
+}
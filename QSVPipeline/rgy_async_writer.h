@@ -0,0 +1,126 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_ASYNC_WRITER_H__
+#define __RGY_ASYNC_WRITER_H__
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include "rgy_osdep.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_util.h"
+
+struct PerfQueueInfo;
+
+//出力ファイルへの非同期書き込み
+//書き込むデータをアラインされた大きなブロックにまとめ、書き込みスレッドからファイル上の位置を指定して書き出す
+//ブロックは複数用意し(ダブルバッファ)、呼び出し側はブロックへのコピーのみで、ページキャッシュのライトバックなどを待たない
+//Linuxでは可能な場合、O_DIRECTでページキャッシュを経由せずに書き出す
+class RGYAsyncFileWriter {
+public:
+    RGYAsyncFileWriter();
+    ~RGYAsyncFileWriter();
+
+    //bufferSizeはすべてのブロックの合計サイズ
+    RGY_ERR open(const TCHAR *filename, size_t bufferSize, PerfQueueInfo *queueInfo);
+    //書き込み待ちのデータをすべて書き出してからファイルを閉じる
+    RGY_ERR close();
+
+    //ブロックにコピーしたバイト数を返す (エラー時はsizeより小さくなる)
+    size_t write(const void *data, size_t size);
+    //書き込み待ちのデータをすべて書き出してから読み込む
+    size_t read(void *buf, size_t size);
+    //シーク後の位置を返す (失敗時は負の値)
+    //書き込みは順に行われるので、シークしてもそれまでのデータの書き出しを待つ必要はない
+    int64_t seek(int64_t offset, int whence);
+    //書き込み待ちのデータをすべて書き出し、完了を待つ
+    RGY_ERR flush();
+
+    bool isOpen() const { return m_thWrite.joinable(); }
+    bool error() const { return m_error; }
+    size_t blockSize() const { return m_blockSize; }
+    int blockCount() const { return (int)m_blocks.size(); }
+    //書き出したバイト数
+    int64_t bytesWritten() const { return m_bytesWritten; }
+    //O_DIRECTで書き出したバイト数
+    int64_t bytesWrittenDirect() const { return m_bytesWrittenDirect; }
+    //空きブロックを待った回数と時間 (us)
+    int64_t waitCount() const { return m_waitCount; }
+    int64_t waitTimeUs() const { return m_waitTimeUs; }
+protected:
+    struct Block {
+        std::unique_ptr<uint8_t, aligned_malloc_deleter> buf;
+        size_t size;    //ブロック内のデータのサイズ
+        int64_t offset; //ブロックの先頭のファイル上の位置
+    };
+    void threadFuncWrite();
+    bool writeBlock(const Block& block);
+    int getFreeBlock();
+    void submitCurrent();
+    void updateQueueInfo();
+#if !(defined(_WIN32) || defined(_WIN64))
+    void setDirect(bool enable);
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+
+#if defined(_WIN32) || defined(_WIN64)
+    FILE *m_fp;
+#else
+    int m_fd;
+    bool m_directEnabled; //O_DIRECTが使用可能か
+    bool m_directCurrent; //現在O_DIRECTが設定されているか
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    size_t m_blockSize;
+    std::vector<Block> m_blocks;
+    std::deque<int> m_free;  //空きブロック
+    std::deque<int> m_queue; //書き出し待ちのブロック (先頭は書き出し中)
+    int m_cur;               //データをコピー中のブロック (-1でなし)
+    int64_t m_pos;           //現在の位置
+    int64_t m_fileSize;      //ファイルの終端の位置
+
+    std::thread m_thWrite;
+    std::mutex m_mtx;
+    std::condition_variable m_cvWrite;
+    std::condition_variable m_cvFree;
+    bool m_abort;
+    std::atomic<bool> m_error;
+    PerfQueueInfo *m_queueInfo;
+
+    int64_t m_bytesWritten;
+    int64_t m_bytesWrittenDirect;
+    int64_t m_waitCount;
+    int64_t m_waitTimeUs;
+};
+
+#endif //__RGY_ASYNC_WRITER_H__
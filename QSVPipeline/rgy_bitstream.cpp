@@ -26,9 +26,116 @@
 // --------------------------------------------------------------------------------------------
 
 #include <regex>
+#include <emmintrin.h>
 #include "rgy_util.h"
+#include "rgy_simd.h"
 #include "rgy_bitstream.h"
 
+const uint8_t *find_start_code_c(const uint8_t *data, const uint8_t *fin) {
+    const uint8_t *ptr = data;
+    while (ptr + 2 < fin) {
+        //ptr[2]が2以上なら、ptr, ptr+1, ptr+2のいずれからもスタートコードは始まらない
+        if (ptr[2] > 1) {
+            ptr += 3;
+        } else if (ptr[2] == 0) {
+            ptr++;
+        } else if (ptr[0] == 0 && ptr[1] == 0) {
+            return ptr;
+        } else {
+            ptr += 3;
+        }
+    }
+    return fin;
+}
+
+const uint8_t *find_start_code_sse2(const uint8_t *data, const uint8_t *fin) {
+    const uint8_t *ptr = data;
+    const __m128i xZero = _mm_setzero_si128();
+    const __m128i xOne = _mm_set1_epi8(1);
+    //ptr+2から16byteを読むので、ptr+18 <= finの範囲をSIMDで処理する
+    for (; fin - ptr >= 18; ptr += 16) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)(ptr + 0));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(ptr + 1));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(ptr + 2));
+        x0 = _mm_and_si128(_mm_cmpeq_epi8(x0, xZero), _mm_cmpeq_epi8(x1, xZero));
+        x0 = _mm_and_si128(x0, _mm_cmpeq_epi8(x2, xOne));
+        const int mask = _mm_movemask_epi8(x0);
+        if (mask) {
+            return ptr + rgy_ctz(mask);
+        }
+    }
+    return find_start_code_c(ptr, fin);
+}
+
+static funcFindStartCode get_find_start_code_func() {
+    const auto simd = get_availableSIMD();
+#if defined(_MSC_VER) || defined(__AVX2__)
+    if ((simd & (AVX2 | AVX)) == (AVX2 | AVX)) {
+        return find_start_code_avx2;
+    }
+#endif
+    if (simd & SSE2) {
+        return find_start_code_sse2;
+    }
+    return find_start_code_c;
+}
+
+const uint8_t *find_start_code(const uint8_t *data, const uint8_t *fin) {
+    static const funcFindStartCode func = get_find_start_code_func();
+    return func(data, fin);
+}
+
+//data[i+3] (NALヘッダ) が存在するスタートコードのみを対象とし、
+//直前に0がある場合は4byteのスタートコードとしてNALに含める
+template<uint8_t (*get_nal_type)(const uint8_t *nal_header), typename T>
+static void parse_nal_unit(const uint8_t *data, size_t size, T& nal_list) {
+    nal_list.clear();
+    if (size > 3) {
+        const uint8_t *fin = data + size;
+        const uint8_t *ptr = data;
+        while ((ptr = find_start_code(ptr, fin - 1)) < fin - 1) {
+            nal_info nal_start = { nullptr, 0, 0 };
+            nal_start.ptr = ptr - (ptr > data && ptr[-1] == 0);
+            nal_start.type = get_nal_type(ptr + 3);
+            nal_start.size = fin - nal_start.ptr;
+            if (nal_list.size()) {
+                auto& prev = nal_list.back();
+                prev.size = nal_start.ptr - prev.ptr;
+            }
+            nal_list.push_back(nal_start);
+            ptr += 4;
+        }
+    }
+}
+
+static uint8_t get_nal_type_h264(const uint8_t *nal_header) {
+    return nal_header[0] & 0x1f;
+}
+
+static uint8_t get_nal_type_hevc(const uint8_t *nal_header) {
+    return (nal_header[0] & 0x7f) >> 1;
+}
+
+void parse_nal_unit_h264(const uint8_t *data, size_t size, RGYNalList& nal_list) {
+    parse_nal_unit<get_nal_type_h264>(data, size, nal_list);
+}
+
+void parse_nal_unit_hevc(const uint8_t *data, size_t size, RGYNalList& nal_list) {
+    parse_nal_unit<get_nal_type_hevc>(data, size, nal_list);
+}
+
+std::vector<nal_info> parse_nal_unit_h264(const uint8_t *data, size_t size) {
+    std::vector<nal_info> nal_list;
+    parse_nal_unit<get_nal_type_h264>(data, size, nal_list);
+    return nal_list;
+}
+
+std::vector<nal_info> parse_nal_unit_hevc(const uint8_t *data, size_t size) {
+    std::vector<nal_info> nal_list;
+    parse_nal_unit<get_nal_type_hevc>(data, size, nal_list);
+    return nal_list;
+}
+
 HEVCHDRSeiPrm::HEVCHDRSeiPrm() : maxcll(-1), maxfall(-1), masterdisplay(), masterdisplay_set(false) {
     memset(&masterdisplay, 0, sizeof(masterdisplay));
 }
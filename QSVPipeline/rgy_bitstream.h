@@ -32,6 +32,7 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <algorithm>
 
 struct nal_info {
     const uint8_t *ptr;
@@ -117,60 +118,80 @@ enum PayloadType {
     REGIONAL_NESTING                     = 157,
 };
 
-static std::vector<nal_info> parse_nal_unit_h264(const uint8_t *data, size_t size) {
-    std::vector<nal_info> nal_list;
-    if (size > 3) {
-        nal_info nal_start = { nullptr, 0, 0 };
-        const auto i_fin = size - 3;
-        for (size_t i = 0; i < i_fin; i++) {
-            if (data[i+0] == 0 && data[i+1] == 0 && data[i+2] == 1) {
-                if (nal_start.ptr) {
-                    nal_list.push_back(nal_start);
-                }
-                nal_start.ptr = data + i - (i > 0 && data[i-1] == 0);
-                nal_start.type = data[i+3] & 0x1f;
-                nal_start.size = data + size - nal_start.ptr;
-                if (nal_list.size()) {
-                    auto prev = nal_list.end()-1;
-                    prev->size = nal_start.ptr - prev->ptr;
-                }
-                i += 3;
-            }
-        }
-        if (nal_start.ptr) {
-            nal_list.push_back(nal_start);
+//Annex-Bのスタートコード(00 00 01)を[data, fin)の範囲で探し、その先頭の位置を返す
+//見つからなければfinを返す (スタートコードの3byteすべてがfin以前にあるものだけを対象とする)
+//NAL内部の00 00 00/01/02はエミュレーション防止バイトにより00 00 03 xxとなるため、
+//00 00 01のみを探せばNALの途中を誤検出することはない
+typedef const uint8_t *(*funcFindStartCode)(const uint8_t *data, const uint8_t *fin);
+const uint8_t *find_start_code_c(const uint8_t *data, const uint8_t *fin);
+const uint8_t *find_start_code_sse2(const uint8_t *data, const uint8_t *fin);
+const uint8_t *find_start_code_avx2(const uint8_t *data, const uint8_t *fin);
+//使用可能なSIMDに応じた関数で探索する
+const uint8_t *find_start_code(const uint8_t *data, const uint8_t *fin);
+
+//NALの解析結果を格納するリスト
+//INLINE_COUNTまでは内部の固定領域を使い、それを超えた場合のみヒープを確保する
+//clear()しても確保済みの領域は解放しないので、フレームごとに再利用すれば定常状態でヒープ確保は発生しない
+class RGYNalList {
+public:
+    static const size_t INLINE_COUNT = 16;
+
+    RGYNalList() : m_inline(), m_heap(), m_data(m_inline), m_size(0), m_capacity(INLINE_COUNT), m_allocCount(0) {};
+    RGYNalList(const RGYNalList&) = delete;
+    RGYNalList &operator=(const RGYNalList&) = delete;
+
+    void clear() { m_size = 0; }
+    void push_back(const nal_info& nal) {
+        if (m_size >= m_capacity) {
+            grow();
         }
+        m_data[m_size++] = nal;
     }
-    return nal_list;
-}
-
-static std::vector<nal_info> parse_nal_unit_hevc(const uint8_t *data, size_t size) {
-    std::vector<nal_info> nal_list;
-    if (size > 3) {
-        nal_info nal_start = { nullptr, 0, 0 };
-        const auto i_fin = size - 3;
-
-        for (size_t i = 0; i < i_fin; i++) {
-            if (data[i+0] == 0 && data[i+1] == 0 && data[i+2] == 1) {
-                if (nal_start.ptr) {
-                    nal_list.push_back(nal_start);
-                }
-                nal_start.ptr = data + i - (i > 0 && data[i-1] == 0);
-                nal_start.type = (data[i+3] & 0x7f) >> 1;
-                nal_start.size = data + size - nal_start.ptr;
-                if (nal_list.size()) {
-                    auto prev = nal_list.end()-1;
-                    prev->size = nal_start.ptr - prev->ptr;
-                }
-                i += 3;
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    nal_info *begin() { return m_data; }
+    nal_info *end() { return m_data + m_size; }
+    const nal_info *begin() const { return m_data; }
+    const nal_info *end() const { return m_data + m_size; }
+    nal_info& operator[](size_t i) { return m_data[i]; }
+    const nal_info& operator[](size_t i) const { return m_data[i]; }
+    nal_info& back() { return m_data[m_size-1]; }
+    //指定したtypeの最初のNALを返す (なければnullptr)
+    const nal_info *find(uint8_t type) const {
+        for (size_t i = 0; i < m_size; i++) {
+            if (m_data[i].type == type) {
+                return &m_data[i];
             }
         }
-        if (nal_start.ptr) {
-            nal_list.push_back(nal_start);
-        }
+        return nullptr;
     }
-    return nal_list;
-}
+    size_t capacity() const { return m_capacity; }
+    //これまでにヒープ確保を行った回数
+    int allocCount() const { return m_allocCount; }
+private:
+    void grow() {
+        std::vector<nal_info> heap(m_capacity * 2);
+        std::copy(m_data, m_data + m_size, heap.begin());
+        m_heap.swap(heap);
+        m_data = m_heap.data();
+        m_capacity = m_heap.size();
+        m_allocCount++;
+    }
+
+    nal_info m_inline[INLINE_COUNT];
+    std::vector<nal_info> m_heap;
+    nal_info *m_data;
+    size_t m_size;
+    size_t m_capacity;
+    int m_allocCount;
+};
+
+//dataのNALを解析し、nal_listに格納する (nal_listはクリアしてから格納する)
+void parse_nal_unit_h264(const uint8_t *data, size_t size, RGYNalList& nal_list);
+void parse_nal_unit_hevc(const uint8_t *data, size_t size, RGYNalList& nal_list);
+
+std::vector<nal_info> parse_nal_unit_h264(const uint8_t *data, size_t size);
+std::vector<nal_info> parse_nal_unit_hevc(const uint8_t *data, size_t size);
 
 struct HEVCHDRSeiPrm {
     int maxcll;
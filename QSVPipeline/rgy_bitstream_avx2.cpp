@@ -0,0 +1,59 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2011-2016 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <immintrin.h>
+#include "rgy_simd.h"
+#include "rgy_bitstream.h"
+
+#if _MSC_VER >= 1800 && !defined(__AVX__) && !defined(_DEBUG)
+static_assert(false, "do not forget to set /arch:AVX or /arch:AVX2 for this file.");
+#endif
+
+#if defined(_MSC_VER) || defined(__AVX2__)
+
+const uint8_t *find_start_code_avx2(const uint8_t *data, const uint8_t *fin) {
+    const uint8_t *ptr = data;
+    const __m256i yZero = _mm256_setzero_si256();
+    const __m256i yOne = _mm256_set1_epi8(1);
+    //ptr+2から32byteを読むので、ptr+34 <= finの範囲をSIMDで処理する
+    for (; fin - ptr >= 34; ptr += 32) {
+        __m256i y0 = _mm256_loadu_si256((const __m256i *)(ptr + 0));
+        __m256i y1 = _mm256_loadu_si256((const __m256i *)(ptr + 1));
+        __m256i y2 = _mm256_loadu_si256((const __m256i *)(ptr + 2));
+        y0 = _mm256_and_si256(_mm256_cmpeq_epi8(y0, yZero), _mm256_cmpeq_epi8(y1, yZero));
+        y0 = _mm256_and_si256(y0, _mm256_cmpeq_epi8(y2, yOne));
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(y0);
+        if (mask) {
+            _mm256_zeroupper();
+            return ptr + rgy_ctz(mask);
+        }
+    }
+    _mm256_zeroupper();
+    return find_start_code_sse2(ptr, fin);
+}
+
+#endif //#if defined(_MSC_VER) || defined(__AVX2__)
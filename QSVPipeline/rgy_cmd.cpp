@@ -33,6 +33,7 @@
 #include "rgy_prm.h"
 #include "rgy_cmd.h"
 #include "rgy_perf_monitor.h"
+#include "rgy_perf_telemetry.h"
 
 static int getAudioTrackIdx(const RGYParamCommon *common, int iTrack) {
     for (int i = 0; i < common->nAudioSelectCount; i++) {
@@ -1032,6 +1033,14 @@ int parse_one_common_option(const TCHAR *option_name, const TCHAR *strInput[], i
         common->outputBufSizeMB = (std::min)(value, RGY_OUTPUT_BUF_MB_MAX);
         return 0;
     }
+    if (IS_OPTION("output-async")) {
+        common->outputAsync = true;
+        return 0;
+    }
+    if (IS_OPTION("no-output-async")) {
+        common->outputAsync = false;
+        return 0;
+    }
     if (IS_OPTION("avsync")) {
         int value = 0;
         i++;
@@ -1066,6 +1075,23 @@ int parse_one_common_option(const TCHAR *option_name, const TCHAR *strInput[], i
         common->disableMp4Opt = true;
         return 0;
     }
+    if (IS_OPTION("mp4-fragment")) {
+        common->mp4Fragment = 0;
+        if (i + 1 < nArgNum && strInput[i+1][0] != _T('-')) {
+            i++;
+            int value = 0;
+            if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+                CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+                return 1;
+            }
+            if (value < 0) {
+                CMD_PARSE_SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+                return 1;
+            }
+            common->mp4Fragment = value;
+        }
+        return 0;
+    }
     if (IS_OPTION("max-cll")) {
         i++;
         common->maxCll = tchar_to_string(strInput[i]);
@@ -1185,6 +1211,58 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         ctrl->threadCsp = value;
         return 0;
     }
+    if (IS_OPTION("thread-pool")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        ctrl->threadPool = value;
+        return 0;
+    }
+    if (IS_OPTION("thread-pool-affinity")) {
+        i++;
+        long long value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%lli"), &value)) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        ctrl->threadPoolAffinity = (uint64_t)value;
+        return 0;
+    }
+    if (IS_OPTION("avs-prefetch")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        ctrl->avsPrefetch = value;
+        return 0;
+    }
+    if (IS_OPTION("avs-prefetch-threads")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 1) {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Invalid value"), option_name, strInput[i]);
+            return 1;
+        }
+        ctrl->avsPrefetchThreads = value;
+        return 0;
+    }
     if (IS_OPTION("simd-csp")) {
         i++;
         int value = 0;
@@ -1220,7 +1298,23 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
             CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
             return 1;
         }
-        ctrl->perfMonitorInterval = std::max(50, v);
+        ctrl->perfMonitorInterval = std::max(10, v);
+        return 0;
+    }
+    if (IS_OPTION("perf-telemetry")) {
+        i++;
+        ctrl->perfTelemetryFile = strInput[i];
+        return 0;
+    }
+    if (IS_OPTION("perf-telemetry-format")) {
+        int value = 0;
+        i++;
+        if (PARSE_ERROR_FLAG != (value = get_value_from_chr(list_perf_telemetry_format, strInput[i]))) {
+            ctrl->perfTelemetryFormat = value;
+        } else {
+            CMD_PARSE_SET_ERR(strInput[0], _T("Unknown value"), option_name, strInput[i]);
+            return 1;
+        }
         return 0;
     }
     return -10;
@@ -1496,12 +1590,14 @@ tstring gen_cmd(const RGYParamCommon *param, const RGYParamCommon *defaultPrm, b
 #endif //#if ENABLE_AVSW_READER
     OPT_LST(_T("--avsync"), AVSyncMode, list_avsync);
     OPT_BOOL(_T("--no-mp4opt"), _T(""), disableMp4Opt);
+    OPT_NUM(_T("--mp4-fragment"), mp4Fragment);
 
     OPT_STR(_T("--max-cll"), maxCll);
     OPT_STR(_T("--master-display"), masterDisplay);
     OPT_TSTR(_T("--dhdr10-info"), dynamicHdr10plusJson);
 
     OPT_NUM(_T("--output-buf"), outputBufSizeMB);
+    OPT_BOOL(_T("--output-async"), _T("--no-output-async"), outputAsync);
     return cmd.str();
 }
 
@@ -1512,6 +1608,12 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
     OPT_NUM(_T("--thread-audio"), threadAudio);
     OPT_NUM(_T("--thread-csp"), threadCsp);
     OPT_LST(_T("--simd-csp"), simdCsp, list_simd);
+    OPT_NUM(_T("--thread-pool"), threadPool);
+    if (param->threadPoolAffinity != defaultPrm->threadPoolAffinity) {
+        cmd << _T(" --thread-pool-affinity 0x") << std::hex << param->threadPoolAffinity << std::dec;
+    }
+    OPT_NUM(_T("--avs-prefetch"), avsPrefetch);
+    OPT_NUM(_T("--avs-prefetch-threads"), avsPrefetchThreads);
     OPT_NUM(_T("--max-procfps"), procSpeedLimit);
     OPT_STR_PATH(_T("--log"), logfile);
     OPT_LST(_T("--log-level"), loglevel, list_log_level);
@@ -1535,6 +1637,8 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
         }
     }
     OPT_NUM(_T("--perf-monitor-interval"), perfMonitorInterval);
+    OPT_STR_PATH(_T("--perf-telemetry"), perfTelemetryFile);
+    OPT_LST(_T("--perf-telemetry-format"), perfTelemetryFormat, list_perf_telemetry_format);
     return cmd.str();
 }
 
@@ -1552,6 +1656,10 @@ tstring gen_cmd_help_input() {
 #endif
 #if ENABLE_AVISYNTH_READER
         _T("   --avs                        set input as avs format\n")
+        _T("   --avs-prefetch <int>         prefetch frames from avs ahead of encoding\n")
+        _T("                                  default: 0 (off)\n")
+        _T("   --avs-prefetch-threads <int> set num of threads for avs prefetch\n")
+        _T("                                  default: 1, >1 requires MT-safe script\n")
 #endif
 #if ENABLE_VAPOURSYNTH_READER
         _T("   --vpy                        set input as vpy format\n")
@@ -1688,7 +1796,11 @@ tstring gen_cmd_help_common() {
         _T("-m,--mux-option <string1>:<string2>\n")
         _T("                                set muxer option name and value.\n")
         _T("                                 these could be only used with\n")
-        _T("                                 avhw/avsw reader and avcodec muxer.\n"),
+        _T("                                 avhw/avsw reader and avcodec muxer.\n")
+        _T("   --mp4-fragment [<int>]       output fragmented mp4, playable while writing\n")
+        _T("                                 and no rewrite of the file at the end.\n")
+        _T("                                 fragments are cut at keyframes (GOP),\n")
+        _T("                                 after at least <int> ms (default: 0).\n"),
         DEFAULT_IGNORE_DECODE_ERROR);
 #else
     tstring str;
@@ -1705,7 +1817,13 @@ tstring gen_cmd_help_ctrl() {
 
     str += strsprintf(_T("")
         _T("   --max-procfps <int>         limit encoding speed for lower utilization.\n")
-        _T("                                 default:0 (no limit)\n"));
+        _T("                                 default:0 (no limit)\n")
+        _T("   --thread-pool <int>          set num of threads for shared thread pool\n")
+        _T("                                 used for color conversion and audio transcoding\n")
+        _T("                                 default: 0 (=auto)\n")
+        _T("   --thread-pool-affinity <int> set cpu affinity mask for shared thread pool\n")
+        _T("                                 ex. 0xff00, default: 0 (=no limit)\n")
+        );
 #if ENABLE_AVCODEC_OUT_THREAD
     str += strsprintf(_T("")
         _T("   --output-thread <int>        set output thread num\n")
@@ -1715,6 +1833,7 @@ tstring gen_cmd_help_ctrl() {
 #if 0
         _T("   --audio-thread <int>         set audio thread num, available only with output thread\n")
         _T("                                 -1: auto (= default)\n")
+        _T("                                     use one thread if 2 or more audio tracks are transcoded\n")
         _T("                                  0: disable (slow, but less memory usage)\n")
         _T("                                  1: use one thread\n")
         _T("                                  2: use two thread\n")
@@ -1730,14 +1849,12 @@ tstring gen_cmd_help_ctrl() {
         _T("                                 all          ... monitor all info\n")
         _T("                                 cpu_total    ... cpu total usage (%%)\n")
         _T("                                 cpu_kernel   ... cpu kernel usage (%%)\n")
-#if defined(_WIN32) || defined(_WIN64)
         _T("                                 cpu_main     ... cpu main thread usage (%%)\n")
         _T("                                 cpu_enc      ... cpu encode thread usage (%%)\n")
         _T("                                 cpu_in       ... cpu input thread usage (%%)\n")
         _T("                                 cpu_out      ... cpu output thread usage (%%)\n")
         _T("                                 cpu_aud_proc ... cpu aud proc thread usage (%%)\n")
         _T("                                 cpu_aud_enc  ... cpu aud enc thread usage (%%)\n")
-#endif //#if defined(_WIN32) || defined(_WIN64)
         _T("                                 cpu          ... monitor all cpu info\n")
 #if defined(_WIN32) || defined(_WIN64)
         _T("                                 gpu_load    ... gpu usage (%%)\n")
@@ -1752,6 +1869,8 @@ tstring gen_cmd_help_ctrl() {
         _T("                                 gpu         ... monitor all gpu info\n")
 #endif //#if defined(_WIN32) || defined(_WIN64)
         _T("                                 queue       ... queue usage\n")
+        _T("                                 queue_write ... async write queue and speed (MB/s)\n")
+        _T("                                 surf_wait   ... time waiting for free surfaces (ms)\n")
         _T("                                 mem_private ... private memory (MB)\n")
         _T("                                 mem_virtual ... virtual memory (MB)\n")
         _T("                                 mem         ... monitor all memory info\n")
@@ -1765,6 +1884,9 @@ tstring gen_cmd_help_ctrl() {
         _T("                                 frame_out   ... written_frames\n")
         _T("                                 \n")
         _T("   --perf-monitor-interval <int> set perf monitor check interval (millisec)\n")
-        _T("                                 default 500, must be 50 or more\n"));
+        _T("                                 default 500, must be 10 or more\n")
+        _T("   --perf-telemetry <string>    output per-frame stage latencies to file\n")
+        _T("   --perf-telemetry-format <string> format of --perf-telemetry\n")
+        _T("                                 json (default), bin\n"));
     return str;
 }
\ No newline at end of file
@@ -28,52 +28,90 @@
 #if !(defined(_WIN32) || defined(_WIN64))
 #include "rgy_event.h"
 
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <atomic>
-#include <climits>
+#include <vector>
 #include <chrono>
+#include <cerrno>
 #include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
+//eventfdを使ったWin32イベントの実装
+//シグナル状態 = eventfdのカウンタが0でない
+//eventfdはpoll/epollで待機できるので、複数のイベントの同時待機や他のfdとの待機を行える
 class Event {
 public:
+    int fd;
     bool bManualReset;
-    bool bReady;
-    std::mutex mtx;
-    std::condition_variable cv;
 
-    Event() : bManualReset(false), bReady(false), mtx(), cv() {
+    Event(bool manualReset) : fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), bManualReset(manualReset) {
 
     };
-    Event(bool manualReset) : Event() {
-        bManualReset = manualReset;
+    ~Event() {
+        if (fd >= 0) {
+            close(fd);
+        }
     };
+    void signal() {
+        const uint64_t one = 1;
+        while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR);
+    }
+    //カウンタをすべて読み出して非シグナル状態にする
+    //他のスレッドに先を越された場合はfalseを返す
+    bool consume() {
+        uint64_t value = 0;
+        ssize_t ret = 0;
+        while ((ret = read(fd, &value, sizeof(value))) < 0 && errno == EINTR);
+        return ret == sizeof(value);
+    }
+    //待機に成功した際の処理、自動リセットならここで非シグナル状態にする
+    bool acquire() {
+        return bManualReset || consume();
+    }
 };
 
-void ResetEvent(HANDLE ev) {
-    Event *event = (Event *)ev;
-    {
-        std::lock_guard<std::mutex> lock(event->mtx);
-        if (event->bReady) {
-            event->bReady = false;
+//待機の残り時間(ms)を管理する
+class WaitDeadline {
+public:
+    WaitDeadline(uint32_t millisec) : m_infinite(millisec == INFINITE),
+        m_deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(m_infinite ? 0 : millisec)) {
+    };
+    //pollに渡すタイムアウト値
+    int remaining() const {
+        if (m_infinite) {
+            return -1;
         }
+        //切り捨てると指定時間より早く戻ってしまうので、切り上げる
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(m_deadline - std::chrono::steady_clock::now()).count();
+        return (int)std::max<int64_t>((us + 999) / 1000, 0);
     }
+private:
+    bool m_infinite;
+    std::chrono::steady_clock::time_point m_deadline;
+};
+
+static int poll_events(pollfd *pfd, uint32_t count, int timeout) {
+    int ret = 0;
+    while ((ret = poll(pfd, count, timeout)) < 0 && errno == EINTR);
+    return ret;
+}
+
+void ResetEvent(HANDLE ev) {
+    Event *event = (Event *)ev;
+    event->consume();
 }
 
 void SetEvent(HANDLE ev) {
     Event *event = (Event *)ev;
-    {
-        std::lock_guard<std::mutex> lock(event->mtx);
-        if (!event->bReady) {
-            event->bReady = true;
-            (event->bManualReset) ? event->cv.notify_all() : event->cv.notify_one();
-        }
-    }
+    event->signal();
 }
 
 HANDLE CreateEvent(void *pDummy, int bManualReset, int bInitialState, void *pDummy2) {
     Event *event = new Event(!!bManualReset);
+    if (event->fd < 0) {
+        delete event;
+        return NULL;
+    }
     if (bInitialState) {
         SetEvent(event);
     }
@@ -83,43 +121,94 @@ HANDLE CreateEvent(void *pDummy, int bManualReset, int bInitialState, void *pDum
 void CloseEvent(HANDLE ev) {
     if (ev != NULL) {
         Event *event = (Event *)ev;
-       delete event;
+        delete event;
     }
 }
 
+int GetEventFd(HANDLE ev) {
+    return (ev != NULL) ? ((Event *)ev)->fd : -1;
+}
+
 uint32_t WaitForSingleObject(HANDLE ev, uint32_t millisec) {
     Event *event = (Event *)ev;
-    {
-        std::unique_lock<std::mutex> uniq_lk(event->mtx);
-        if (millisec == INFINITE) {
-            event->cv.wait(uniq_lk, [&event]{ return event->bReady;});
-            if (!event->bManualReset) {
-                event->bReady = false;
-            }
-        } else {
-            event->cv.wait_for(uniq_lk, std::chrono::milliseconds(millisec), [&event]{ return event->bReady;});
-            if (!event->bReady) {
-                return WAIT_TIMEOUT;
-            }
-            if (!event->bManualReset) {
-                event->bReady = false;
-            }
+    WaitDeadline deadline(millisec);
+    for (;;) {
+        pollfd pfd = { event->fd, POLLIN, 0 };
+        const int timeout = deadline.remaining();
+        if (poll_events(&pfd, 1, timeout) > 0 && event->acquire()) {
+            return WAIT_OBJECT_0;
+        }
+        //自動リセットのイベントを他のスレッドに取られた場合は、残り時間で待機しなおす
+        if (timeout == 0) {
+            return WAIT_TIMEOUT;
         }
     }
-    return WAIT_OBJECT_0;
 }
 
-uint32_t WaitForMultipleObjects(uint32_t count, HANDLE *pev, int dummy, uint32_t millisec) {
+uint32_t WaitForMultipleObjects(uint32_t count, HANDLE *pev, int bWaitAll, uint32_t millisec) {
     Event **pevent = (Event **)pev;
-    int success = 0;
-    bool bTimeout = false;
-    for (uint32_t i = 0; i < count; i++) {
-        if (WAIT_TIMEOUT == WaitForSingleObject(pevent[i], (bTimeout) ? 0 : millisec)) {
-            bTimeout = true;
+    pollfd pfdStack[MAXIMUM_WAIT_OBJECTS];
+    std::vector<pollfd> pfdHeap;
+    pollfd *pfd = pfdStack;
+    if (count > _countof(pfdStack)) {
+        pfdHeap.resize(count);
+        pfd = pfdHeap.data();
+    }
+    WaitDeadline deadline(millisec);
+    for (;;) {
+        for (uint32_t i = 0; i < count; i++) {
+            pfd[i].fd = pevent[i]->fd;
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+        }
+        const int timeout = deadline.remaining();
+        if (!bWaitAll) {
+            //いずれかのイベントがシグナル状態になるまで待機し、最も小さいindexを返す
+            if (poll_events(pfd, count, timeout) > 0) {
+                for (uint32_t i = 0; i < count; i++) {
+                    if ((pfd[i].revents & POLLIN) && pevent[i]->acquire()) {
+                        return WAIT_OBJECT_0 + i;
+                    }
+                }
+            }
         } else {
-            success++;
+            //すべてのイベントがシグナル状態になった時点で、自動リセットのイベントをまとめて非シグナル状態にする
+            //途中で他のスレッドに取られた場合は、取得済みのものをシグナル状態に戻してやり直す
+            const int nReady = poll_events(pfd, count, 0);
+            if (nReady == (int)count) {
+                uint32_t acquired = 0;
+                for (; acquired < count; acquired++) {
+                    if (!pevent[acquired]->acquire()) {
+                        break;
+                    }
+                }
+                if (acquired == count) {
+                    return WAIT_OBJECT_0;
+                }
+                for (uint32_t i = 0; i < acquired; i++) {
+                    if (!pevent[i]->bManualReset) {
+                        pevent[i]->signal();
+                    }
+                }
+            } else if (nReady >= 0) {
+                //まだシグナル状態になっていないイベントのみを待機する
+                uint32_t nWait = 0;
+                for (uint32_t i = 0; i < count; i++) {
+                    if (!(pfd[i].revents & POLLIN)) {
+                        pfd[nWait].fd = pfd[i].fd;
+                        pfd[nWait].events = POLLIN;
+                        pfd[nWait].revents = 0;
+                        nWait++;
+                    }
+                }
+                if (poll_events(pfd, nWait, timeout) > 0) {
+                    continue;
+                }
+            }
+        }
+        if (timeout == 0) {
+            return WAIT_TIMEOUT;
         }
     }
-    return (bTimeout) ? WAIT_TIMEOUT : (WAIT_OBJECT_0 + success);
 }
 #endif //#if !(defined(_WIN32) || defined(_WIN64))
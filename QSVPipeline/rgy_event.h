@@ -44,6 +44,7 @@ enum : uint32_t {
 };
 
 static const uint32_t INFINITE = UINT_MAX;
+static const uint32_t MAXIMUM_WAIT_OBJECTS = 64;
 
 void ResetEvent(HANDLE ev);
 
@@ -55,7 +56,11 @@ void CloseEvent(HANDLE ev);
 
 uint32_t WaitForSingleObject(HANDLE ev, uint32_t millisec);
 
-uint32_t WaitForMultipleObjects(uint32_t count, HANDLE *pev, int dummy, uint32_t millisec);
+uint32_t WaitForMultipleObjects(uint32_t count, HANDLE *pev, int bWaitAll, uint32_t millisec);
+
+//イベントに対応するfdを取得する (poll/epollで他のfdと同時に待機するため)
+//シグナル状態でPOLLINとなる。fdの読み出しは行わないこと
+int GetEventFd(HANDLE ev);
 
 #endif //#if defined(_WIN32) || defined(_WIN64)
 
@@ -25,76 +25,442 @@
 //
 // --------------------------------------------------------------------------------------------
 
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
-#include <fcntl.h>
-#include <io.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
 #include "rgy_hdr10plus.h"
 
-const TCHAR *RGYHDR10Plus::HDR10PLUS_GEN_EXE_NAME =  _T("hdr10plus_gen.exe");
+//jsonの読み込みで許容する入れ子の深さ
+static const int HDR10PLUS_JSON_MAX_DEPTH = 64;
+//SequenceFrameIndexとして許容する最大値 (60fpsで約46時間分)
+//不正な値でフレームごとのインデックスの配列を巨大に確保しないよう、INT_MAXより十分小さくしておく
+static const int HDR10PLUS_MAX_FRAME_INDEX = 10000000;
+
+//HDR10+のjsonの読み込みに必要な最低限のjsonの値
+struct HDR10PlusJsonValue {
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+    Type type;
+    double number;
+    std::string str;
+    std::vector<std::string> keys;           //JSON_OBJECTのキー
+    std::vector<HDR10PlusJsonValue> values;  //JSON_ARRAYの要素、JSON_OBJECTの値
+
+    HDR10PlusJsonValue() : type(JSON_NULL), number(0.0), str(), keys(), values() {};
+    const HDR10PlusJsonValue *find(const char *key) const {
+        if (type != JSON_OBJECT) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) {
+                return &values[i];
+            }
+        }
+        return nullptr;
+    }
+};
+
+//ファイルを少しずつ読みながらjsonを解析する
+//SceneInfoの要素ごとに値を作成して使い捨てるため、ファイル全体を保持しない
+class HDR10PlusJsonReader {
+public:
+    HDR10PlusJsonReader(FILE *fp) : m_fp(fp), m_buf(64 * 1024), m_pos(0), m_size(0), m_line(1) {
+        //UTF-8のBOMを飛ばす
+        if (peekRaw() == 0xEF) {
+            get(); get(); get();
+        }
+    };
+    int line() const { return m_line; }
+    //空白を飛ばして次の文字を返す (ファイル終端ではEOF)
+    int peek() {
+        skipSpace();
+        return peekRaw();
+    }
+    //次の文字がcなら読み進めてtrueを返す
+    bool expect(int c) {
+        if (peek() != c) {
+            return false;
+        }
+        get();
+        return true;
+    }
+    //valueがnullptrの場合は読み飛ばす
+    bool parseValue(HDR10PlusJsonValue *value, int depth);
+    bool parseString(std::string *str);
+protected:
+    int peekRaw() {
+        if (m_pos >= m_size && !fill()) {
+            return EOF;
+        }
+        return (uint8_t)m_buf[m_pos];
+    }
+    int get() {
+        const int c = peekRaw();
+        if (c != EOF) {
+            m_pos++;
+            if (c == '\n') {
+                m_line++;
+            }
+        }
+        return c;
+    }
+    bool fill() {
+        m_pos = 0;
+        m_size = fread(m_buf.data(), 1, m_buf.size(), m_fp);
+        return m_size > 0;
+    }
+    void skipSpace() {
+        for (int c = peekRaw(); c == ' ' || c == '\t' || c == '\r' || c == '\n'; c = peekRaw()) {
+            get();
+        }
+    }
+
+    FILE *m_fp;
+    std::vector<char> m_buf;
+    size_t m_pos;
+    size_t m_size;
+    int m_line;
+};
+
+bool HDR10PlusJsonReader::parseString(std::string *str) {
+    if (!expect('"')) {
+        return false;
+    }
+    for (;;) {
+        int c = get();
+        if (c == EOF) {
+            return false;
+        } else if (c == '"') {
+            return true;
+        } else if (c == '\\') {
+            c = get();
+            switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case '"': case '\\': case '/': break;
+            case 'u': {
+                //HDR10+のjsonで使用するキーや値はASCIIのみなので、それ以外は'?'にしておく
+                int code = 0;
+                for (int i = 0; i < 4; i++) {
+                    const int h = get();
+                    if (!isxdigit(h)) {
+                        return false;
+                    }
+                    code = (code << 4) | (isdigit(h) ? h - '0' : (tolower(h) - 'a' + 10));
+                }
+                c = (code < 0x80) ? code : '?';
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (str) {
+            str->push_back((char)c);
+        }
+    }
+}
+
+bool HDR10PlusJsonReader::parseValue(HDR10PlusJsonValue *value, int depth) {
+    if (depth > HDR10PLUS_JSON_MAX_DEPTH) {
+        return false;
+    }
+    const int c = peek();
+    if (c == '{' || c == '[') {
+        const bool isObject = c == '{';
+        const int close = (isObject) ? '}' : ']';
+        get();
+        if (value) {
+            value->type = (isObject) ? HDR10PlusJsonValue::JSON_OBJECT : HDR10PlusJsonValue::JSON_ARRAY;
+        }
+        if (expect(close)) {
+            return true;
+        }
+        for (;;) {
+            std::string key;
+            if (isObject && (!parseString(&key) || !expect(':'))) {
+                return false;
+            }
+            HDR10PlusJsonValue *child = nullptr;
+            if (value) {
+                if (isObject) {
+                    value->keys.push_back(key);
+                }
+                value->values.push_back(HDR10PlusJsonValue());
+                child = &value->values.back();
+            }
+            if (!parseValue(child, depth + 1)) {
+                return false;
+            }
+            if (!expect(',')) {
+                return expect(close);
+            }
+        }
+    } else if (c == '"') {
+        if (value) {
+            value->type = HDR10PlusJsonValue::JSON_STRING;
+        }
+        return parseString((value) ? &value->str : nullptr);
+    } else if (c == '-' || isdigit(c)) {
+        std::string num;
+        for (int n = peekRaw(); n != EOF && (isdigit(n) || n == '-' || n == '+' || n == '.' || n == 'e' || n == 'E'); n = peekRaw()) {
+            num.push_back((char)get());
+        }
+        char *end = nullptr;
+        const double d = strtod(num.c_str(), &end);
+        if (end != num.c_str() + num.length()) {
+            return false;
+        }
+        if (value) {
+            value->type = HDR10PlusJsonValue::JSON_NUMBER;
+            value->number = d;
+        }
+        return true;
+    }
+    std::string literal;
+    for (int n = peekRaw(); n != EOF && isalpha(n); n = peekRaw()) {
+        literal.push_back((char)get());
+    }
+    if (literal == "true" || literal == "false") {
+        if (value) {
+            value->type = HDR10PlusJsonValue::JSON_BOOL;
+            value->number = (literal == "true") ? 1.0 : 0.0;
+        }
+        return true;
+    } else if (literal == "null") {
+        return true;
+    }
+    return false;
+}
+
+//ST 2094-40のペイロードの作成用
+class HDR10PlusBitWriter {
+public:
+    HDR10PlusBitWriter() : m_data(), m_bits(0) {};
+    void put(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            if ((m_bits & 7) == 0) {
+                m_data.push_back(0);
+            }
+            if ((value >> i) & 1) {
+                m_data.back() |= (uint8_t)(0x80 >> (m_bits & 7));
+            }
+            m_bits++;
+        }
+    }
+    //最後のバイトの残りのビットは0となっている
+    const std::vector<uint8_t>& data() const { return m_data; }
+protected:
+    std::vector<uint8_t> m_data;
+    size_t m_bits;
+};
+
+//数値をbitsビットに収まるよう制限して返す
+static uint32_t hdr10plus_json_uint(const HDR10PlusJsonValue *value, int bits) {
+    const double maxValue = (double)((1u << bits) - 1);
+    return (uint32_t)clamp(value->number + 0.5, 0.0, maxValue);
+}
+
+static bool hdr10plus_json_is_number_array(const HDR10PlusJsonValue *value, size_t minCount, size_t maxCount) {
+    if (!value || value->type != HDR10PlusJsonValue::JSON_ARRAY
+        || value->values.size() < minCount || maxCount < value->values.size()) {
+        return false;
+    }
+    for (const auto& v : value->values) {
+        if (v.type != HDR10PlusJsonValue::JSON_NUMBER) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//SceneInfoの1要素 (1フレーム分) から、ST 2094-40のペイロード (user_data_registered_itu_t_t35) を作成する
+static RGY_ERR hdr10plus_gen_payload(std::vector<uint8_t>& payload, const HDR10PlusJsonValue& scene, const TCHAR **errMes) {
+    const auto numWindows = scene.find("NumberOfWindows");
+    if (numWindows && numWindows->number != 1.0) {
+        //jsonにはウィンドウの位置の情報がないため、ウィンドウは1つのみ対応
+        *errMes = _T("NumberOfWindows other than 1 is not supported");
+        return RGY_ERR_UNSUPPORTED;
+    }
+    const auto luminance = scene.find("LuminanceParameters");
+    if (!luminance) {
+        *errMes = _T("LuminanceParameters not found");
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    const auto maxScl = luminance->find("MaxScl");
+    const auto averageRGB = luminance->find("AverageRGB");
+    const auto distributions = luminance->find("LuminanceDistributions");
+    const auto distIndex = (distributions) ? distributions->find("DistributionIndex") : nullptr;
+    const auto distValues = (distributions) ? distributions->find("DistributionValues") : nullptr;
+    if (!hdr10plus_json_is_number_array(maxScl, 3, 3)
+        || !averageRGB || averageRGB->type != HDR10PlusJsonValue::JSON_NUMBER
+        || !hdr10plus_json_is_number_array(distIndex, 0, 15)
+        || !hdr10plus_json_is_number_array(distValues, distIndex->values.size(), distIndex->values.size())) {
+        *errMes = _T("invalid LuminanceParameters");
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    const auto bezier = scene.find("BezierCurveData");
+    const auto kneePointX = (bezier) ? bezier->find("KneePointX") : nullptr;
+    const auto kneePointY = (bezier) ? bezier->find("KneePointY") : nullptr;
+    const auto anchors = (bezier) ? bezier->find("Anchors") : nullptr;
+    if (bezier && (!kneePointX || !kneePointY || !hdr10plus_json_is_number_array(anchors, 0, 15))) {
+        *errMes = _T("invalid BezierCurveData");
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    const auto targetedMaxLuminance = scene.find("TargetedSystemDisplayMaximumLuminance");
+
+    HDR10PlusBitWriter writer;
+    writer.put(0xB5, 8);   //itu_t_t35_country_code
+    writer.put(0x003C, 16); //itu_t_t35_terminal_provider_code
+    writer.put(0x0001, 16); //itu_t_t35_terminal_provider_oriented_code
+    writer.put(4, 8);      //application_identifier
+    writer.put(1, 8);      //application_version
+    writer.put(1, 2);      //num_windows
+    writer.put((targetedMaxLuminance) ? hdr10plus_json_uint(targetedMaxLuminance, 27) : 0, 27);
+    writer.put(0, 1);      //targeted_system_display_actual_peak_luminance_flag
+    for (const auto& scl : maxScl->values) {
+        writer.put(hdr10plus_json_uint(&scl, 17), 17);
+    }
+    writer.put(hdr10plus_json_uint(averageRGB, 17), 17);
+    writer.put((uint32_t)distIndex->values.size(), 4);
+    for (size_t i = 0; i < distIndex->values.size(); i++) {
+        writer.put(hdr10plus_json_uint(&distIndex->values[i], 7), 7);
+        writer.put(hdr10plus_json_uint(&distValues->values[i], 17), 17);
+    }
+    writer.put(0, 10);     //fraction_bright_pixels
+    writer.put(0, 1);      //mastering_display_actual_peak_luminance_flag
+    writer.put((bezier) ? 1 : 0, 1); //tone_mapping_flag
+    if (bezier) {
+        writer.put(hdr10plus_json_uint(kneePointX, 12), 12);
+        writer.put(hdr10plus_json_uint(kneePointY, 12), 12);
+        writer.put((uint32_t)anchors->values.size(), 4);
+        for (const auto& anchor : anchors->values) {
+            writer.put(hdr10plus_json_uint(&anchor, 10), 10);
+        }
+    }
+    writer.put(0, 1);      //color_saturation_mapping_flag
+    payload = writer.data();
+    return RGY_ERR_NONE;
+}
 
 RGYHDR10Plus::RGYHDR10Plus() :
-    m_proc(), m_pipes(),
-    m_fpStdOut(std::unique_ptr<FILE, decltype(&fclose)>(nullptr, fclose)),
-    m_buffer(std::make_pair(-1, vector<uint8_t>())){
+    m_inputJson(),
+    m_payloads(),
+    m_frameIndex(),
+    m_frameCount(0) {
 }
 
 RGYHDR10Plus::~RGYHDR10Plus() {
-    m_fpStdOut.reset();
-    m_proc.reset();
 }
 
-RGY_ERR RGYHDR10Plus::init(const tstring &inputJson) {
-    if (!(PathFileExists(inputJson.c_str()))) {
-        return RGY_ERR_NOT_FOUND;
-    }
+RGY_ERR RGYHDR10Plus::init(const tstring &inputJson, std::shared_ptr<RGYLog> log) {
     m_inputJson = inputJson;
-    const tstring HDR10PlusGenExePath = (PathFileExists(HDR10PLUS_GEN_EXE_NAME)) ? HDR10PLUS_GEN_EXE_NAME : getExeDir() + _T("\\") + HDR10PLUS_GEN_EXE_NAME;
-    if (!(PathFileExists(HDR10PlusGenExePath.c_str()))) {
-        return RGY_ERR_NOT_FOUND;
-    }
-    const tstring HDR10PlusGenExePathWithQuotes = tstring(_T("\"")) + HDR10PlusGenExePath + _T("\"");
-    const tstring inputJsonWithQuotes = tstring(_T("\"")) + inputJson + _T("\"");
-    std::vector<const TCHAR *> args;
-    args.push_back(HDR10PlusGenExePathWithQuotes.c_str());
-    args.push_back(_T("-i"));
-    args.push_back(inputJsonWithQuotes.c_str());
-    args.push_back(_T("-o"));
-    args.push_back(_T("-"));
-
-    m_pipes.stdOut.mode = PIPE_MODE_ENABLE;
-    m_pipes.stdOut.bufferSize = 1024;
-
-    m_proc = std::make_unique<RGYPipeProcessWin>();
-    m_proc->init();
-    if (m_proc->run(args, nullptr, &m_pipes, 0, true, true)) {
-        return RGY_ERR_RUN_PROCESS;
-    }
-    m_fpStdOut = std::unique_ptr<FILE, decltype(&fclose)>(_fdopen(_open_osfhandle((intptr_t)m_pipes.stdOut.h_read, _O_BINARY), "rb"), fclose);
-    if (!m_fpStdOut) {
-        return RGY_ERR_INVALID_HANDLE;
+    m_payloads.clear();
+    m_frameIndex.clear();
+    m_frameCount = 0;
+
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, inputJson.c_str(), _T("rb")) || fp == nullptr) {
+        log->write(RGY_LOG_ERROR, _T("hdr10plus: failed to open \"%s\".\n"), inputJson.c_str());
+        return RGY_ERR_FILE_OPEN;
+    }
+    std::unique_ptr<FILE, fp_deleter> fpJson(fp);
+    HDR10PlusJsonReader reader(fpJson.get());
+    auto parseError = [&]() {
+        log->write(RGY_LOG_ERROR, _T("hdr10plus: failed to parse json at line %d.\n"), reader.line());
+        return RGY_ERR_INVALID_FORMAT;
+    };
+
+    //同じ内容のペイロードは1つにまとめる (シーン内のフレームは同じメタデータを持つことが多い)
+    std::map<std::vector<uint8_t>, int> payloadIndex;
+    int sceneCount = 0;
+    if (!reader.expect('{')) {
+        return parseError();
+    }
+    if (!reader.expect('}')) {
+        for (;;) {
+            std::string key;
+            if (!reader.parseString(&key) || !reader.expect(':')) {
+                return parseError();
+            }
+            if (key == "SceneInfo") {
+                if (!reader.expect('[')) {
+                    return parseError();
+                }
+                if (!reader.expect(']')) {
+                    for (;;) {
+                        const int line = reader.line();
+                        HDR10PlusJsonValue scene;
+                        if (!reader.parseValue(&scene, 1) || scene.type != HDR10PlusJsonValue::JSON_OBJECT) {
+                            return parseError();
+                        }
+                        std::vector<uint8_t> payload;
+                        const TCHAR *errMes = _T("");
+                        auto err = hdr10plus_gen_payload(payload, scene, &errMes);
+                        if (err != RGY_ERR_NONE) {
+                            log->write(RGY_LOG_ERROR, _T("hdr10plus: %s at line %d.\n"), errMes, line);
+                            return err;
+                        }
+                        //SequenceFrameIndexがなければ、SceneInfoの順番をフレーム番号とする
+                        const auto frameIndex = scene.find("SequenceFrameIndex");
+                        const double frameNumber = (frameIndex && frameIndex->type == HDR10PlusJsonValue::JSON_NUMBER) ? frameIndex->number : (double)sceneCount;
+                        //intへの変換前に範囲を確認する (NaNもここで弾かれる)
+                        if (!(0.0 <= frameNumber && frameNumber <= (double)HDR10PLUS_MAX_FRAME_INDEX) || frameNumber != std::floor(frameNumber)) {
+                            log->write(RGY_LOG_ERROR, _T("hdr10plus: invalid SequenceFrameIndex %g at line %d (must be an integer in 0 - %d).\n"), frameNumber, line, HDR10PLUS_MAX_FRAME_INDEX);
+                            return RGY_ERR_INVALID_FORMAT;
+                        }
+                        const int iframe = (int)frameNumber;
+                        sceneCount++;
+                        if (iframe < (int)m_frameIndex.size() && m_frameIndex[iframe] >= 0) {
+                            //重複したフレームは最初のものを使う
+                            log->write(RGY_LOG_WARN, _T("hdr10plus: duplicate SequenceFrameIndex %d at line %d, ignored.\n"), iframe, line);
+                        } else {
+                            auto it = payloadIndex.find(payload);
+                            if (it == payloadIndex.end()) {
+                                it = payloadIndex.insert(std::make_pair(payload, (int)m_payloads.size())).first;
+                                m_payloads.push_back(std::move(payload));
+                            }
+                            if ((int)m_frameIndex.size() <= iframe) {
+                                m_frameIndex.resize(iframe + 1, -1);
+                            }
+                            m_frameIndex[iframe] = it->second;
+                            m_frameCount++;
+                        }
+                        if (!reader.expect(',')) {
+                            if (!reader.expect(']')) {
+                                return parseError();
+                            }
+                            break;
+                        }
+                    }
+                }
+            } else if (!reader.parseValue(nullptr, 1)) {
+                return parseError();
+            }
+            if (!reader.expect(',')) {
+                if (!reader.expect('}')) {
+                    return parseError();
+                }
+                break;
+            }
+        }
     }
+    if (m_frameCount == 0) {
+        log->write(RGY_LOG_ERROR, _T("hdr10plus: no SceneInfo found in \"%s\".\n"), inputJson.c_str());
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    log->write(RGY_LOG_DEBUG, _T("hdr10plus: loaded %d frames (%d unique payloads) from \"%s\".\n"),
+        m_frameCount, (int)m_payloads.size(), inputJson.c_str());
     return RGY_ERR_NONE;
 }
 
-const vector<uint8_t> *RGYHDR10Plus::getData(int iframe) {
-    if (!m_fpStdOut) {
+const vector<uint8_t> *RGYHDR10Plus::getData(int iframe) const {
+    if (iframe < 0 || (int)m_frameIndex.size() <= iframe || m_frameIndex[iframe] < 0) {
         return nullptr;
     }
-    while (m_buffer.first != iframe) {
-        m_buffer.second.clear();
-        int header[2];
-        if (fread(header, sizeof(header[0]), _countof(header), m_fpStdOut.get()) != _countof(header)) {
-            return nullptr;
-        }
-        const int frameNum = header[0];
-        const int dataSize = header[1];
-        m_buffer.second.resize(dataSize, 0);
-        if (fread(m_buffer.second.data(), 1, m_buffer.second.size(), m_fpStdOut.get()) != m_buffer.second.size()) {
-            return nullptr;
-        }
-        m_buffer.first = frameNum;
-    }
-    return &m_buffer.second;
+    return &m_payloads[m_frameIndex[iframe]];
 }
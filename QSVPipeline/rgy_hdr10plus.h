@@ -31,25 +31,30 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include "rgy_err.h"
-#include "rgy_pipe.h"
 #include "rgy_util.h"
+#include "rgy_log.h"
 
+//HDR10+のメタデータのjson (SceneInfoに1フレーム1要素) を読み込み、
+//フレームごとのST 2094-40のSEI (user_data_registered_itu_t_t35) のペイロードを作成しておく
+//作成したペイロードは同じ内容のものをまとめて保持し、フレーム番号から直接参照する
 class RGYHDR10Plus {
 public:
-    static const TCHAR *HDR10PLUS_GEN_EXE_NAME;
     RGYHDR10Plus();
     virtual ~RGYHDR10Plus();
 
-    RGY_ERR init(const tstring& inputJson);
-    const vector<uint8_t> *getData(int iframe);
+    RGY_ERR init(const tstring& inputJson, std::shared_ptr<RGYLog> log);
+    //指定フレームのペイロードを返す (データのないフレームではnullptr)
+    const vector<uint8_t> *getData(int iframe) const;
     const tstring &inputJson() const { return m_inputJson; };
+    //データのあるフレーム数
+    int frameCount() const { return m_frameCount; }
 protected:
     tstring m_inputJson;
-    std::unique_ptr<RGYPipeProcess> m_proc;
-    ProcessPipe m_pipes;
-    std::unique_ptr<FILE, decltype(&fclose)> m_fpStdOut;
-    std::pair<int, std::vector<uint8_t>> m_buffer;
+    std::vector<std::vector<uint8_t>> m_payloads; //重複を除いたペイロード
+    std::vector<int> m_frameIndex;                //フレームごとのm_payloadsのインデックス (-1でデータなし)
+    int m_frameCount;
 };
 
 #endif //__RGY_HDR10PLUS_H__
@@ -29,24 +29,12 @@
 #include <iostream>
 #include <fstream>
 #include <set>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#endif
 #include "rgy_input.h"
 #include "cpu_info.h"
-
-RGYConvertCSPPrm::RGYConvertCSPPrm() :
-    abort(false),
-    dst(nullptr),
-    src(nullptr),
-    interlaced(false),
-    width(0),
-    src_y_pitch_byte(0),
-    src_uv_pitch_byte(0),
-    dst_y_pitch_byte(0),
-    height(0),
-    dst_height(0),
-    crop(nullptr) {
-
-}
-
+#include "rgy_thread_pool.h"
 
 RGYConvertCSP::RGYConvertCSP() : RGYConvertCSP(0) {
 }
@@ -57,22 +45,10 @@ RGYConvertCSP::RGYConvertCSP(int threads) :
     m_csp_to(RGY_CSP_NA),
     m_uv_only(false),
     m_threads(threads),
-    m_th(), m_heStart(), m_heFin(), m_heFinCopy(),
-    m_prm() {
+    m_bandBytes(0) {
 };
 
 RGYConvertCSP::~RGYConvertCSP() {
-    m_prm.abort = true;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
-    }
-    for (size_t i = 0; i < m_th.size(); i++) {
-        m_th[i].join();
-    }
-    m_heFinCopy.clear();
-    m_heStart.clear();
-    m_heFin.clear();
-    m_th.clear();
 };
 const ConvertCSP *RGYConvertCSP::getFunc(RGY_CSP csp_from, RGY_CSP csp_to, bool uv_only, uint32_t simd) {
     if (m_csp == nullptr
@@ -85,53 +61,95 @@ const ConvertCSP *RGYConvertCSP::getFunc(RGY_CSP csp_from, RGY_CSP csp_to, bool
     return m_csp;
 }
 
-int RGYConvertCSP::run(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int *crop) {
+//1コアあたりのL2キャッシュサイズ
+static int get_l2_cache_size_per_core() {
+    const auto cpu = get_cpu_info();
+    if (cpu.caches[1].count > 0 && cpu.caches[1].size > 0) {
+        return (int)(cpu.caches[1].size / cpu.caches[1].count);
+    }
+#if !(defined(_WIN32) || defined(_WIN64)) && defined(_SC_LEVEL2_CACHE_SIZE)
+    const long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (size > 0) {
+        return (int)size;
+    }
+#endif
+    return 256 * 1024;
+}
+
+//1行(輝度1行分)あたりの全プレーンのバイト数の概算
+static int csp_row_bytes(RGY_CSP csp, int y_pitch_byte, int uv_pitch_byte) {
+    const int planes = RGY_CSP_PLANES[csp];
+    if (planes <= 1) {
+        return y_pitch_byte;
+    }
+    //輝度1行に対応する色差の行数 x2
+    const int chroma_rows_x2 = (RGY_CSP_CHROMA_FORMAT[csp] == RGY_CHROMAFMT_YUV420) ? 1 : 2;
+    const int uv_planes = (planes == 2) ? 1 : planes - 1;
+    return y_pitch_byte + uv_planes * ((uv_pitch_byte > 0) ? uv_pitch_byte : y_pitch_byte) * chroma_rows_x2 / 2;
+}
+
+//バンドの先頭行を修復する際の変換幅
+//SIMD版の変換関数の1ループあたりの処理幅(最大128画素)より十分大きくとる
+static const int CSP_BAND_REPAIR_WIDTH = 256;
+
+int RGYConvertCSP::getBandNum(int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, const int *crop) {
     if (m_threads == 0) {
         const int div = (m_csp->simd == 0) ? 2 : 4;
         const int max = (m_csp->simd == 0) ? 8 : 4;
-        m_threads = (dst_y_pitch_byte % 128 != 0) ? 1 : std::min(max, ((int)get_cpu_info().physical_cores + div) / div);
+        m_threads = std::min(max, ((int)get_cpu_info().physical_cores + div) / div);
     }
-    if (m_threads > 1 && m_th.size() == 0) {
-        m_heFinCopy.clear();
-        m_heStart.clear();
-        m_heFin.clear();
-        for (int ith = 1; ith < m_threads; ith++) {
-            auto heStart = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            auto heFin = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            m_th.push_back(std::thread([heStart = heStart.get(), heFin = heFin.get(), ithId = ith, threadN = m_threads, prm = &m_prm, cspfunc = &m_csp]() {
-                WaitForSingleObject((HANDLE)heStart, INFINITE);
-                while (!prm->abort) {
-                    (*cspfunc)->func[prm->interlaced](prm->dst, prm->src,
-                        prm->width, prm->src_y_pitch_byte, prm->src_uv_pitch_byte, prm->dst_y_pitch_byte,
-                        prm->height, prm->dst_height, ithId, threadN, prm->crop);
-                    SetEvent((HANDLE)heFin);
-                    WaitForSingleObject((HANDLE)heStart, INFINITE);
-                }
-            }));
-            m_heFinCopy.push_back(heFin.get());
-            m_heStart.push_back(std::move(heStart));
-            m_heFin.push_back(std::move(heFin));
-        }
+    const int targetWidth = width - crop[0] - crop[2];
+    const int targetHeight = height - crop[1] - crop[3];
+    if (m_threads <= 1 || targetWidth < CSP_BAND_REPAIR_WIDTH * 2 || targetHeight < 16) {
+        return 1;
     }
-    m_prm.abort = false;
-    m_prm.interlaced = interlaced;
-    m_prm.dst = dst;
-    m_prm.src = src;
-    m_prm.width = width;
-    m_prm.src_y_pitch_byte = src_y_pitch_byte;
-    m_prm.src_uv_pitch_byte = src_uv_pitch_byte;
-    m_prm.dst_y_pitch_byte = dst_y_pitch_byte;
-    m_prm.height = height;
-    m_prm.dst_height = dst_height;
-    m_prm.crop = crop;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
+    if (m_bandBytes == 0) {
+        //ほかのデータのために半分は残しておく
+        m_bandBytes = get_l2_cache_size_per_core() / 2;
     }
-    m_csp->func[interlaced](dst, src,
-        width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
-        height, dst_height, 0, (int)m_th.size()+1, crop);
-    if (m_th.size() > 0) {
-        WaitForMultipleObjects((uint32_t)m_heFinCopy.size(), m_heFinCopy.data(), TRUE, INFINITE);
+    //L2に収まる程度の行数のバンドに分割する
+    //バンドの境界は4行単位 (thread_y_range)
+    const int rowBytes = csp_row_bytes(m_csp->csp_from, src_y_pitch_byte, src_uv_pitch_byte)
+                       + csp_row_bytes(m_csp->csp_to, dst_y_pitch_byte, dst_y_pitch_byte);
+    const int bandRows = std::max(8, (m_bandBytes / std::max(rowBytes, 1)) & ~3);
+    return std::max(std::min((targetHeight + bandRows - 1) / bandRows, targetHeight / 4), m_threads);
+}
+
+void RGYConvertCSP::repairBands(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int bandN, int *crop) {
+    //SIMD版の変換関数は行末の端数を考慮せず、1ループ分行末を超えて書き込むことがある
+    //pitchに余裕がない場合、バンドの最終行からの書き込みが次のバンドの先頭行の行頭を壊すので、
+    //全バンドの終了後、各バンドの先頭の数行の行頭を幅を絞って変換しなおす
+    //このときの行末を超えた書き込みは同じ行の(正しい)変換結果になる
+    //C版の変換関数は行末を超えて書き込まないので不要
+    //(左右の画素を参照するものがあり、幅を絞ると右端の結果が変わってしまうので行わない)
+    if (m_csp->simd == NONE) {
+        return;
+    }
+    //thread_y_rangeでは、(iband, bandN)と(iband*sub, bandN*sub)の範囲の開始行は(各プレーンとも)一致するので、
+    //色差(4:2:0)でも4行以上となるようにsubを決めれば、各バンドの先頭部分のみを処理できる
+    int cropRepair[4] = { crop[0], crop[1], 0, crop[3] };
+    const int sub = std::max(1, (height - crop[1] - crop[3]) / (bandN * 8));
+    for (int iband = 1; iband < bandN; iband++) {
+        m_csp->func[interlaced](dst, src,
+            crop[0] + CSP_BAND_REPAIR_WIDTH, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
+            height, dst_height, iband * sub, bandN * sub, cropRepair);
+    }
+}
+
+int RGYConvertCSP::run(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int *crop) {
+    const int bandN = getBandNum(width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, crop);
+    if (bandN > 1) {
+        //空いたスレッドから順にバンドを処理する
+        RGYThreadPool::get().parallel_for(bandN, [=](int iband) {
+            m_csp->func[interlaced](dst, src,
+                width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
+                height, dst_height, iband, bandN, crop);
+        }, RGY_THREAD_POOL_STAGE_CSP, m_threads);
+        repairBands(interlaced, dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, bandN, crop);
+    } else {
+        m_csp->func[interlaced](dst, src,
+            width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
+            height, dst_height, 0, 1, crop);
     }
     return 0;
 }
@@ -376,6 +394,8 @@ RGY_ERR initReaders(
 #if ENABLE_AVISYNTH_READER
     case RGY_INPUT_FMT_AVS:
         inputPrmAvs.readAudio = common->nAudioSelectCount > 0;
+        inputPrmAvs.prefetch = ctrl->avsPrefetch;
+        inputPrmAvs.prefetchThreads = ctrl->avsPrefetchThreads;
         pInputPrm = &inputPrmAvs;
         log->write(RGY_LOG_DEBUG, _T("avs reader selected.\n"));
         pFileReader.reset(new RGYInputAvs());
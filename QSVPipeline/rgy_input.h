@@ -84,22 +84,6 @@ static int trackID(int trackID) {
 }
 #endif //#if ENABLE_AVSW_READER
 
-struct RGYConvertCSPPrm {
-    bool abort;
-    void **dst;
-    const void **src;
-    int interlaced;
-    int width;
-    int src_y_pitch_byte;
-    int src_uv_pitch_byte;
-    int dst_y_pitch_byte;
-    int height;
-    int dst_height;
-    int *crop;
-
-    RGYConvertCSPPrm();
-};
-
 class RGYConvertCSP {
 private:
     const ConvertCSP *m_csp;
@@ -107,11 +91,7 @@ private:
     RGY_CSP m_csp_to;
     bool m_uv_only;
     int m_threads;
-    std::vector<std::thread> m_th;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heStart;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heFin;
-    std::vector<HANDLE> m_heFinCopy;
-    RGYConvertCSPPrm m_prm;
+    int m_bandBytes; //1バンドあたりの目標データ量 (L2キャッシュに収まるように)
 public:
     RGYConvertCSP();
     RGYConvertCSP(int threads);
@@ -119,6 +99,10 @@ public:
     const ConvertCSP *getFunc(RGY_CSP csp_from, RGY_CSP csp_to, bool uv_only, uint32_t simd);
     const ConvertCSP *getFunc() const { return m_csp; };
 
+    //バンドの分割数 (分割しない場合は1)
+    int getBandNum(int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, const int *crop);
+    //全バンドの処理後、隣のバンドからの行末を超えた書き込みで壊れたバンドの先頭を修復する
+    void repairBands(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int bandN, int *crop);
     int run(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int *crop);
 };
 
@@ -119,6 +119,13 @@ RGYInputAvcodec::~RGYInputAvcodec() {
 
 void RGYInputAvcodec::CloseThread() {
     m_Demux.thread.bAbortInput = true;
+    if (m_Demux.thread.thDecode.joinable()) {
+        //キューが満杯で待機している可能性があるので、capacityを無限大にして待機を解除する
+        m_Demux.qVideoFrame.set_capacity(SIZE_MAX);
+        m_Demux.thread.thDecode.join();
+        AddMessage(RGY_LOG_DEBUG, _T("Closed Decode thread, waited for decoded frames %d times, %.3f ms.\n"),
+            m_Demux.thread.decodeStallCount, m_Demux.thread.decodeStallUs / 1000.0);
+    }
     if (m_Demux.thread.thInput.joinable()) {
         m_Demux.qVideoPkt.set_capacity(SIZE_MAX);
         m_Demux.qVideoPkt.set_keep_length(0);
@@ -166,9 +173,6 @@ void RGYInputAvcodec::CloseVideo(AVDemuxVideo *video) {
     if (video->bsfcCtx) {
         av_bsf_free(&video->bsfcCtx);
     }
-    if (video->frame) {
-        av_frame_free(&video->frame);
-    }
 
     if (video->extradata) {
         av_free(video->extradata);
@@ -196,6 +200,8 @@ void RGYInputAvcodec::Close() {
     //リソースの解放
     CloseThread();
     m_Demux.qVideoPkt.close([](AVPacket *pkt) { av_packet_unref(pkt); });
+    m_Demux.qVideoFrame.close([](AVFrame **frame) { av_frame_free(frame); });
+    m_Demux.qVideoFrameFree.close([](AVFrame **frame) { av_frame_free(frame); });
     for (uint32_t i = 0; i < m_Demux.qStreamPktL1.size(); i++) {
         av_packet_unref(&m_Demux.qStreamPktL1[i]);
     }
@@ -213,6 +219,7 @@ void RGYInputAvcodec::Close() {
         AddMessage(RGY_LOG_DEBUG, _T("Cleared Stream #%d.\n"), i);
     }
     m_Demux.stream.clear();
+    m_Demux.streamInfo.clear();
     m_Demux.chapter.clear();
 
     m_trimParam.list.clear();
@@ -1417,10 +1424,6 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *inputInfo, co
                 m_inputVideoInfo.shift = (RGY_CSP_BIT_DEPTH[m_inputCsp] > 8) ? 16 - RGY_CSP_BIT_DEPTH[m_inputCsp] : 0;
             }
             m_inputVideoInfo.shift = (m_inputVideoInfo.csp == RGY_CSP_P010 || m_inputVideoInfo.csp == RGY_CSP_P210) ? m_inputVideoInfo.shift : 0;
-            if (nullptr == (m_Demux.video.frame = av_frame_alloc())) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to allocate frame for decoder.\n"));
-                return RGY_ERR_NULL_PTR;
-            }
         } else {
             //HWデコードの場合は、色変換がかからないので、入力フォーマットがそのまま出力フォーマットとなる
             m_inputVideoInfo.csp = pixfmtData->output_csp;
@@ -1474,12 +1477,26 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *inputInfo, co
         //NVEncではいまのところ、常に無効
         m_Demux.thread.threadInput = 0;
 #endif
+        //m_Demux.streamのlastVidIndex等は読み込み/デコードスレッドから更新されるため、
+        //スレッドの開始前にコピーしておき、GetInputStreamInfoではそちらを返す
+        m_Demux.streamInfo = m_Demux.stream;
         if (m_Demux.thread.threadInput) {
             m_Demux.thread.thInput = std::thread(&RGYInputAvcodec::ThreadFuncRead, this);
             //はじめcapacityを無限大にセットしたので、この段階で制限をかける
             //入力をスレッド化しない場合には、自動的に同期が保たれるので、ここでの制限は必要ない
             m_Demux.qVideoPkt.set_capacity(256);
         }
+        if (m_Demux.video.codecCtxDecode) {
+            //swデコードは専用のスレッドで先行して行い、デコード済みのフレームをキューにためておく
+            //色変換はLoadNextFrameでスレッドプールを使って行う
+            m_Demux.qVideoFrame.init(AVCODEC_DECODE_QUEUE_SIZE, AVCODEC_DECODE_QUEUE_SIZE);
+            m_Demux.qVideoFrameFree.init(AVCODEC_DECODE_QUEUE_SIZE * 2);
+            m_Demux.thread.stsDecode = RGY_ERR_NONE;
+            m_Demux.thread.decodeStallCount = 0;
+            m_Demux.thread.decodeStallUs = 0;
+            m_Demux.thread.thDecode = std::thread(&RGYInputAvcodec::ThreadFuncDecode, this);
+            AddMessage(RGY_LOG_DEBUG, _T("Started Decode thread, queue size %d.\n"), AVCODEC_DECODE_QUEUE_SIZE);
+        }
     } else {
         //音声との同期とかに使うので、動画の情報を格納する
         m_Demux.video.nAvgFramerate = av_make_q(input_prm->videoAvgFramerate.first, input_prm->videoAvgFramerate.second);
@@ -1500,6 +1517,7 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *inputInfo, co
 
             m_Demux.frames.checkPtsStatus();
         }
+        m_Demux.streamInfo = m_Demux.stream;
 
         tstring mes;
         for (const auto& stream : m_Demux.stream) {
@@ -2031,7 +2049,7 @@ vector<AVPacket> RGYInputAvcodec::GetStreamDataPackets(int inputFrame) {
 }
 
 vector<AVDemuxStream> RGYInputAvcodec::GetInputStreamInfo() {
-    return vector<AVDemuxStream>(m_Demux.stream.begin(), m_Demux.stream.end());
+    return m_Demux.streamInfo;
 }
 
 RGY_ERR RGYInputAvcodec::GetHeader(RGYBitstream *pBitstream) {
@@ -2114,70 +2132,123 @@ RGY_ERR RGYInputAvcodec::GetHeader(RGYBitstream *pBitstream) {
     return RGY_ERR_NONE;
 }
 
+RGY_ERR RGYInputAvcodec::decodeNextFrame(AVFrame *frame) {
+    for (;;) {
+        if (m_Demux.thread.bAbortInput) {
+            return RGY_ERR_ABORTED;
+        }
+        AVPacket pkt;
+        av_init_packet(&pkt);
+        if (!m_Demux.thread.thInput.joinable() //入力スレッドがなければ、自分で読み込む
+            && m_Demux.qVideoPkt.get_keep_length() > 0) { //keep_length == 0なら読み込みは終了していて、これ以上読み込む必要はない
+            if (0 == getSample(&pkt)) {
+                m_Demux.qVideoPkt.push(pkt);
+            }
+        }
+
+        bool bGetPacket = false;
+        for (int i = 0; false == (bGetPacket = m_Demux.qVideoPkt.front_copy_no_lock(&pkt, (m_Demux.thread.queueInfo) ? &m_Demux.thread.queueInfo->usage_vid_in : nullptr)) && m_Demux.qVideoPkt.size() > 0 && !m_Demux.thread.bAbortInput; i++) {
+            m_Demux.qVideoPkt.wait_for_push();
+        }
+        if (!bGetPacket) {
+            //flushするためのパケット
+            pkt.data = nullptr;
+            pkt.size = 0;
+        }
+        int ret = avcodec_send_packet(m_Demux.video.codecCtxDecode, &pkt);
+        //AVERROR(EAGAIN) -> パケットを送る前に受け取る必要がある
+        //パケットが受け取られていないのでpopしない
+        if (ret != AVERROR(EAGAIN)) {
+            m_Demux.qVideoPkt.pop();
+            av_packet_unref(&pkt);
+        }
+        if (ret == AVERROR_EOF) { //これ以上パケットを送れない
+            AddMessage(RGY_LOG_DEBUG, _T("failed to send packet to video decoder, already flushed: %s.\n"), qsv_av_err2str(ret).c_str());
+        } else if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            AddMessage(RGY_LOG_ERROR, _T("failed to send packet to video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
+            return RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+        ret = avcodec_receive_frame(m_Demux.video.codecCtxDecode, frame);
+        if (ret == AVERROR(EAGAIN)) { //もっとパケットを送る必要がある
+            continue;
+        }
+        if (ret == AVERROR_EOF) {
+            //最後まで読み込んだ
+            return RGY_ERR_MORE_DATA;
+        }
+        if (ret < 0) {
+            AddMessage(RGY_LOG_ERROR, _T("failed to receive frame from video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
+            return RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+        return RGY_ERR_NONE;
+    }
+}
+
+RGY_ERR RGYInputAvcodec::ThreadFuncDecode() {
+    RGY_ERR sts = RGY_ERR_NONE;
+    while (sts == RGY_ERR_NONE) {
+        //使用済みのフレームがあれば再利用する
+        AVFrame *frame = nullptr;
+        if (!m_Demux.qVideoFrameFree.front_copy_and_pop_no_lock(&frame)
+            && nullptr == (frame = av_frame_alloc())) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate frame for decoder.\n"));
+            sts = RGY_ERR_NULL_PTR;
+            break;
+        }
+        if ((sts = decodeNextFrame(frame)) != RGY_ERR_NONE) {
+            av_frame_free(&frame);
+            break;
+        }
+        //キューが満杯の場合は、LoadNextFrameが取り出すまで待機する
+        m_Demux.qVideoFrame.push(frame);
+    }
+    //すべてのフレームをキューに入れてから終了ステータスをセットする
+    m_Demux.thread.stsDecode = sts;
+    AddMessage((sts == RGY_ERR_MORE_DATA || sts == RGY_ERR_ABORTED) ? RGY_LOG_DEBUG : RGY_LOG_ERROR,
+        _T("Decode thread finished: %s.\n"), get_err_mes(sts));
+    return sts;
+}
+
 #pragma warning(push)
 #pragma warning(disable:4100)
 RGY_ERR RGYInputAvcodec::LoadNextFrame(RGYFrame *pSurface) {
     if (m_Demux.video.codecCtxDecode) {
-        //動画のデコードを行う
-        int got_frame = 0;
-        while (!got_frame) {
-            AVPacket pkt;
-            av_init_packet(&pkt);
-            if (!m_Demux.thread.thInput.joinable() //入力スレッドがなければ、自分で読み込む
-                && m_Demux.qVideoPkt.get_keep_length() > 0) { //keep_length == 0なら読み込みは終了していて、これ以上読み込む必要はない
-                if (0 == getSample(&pkt)) {
-                    m_Demux.qVideoPkt.push(pkt);
+        //デコードスレッドからデコード済みのフレームを受け取る
+        //キューが空の場合のみ待機する
+        AVFrame *frame = nullptr;
+        size_t queueSize = 0;
+        if (!m_Demux.qVideoFrame.front_copy_and_pop_no_lock(&frame, &queueSize)) {
+            const auto tmStart = std::chrono::high_resolution_clock::now();
+            while (!m_Demux.qVideoFrame.front_copy_and_pop_no_lock(&frame, &queueSize)) {
+                const RGY_ERR stsDecode = m_Demux.thread.stsDecode;
+                if (stsDecode != RGY_ERR_NONE && m_Demux.qVideoFrame.empty()) {
+                    //デコードスレッドが終了していて、これ以上フレームはない
+                    return (stsDecode == RGY_ERR_ABORTED) ? RGY_ERR_MORE_DATA : stsDecode;
                 }
+                m_Demux.qVideoFrame.wait_for_push();
             }
-
-            bool bGetPacket = false;
-            for (int i = 0; false == (bGetPacket = m_Demux.qVideoPkt.front_copy_no_lock(&pkt, (m_Demux.thread.queueInfo) ? &m_Demux.thread.queueInfo->usage_vid_in : nullptr)) && m_Demux.qVideoPkt.size() > 0; i++) {
-                m_Demux.qVideoPkt.wait_for_push();
-            }
-            if (!bGetPacket) {
-                //flushするためのパケット
-                pkt.data = nullptr;
-                pkt.size = 0;
-            }
-            int ret = avcodec_send_packet(m_Demux.video.codecCtxDecode, &pkt);
-            //AVERROR(EAGAIN) -> パケットを送る前に受け取る必要がある
-            //パケットが受け取られていないのでpopしない
-            if (ret != AVERROR(EAGAIN)) {
-                m_Demux.qVideoPkt.pop();
-                av_packet_unref(&pkt);
-            }
-            if (ret == AVERROR_EOF) { //これ以上パケットを送れない
-                AddMessage(RGY_LOG_DEBUG, _T("failed to send packet to video decoder, already flushed: %s.\n"), qsv_av_err2str(ret).c_str());
-            } else if (ret < 0 && ret != AVERROR(EAGAIN)) {
-                AddMessage(RGY_LOG_ERROR, _T("failed to send packet to video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
-                return RGY_ERR_UNDEFINED_BEHAVIOR;
-            }
-            ret = avcodec_receive_frame(m_Demux.video.codecCtxDecode, m_Demux.video.frame);
-            if (ret == AVERROR(EAGAIN)) { //もっとパケットを送る必要がある
-                continue;
-            }
-            if (ret == AVERROR_EOF) {
-                //最後まで読み込んだ
-                return RGY_ERR_MORE_DATA;
-            }
-            if (ret < 0) {
-                AddMessage(RGY_LOG_ERROR, _T("failed to receive frame from video decoder: %s.\n"), qsv_av_err2str(ret).c_str());
-                return RGY_ERR_UNDEFINED_BEHAVIOR;
+            const auto stallUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tmStart).count();
+            m_Demux.thread.decodeStallCount++;
+            m_Demux.thread.decodeStallUs += stallUs;
+            if (m_Demux.thread.queueInfo) {
+                m_Demux.thread.queueInfo->vid_dec_stall_us += stallUs;
             }
-            got_frame = TRUE;
         }
-        pSurface->setTimestamp(m_Demux.video.frame->pts);
-        pSurface->setDuration(m_Demux.video.frame->pkt_duration);
+        if (m_Demux.thread.queueInfo) {
+            m_Demux.thread.queueInfo->usage_vid_dec = queueSize;
+        }
+        pSurface->setTimestamp(frame->pts);
+        pSurface->setDuration(frame->pkt_duration);
         //フレームデータをコピー
         void *dst_array[3];
         pSurface->ptrArray(dst_array, m_convert->getFunc()->csp_to == RGY_CSP_RGB24 || m_convert->getFunc()->csp_to == RGY_CSP_RGB32);
-        m_convert->run(m_Demux.video.frame->interlaced_frame != 0,
-            dst_array, (const void **)m_Demux.video.frame->data,
-            m_inputVideoInfo.srcWidth, m_Demux.video.frame->linesize[0], m_Demux.video.frame->linesize[1], pSurface->pitch(),
+        m_convert->run(frame->interlaced_frame != 0,
+            dst_array, (const void **)frame->data,
+            m_inputVideoInfo.srcWidth, frame->linesize[0], frame->linesize[1], pSurface->pitch(),
             m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
-        if (got_frame) {
-            av_frame_unref(m_Demux.video.frame);
-        }
+        //使用済みのフレームはデコードスレッドに返す
+        av_frame_unref(frame);
+        m_Demux.qVideoFrameFree.push(frame);
         m_encSatusInfo->m_sData.frameIn++;
     } else {
         if (m_Demux.qVideoPkt.size() == 0) {
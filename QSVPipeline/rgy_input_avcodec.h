@@ -40,6 +40,7 @@
 #include <deque>
 #include <atomic>
 #include <thread>
+#include <chrono>
 #include <cassert>
 
 #if (defined(_WIN32) || defined(_WIN64))
@@ -57,6 +58,7 @@ using std::deque;
 
 static const uint32_t AVCODEC_READER_INPUT_BUF_SIZE = 16 * 1024 * 1024;
 static const uint32_t AV_FRAME_MAX_REORDER = 16;
+static const uint32_t AVCODEC_DECODE_QUEUE_SIZE = 8; //swデコード時に先行してデコードしておくフレーム数
 static const int FRAMEPOS_POC_INVALID = -1;
 
 enum RGYPtsStatus : uint32_t {
@@ -688,7 +690,6 @@ typedef struct AVDemuxVideo {
     const AVStream           *stream;                //動画のStream, 動画を読み込むかどうかの判定には使用しないこと (readVideoを使用)
     const AVCodec            *codecDecode;           //動画のデコーダ (使用しない場合はnullptr)
     AVCodecContext           *codecCtxDecode;        //動画のデコーダ (使用しない場合はnullptr)
-    AVFrame                  *frame;                 //動画デコード用のフレーム
     int                       index;                 //動画のストリームID
     int64_t                   streamFirstKeyPts;     //動画ファイルの最初のpts
     uint32_t                  streamPtsInvalid;      //動画ファイルのptsが無効 (H.264/ES, 等)
@@ -713,19 +714,26 @@ typedef struct AVDemuxThread {
     int                          threadInput;       //入力スレッドを使用する
     std::atomic<bool>            bAbortInput;        //読み込みスレッドに停止を通知する
     std::thread                  thInput;            //読み込みスレッド
+    std::thread                  thDecode;           //swデコードスレッド
+    std::atomic<RGY_ERR>         stsDecode;          //swデコードスレッドの終了ステータス (RGY_ERR_NONEなら実行中)
+    int                          decodeStallCount;   //デコード済みフレームがなく待機した回数
+    int64_t                      decodeStallUs;      //デコード済みフレームを待機した時間 (us)
     PerfQueueInfo               *queueInfo;         //キューの情報を格納する構造体
 } AVDemuxThread;
 
 typedef struct AVDemuxer {
-    AVDemuxFormat            format;
-    AVDemuxVideo             video;
-    FramePosList             frames;
-    vector<AVDemuxStream>    stream;
-    vector<const AVChapter*> chapter;
-    AVDemuxThread            thread;
-    RGYQueueSPSP<AVPacket>   qVideoPkt;
-    deque<AVPacket>          qStreamPktL1;
-    RGYQueueSPSP<AVPacket>   qStreamPktL2;
+    AVDemuxFormat              format;
+    AVDemuxVideo               video;
+    FramePosList               frames;
+    vector<AVDemuxStream>      stream;
+    vector<AVDemuxStream>      streamInfo;      //GetInputStreamInfo用に、読み込み/デコードスレッドの開始前に取得したstreamのコピー
+    vector<const AVChapter*>   chapter;
+    AVDemuxThread              thread;
+    RGYQueueSPSPRing<AVPacket> qVideoPkt;
+    RGYQueueSPSPRing<AVFrame*> qVideoFrame;     //swデコード済みのフレーム (デコードスレッド -> LoadNextFrame)
+    RGYQueueSPSPRing<AVFrame*> qVideoFrameFree; //使用済みのフレーム (LoadNextFrame -> デコードスレッド)
+    deque<AVPacket>            qStreamPktL1;
+    RGYQueueSPSPRing<AVPacket> qStreamPktL2;
 } AVDemuxer;
 
 enum AVCAPTION_STATE {
@@ -1044,6 +1052,12 @@ protected:
     //読み込みスレッド関数
     RGY_ERR ThreadFuncRead();
 
+    //動画のパケットをデコーダに送り、デコードしたフレームをframeに格納する
+    RGY_ERR decodeNextFrame(AVFrame *frame);
+
+    //swデコードスレッド関数
+    RGY_ERR ThreadFuncDecode();
+
     //指定したptsとtimebaseから、該当する動画フレームを取得する
     int getVideoFrameIdx(int64_t pts, AVRational timebase, int iStart);
 
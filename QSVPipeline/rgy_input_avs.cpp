@@ -55,7 +55,9 @@ const uint8_t* AVSC_CC rgy_avs_get_read_ptr_p(const AVS_VideoFrame * p, int plan
 
 RGYInputAvsPrm::RGYInputAvsPrm(RGYInputPrm base) :
     RGYInputPrm(base),
-    readAudio(false) {
+    readAudio(false),
+    prefetch(0),
+    prefetchThreads(1) {
 
 }
 
@@ -64,6 +66,20 @@ RGYInputAvs::RGYInputAvs() :
     m_sAVSclip(nullptr),
     m_sAVSinfo(nullptr),
     m_sAvisynth(),
+    m_prefetch(0),
+    m_prefetchThreadCount(1),
+    m_prefetchEnd(0),
+    m_prefetchNext(0),
+    m_prefetchRead(0),
+    m_prefetchBuf(),
+    m_prefetchThreads(),
+    m_prefetchMtx(),
+    m_prefetchCvRequest(),
+    m_prefetchCvReady(),
+    m_prefetchAbort(false),
+    m_avsMtx(),
+    m_prefetchReadyFrames(0),
+    m_prefetchWaitCount(0),
 #if ENABLE_AVSW_READER
     m_audio(),
     m_format(unique_ptr<AVFormatContext, decltype(&avformat_free_context)>(nullptr, &avformat_free_context)),
@@ -220,8 +236,12 @@ vector<AVPacket> RGYInputAvs::GetStreamDataPackets(int inputFrame) {
     pkt.stream_index = m_audio.begin()->index;
     pkt.flags = (pkt.flags & 0xffff) | ((uint32_t)m_audio.begin()->trackId << 16); //flagsの上位16bitには、trackIdへのポインタを格納しておく
 
-    m_sAvisynth.f_get_audio(m_sAVSclip, pkt.data, m_audioCurrentSample, samples);
-    const auto avs_err = m_sAvisynth.f_clip_get_error(m_sAVSclip);
+    const char *avs_err = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_avsMtx);
+        m_sAvisynth.f_get_audio(m_sAVSclip, pkt.data, m_audioCurrentSample, samples);
+        avs_err = m_sAvisynth.f_clip_get_error(m_sAVSclip);
+    }
     if (avs_err) {
         AddMessage(RGY_LOG_ERROR, _T("Unknown error when reading audio frame from avisynth: %d.\n"), avs_err);
         return pkts;
@@ -366,6 +386,11 @@ RGY_ERR RGYInputAvs::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     rgy_reduce(m_inputVideoInfo.fpsN, m_inputVideoInfo.fpsD);
 
     auto avsPrm = reinterpret_cast<const RGYInputAvsPrm *>(prm);
+    if (avsPrm != nullptr && avsPrm->prefetch > 0) {
+        m_prefetch = avsPrm->prefetch;
+        m_prefetchThreadCount = clamp(avsPrm->prefetchThreads, 1, m_prefetch);
+        AddMessage(RGY_LOG_DEBUG, _T("prefetch %d frames with %d thread(s).\n"), m_prefetch, m_prefetchThreadCount);
+    }
     if (avsPrm != nullptr && avsPrm->readAudio) {
         if (!avs_has_audio(m_sAVSinfo)) {
             AddMessage(RGY_LOG_WARN, _T("avs has no audio.\n"));
@@ -396,8 +421,115 @@ RGY_ERR RGYInputAvs::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
 }
 #pragma warning(pop)
 
+void RGYInputAvs::startPrefetch() {
+    //trimの結果不要なフレームは先読みしない (LoadNextFrameで読み込む範囲に合わせる)
+    m_prefetchEnd = (int)std::min<int64_t>(m_inputVideoInfo.frames, (int64_t)getVideoTrimMaxFramIdx() + TRIM_OVERREAD_FRAMES + 1);
+    m_prefetchNext = (int)m_encSatusInfo->m_sData.frameIn;
+    m_prefetchRead = m_prefetchNext;
+    m_prefetchAbort = false;
+    m_prefetchBuf.assign(m_prefetch, AvsPrefetchFrame{ nullptr, nullptr, false });
+    for (int i = 0; i < m_prefetchThreadCount; i++) {
+        m_prefetchThreads.push_back(std::thread(&RGYInputAvs::threadFuncPrefetch, this));
+    }
+}
+
+void RGYInputAvs::stopPrefetch() {
+    if (m_prefetchThreads.size() == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_prefetchMtx);
+        m_prefetchAbort = true;
+    }
+    m_prefetchCvRequest.notify_all();
+    for (auto& th : m_prefetchThreads) {
+        th.join();
+    }
+    m_prefetchThreads.clear();
+    for (auto& buf : m_prefetchBuf) {
+        if (buf.frame) {
+            m_sAvisynth.f_release_video_frame(buf.frame);
+        }
+    }
+    m_prefetchBuf.clear();
+    if (m_prefetchRead > 0) {
+        AddMessage(RGY_LOG_INFO, _T("avs prefetch: %d frames ahead with %d thread(s), %.1f frames ready on average, waited for %d of %d frames.\n"),
+            m_prefetch, m_prefetchThreadCount, m_prefetchReadyFrames / (double)m_prefetchRead, m_prefetchWaitCount, m_prefetchRead);
+    }
+}
+
+void RGYInputAvs::threadFuncPrefetch() {
+    std::unique_lock<std::mutex> lock(m_prefetchMtx);
+    for (;;) {
+        //読み込み待ちのフレームがm_prefetchを超えないよう、空きができるまで待つ
+        m_prefetchCvRequest.wait(lock, [this]() {
+            return m_prefetchAbort || (m_prefetchNext < m_prefetchEnd && m_prefetchNext < m_prefetchRead + m_prefetch);
+        });
+        if (m_prefetchAbort) {
+            break;
+        }
+        const int iframe = m_prefetchNext++;
+        lock.unlock();
+        //avisynthのフレームの取得は、ロックを外して行う
+        //複数スレッドの場合は、スクリプト側がマルチスレッドに対応している必要がある
+        AVS_VideoFrame *frame = nullptr;
+        const char *err = nullptr;
+        {
+            std::unique_lock<std::mutex> lockAvs(m_avsMtx, std::defer_lock);
+            if (m_prefetchThreadCount == 1) {
+                lockAvs.lock();
+            }
+            frame = m_sAvisynth.f_get_frame(m_sAVSclip, iframe);
+            err = m_sAvisynth.f_clip_get_error(m_sAVSclip);
+        }
+        lock.lock();
+        auto& buf = m_prefetchBuf[iframe % m_prefetch];
+        buf.frame = frame;
+        buf.err = err;
+        buf.ready = true;
+        m_prefetchCvReady.notify_all();
+    }
+}
+
+AVS_VideoFrame *RGYInputAvs::getFrame(int iframe, const char **err) {
+    if (m_prefetch <= 0) {
+        std::lock_guard<std::mutex> lock(m_avsMtx);
+        auto frame = m_sAvisynth.f_get_frame(m_sAVSclip, iframe);
+        *err = m_sAvisynth.f_clip_get_error(m_sAVSclip);
+        return frame;
+    }
+    if (m_prefetchThreads.size() == 0) {
+        startPrefetch();
+    }
+    std::unique_lock<std::mutex> lock(m_prefetchMtx);
+    if (iframe != m_prefetchRead || iframe >= m_prefetchEnd) {
+        //先読みは順に読み込む場合のみ
+        *err = nullptr;
+        return nullptr;
+    }
+    //取得済みの先読みフレームの数を数える
+    int ready = 0;
+    for (int i = 1; i < m_prefetch && iframe + i < m_prefetchNext; i++) {
+        ready += (m_prefetchBuf[(iframe + i) % m_prefetch].ready) ? 1 : 0;
+    }
+    m_prefetchReadyFrames += ready;
+    auto& buf = m_prefetchBuf[iframe % m_prefetch];
+    if (!buf.ready) {
+        m_prefetchWaitCount++;
+        m_prefetchCvReady.wait(lock, [&buf]() { return buf.ready; });
+    }
+    AVS_VideoFrame *frame = buf.frame;
+    *err = buf.err;
+    buf = AvsPrefetchFrame{ nullptr, nullptr, false };
+    m_prefetchRead++;
+    lock.unlock();
+    m_prefetchCvRequest.notify_one();
+    return frame;
+}
+
 void RGYInputAvs::Close() {
     AddMessage(RGY_LOG_DEBUG, _T("Closing...\n"));
+    stopPrefetch();
 #if ENABLE_AVSW_READER
     m_format.reset();
 #endif //#if ENABLE_AVSW_READER
@@ -423,12 +555,13 @@ RGY_ERR RGYInputAvs::LoadNextFrame(RGYFrame *pSurface) {
         return RGY_ERR_MORE_DATA;
     }
 
-    AVS_VideoFrame *frame = m_sAvisynth.f_get_frame(m_sAVSclip, m_encSatusInfo->m_sData.frameIn);
+    const char *avs_err = nullptr;
+    AVS_VideoFrame *frame = getFrame((int)m_encSatusInfo->m_sData.frameIn, &avs_err);
     if (frame == nullptr) {
         return RGY_ERR_MORE_DATA;
     }
-    auto avs_err = m_sAvisynth.f_clip_get_error(m_sAVSclip);
     if (avs_err) {
+        m_sAvisynth.f_release_video_frame(frame);
         AddMessage(RGY_LOG_ERROR, _T("Unknown error when reading video frame from avisynth: %d.\n"), avs_err);
         return RGY_ERR_UNKNOWN;
     }
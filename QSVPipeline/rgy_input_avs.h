@@ -41,6 +41,9 @@
 #include "avxsynth_c.h"
 #define IS_AVXSYNTH 1
 #endif
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "rgy_osdep.h"
 #include "rgy_input.h"
 #pragma warning(pop)
@@ -100,6 +103,8 @@ struct avs_dll_t {
 class RGYInputAvsPrm : public RGYInputPrm {
 public:
     bool readAudio;
+    int prefetch;        //先読みするフレーム数 (0で先読みしない)
+    int prefetchThreads; //先読みを行うスレッド数
     RGYInputAvsPrm(RGYInputPrm base);
 
     virtual ~RGYInputAvsPrm() {};
@@ -128,12 +133,40 @@ protected:
     RGY_ERR load_avisynth();
     void release_avisynth();
 
+    //先読みしたフレーム
+    struct AvsPrefetchFrame {
+        AVS_VideoFrame *frame;
+        const char *err; //avs_clip_get_errorの値
+        bool ready; //取得済み
+    };
+    void startPrefetch();
+    void stopPrefetch();
+    void threadFuncPrefetch();
+    //指定フレームを取得する (先読みしていれば、その完了を待つ)
+    AVS_VideoFrame *getFrame(int iframe, const char **err);
+
     AVS_ScriptEnvironment *m_sAVSenv;
     AVS_Clip *m_sAVSclip;
     const AVS_VideoInfo *m_sAVSinfo;
 
     avs_dll_t m_sAvisynth;
 
+    int m_prefetch;                           //先読みするフレーム数 (0で先読みしない)
+    int m_prefetchThreadCount;                //先読みを行うスレッド数
+    int m_prefetchEnd;                        //先読みを行う最後のフレーム+1
+    int m_prefetchNext;                       //次に要求するフレーム
+    int m_prefetchRead;                       //次に読み込むフレーム
+    std::vector<AvsPrefetchFrame> m_prefetchBuf; //フレーム番号 % m_prefetch の位置に格納する
+    std::vector<std::thread> m_prefetchThreads;
+    std::mutex m_prefetchMtx;
+    std::condition_variable m_prefetchCvRequest; //空きができた/終了
+    std::condition_variable m_prefetchCvReady;   //フレームを取得した
+    bool m_prefetchAbort;
+    std::mutex m_avsMtx;                      //先読みが1スレッドの場合に、avisynthの呼び出しを排他する
+    //先読みの状況 (ログ用)
+    int64_t m_prefetchReadyFrames;            //読み込み時に取得済みだった先読みフレーム数の合計
+    int m_prefetchWaitCount;                  //フレームの取得を待った回数
+
 #if ENABLE_AVSW_READER
     RGY_ERR InitAudio();
 
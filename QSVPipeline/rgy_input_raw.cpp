@@ -26,11 +26,284 @@
 // ------------------------------------------------------------------------------------------
 
 #include <sstream>
+#include <chrono>
 #include <fcntl.h>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 #include "rgy_input_raw.h"
 
 #if ENABLE_RAW_READER
 
+//先読みに使うフレームバッファの数
+//1つは色変換中、1つは先読みスレッドが読み込み中なので、先読み済みで待機できるのは RAW_READ_AHEAD_FRAMES - 2
+static const int RAW_READ_AHEAD_FRAMES = 4;
+//色変換のSIMD関数はフレームの終端を超えて読み込むことがあるので、その分の余白
+static const size_t RAW_READ_PADDING = 256;
+
+static size_t get_page_size() {
+#if defined(_WIN32) || defined(_WIN64)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+}
+
+RGYRawReadAhead::RGYRawReadAhead() :
+    m_fp(nullptr),
+    m_y4m(false),
+    m_frameSize(0),
+    m_bufferCount(0),
+    m_buffer(),
+    m_slot(),
+    m_qFrames(),
+    m_thRead(),
+    m_abort(false),
+    m_fin(false),
+    m_mapBase(nullptr),
+    m_mapSize(0),
+    m_mapOffset(0),
+    m_mapReleased(0),
+#if defined(_WIN32) || defined(_WIN64)
+    m_hMap(NULL),
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_readTimeUs(0),
+    m_waitTimeUs(0) {
+}
+
+RGYRawReadAhead::~RGYRawReadAhead() {
+    close();
+}
+
+void RGYRawReadAhead::close() {
+    m_abort = true;
+    if (m_thRead.joinable()) {
+        //先読みスレッドがpush()で空き待ちしている可能性があるので、上限を解除してから終了を待つ
+        m_qFrames.set_capacity(SIZE_MAX);
+        m_thRead.join();
+    }
+    m_qFrames.close();
+    unmapFile();
+    m_buffer.clear();
+    m_slot.clear();
+    m_fp = nullptr;
+    m_bufferCount = 0;
+    m_abort = false;
+    m_fin = false;
+}
+
+RGY_ERR RGYRawReadAhead::init(FILE *fp, bool y4m, size_t frameSize, int bufferCount) {
+    close();
+    m_fp = fp;
+    m_y4m = y4m;
+    m_frameSize = frameSize;
+    m_bufferCount = (std::max)(bufferCount, 3);
+    m_readTimeUs = 0;
+    m_waitTimeUs = 0;
+    //通常のファイルならメモリマップし、コピーせずにそのまま色変換の入力とする
+    //メモリマップの場合も、終端付近のフレームは余白を確保できないことがあるので、コピー用のバッファを用意しておく
+    mapFile(fp);
+    for (int i = 0; i < m_bufferCount; i++) {
+        std::unique_ptr<uint8_t, aligned_malloc_deleter> buf((uint8_t *)_aligned_malloc(frameSize + RAW_READ_PADDING, 64), aligned_malloc_deleter());
+        if (!buf) {
+            return RGY_ERR_NULL_PTR;
+        }
+        m_buffer.push_back(std::move(buf));
+    }
+    m_slot.resize(m_bufferCount, nullptr);
+    m_qFrames.init(16, m_bufferCount - 2);
+    m_thRead = std::thread(&RGYRawReadAhead::threadFuncRead, this);
+    return RGY_ERR_NONE;
+}
+
+bool RGYRawReadAhead::mapFile(FILE *fp) {
+    const int64_t offset = _ftelli64(fp);
+    if (offset < 0) {
+        return false; //シークできない (パイプなど)
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (sizeof(void *) < 8) {
+        return false; //32bitでは大きなファイルをマップできない
+    }
+    HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (hFile == INVALID_HANDLE_VALUE || GetFileType(hFile) != FILE_TYPE_DISK) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart <= offset) {
+        return false;
+    }
+    m_hMap = CreateFileMapping(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_hMap == NULL) {
+        return false;
+    }
+    void *ptr = MapViewOfFile(m_hMap, FILE_MAP_READ, 0, 0, 0);
+    if (ptr == nullptr) {
+        CloseHandle(m_hMap);
+        m_hMap = NULL;
+        return false;
+    }
+    m_mapSize = fileSize.QuadPart;
+#else
+    const int fd = fileno(fp);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= offset) {
+        return false;
+    }
+    void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+    m_mapSize = st.st_size;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_mapBase = (uint8_t *)ptr;
+    m_mapOffset = offset;
+    m_mapReleased = 0;
+    return true;
+}
+
+void RGYRawReadAhead::unmapFile() {
+    if (m_mapBase) {
+#if defined(_WIN32) || defined(_WIN64)
+        UnmapViewOfFile(m_mapBase);
+#else
+        munmap(m_mapBase, (size_t)m_mapSize);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+        m_mapBase = nullptr;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_hMap) {
+        CloseHandle(m_hMap);
+        m_hMap = NULL;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_mapSize = 0;
+    m_mapOffset = 0;
+    m_mapReleased = 0;
+}
+
+bool RGYRawReadAhead::readFrameBuffered(int slot) {
+    if (m_y4m) {
+        uint8_t y4m_buf[8] = { 0 };
+        if (_fread_nolock(y4m_buf, 1, strlen("FRAME"), m_fp) != strlen("FRAME")
+            || memcmp(y4m_buf, "FRAME", strlen("FRAME")) != 0) {
+            return false;
+        }
+        for (int i = 0; _fgetc_nolock(m_fp) != '\n'; i++) {
+            if (i >= 64) {
+                return false;
+            }
+        }
+    }
+    uint8_t *buf = m_buffer[slot].get();
+    if (m_frameSize != _fread_nolock(buf, 1, m_frameSize, m_fp)) {
+        return false;
+    }
+    m_slot[slot] = buf;
+    return true;
+}
+
+bool RGYRawReadAhead::readFrameMapped(int slot) {
+    uint64_t offset = m_mapOffset;
+    if (m_y4m) {
+        if (offset + strlen("FRAME") > m_mapSize
+            || memcmp(m_mapBase + offset, "FRAME", strlen("FRAME")) != 0) {
+            return false;
+        }
+        offset += strlen("FRAME");
+        for (int i = 0; ; i++) {
+            if (offset >= m_mapSize) {
+                return false;
+            }
+            if (m_mapBase[offset++] == '\n') {
+                break;
+            }
+            if (i >= 64) {
+                return false;
+            }
+        }
+    }
+    if (offset + m_frameSize > m_mapSize) {
+        return false;
+    }
+    const uint8_t *ptr = m_mapBase + offset;
+    const size_t pageSize = get_page_size();
+    //マップの末尾のページのうち、ファイルの終端以降も読み込み可能 (0埋め) だが、それを超えると読み込めない
+    //色変換がフレームの終端を超えて読み込んでも問題ないよう、余白を確保できないフレームはバッファにコピーする
+    const uint64_t mapReadable = (m_mapSize + pageSize - 1) & ~(uint64_t)(pageSize - 1);
+    if (offset + m_frameSize + RAW_READ_PADDING > mapReadable) {
+        uint8_t *buf = m_buffer[slot].get();
+        memcpy(buf, ptr, m_frameSize);
+        memset(buf + m_frameSize, 0, RAW_READ_PADDING);
+        m_slot[slot] = buf;
+        m_mapOffset = offset + m_frameSize;
+        return true;
+    }
+    //ここでページを読み込んでおき、色変換側がページフォールトでI/Oを待たないようにする
+#if !(defined(_WIN32) || defined(_WIN64))
+    const size_t pageOffset = (size_t)offset & (pageSize - 1);
+    madvise((void *)(ptr - pageOffset), m_frameSize + pageOffset, MADV_WILLNEED);
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    const volatile uint8_t *touch = ptr;
+    for (size_t pos = 0; pos < m_frameSize; pos += pageSize) {
+        touch[pos];
+    }
+    touch[m_frameSize - 1];
+    m_slot[slot] = ptr;
+    m_mapOffset = offset + m_frameSize;
+    return true;
+}
+
+void RGYRawReadAhead::threadFuncRead() {
+    for (uint32_t iframe = 0; !m_abort; iframe++) {
+        const int slot = (int)(iframe % (uint32_t)m_bufferCount);
+        const auto timeStart = std::chrono::high_resolution_clock::now();
+        const bool ret = (m_mapBase) ? readFrameMapped(slot) : readFrameBuffered(slot);
+        m_readTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - timeStart).count();
+        if (!ret) {
+            break;
+        }
+        m_qFrames.push(slot);
+    }
+    m_qFrames.push(-1);
+}
+
+const uint8_t *RGYRawReadAhead::getFrame() {
+    if (m_fin || !m_thRead.joinable()) {
+        return nullptr;
+    }
+    int slot = -1;
+    if (!m_qFrames.front_copy_and_pop_no_lock(&slot)) {
+        //先読みが間に合っていない
+        const auto timeStart = std::chrono::high_resolution_clock::now();
+        while (!m_qFrames.front_copy_and_pop_no_lock(&slot)) {
+            m_qFrames.wait_for_push();
+        }
+        m_waitTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - timeStart).count();
+    }
+    if (slot < 0) {
+        m_fin = true;
+        return nullptr;
+    }
+    const uint8_t *ptr = m_slot[slot];
+#if !(defined(_WIN32) || defined(_WIN64))
+    if (m_mapBase && m_mapBase <= ptr && ptr < m_mapBase + m_mapSize) {
+        //色変換の終わった領域はマップから外し、常駐メモリが増え続けないようにする
+        const uint64_t releaseEnd = (uint64_t)(ptr - m_mapBase) & ~(uint64_t)(get_page_size() - 1);
+        if (releaseEnd > m_mapReleased) {
+            madvise(m_mapBase + m_mapReleased, (size_t)(releaseEnd - m_mapReleased), MADV_DONTNEED);
+            m_mapReleased = releaseEnd;
+        }
+    }
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    return ptr;
+}
+
 RGY_ERR RGYInputRaw::ParseY4MHeader(char *buf, VideoInfo *pInfo) {
     char *p, *q = nullptr;
 
@@ -152,7 +425,7 @@ RGY_ERR RGYInputRaw::ParseY4MHeader(char *buf, VideoInfo *pInfo) {
 RGYInputRaw::RGYInputRaw() :
     m_fSource(NULL),
     m_nBufSize(0),
-    m_pBuffer() {
+    m_readAhead() {
     m_readerName = _T("raw");
 }
 
@@ -161,11 +434,11 @@ RGYInputRaw::~RGYInputRaw() {
 }
 
 void RGYInputRaw::Close() {
+    m_readAhead.close();
     if (m_fSource) {
         fclose(m_fSource);
         m_fSource = NULL;
     }
-    m_pBuffer.reset();
     m_nBufSize = 0;
     RGYInput::Close();
 }
@@ -288,11 +561,12 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         m_inputVideoInfo.csp = output_csp_if_lossless;
     }
 
-    m_pBuffer = std::shared_ptr<uint8_t>((uint8_t *)_aligned_malloc(bufferSize, 32), aligned_malloc_deleter());
-    if (!m_pBuffer) {
+    m_nBufSize = bufferSize;
+    if (m_readAhead.init(m_fSource, m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M, bufferSize, RAW_READ_AHEAD_FRAMES) != RGY_ERR_NONE) {
         AddMessage(RGY_LOG_ERROR, _T("Failed to allocate input buffer.\n"));
         return RGY_ERR_NULL_PTR;
     }
+    AddMessage(RGY_LOG_DEBUG, _T("read-ahead: %s, %d buffers.\n"), (m_readAhead.mmapped()) ? _T("mmap") : _T("fread"), m_readAhead.bufferCount());
 
     m_inputVideoInfo.shift = ((m_inputVideoInfo.csp == RGY_CSP_P010 || m_inputVideoInfo.csp == RGY_CSP_P210) && m_inputVideoInfo.shift) ? m_inputVideoInfo.shift : 0;
 
@@ -315,60 +589,10 @@ RGY_ERR RGYInputRaw::LoadNextFrame(RGYFrame *pSurface) {
         return RGY_ERR_MORE_DATA;
     }
 
-    if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
-        uint8_t y4m_buf[8] = { 0 };
-        if (_fread_nolock(y4m_buf, 1, strlen("FRAME"), m_fSource) != strlen("FRAME")) {
-            AddMessage(RGY_LOG_DEBUG, _T("header1: finish.\n"));
-            return RGY_ERR_MORE_DATA;
-        }
-        if (memcmp(y4m_buf, "FRAME", strlen("FRAME")) != 0) {
-            AddMessage(RGY_LOG_DEBUG, _T("header2: finish.\n"));
-            return RGY_ERR_MORE_DATA;
-        }
-        int i;
-        for (i = 0; _fgetc_nolock(m_fSource) != '\n'; i++) {
-            if (i >= 64) {
-                AddMessage(RGY_LOG_DEBUG, _T("header3: finish.\n"));
-                return RGY_ERR_MORE_DATA;
-            }
-        }
-    }
-
-    uint32_t frameSize = 0;
-    switch (m_convert->getFunc()->csp_from) {
-    case RGY_CSP_NV12:
-    case RGY_CSP_YV12:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3 / 2; break;
-    case RGY_CSP_P010:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YUV422:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 2; break;
-    case RGY_CSP_YUV444:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YV12_09:
-    case RGY_CSP_YV12_10:
-    case RGY_CSP_YV12_12:
-    case RGY_CSP_YV12_14:
-    case RGY_CSP_YV12_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YUV422_09:
-    case RGY_CSP_YUV422_10:
-    case RGY_CSP_YUV422_12:
-    case RGY_CSP_YUV422_14:
-    case RGY_CSP_YUV422_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 4; break;
-    case RGY_CSP_YUV444_09:
-    case RGY_CSP_YUV444_10:
-    case RGY_CSP_YUV444_12:
-    case RGY_CSP_YUV444_14:
-    case RGY_CSP_YUV444_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 6; break;
-    default:
-        AddMessage(RGY_LOG_ERROR, _T("Unknown color foramt.\n"));
-        return RGY_ERR_INVALID_COLOR_FORMAT;
-    }
-    if (frameSize != _fread_nolock(m_pBuffer.get(), 1, frameSize, m_fSource)) {
-        AddMessage(RGY_LOG_DEBUG, _T("fread: finish: %d.\n"), frameSize);
+    const uint8_t *frameData = m_readAhead.getFrame();
+    m_encSatusInfo->SetInputReadTime(m_readAhead.readTimeUs(), m_readAhead.waitTimeUs());
+    if (frameData == nullptr) {
+        AddMessage(RGY_LOG_DEBUG, _T("read: finish.\n"));
         return RGY_ERR_MORE_DATA;
     }
 
@@ -376,7 +600,7 @@ RGY_ERR RGYInputRaw::LoadNextFrame(RGYFrame *pSurface) {
     pSurface->ptrArray(dst_array, m_convert->getFunc()->csp_to == RGY_CSP_RGB24 || m_convert->getFunc()->csp_to == RGY_CSP_RGB32);
 
     const void *src_array[3];
-    src_array[0] = m_pBuffer.get();
+    src_array[0] = frameData;
     src_array[1] = (uint8_t *)src_array[0] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
     switch (m_convert->getFunc()->csp_from) {
     case RGY_CSP_YV12:
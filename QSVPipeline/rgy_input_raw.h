@@ -29,10 +29,66 @@
 #ifndef __RGY_INPUT_RAW_H__
 #define __RGY_INPUT_RAW_H__
 
+#include <atomic>
 #include "rgy_input.h"
+#include "rgy_queue.h"
 
 #if ENABLE_RAW_READER
 
+//raw/y4mの先読みを行う
+//通常のファイルはメモリマップし、先読みスレッドで次のフレームのページを事前に読み込んでおく
+//パイプ/標準入力の場合は、複数のバッファに先読みスレッドでfreadする
+//いずれの場合も、フレームNの色変換中にフレームN+1以降の読み込みが行われる
+class RGYRawReadAhead {
+public:
+    RGYRawReadAhead();
+    ~RGYRawReadAhead();
+
+    //fpは読み込み開始位置までシーク済みであること
+    RGY_ERR init(FILE *fp, bool y4m, size_t frameSize, int bufferCount);
+    void close();
+
+    //次のフレームのデータへのポインタを返す (終端ならnullptr)
+    //ポインタは次のgetFrame()の呼び出しまで有効
+    const uint8_t *getFrame();
+
+    bool mmapped() const { return m_mapBase != nullptr; }
+    int bufferCount() const { return m_bufferCount; }
+    //先読みスレッドで読み込みにかかった時間 (us)
+    int64_t readTimeUs() const { return m_readTimeUs.load(); }
+    //getFrame()で先読みを待った時間 (us)
+    int64_t waitTimeUs() const { return m_waitTimeUs; }
+protected:
+    void threadFuncRead();
+    bool readFrameBuffered(int slot);
+    bool readFrameMapped(int slot);
+    bool mapFile(FILE *fp);
+    void unmapFile();
+
+    FILE *m_fp;
+    bool m_y4m;
+    size_t m_frameSize;
+    int m_bufferCount;
+
+    std::vector<std::unique_ptr<uint8_t, aligned_malloc_deleter>> m_buffer; //先読み用バッファ (パイプ時、メモリマップ時は終端付近のフレームのみ)
+    std::vector<const uint8_t *> m_slot;   //各スロットのフレームデータの位置
+    RGYQueueSPSPRing<int> m_qFrames;       //読み込みの終わったスロット (-1で終端)
+    std::thread m_thRead;
+    std::atomic<bool> m_abort;
+    bool m_fin;
+
+    uint8_t *m_mapBase;     //メモリマップの先頭
+    uint64_t m_mapSize;     //メモリマップのサイズ
+    uint64_t m_mapOffset;   //次に読み込む位置
+    uint64_t m_mapReleased; //解放済みの位置
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE m_hMap;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+    std::atomic<int64_t> m_readTimeUs;
+    int64_t m_waitTimeUs;
+};
+
 class RGYInputRaw : public RGYInput {
 public:
     RGYInputRaw();
@@ -48,7 +104,7 @@ protected:
     FILE *m_fSource;
 
     uint32_t m_nBufSize;
-    shared_ptr<uint8_t> m_pBuffer;
+    RGYRawReadAhead m_readAhead;
 };
 
 #endif //ENABLE_RAW_READER
@@ -1,4 +1,4 @@
-﻿// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
 // QSVEnc/NVEnc by rigaya
 // -----------------------------------------------------------------------------------------
 // The MIT License
@@ -26,13 +26,229 @@
 // ------------------------------------------------------------------------------------------
 
 #include "rgy_input_sm.h"
+#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+#include <climits>
+#include <cerrno>
+#include <chrono>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif //#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+
+uint32_t rgy_input_sm_frame_size(RGY_CSP csp, int pitch, int height) {
+    switch (csp) {
+    case RGY_CSP_NV12:
+    case RGY_CSP_YV12:
+        return pitch * height * 3 / 2;
+    case RGY_CSP_P010:
+    case RGY_CSP_YV12_09:
+    case RGY_CSP_YV12_10:
+    case RGY_CSP_YV12_12:
+    case RGY_CSP_YV12_14:
+    case RGY_CSP_YV12_16:
+    case RGY_CSP_YUV444:
+        return pitch * height * 3;
+    case RGY_CSP_YUV422:
+        return pitch * height * 2;
+    case RGY_CSP_YUV422_09:
+    case RGY_CSP_YUV422_10:
+    case RGY_CSP_YUV422_12:
+    case RGY_CSP_YUV422_14:
+    case RGY_CSP_YUV422_16:
+        return pitch * height * 4;
+    case RGY_CSP_YUV444_09:
+    case RGY_CSP_YUV444_10:
+    case RGY_CSP_YUV444_12:
+    case RGY_CSP_YUV444_14:
+    case RGY_CSP_YUV444_16:
+        return pitch * height * 6;
+    default:
+        return 0;
+    }
+}
+
+#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+
+//プロセス間で共有するので、FUTEX_PRIVATE_FLAGは使用しない
+static void sm_futex_wait(std::atomic<uint32_t> *addr, uint32_t expected, int timeoutMs) {
+    struct timespec ts;
+    if (timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000 * 1000;
+    }
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, expected, (timeoutMs >= 0) ? &ts : nullptr, nullptr, 0);
+}
+
+static void sm_futex_wake(std::atomic<uint32_t> *addr) {
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+//cond()が満たされるまでsignalの変化を待つ (timeoutMs < 0 なら無制限)
+//待機前にwaitingを立て、相手はsignalを加算した後、waitingが立っている場合のみfutexで起こす
+template<typename Func>
+static bool sm_ring_wait(std::atomic<uint32_t>& signal, std::atomic<uint32_t>& waiting, int timeoutMs, Func cond) {
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        const uint32_t sig = signal.load();
+        if (cond()) {
+            return true;
+        }
+        waiting.store(1);
+        if (cond()) {
+            return true;
+        }
+        int remainMs = -1;
+        if (timeoutMs >= 0) {
+            remainMs = timeoutMs - (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            if (remainMs <= 0) {
+                return false;
+            }
+        }
+        sm_futex_wait(&signal, sig, remainMs);
+    }
+}
+
+static void sm_ring_notify(std::atomic<uint32_t>& signal, std::atomic<uint32_t>& waiting) {
+    signal.fetch_add(1);
+    if (waiting.exchange(0)) {
+        sm_futex_wake(&signal);
+    }
+}
+
+RGYInputSMRingWriter::RGYInputSMRingWriter() :
+    m_sm(),
+    m_name(),
+    m_header(nullptr) {
+}
+
+RGYInputSMRingWriter::~RGYInputSMRingWriter() {
+    close();
+}
+
+RGY_ERR RGYInputSMRingWriter::open(const char *name, int w, int h, int fpsN, int fpsD, RGY_CSP csp, RGY_PICSTRUCT picstruct, int frames, int slotCount) {
+    close();
+    if (slotCount <= 0 || RGY_INPUT_SM_RING_MAX_SLOTS < slotCount) {
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //読み込み側 (Windows版のRGYInputSM) と同じpitch
+    const int pitch = ALIGN(w, 128) * (RGY_CSP_BIT_DEPTH[csp] > 8 ? 2 : 1);
+    const uint32_t frameSize = rgy_input_sm_frame_size(csp, pitch, h);
+    if (frameSize == 0) {
+        return RGY_ERR_INVALID_COLOR_FORMAT;
+    }
+    const uint32_t headerSize = ALIGN((uint32_t)sizeof(RGYInputSMRingHeader), RGY_INPUT_SM_RING_ALIGN);
+    const uint32_t slotSize = ALIGN(frameSize, RGY_INPUT_SM_RING_ALIGN);
+    //古いものが残っていれば削除してから作成する
+    shm_unlink(name);
+    m_sm = std::unique_ptr<RGYSharedMemPosix>(new RGYSharedMemPosix(name, headerSize + (uint64_t)slotSize * slotCount));
+    if (!m_sm->is_open()) {
+        m_sm.reset();
+        return RGY_ERR_INVALID_HANDLE;
+    }
+    m_name = name;
+    m_header = (RGYInputSMRingHeader *)m_sm->ptr();
+    memset((void *)m_header, 0, headerSize);
+    m_header->version = RGY_INPUT_SM_RING_VERSION;
+    m_header->headerSize = headerSize;
+    m_header->w = w;
+    m_header->h = h;
+    m_header->fpsN = fpsN;
+    m_header->fpsD = fpsD;
+    m_header->pitch = pitch;
+    m_header->csp = csp;
+    m_header->picstruct = picstruct;
+    m_header->frames = frames;
+    m_header->slotCount = slotCount;
+    m_header->slotSize = slotSize;
+    //magicは最後に設定し、設定途中のヘッダを読み込み側が使わないようにする
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_header->magic, RGY_INPUT_SM_RING_MAGIC, sizeof(m_header->magic));
+    return RGY_ERR_NONE;
+}
+
+void RGYInputSMRingWriter::close() {
+    if (m_header) {
+        finish();
+        m_header = nullptr;
+    }
+    m_sm.reset();
+    if (m_name.length() > 0) {
+        //エンコーダ側は既にマッピングしていれば、そのまま使用できる
+        shm_unlink(m_name.c_str());
+        m_name.clear();
+    }
+}
+
+bool RGYInputSMRingWriter::readerAlive() const {
+    if (!m_header || m_header->readerClosed.load()) {
+        return false;
+    }
+    const pid_t pid = m_header->readerPid.load();
+    //EPERMはプロセスが存在するが、シグナルを送る権限がない場合
+    return pid == 0 || kill(pid, 0) == 0 || errno == EPERM;
+}
+
+uint8_t *RGYInputSMRingWriter::acquire(int timeoutMs) {
+    if (!m_header) {
+        return nullptr;
+    }
+    const uint32_t writeCount = m_header->writeCount.load(std::memory_order_relaxed);
+    auto header = m_header;
+    auto slotAvailable = [header, writeCount]() {
+        return header->readerClosed.load() || writeCount - header->readCount.load(std::memory_order_acquire) < header->slotCount;
+    };
+    //エンコーダが異常終了するとreaderClosedが立たないので、一定間隔ごとに生存を確認する
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        int waitMs = RGY_INPUT_SM_RING_LIVENESS_INTERVAL_MS;
+        if (timeoutMs >= 0) {
+            const int remainMs = timeoutMs - (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            waitMs = (std::max)(0, (std::min)(waitMs, remainMs));
+        }
+        if (sm_ring_wait(m_header->readerSignal, m_header->writerWaiting, waitMs, slotAvailable)) {
+            break;
+        }
+        if (!readerAlive() || (timeoutMs >= 0 && waitMs < RGY_INPUT_SM_RING_LIVENESS_INTERVAL_MS)) {
+            return nullptr;
+        }
+    }
+    if (m_header->readerClosed.load()) {
+        return nullptr;
+    }
+    return (uint8_t *)m_header + m_header->headerSize + (size_t)m_header->slotSize * (writeCount % m_header->slotCount);
+}
+
+void RGYInputSMRingWriter::commit(int64_t timestamp, int duration) {
+    const uint32_t writeCount = m_header->writeCount.load(std::memory_order_relaxed);
+    auto& slot = m_header->slot[writeCount % m_header->slotCount];
+    slot.timestamp = timestamp;
+    slot.duration = duration;
+    m_header->writeCount.store(writeCount + 1, std::memory_order_release);
+    sm_ring_notify(m_header->writerSignal, m_header->readerWaiting);
+}
+
+void RGYInputSMRingWriter::finish() {
+    if (m_header && !m_header->eof.load()) {
+        m_header->eof.store(1);
+        sm_ring_notify(m_header->writerSignal, m_header->readerWaiting);
+    }
+}
+
+#endif //#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
 
 #if ENABLE_SM_READER
 
 RGYInputSM::RGYInputSM() :
     m_sm(),
+#if defined(_WIN32) || defined(_WIN64)
+    m_prm(),
     m_buf_empty(),
     m_buf_filled() {
+#else
+    m_ring(nullptr) {
+#endif //#if defined(_WIN32) || defined(_WIN64)
     m_readerName = _T("sm");
 }
 
@@ -41,8 +257,17 @@ RGYInputSM::~RGYInputSM() {
 }
 
 void RGYInputSM::Close() {
+#if defined(_WIN32) || defined(_WIN64)
     m_buf_empty.reset();
     m_buf_filled.reset();
+#else
+    if (m_ring) {
+        //上流が空きスロットを待っていれば起こす
+        m_ring->readerClosed.store(1);
+        sm_ring_notify(m_ring->readerSignal, m_ring->writerWaiting);
+        m_ring = nullptr;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
     m_sm.reset();
     RGYInput::Close();
 }
@@ -52,8 +277,12 @@ rgy_rational<int> RGYInputSM::getInputTimebase() {
 }
 
 bool RGYInputSM::isAfs() {
+#if defined(_WIN32) || defined(_WIN64)
     RGYInputSMPrm* prmsm = (RGYInputSMPrm*)m_prm->ptr();
     return prmsm->afs;
+#else
+    return false;
+#endif //#if defined(_WIN32) || defined(_WIN64)
 }
 
 RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) {
@@ -62,8 +291,9 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
 
     m_readerName = _T("sm");
 
-    m_convert = std::make_unique<RGYConvertCSP>(prm->threadCsp);
+    m_convert = std::unique_ptr<RGYConvertCSP>(new RGYConvertCSP(prm->threadCsp));
 
+#if defined(_WIN32) || defined(_WIN64)
     const auto pid = GetCurrentProcessId();
     const int handleOpenRetry = 10 * 60 * 10;
     {
@@ -118,16 +348,48 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     m_inputVideoInfo.frames = prmsm->frames;
     m_inputCsp = m_inputVideoInfo.csp = prmsm->csp;
 
+#else
+    //上流が作成した共有メモリを開く
+    m_sm = std::unique_ptr<RGYSharedMemPosix>(new RGYSharedMemPosix(tchar_to_string(strFileName).c_str(), 0));
+    if (!m_sm->is_open()) {
+        AddMessage(RGY_LOG_ERROR, _T("could not open shared memory \"%s\" for input.\n"), strFileName);
+        return RGY_ERR_INVALID_HANDLE;
+    }
+    m_ring = (RGYInputSMRingHeader *)m_sm->ptr();
+    if (m_sm->size() < sizeof(RGYInputSMRingHeader)
+        || memcmp(m_ring->magic, RGY_INPUT_SM_RING_MAGIC, sizeof(m_ring->magic)) != 0
+        || m_ring->version != RGY_INPUT_SM_RING_VERSION
+        || m_ring->slotCount == 0 || RGY_INPUT_SM_RING_MAX_SLOTS < m_ring->slotCount
+        || m_ring->headerSize < sizeof(RGYInputSMRingHeader)
+        || m_sm->size() < m_ring->headerSize + (uint64_t)m_ring->slotSize * m_ring->slotCount) {
+        AddMessage(RGY_LOG_ERROR, _T("invalid shared memory \"%s\" for input.\n"), strFileName);
+        m_ring = nullptr;
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    //上流が生存を確認できるよう、プロセスIDを通知する
+    m_ring->readerPid.store((int32_t)getpid());
+    AddMessage(RGY_LOG_DEBUG, _T("Opened shared memory \"%s\": %d slots x %u bytes.\n"), strFileName, m_ring->slotCount, m_ring->slotSize);
+
+    auto nOutputCSP = m_inputVideoInfo.csp;
+    m_inputVideoInfo.srcWidth = m_ring->w;
+    m_inputVideoInfo.srcHeight = m_ring->h;
+    m_inputVideoInfo.fpsN = m_ring->fpsN;
+    m_inputVideoInfo.fpsD = m_ring->fpsD;
+    m_inputVideoInfo.srcPitch = m_ring->pitch;
+    m_inputVideoInfo.picstruct = m_ring->picstruct;
+    m_inputVideoInfo.frames = m_ring->frames;
+    m_inputCsp = m_inputVideoInfo.csp = m_ring->csp;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
     RGY_CSP output_csp_if_lossless = RGY_CSP_NA;
-    uint32_t bufferSize = 0;
+    const uint32_t bufferSize = rgy_input_sm_frame_size(m_inputCsp, m_inputVideoInfo.srcPitch, m_inputVideoInfo.srcHeight);
     switch (m_inputCsp) {
     case RGY_CSP_NV12:
     case RGY_CSP_YV12:
-        bufferSize = m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight * 3 / 2;
         output_csp_if_lossless = RGY_CSP_NV12;
         break;
     case RGY_CSP_P010:
-        bufferSize = m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight * 3;
         output_csp_if_lossless = RGY_CSP_P010;
         break;
     case RGY_CSP_YV12_09:
@@ -135,11 +397,9 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     case RGY_CSP_YV12_12:
     case RGY_CSP_YV12_14:
     case RGY_CSP_YV12_16:
-        bufferSize = m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight * 3;
         output_csp_if_lossless = RGY_CSP_P010;
         break;
     case RGY_CSP_YUV422:
-        bufferSize = m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight * 2;
         if (ENCODER_VCEENC) {
             AddMessage(RGY_LOG_ERROR, _T("yuv422 not supported as input color format."));
             return RGY_ERR_INVALID_FORMAT;
@@ -153,7 +413,6 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     case RGY_CSP_YUV422_12:
     case RGY_CSP_YUV422_14:
     case RGY_CSP_YUV422_16:
-        bufferSize = m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight * 4;
         if (ENCODER_VCEENC) {
             AddMessage(RGY_LOG_ERROR, _T("yuv422 not supported as input color format."));
             return RGY_ERR_INVALID_FORMAT;
@@ -165,7 +424,6 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         output_csp_if_lossless = RGY_CSP_YUV444_16;
         break;
     case RGY_CSP_YUV444:
-        bufferSize = m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight * 3;
         output_csp_if_lossless = RGY_CSP_YUV444;
         break;
     case RGY_CSP_YUV444_09:
@@ -173,7 +431,6 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     case RGY_CSP_YUV444_12:
     case RGY_CSP_YUV444_14:
     case RGY_CSP_YUV444_16:
-        bufferSize = m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight * 6;
         output_csp_if_lossless = RGY_CSP_YUV444_16;
         break;
     default:
@@ -192,6 +449,7 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         m_inputVideoInfo.csp = output_csp_if_lossless;
     }
 
+#if defined(_WIN32) || defined(_WIN64)
     m_sm = std::unique_ptr<RGYSharedMemWin>(new RGYSharedMemWin(strsprintf("%s_%d", RGYInputSMBuffer, pid).c_str(), bufferSize));
     if (!m_sm->is_open()) {
         AddMessage(RGY_LOG_ERROR, _T("Failed to allocate input buffer.\n"));
@@ -200,6 +458,13 @@ RGY_ERR RGYInputSM::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     prmsm->bufSize = bufferSize;
     SetEvent(m_buf_empty.get());
     AddMessage(RGY_LOG_DEBUG, _T("SetEvent: m_buf_empty.\n"));
+#else
+    if (m_ring->slotSize < bufferSize || (int)m_inputVideoInfo.srcPitch < (int)m_inputVideoInfo.srcWidth * (RGY_CSP_BIT_DEPTH[m_inputCsp] > 8 ? 2 : 1)) {
+        AddMessage(RGY_LOG_ERROR, _T("slot size %u (pitch %d) too small for %dx%d %s.\n"),
+            m_ring->slotSize, m_inputVideoInfo.srcPitch, m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcHeight, RGY_CSP_NAMES[m_inputCsp]);
+        return RGY_ERR_INVALID_FORMAT;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
 
     m_inputVideoInfo.shift = ((m_inputVideoInfo.csp == RGY_CSP_P010 || m_inputVideoInfo.csp == RGY_CSP_P210) && m_inputVideoInfo.shift) ? m_inputVideoInfo.shift : 0;
 
@@ -222,6 +487,7 @@ RGY_ERR RGYInputSM::LoadNextFrame(RGYFrame *pSurface) {
         return RGY_ERR_MORE_DATA;
     }
 
+#if defined(_WIN32) || defined(_WIN64)
     if (WaitForSingleObject(m_buf_filled.get(), 10 * 1000) == WAIT_TIMEOUT) {
         AddMessage(RGY_LOG_ERROR, _T("timeout, no input for 10 seconds.\n"));
         return RGY_ERR_ABORTED;
@@ -230,12 +496,33 @@ RGY_ERR RGYInputSM::LoadNextFrame(RGYFrame *pSurface) {
     if (prmsm->abort) {
         return RGY_ERR_MORE_DATA;
     }
+    const uint8_t *srcFrame = (const uint8_t *)m_sm->ptr();
+    const int64_t timestamp = prmsm->timestamp;
+    const int duration = prmsm->duration;
+#else
+    //上流が入力の終了を通知しても、書き込み済みのフレームはすべて読み込む
+    auto ring = m_ring;
+    const uint32_t readCount = m_ring->readCount.load(std::memory_order_relaxed);
+    if (!sm_ring_wait(m_ring->writerSignal, m_ring->readerWaiting, 10 * 1000, [ring, readCount]() {
+        return ring->writeCount.load(std::memory_order_acquire) != readCount || ring->eof.load();
+    })) {
+        AddMessage(RGY_LOG_ERROR, _T("timeout, no input for 10 seconds.\n"));
+        return RGY_ERR_ABORTED;
+    }
+    if (m_ring->writeCount.load(std::memory_order_acquire) == readCount) {
+        return RGY_ERR_MORE_DATA;
+    }
+    const uint32_t islot = readCount % m_ring->slotCount;
+    const uint8_t *srcFrame = (const uint8_t *)m_ring + m_ring->headerSize + (size_t)m_ring->slotSize * islot;
+    const int64_t timestamp = m_ring->slot[islot].timestamp;
+    const int duration = m_ring->slot[islot].duration;
+#endif //#if defined(_WIN32) || defined(_WIN64)
 
     void *dst_array[3];
     pSurface->ptrArray(dst_array, m_convert->getFunc()->csp_to == RGY_CSP_RGB24 || m_convert->getFunc()->csp_to == RGY_CSP_RGB32);
 
     const void *src_array[3];
-    src_array[0] = m_sm->ptr();
+    src_array[0] = srcFrame;
     src_array[1] = (uint8_t *)src_array[0] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
     switch (m_convert->getFunc()->csp_from) {
     case RGY_CSP_YV12:
@@ -287,10 +574,16 @@ RGY_ERR RGYInputSM::LoadNextFrame(RGYFrame *pSurface) {
         dst_array, src_array, m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcPitch,
         src_uv_pitch, pSurface->pitch(), m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
 
-    pSurface->setTimestamp(prmsm->timestamp);
-    pSurface->setDuration(prmsm->duration);
+    pSurface->setTimestamp(timestamp);
+    pSurface->setDuration(duration);
 
+#if defined(_WIN32) || defined(_WIN64)
     SetEvent(m_buf_empty.get());
+#else
+    //変換が終わったのでスロットを解放する
+    m_ring->readCount.store(readCount + 1, std::memory_order_release);
+    sm_ring_notify(m_ring->readerSignal, m_ring->writerWaiting);
+#endif //#if defined(_WIN32) || defined(_WIN64)
     m_encSatusInfo->m_sData.frameIn++;
     return m_encSatusInfo->UpdateDisplay();
 }
@@ -54,6 +54,89 @@ struct RGYInputSMPrm {
 };
 #pragma pack(pop)
 
+//1フレームの読み込みに必要なバッファサイズ (対応していない色空間では0)
+uint32_t rgy_input_sm_frame_size(RGY_CSP csp, int pitch, int height);
+
+#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+#include <atomic>
+
+//Linux用の共有メモリ上の複数フレームのリングバッファ
+//上流のプロセス (RGYInputSMRingWriter) が共有メモリを作成してヘッダを設定し、
+//その名前を"--sm -i <名前>"に指定してエンコーダを起動する
+//上流はスロットにフレームを直接書き込み、エンコーダはスロットから直接色空間変換を行う
+//待機はfutexで行い、相手が待機中の場合のみ起こす
+//上流は一定間隔ごとにエンコーダのプロセスが生存しているかを確認し、異常終了していれば待機をやめる
+static const char RGY_INPUT_SM_RING_MAGIC[8] = "RGYSMRG";
+static const uint32_t RGY_INPUT_SM_RING_VERSION = 2;
+static const int RGY_INPUT_SM_RING_MAX_SLOTS = 64;
+//スロットのデータの開始位置と1スロットのサイズの単位
+static const uint32_t RGY_INPUT_SM_RING_ALIGN = 4096;
+//上流が空きスロットを待つ際に、エンコーダの生存を確認する間隔 (ms)
+static const int RGY_INPUT_SM_RING_LIVENESS_INTERVAL_MS = 1000;
+
+struct RGYInputSMRingSlot {
+    int64_t timestamp; //getInputTimebase()単位
+    int duration;
+    uint32_t reserved;
+};
+
+struct RGYInputSMRingHeader {
+    char magic[8];       //RGY_INPUT_SM_RING_MAGIC
+    uint32_t version;    //RGY_INPUT_SM_RING_VERSION
+    uint32_t headerSize; //スロットのデータの開始位置
+    int w, h;
+    int fpsN, fpsD;
+    int pitch;
+    RGY_CSP csp;
+    RGY_PICSTRUCT picstruct;
+    int frames;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    //上流 -> エンコーダ
+    alignas(64) std::atomic<uint32_t> writeCount;   //書き込み済みのフレーム数
+    std::atomic<uint32_t> eof;                      //入力の終了
+    std::atomic<uint32_t> writerSignal;             //futex (writeCount, eofの変更ごとに加算)
+    std::atomic<uint32_t> readerWaiting;            //エンコーダがwriterSignalで待機中
+    //エンコーダ -> 上流
+    alignas(64) std::atomic<uint32_t> readCount;    //読み込み済み(スロットを解放した)フレーム数
+    std::atomic<uint32_t> readerClosed;             //エンコーダの終了
+    std::atomic<uint32_t> readerSignal;             //futex (readCount, readerClosedの変更ごとに加算)
+    std::atomic<uint32_t> writerWaiting;            //上流がreaderSignalで待機中
+    std::atomic<int32_t> readerPid;                 //エンコーダのプロセスID (0なら未接続)
+    alignas(64) RGYInputSMRingSlot slot[RGY_INPUT_SM_RING_MAX_SLOTS];
+};
+
+//上流側のリングバッファへの書き込み
+class RGYInputSMRingWriter {
+public:
+    RGYInputSMRingWriter();
+    ~RGYInputSMRingWriter();
+
+    //共有メモリを作成してヘッダを設定する
+    RGY_ERR open(const char *name, int w, int h, int fpsN, int fpsD, RGY_CSP csp, RGY_PICSTRUCT picstruct, int frames, int slotCount);
+    //入力の終了を通知し、共有メモリを削除する
+    void close();
+    //次に書き込むスロットを返す
+    //空くまで最大timeoutMs待つ (負なら、エンコーダが生存している限り待つ)
+    //エンコーダが終了した場合、異常終了した場合、タイムアウトした場合はnullptr
+    uint8_t *acquire(int timeoutMs = -1);
+    //acquire()したスロットを書き込み済みにする
+    void commit(int64_t timestamp, int duration);
+    //入力の終了を通知する
+    void finish();
+    //エンコーダが接続して動作中か (未接続の場合も、これから接続しうるのでtrue)
+    bool readerAlive() const;
+    //エンコーダが共有メモリをマッピング済みか (以降はclose()しても読み込みを続けられる)
+    bool readerConnected() const { return m_header && m_header->readerPid.load() != 0; }
+
+    int pitch() const { return (m_header) ? m_header->pitch : 0; }
+protected:
+    std::unique_ptr<RGYSharedMemPosix> m_sm;
+    std::string m_name;
+    RGYInputSMRingHeader *m_header;
+};
+#endif //#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+
 #if ENABLE_SM_READER
 
 class RGYInputSM : public RGYInput {
@@ -69,10 +152,14 @@ public:
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) override;
 
-    std::unique_ptr<RGYSharedMemWin> m_prm;
     std::unique_ptr<RGYSharedMem> m_sm;
+#if defined(_WIN32) || defined(_WIN64)
+    std::unique_ptr<RGYSharedMemWin> m_prm;
     std::unique_ptr<void, handle_deleter> m_buf_empty;
     std::unique_ptr<void, handle_deleter> m_buf_filled;
+#else
+    RGYInputSMRingHeader *m_ring;
+#endif //#if defined(_WIN32) || defined(_WIN64)
 };
 
 #endif //#if ENABLE_SM_READER
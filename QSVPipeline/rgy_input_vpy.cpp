@@ -31,17 +31,44 @@
 #include <sstream>
 #include <map>
 #include <fstream>
+#include <cmath>
+
+//先読みの深さを調整する間隔 (フレーム数)
+static const int VPY_ASYNC_ADJUST_FRAMES = 16;
+//待ち時間が減らなかった深さを上限とする期間 (調整の回数)、その後は再度深くしてみる
+static const int VPY_ASYNC_SATURATED_WINDOWS = 32;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point fin) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(fin - start).count() * 1e-3;
+}
 
 RGYInputVpy::RGYInputVpy() :
     m_pAsyncBuffer(),
     m_hAsyncEventFrameSetFin(),
     m_hAsyncEventFrameSetStart(),
-    m_bAbortAsync(false),
+    m_asyncRequestTime(),
+    m_asyncLatency(),
     m_nCopyOfInputFrames(0),
     m_sVSapi(nullptr),
     m_sVSscript(nullptr),
     m_sVSnode(nullptr),
     m_nAsyncFrames(0),
+    m_asyncDepth(1),
+    m_asyncDepthMax(1),
+    m_asyncDepthPeak(1),
+    m_asyncSaturatedDepth(INT_MAX),
+    m_asyncSaturatedWindows(0),
+    m_asyncLastStep(0),
+    m_asyncWindowFrames(0),
+    m_asyncWindowWait(0.0),
+    m_asyncPrevWindowWait(-1.0),
+    m_asyncLatencyAvg(0.0),
+    m_asyncDemandAvg(0.0),
+    m_asyncPrevFrameTime(),
+    m_asyncWaitTotal(0.0),
+    m_asyncWaitMax(0.0),
+    m_asyncLatencyTotal(0.0),
+    m_asyncWaitCount(0),
     m_sVS() {
     memset(m_pAsyncBuffer, 0, sizeof(m_pAsyncBuffer));
     memset(m_hAsyncEventFrameSetFin,   0, sizeof(m_hAsyncEventFrameSetFin));
@@ -111,7 +138,7 @@ int RGYInputVpy::initAsyncEvents() {
 }
 
 void RGYInputVpy::closeAsyncEvents() {
-    m_bAbortAsync = true;
+    //要求済みのフレームは、すべて取得完了を待ってから解放する
     for (int i_frame = m_nCopyOfInputFrames; i_frame < m_nAsyncFrames; i_frame++) {
         const VSFrameRef *src_frame = getFrameFromAsyncBuffer(i_frame);
         m_sVSapi->freeFrame(src_frame);
@@ -124,7 +151,6 @@ void RGYInputVpy::closeAsyncEvents() {
     }
     memset(m_hAsyncEventFrameSetFin,   0, sizeof(m_hAsyncEventFrameSetFin));
     memset(m_hAsyncEventFrameSetStart, 0, sizeof(m_hAsyncEventFrameSetStart));
-    m_bAbortAsync = false;
 }
 
 #pragma warning(push)
@@ -135,16 +161,76 @@ void __stdcall frameDoneCallback(void *userData, const VSFrameRef *f, int n, VSN
 #pragma warning(pop)
 
 void RGYInputVpy::setFrameToAsyncBuffer(int n, const VSFrameRef* f) {
+    const auto now = std::chrono::steady_clock::now();
     WaitForSingleObject(m_hAsyncEventFrameSetStart[n & (ASYNC_BUFFER_SIZE-1)], INFINITE);
     m_pAsyncBuffer[n & (ASYNC_BUFFER_SIZE-1)] = f;
+    m_asyncLatency[n & (ASYNC_BUFFER_SIZE-1)] = elapsed_ms(m_asyncRequestTime[n & (ASYNC_BUFFER_SIZE-1)], now);
     SetEvent(m_hAsyncEventFrameSetFin[n & (ASYNC_BUFFER_SIZE-1)]);
+}
 
-    if (m_nAsyncFrames < m_inputVideoInfo.frames && !m_bAbortAsync) {
+void RGYInputVpy::requestAsyncFrames() {
+    //trimの結果不要なフレームは要求しない (LoadNextFrameで読み込む範囲に合わせる)
+    const int requestEnd = (int)(std::min<int64_t>)(m_inputVideoInfo.frames, (int64_t)getVideoTrimMaxFramIdx() + TRIM_OVERREAD_FRAMES + 1);
+    //新たな要求はこのスレッドからのみ行うので、m_nAsyncFramesはロック不要
+    while (m_nAsyncFrames < requestEnd && m_nAsyncFrames - (int)m_nCopyOfInputFrames < m_asyncDepth) {
+        m_asyncRequestTime[m_nAsyncFrames & (ASYNC_BUFFER_SIZE-1)] = std::chrono::steady_clock::now();
         m_sVSapi->getFrameAsync(m_nAsyncFrames, m_sVSnode, frameDoneCallback, this);
         m_nAsyncFrames++;
     }
 }
 
+void RGYInputVpy::adjustAsyncDepth(double waitMs) {
+    m_asyncWindowFrames++;
+    m_asyncWindowWait += waitMs;
+    if (m_asyncWindowFrames < VPY_ASYNC_ADJUST_FRAMES) {
+        return;
+    }
+    const double windowWait = m_asyncWindowWait / m_asyncWindowFrames;
+    m_asyncWindowFrames = 0;
+    m_asyncWindowWait = 0.0;
+    if (m_asyncSaturatedDepth < INT_MAX && --m_asyncSaturatedWindows <= 0) {
+        m_asyncSaturatedDepth = INT_MAX;
+    }
+
+    const int prevDepth = m_asyncDepth;
+    if (windowWait > m_asyncDemandAvg * 0.05) {
+        //スクリプト側の処理待ちが発生している
+        if (m_asyncLastStep > 0 && m_asyncPrevWindowWait >= 0.0 && windowWait > m_asyncPrevWindowWait * 0.95) {
+            //深くしても待ち時間が減らない場合は、スクリプト側の処理能力が上限に達しているので元に戻す
+            m_asyncDepth = (std::max)(1, m_asyncDepth - m_asyncLastStep);
+            m_asyncSaturatedDepth = m_asyncDepth;
+            m_asyncSaturatedWindows = VPY_ASYNC_SATURATED_WINDOWS;
+        } else {
+            const int depthLimit = (std::min)(m_asyncDepthMax, m_asyncSaturatedDepth);
+            m_asyncDepth = (std::max)(m_asyncDepth, (std::min)(m_asyncDepth + (std::max)(1, m_asyncDepth / 4), depthLimit));
+        }
+    } else {
+        //待ちが発生していない場合は、処理にかかる時間から必要な深さまで浅くし、メモリを節約する
+        const int required = (int)std::ceil(m_asyncLatencyAvg / (std::max)(m_asyncDemandAvg, 0.01)) + 1;
+        if (m_asyncDepth > required) {
+            m_asyncDepth--;
+        }
+    }
+    m_asyncLastStep = m_asyncDepth - prevDepth;
+    m_asyncPrevWindowWait = windowWait;
+    m_asyncDepthPeak = (std::max)(m_asyncDepthPeak, m_asyncDepth);
+    if (m_asyncDepth != prevDepth) {
+        AddMessage(RGY_LOG_DEBUG, _T("async depth %d -> %d (wait %.2f ms/frame, latency %.2f ms, demand %.2f ms).\n"),
+            prevDepth, m_asyncDepth, windowWait, m_asyncLatencyAvg, m_asyncDemandAvg);
+    }
+}
+
+void RGYInputVpy::printAsyncStats() {
+    if (m_nCopyOfInputFrames == 0) {
+        return;
+    }
+    AddMessage(RGY_LOG_INFO, _T("vpy async: depth %d (peak %d, limit %d), script latency %.2f ms, waited for %d of %d frames, %.2f ms/frame (max %.2f ms).\n"),
+        m_asyncDepth, m_asyncDepthPeak, m_asyncDepthMax,
+        m_asyncLatencyTotal / m_nCopyOfInputFrames,
+        m_asyncWaitCount, (int)m_nCopyOfInputFrames,
+        m_asyncWaitTotal / m_nCopyOfInputFrames, m_asyncWaitMax);
+}
+
 int RGYInputVpy::getRevInfo(const char *vsVersionString) {
     char *api_info = NULL;
     char buf[1024];
@@ -302,16 +388,27 @@ RGY_ERR RGYInputVpy::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     m_inputVideoInfo.shift = ((m_inputVideoInfo.csp == RGY_CSP_P010 || m_inputVideoInfo.csp == RGY_CSP_P210) && m_inputVideoInfo.shift) ? m_inputVideoInfo.shift : 0;
     m_inputVideoInfo.frames = vsvideoinfo->numFrames;
 
-    m_nAsyncFrames = vsvideoinfo->numFrames;
-    m_nAsyncFrames = (std::min)(m_nAsyncFrames, vscoreinfo->numThreads);
-    m_nAsyncFrames = (std::min)(m_nAsyncFrames, ASYNC_BUFFER_SIZE-1);
+    //先読みしたフレームが使用するメモリ量が、空きメモリの1/4を超えないようにする
+    const VSFormat *vsformat = vsvideoinfo->format;
+    const uint64_t frameSize = (uint64_t)vsformat->bytesPerSample
+        * ((uint64_t)vsvideoinfo->width * vsvideoinfo->height
+            + (uint64_t)(vsformat->numPlanes - 1) * (vsvideoinfo->width >> vsformat->subSamplingW) * (vsvideoinfo->height >> vsformat->subSamplingH));
+    uint64_t ramUsed = 0;
+    const uint64_t ramTotal = getPhysicalRamSize(&ramUsed);
+    const uint64_t ramFree = (ramTotal > ramUsed) ? ramTotal - ramUsed : 0;
+    m_asyncDepthMax = (int)(std::min<uint64_t>)(ramFree / 4 / (std::max<uint64_t>)(frameSize, 1), ASYNC_BUFFER_SIZE-1);
+    m_asyncDepthMax = (std::max)(m_asyncDepthMax, 1);
+    m_asyncDepthMax = (std::min)(m_asyncDepthMax, vsvideoinfo->numFrames);
+    m_asyncDepth = (std::min)(m_asyncDepthMax, vscoreinfo->numThreads);
     if (m_inputVideoInfo.type != RGY_INPUT_FMT_VPY_MT) {
-        m_nAsyncFrames = 1;
+        m_asyncDepthMax = 1;
+        m_asyncDepth = 1;
     }
+    m_asyncDepthPeak = m_asyncDepth;
+    AddMessage(RGY_LOG_DEBUG, _T("async depth %d (limit %d, %d threads, frame size %.1f MB, free ram %.1f MB).\n"),
+        m_asyncDepth, m_asyncDepthMax, vscoreinfo->numThreads, frameSize / (double)(1024 * 1024), ramFree / (double)(1024 * 1024));
 
-    for (int i = 0; i < m_nAsyncFrames; i++) {
-        m_sVSapi->getFrameAsync(i, m_sVSnode, frameDoneCallback, this);
-    }
+    requestAsyncFrames();
 
     tstring vs_ver = _T("VapourSynth");
     if (m_inputVideoInfo.type == RGY_INPUT_FMT_VPY_MT) {
@@ -331,6 +428,7 @@ RGY_ERR RGYInputVpy::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
 
 void RGYInputVpy::Close() {
     AddMessage(RGY_LOG_DEBUG, _T("Closing...\n"));
+    printAsyncStats();
     closeAsyncEvents();
     if (m_sVSapi && m_sVSnode)
         m_sVSapi->freeNode(m_sVSnode);
@@ -341,13 +439,27 @@ void RGYInputVpy::Close() {
 
     release_vapoursynth();
 
-    m_bAbortAsync = false;
     m_nCopyOfInputFrames = 0;
 
     m_sVSapi = nullptr;
     m_sVSscript = nullptr;
     m_sVSnode = nullptr;
     m_nAsyncFrames = 0;
+    m_asyncDepth = 1;
+    m_asyncDepthMax = 1;
+    m_asyncDepthPeak = 1;
+    m_asyncSaturatedDepth = INT_MAX;
+    m_asyncSaturatedWindows = 0;
+    m_asyncLastStep = 0;
+    m_asyncWindowFrames = 0;
+    m_asyncWindowWait = 0.0;
+    m_asyncPrevWindowWait = -1.0;
+    m_asyncLatencyAvg = 0.0;
+    m_asyncDemandAvg = 0.0;
+    m_asyncWaitTotal = 0.0;
+    m_asyncWaitMax = 0.0;
+    m_asyncLatencyTotal = 0.0;
+    m_asyncWaitCount = 0;
     m_encSatusInfo.reset();
     AddMessage(RGY_LOG_DEBUG, _T("Closed.\n"));
 }
@@ -360,10 +472,25 @@ RGY_ERR RGYInputVpy::LoadNextFrame(RGYFrame *pSurface) {
         return RGY_ERR_MORE_DATA;
     }
 
-    const VSFrameRef *src_frame = getFrameFromAsyncBuffer(m_encSatusInfo->m_sData.frameIn);
+    bool waited = false;
+    const auto waitStart = std::chrono::steady_clock::now();
+    const VSFrameRef *src_frame = getFrameFromAsyncBuffer(m_encSatusInfo->m_sData.frameIn, &waited);
+    const auto waitEnd = std::chrono::steady_clock::now();
     if (src_frame == nullptr) {
         return RGY_ERR_MORE_DATA;
     }
+    //待ち時間と、スクリプト側の処理時間 (要求から取得完了まで) を記録する
+    const double waitMs = (waited) ? elapsed_ms(waitStart, waitEnd) : 0.0;
+    const double latencyMs = m_asyncLatency[m_encSatusInfo->m_sData.frameIn & (ASYNC_BUFFER_SIZE-1)];
+    //1フレームあたりの待ち以外の時間 (色空間変換とエンコード側の処理)
+    const double demandMs = (m_nCopyOfInputFrames > 0) ? elapsed_ms(m_asyncPrevFrameTime, waitStart) : 0.0;
+    m_asyncPrevFrameTime = waitEnd;
+    m_asyncLatencyAvg = (m_nCopyOfInputFrames > 0) ? m_asyncLatencyAvg * 0.9 + latencyMs * 0.1 : latencyMs;
+    m_asyncDemandAvg  = (m_nCopyOfInputFrames > 1) ? m_asyncDemandAvg  * 0.9 + demandMs  * 0.1 : demandMs;
+    m_asyncLatencyTotal += latencyMs;
+    m_asyncWaitTotal += waitMs;
+    m_asyncWaitMax = (std::max)(m_asyncWaitMax, waitMs);
+    m_asyncWaitCount += (waited) ? 1 : 0;
 
     void *dst_array[3];
     pSurface->ptrArray(dst_array, m_convert->getFunc()->csp_to == RGY_CSP_RGB24 || m_convert->getFunc()->csp_to == RGY_CSP_RGB32);
@@ -378,6 +505,11 @@ RGY_ERR RGYInputVpy::LoadNextFrame(RGYFrame *pSurface) {
     m_encSatusInfo->m_sData.frameIn++;
     m_nCopyOfInputFrames = m_encSatusInfo->m_sData.frameIn;
 
+    if (m_inputVideoInfo.type == RGY_INPUT_FMT_VPY_MT) {
+        adjustAsyncDepth(waitMs);
+    }
+    requestAsyncFrames();
+
     return m_encSatusInfo->UpdateDisplay();
 }
 
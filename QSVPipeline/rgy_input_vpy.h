@@ -31,6 +31,7 @@
 
 #include "rgy_version.h"
 #if ENABLE_VAPOURSYNTH_READER
+#include <chrono>
 #include "rgy_osdep.h"
 #include "rgy_input.h"
 #include "VapourSynth.h"
@@ -87,8 +88,16 @@ protected:
     int load_vapoursynth();
     int initAsyncEvents();
     void closeAsyncEvents();
-    const VSFrameRef* getFrameFromAsyncBuffer(int n) {
-        WaitForSingleObject(m_hAsyncEventFrameSetFin[n & (ASYNC_BUFFER_SIZE-1)], INFINITE);
+    //waitedには、フレームの取得完了を待つ必要があったかを返す
+    const VSFrameRef* getFrameFromAsyncBuffer(int n, bool *waited = nullptr) {
+        HANDLE hFin = m_hAsyncEventFrameSetFin[n & (ASYNC_BUFFER_SIZE-1)];
+        const bool wait = WaitForSingleObject(hFin, 0) == WAIT_TIMEOUT;
+        if (wait) {
+            WaitForSingleObject(hFin, INFINITE);
+        }
+        if (waited) {
+            *waited = wait;
+        }
         const VSFrameRef *frame = m_pAsyncBuffer[n & (ASYNC_BUFFER_SIZE-1)];
         SetEvent(m_hAsyncEventFrameSetStart[n & (ASYNC_BUFFER_SIZE-1)]);
         return frame;
@@ -96,16 +105,40 @@ protected:
     const VSFrameRef* m_pAsyncBuffer[ASYNC_BUFFER_SIZE];
     HANDLE m_hAsyncEventFrameSetFin[ASYNC_BUFFER_SIZE];
     HANDLE m_hAsyncEventFrameSetStart[ASYNC_BUFFER_SIZE];
+    std::chrono::steady_clock::time_point m_asyncRequestTime[ASYNC_BUFFER_SIZE]; //フレームを要求した時刻
+    double m_asyncLatency[ASYNC_BUFFER_SIZE]; //フレームの要求から取得完了までの時間 (ms)
+
+    //先読みの深さ (要求済みで未読み込みのフレーム数の上限) まで、フレームを要求する
+    void requestAsyncFrames();
+    //スクリプト側の処理待ちの時間をもとに、先読みの深さを調整する
+    void adjustAsyncDepth(double waitMs);
+    void printAsyncStats();
 
     int getRevInfo(const char *vs_version_string);
 
-    bool m_bAbortAsync;
     uint32_t m_nCopyOfInputFrames;
 
     const VSAPI *m_sVSapi;
     VSScript *m_sVSscript;
     VSNodeRef *m_sVSnode;
-    int m_nAsyncFrames;
+    int m_nAsyncFrames;         //要求済みのフレーム数
+
+    int m_asyncDepth;           //先読みの深さ
+    int m_asyncDepthMax;        //先読みの深さの上限 (空きメモリから決定)
+    int m_asyncDepthPeak;
+    int m_asyncSaturatedDepth;  //これ以上深くしても待ち時間が減らなかった深さ
+    int m_asyncSaturatedWindows;
+    int m_asyncLastStep;        //直前の調整で増やした数
+    int m_asyncWindowFrames;
+    double m_asyncWindowWait;   //調整の区間内の待ち時間の合計 (ms)
+    double m_asyncPrevWindowWait;
+    double m_asyncLatencyAvg;   //フレームの要求から取得完了までの時間の移動平均 (ms)
+    double m_asyncDemandAvg;    //1フレームあたりの待ち以外の時間の移動平均 (ms)
+    std::chrono::steady_clock::time_point m_asyncPrevFrameTime;
+    double m_asyncWaitTotal;    //フレームの取得完了を待った時間の合計 (ms)
+    double m_asyncWaitMax;
+    double m_asyncLatencyTotal;
+    int m_asyncWaitCount;       //フレームの取得完了を待ったフレーム数
 
     vsscript_t m_sVS;
 };
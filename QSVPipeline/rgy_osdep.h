@@ -240,7 +240,7 @@ static void SetThreadAffinityMask(pthread_t thread, size_t mask) {
     cpu_set_t cpuset;
     CPU_ZERO(&cpuset);
     for (uint32_t j = 0; j < sizeof(mask) * 8; j++) {
-        if (mask & (1 << j)) {
+        if (mask & ((size_t)1 << j)) {
             CPU_SET(j, &cpuset);
         }
     }
@@ -262,6 +262,7 @@ static void SetThreadPriority(pthread_t thread, int priority) {
 
 #define _fread_nolock fread
 #define _fwrite_nolock fwrite
+#define _fgetc_nolock fgetc
 #define _fseeki64 fseek
 #define _ftelli64 ftell
 
@@ -27,19 +27,23 @@
 
 #include "rgy_output.h"
 #include "rgy_bitstream.h"
+#include "rgy_perf_monitor.h"
 #include <smmintrin.h>
 
 #if ENCODER_QSV
 
-static RGY_ERR WriteY4MHeader(FILE *fp, const VideoInfo *info) {
-    char buffer[256] = { 0 };
+//y4mのヘッダの最大長
+static const size_t Y4M_HEADER_MAX = 256;
+
+//y4mのヘッダを生成し、その長さを返す
+static int GenY4MHeader(char *buffer, size_t bufferSize, const VideoInfo *info) {
     char *ptr = buffer;
-    uint32_t len = 0;
+    int len = 0;
     memcpy(ptr, "YUV4MPEG2 ", 10);
     len += 10;
 
-    len += sprintf_s(ptr+len, sizeof(buffer)-len, "W%d H%d ", info->dstWidth, info->dstHeight);
-    len += sprintf_s(ptr+len, sizeof(buffer)-len, "F%d:%d ", info->fpsN, info->fpsD);
+    len += sprintf_s(ptr+len, bufferSize-len, "W%d H%d ", info->dstWidth, info->dstHeight);
+    len += sprintf_s(ptr+len, bufferSize-len, "F%d:%d ", info->fpsN, info->fpsD);
 
     const char *picstruct = "Ip ";
     if (info->picstruct & RGY_PICSTRUCT_TFF) {
@@ -47,10 +51,49 @@ static RGY_ERR WriteY4MHeader(FILE *fp, const VideoInfo *info) {
     } else if (info->picstruct & RGY_PICSTRUCT_BFF) {
         picstruct = "Ib ";
     }
-    strcpy_s(ptr+len, sizeof(buffer)-len, picstruct); len += 3;
-    len += sprintf_s(ptr+len, sizeof(buffer)-len, "A%d:%d ", info->sar[0], info->sar[1]);
-    strcpy_s(ptr+len, sizeof(buffer)-len, "C420mpeg2\n"); len += (mfxU32)strlen("C420mpeg2\n");
-    return (len == fwrite(buffer, 1, len, fp)) ? RGY_ERR_NONE : RGY_ERR_UNDEFINED_BEHAVIOR;
+    strcpy_s(ptr+len, bufferSize-len, picstruct); len += 3;
+    len += sprintf_s(ptr+len, bufferSize-len, "A%d:%d ", info->sar[0], info->sar[1]);
+    strcpy_s(ptr+len, bufferSize-len, "C420mpeg2\n"); len += (int)strlen("C420mpeg2\n");
+    return len;
+}
+
+//USWCメモリ(ビデオメモリ)からの読み込みは遅いので、ストリーミングロードで1ライン分をバッファに読み込む
+static void load_line_to_buffer(uint8_t *ptrBuf, const uint8_t *ptrSrc, int pitch) {
+    for (int i = 0; i < pitch; i += 128, ptrSrc += 128, ptrBuf += 128) {
+        __m128i x0 = _mm_stream_load_si128((__m128i *)(ptrSrc +   0));
+        __m128i x1 = _mm_stream_load_si128((__m128i *)(ptrSrc +  16));
+        __m128i x2 = _mm_stream_load_si128((__m128i *)(ptrSrc +  32));
+        __m128i x3 = _mm_stream_load_si128((__m128i *)(ptrSrc +  48));
+        __m128i x4 = _mm_stream_load_si128((__m128i *)(ptrSrc +  64));
+        __m128i x5 = _mm_stream_load_si128((__m128i *)(ptrSrc +  80));
+        __m128i x6 = _mm_stream_load_si128((__m128i *)(ptrSrc +  96));
+        __m128i x7 = _mm_stream_load_si128((__m128i *)(ptrSrc + 112));
+        _mm_store_si128((__m128i *)(ptrBuf +   0), x0);
+        _mm_store_si128((__m128i *)(ptrBuf +  16), x1);
+        _mm_store_si128((__m128i *)(ptrBuf +  32), x2);
+        _mm_store_si128((__m128i *)(ptrBuf +  48), x3);
+        _mm_store_si128((__m128i *)(ptrBuf +  64), x4);
+        _mm_store_si128((__m128i *)(ptrBuf +  80), x5);
+        _mm_store_si128((__m128i *)(ptrBuf +  96), x6);
+        _mm_store_si128((__m128i *)(ptrBuf + 112), x7);
+    }
+}
+
+//NV12のUVを、U, Vそれぞれに分離する
+//出力先は連続したフレームバッファ内なので、uvWidthを超えて書き込まないよう端数は1画素ずつ処理する
+static void deinterleave_uv_line(uint8_t *ptrU, uint8_t *ptrV, const uint8_t *ptrUV, uint32_t uvWidth) {
+    const __m128i xMaskLow8 = _mm_set1_epi16(0x00ff);
+    uint32_t i = 0;
+    for (; i + 16 <= uvWidth; i += 16, ptrUV += 32, ptrU += 16, ptrV += 16) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)(ptrUV +  0));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(ptrUV + 16));
+        _mm_storeu_si128((__m128i *)ptrU, _mm_packus_epi16(_mm_and_si128(x0, xMaskLow8), _mm_and_si128(x1, xMaskLow8)));
+        _mm_storeu_si128((__m128i *)ptrV, _mm_packus_epi16(_mm_srli_epi16(x0, 8), _mm_srli_epi16(x1, 8)));
+    }
+    for (; i < uvWidth; i++, ptrUV += 2) {
+        *ptrU++ = ptrUV[0];
+        *ptrV++ = ptrUV[1];
+    }
 }
 
 #endif //#if ENCODER_QSV
@@ -76,7 +119,7 @@ RGYOutput::RGYOutput() :
     m_printMes(),
     m_outputBuffer(),
     m_readBuffer(),
-    m_UVBuffer() {
+    m_asyncWriter() {
     memset(&m_VideoOutputInfo, 0, sizeof(m_VideoOutputInfo));
 }
 
@@ -88,6 +131,7 @@ RGYOutput::~RGYOutput() {
 
 void RGYOutput::Close() {
     AddMessage(RGY_LOG_DEBUG, _T("Closing...\n"));
+    closeAsyncWriter();
     if (m_fDest) {
         m_fDest.reset();
         AddMessage(RGY_LOG_DEBUG, _T("Closed file pointer.\n"));
@@ -95,7 +139,6 @@ void RGYOutput::Close() {
     m_encSatusInfo.reset();
     m_outputBuffer.reset();
     m_readBuffer.reset();
-    m_UVBuffer.reset();
 
     m_noOutput = false;
     m_inited = false;
@@ -105,8 +148,42 @@ void RGYOutput::Close() {
     m_printMes.reset();
 }
 
+RGY_ERR RGYOutput::openAsyncWriter(const TCHAR *strFileName, int bufSizeMB, PerfQueueInfo *queueInfo) {
+    CreateDirectoryRecursive(PathRemoveFileSpecFixed(strFileName).second.c_str());
+    m_asyncWriter.reset(new RGYAsyncFileWriter());
+    const size_t bufferSizeByte = (size_t)clamp(bufSizeMB, 0, RGY_OUTPUT_BUF_MB_MAX) * 1024 * 1024;
+    if (m_asyncWriter->open(strFileName, bufferSizeByte, queueInfo) != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to open output file \"%s\".\n"), strFileName);
+        m_asyncWriter.reset();
+        return RGY_ERR_FILE_OPEN;
+    }
+    AddMessage(RGY_LOG_DEBUG, _T("Opened file \"%s\" with async writer, %d blocks x %d KB.\n"),
+        strFileName, m_asyncWriter->blockCount(), (int)(m_asyncWriter->blockSize() / 1024));
+    return RGY_ERR_NONE;
+}
+
+void RGYOutput::closeAsyncWriter() {
+    if (m_asyncWriter) {
+        if (m_asyncWriter->close() != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("Error writing file.\nNot enough disk space!\n"));
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("async writer: %.2f MB written (direct %.2f MB), waited for free block %d times, %.3f ms.\n"),
+            m_asyncWriter->bytesWritten() / (double)(1024 * 1024), m_asyncWriter->bytesWrittenDirect() / (double)(1024 * 1024),
+            (int)m_asyncWriter->waitCount(), m_asyncWriter->waitTimeUs() / 1000.0);
+        m_asyncWriter.reset();
+    }
+}
+
+size_t RGYOutput::writeData(const void *data, size_t size) {
+    if (m_asyncWriter) {
+        return m_asyncWriter->write(data, size);
+    }
+    return _fwrite_nolock(data, 1, size, m_fDest.get());
+}
+
 RGYOutputRaw::RGYOutputRaw() :
-    m_seiNal()
+    m_seiNal(),
+    m_nalList()
 #if ENABLE_AVSW_READER
     , m_pBsfc()
 #endif //#if ENABLE_AVSW_READER
@@ -139,6 +216,11 @@ RGY_ERR RGYOutputRaw::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutp
             m_fDest.reset(stdout);
             m_outputIsStdout = true;
             AddMessage(RGY_LOG_DEBUG, _T("using stdout\n"));
+        } else if (rawPrm->asyncWrite) {
+            auto sts = openAsyncWriter(strFileName, rawPrm->bufSizeMB, rawPrm->queueInfo);
+            if (sts != RGY_ERR_NONE) {
+                return sts;
+            }
         } else {
             CreateDirectoryRecursive(PathRemoveFileSpecFixed(strFileName).second.c_str());
             FILE *fp = NULL;
@@ -284,16 +366,16 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
 #if ENABLE_AVSW_READER
         if (m_pBsfc) {
             uint8_t nal_type = 0;
-            std::vector<nal_info> nal_list;
+            m_nalList.clear();
             if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
                 nal_type = NALU_HEVC_SPS;
-                nal_list = parse_nal_unit_hevc(pBitstream->data(), pBitstream->size());
+                parse_nal_unit_hevc(pBitstream->data(), pBitstream->size(), m_nalList);
             } else if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
                 nal_type = NALU_H264_SPS;
-                nal_list = parse_nal_unit_h264(pBitstream->data(), pBitstream->size());
+                parse_nal_unit_h264(pBitstream->data(), pBitstream->size(), m_nalList);
             }
-            auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
-            if (sps_nal != nal_list.end()) {
+            const nal_info *sps_nal = m_nalList.find(nal_type);
+            if (sps_nal) {
                 AVPacket pkt = { 0 };
                 av_init_packet(&pkt);
                 av_new_packet(&pkt, (int)sps_nal->size);
@@ -330,19 +412,19 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
         }
 #endif //#if ENABLE_AVSW_READER
         if (m_seiNal.size()) {
-            const auto nal_list     = parse_nal_unit_hevc(pBitstream->data(), pBitstream->size());
-            const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
-            const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
-            const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
-            const bool header_check = (nal_list.end() != hevc_vps_nal) && (nal_list.end() != hevc_sps_nal) && (nal_list.end() != hevc_pps_nal);
+            parse_nal_unit_hevc(pBitstream->data(), pBitstream->size(), m_nalList);
+            const auto hevc_vps_nal = m_nalList.find(NALU_HEVC_VPS);
+            const auto hevc_sps_nal = m_nalList.find(NALU_HEVC_SPS);
+            const auto hevc_pps_nal = m_nalList.find(NALU_HEVC_PPS);
+            const bool header_check = hevc_vps_nal && hevc_sps_nal && hevc_pps_nal;
             if (header_check) {
-                nBytesWritten  = _fwrite_nolock(hevc_vps_nal->ptr, 1, hevc_vps_nal->size, m_fDest.get());
-                nBytesWritten += _fwrite_nolock(hevc_sps_nal->ptr, 1, hevc_sps_nal->size, m_fDest.get());
-                nBytesWritten += _fwrite_nolock(hevc_pps_nal->ptr, 1, hevc_pps_nal->size, m_fDest.get());
-                nBytesWritten += _fwrite_nolock(m_seiNal.data(),   1, m_seiNal.size(),    m_fDest.get());
-                for (const auto& nal : nal_list) {
+                nBytesWritten  = writeData(hevc_vps_nal->ptr, hevc_vps_nal->size);
+                nBytesWritten += writeData(hevc_sps_nal->ptr, hevc_sps_nal->size);
+                nBytesWritten += writeData(hevc_pps_nal->ptr, hevc_pps_nal->size);
+                nBytesWritten += writeData(m_seiNal.data(),   m_seiNal.size());
+                for (const auto& nal : m_nalList) {
                     if (nal.type != NALU_HEVC_VPS && nal.type != NALU_HEVC_SPS && nal.type != NALU_HEVC_PPS) {
-                        nBytesWritten += _fwrite_nolock(nal.ptr, 1, nal.size, m_fDest.get());
+                        nBytesWritten += writeData(nal.ptr, nal.size);
                     }
                 }
             } else {
@@ -351,7 +433,7 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
             }
             m_seiNal.clear();
         } else {
-            nBytesWritten = _fwrite_nolock(pBitstream->data(), 1, pBitstream->size(), m_fDest.get());
+            nBytesWritten = writeData(pBitstream->data(), pBitstream->size());
             WRITE_CHECK(nBytesWritten, pBitstream->size());
         }
     }
@@ -369,7 +451,10 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYFrame *pSurface) {
 
 #if ENCODER_QSV
 
-RGYOutFrame::RGYOutFrame() : m_bY4m(true) {
+RGYOutFrame::RGYOutFrame() :
+    m_bY4m(true),
+    m_frameBuffer(),
+    m_frameBufferSize(0) {
     m_strWriterName = _T("yuv writer");
     m_OutType = OUT_TYPE_SURFACE;
 };
@@ -379,10 +464,16 @@ RGYOutFrame::~RGYOutFrame() {
 
 RGY_ERR RGYOutFrame::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutputInfo, const void *prm) {
     UNREFERENCED_PARAMETER(pVideoOutputInfo);
+    YUVWriterParam *writerParam = (YUVWriterParam *)prm;
     if (_tcscmp(strFileName, _T("-")) == 0) {
         m_fDest.reset(stdout);
         m_outputIsStdout = true;
         AddMessage(RGY_LOG_DEBUG, _T("using stdout\n"));
+    } else if (writerParam->asyncWrite) {
+        auto sts = openAsyncWriter(strFileName, writerParam->bufSizeMB, writerParam->queueInfo);
+        if (sts != RGY_ERR_NONE) {
+            return sts;
+        }
     } else {
         FILE *fp = NULL;
         int error = _tfopen_s(&fp, strFileName, _T("wb"));
@@ -393,8 +484,6 @@ RGY_ERR RGYOutFrame::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutpu
         m_fDest.reset(fp);
     }
 
-    YUVWriterParam *writerParam = (YUVWriterParam *)prm;
-
     m_bY4m = writerParam->bY4m;
     m_sourceHWMem = true;
     m_inited = true;
@@ -402,13 +491,19 @@ RGY_ERR RGYOutFrame::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutpu
     return RGY_ERR_NONE;
 }
 
+void RGYOutFrame::Close() {
+    m_frameBuffer.reset();
+    m_frameBufferSize = 0;
+    RGYOutput::Close();
+}
+
 RGY_ERR RGYOutFrame::WriteNextFrame(RGYBitstream *pBitstream) {
     UNREFERENCED_PARAMETER(pBitstream);
     return RGY_ERR_UNSUPPORTED;
 }
 
 RGY_ERR RGYOutFrame::WriteNextFrame(RGYFrame *pSurface) {
-    if (!m_fDest) {
+    if (!m_fDest && !m_asyncWriter) {
         return RGY_ERR_NULL_PTR;
     }
 
@@ -417,130 +512,106 @@ RGY_ERR RGYOutFrame::WriteNextFrame(RGYFrame *pSurface) {
             m_readBuffer.reset((uint8_t *)_aligned_malloc(pSurface->pitch() + 128, 16));
         }
     }
+    //HWメモリの場合はストリーミングロードでバッファに読み込んでから、そうでなければ直接参照する
+    auto loadLine = [this](const uint8_t *ptrSrc, int pitch) {
+        if (m_sourceHWMem) {
+            load_line_to_buffer(m_readBuffer.get(), ptrSrc, pitch);
+            return (const uint8_t *)m_readBuffer.get();
+        }
+        return ptrSrc;
+    };
+
+    const uint32_t lumaWidthBytes = pSurface->width() << ((pSurface->csp() == RGY_CSP_P010) ? 1 : 0);
+    const uint32_t uvWidth = pSurface->width() >> 1;
+    const uint32_t uvHeight = pSurface->height() >> 1;
+    uint32_t frameSize = 0;
+    size_t outputSize = 0; //書き出す画像データのサイズ
+    switch ((int)pSurface->csp()) {
+    case RGY_CSP_YV12:
+    case RGY_CSP_NV12:
+        frameSize = lumaWidthBytes * pSurface->height() * 3 / 2;
+        outputSize = (size_t)lumaWidthBytes * pSurface->height() + (size_t)uvWidth * uvHeight * 2;
+        break;
+    case RGY_CSP_P010:
+        frameSize = lumaWidthBytes * pSurface->height() * 3 / 2;
+        outputSize = (size_t)lumaWidthBytes * pSurface->height() + (size_t)uvHeight * (pSurface->width() << 1);
+        break;
+    case RGY_CSP_RGB32R:
+    case 100: //DXGI_FORMAT_AYUV
+    /*case RGY_CSP_A2RGB10:*/
+        frameSize = lumaWidthBytes * pSurface->height() * 4;
+        outputSize = (size_t)pSurface->width() * pSurface->height() * 4;
+        break;
+    default:
+        return RGY_ERR_INVALID_COLOR_FORMAT;
+    }
 
+    //y4mのヘッダを含むフレーム全体を1つのバッファに詰めてから、まとめて書き出す
+    const size_t bufferSize = Y4M_HEADER_MAX + strlen("FRAME\n") + outputSize;
+    if (m_frameBufferSize < bufferSize) {
+        m_frameBuffer.reset((uint8_t *)_aligned_malloc(bufferSize, 64));
+        if (!m_frameBuffer) {
+            m_frameBufferSize = 0;
+            return RGY_ERR_MEMORY_ALLOC;
+        }
+        m_frameBufferSize = bufferSize;
+    }
+    uint8_t *ptrDst = m_frameBuffer.get();
     if (m_bY4m) {
         if (!m_y4mHeaderWritten) {
-            WriteY4MHeader(m_fDest.get(), &m_VideoOutputInfo);
+            ptrDst += GenY4MHeader((char *)ptrDst, Y4M_HEADER_MAX, &m_VideoOutputInfo);
             m_y4mHeaderWritten = true;
         }
-        WRITE_CHECK(fwrite("FRAME\n", 1, strlen("FRAME\n"), m_fDest.get()), strlen("FRAME\n"));
+        memcpy(ptrDst, "FRAME\n", strlen("FRAME\n"));
+        ptrDst += strlen("FRAME\n");
     }
 
-    auto loadLineToBuffer = [](uint8_t *ptrBuf, uint8_t *ptrSrc, int pitch) {
-        for (int i = 0; i < pitch; i += 128, ptrSrc += 128, ptrBuf += 128) {
-            __m128i x0 = _mm_stream_load_si128((__m128i *)(ptrSrc +   0));
-            __m128i x1 = _mm_stream_load_si128((__m128i *)(ptrSrc +  16));
-            __m128i x2 = _mm_stream_load_si128((__m128i *)(ptrSrc +  32));
-            __m128i x3 = _mm_stream_load_si128((__m128i *)(ptrSrc +  48));
-            __m128i x4 = _mm_stream_load_si128((__m128i *)(ptrSrc +  64));
-            __m128i x5 = _mm_stream_load_si128((__m128i *)(ptrSrc +  80));
-            __m128i x6 = _mm_stream_load_si128((__m128i *)(ptrSrc +  96));
-            __m128i x7 = _mm_stream_load_si128((__m128i *)(ptrSrc + 112));
-            _mm_store_si128((__m128i *)(ptrBuf +   0), x0);
-            _mm_store_si128((__m128i *)(ptrBuf +  16), x1);
-            _mm_store_si128((__m128i *)(ptrBuf +  32), x2);
-            _mm_store_si128((__m128i *)(ptrBuf +  48), x3);
-            _mm_store_si128((__m128i *)(ptrBuf +  64), x4);
-            _mm_store_si128((__m128i *)(ptrBuf +  80), x5);
-            _mm_store_si128((__m128i *)(ptrBuf +  96), x6);
-            _mm_store_si128((__m128i *)(ptrBuf + 112), x7);
-        }
-    };
-
-    const uint32_t lumaWidthBytes = pSurface->width() << ((pSurface->csp() == RGY_CSP_P010) ? 1 : 0);
+    const auto crop = pSurface->crop().e;
     if (   pSurface->csp() == RGY_CSP_YV12
         || pSurface->csp() == RGY_CSP_NV12
         || pSurface->csp() == RGY_CSP_P010) {
-        const uint32_t cropOffset = pSurface->crop().e.up * pSurface->pitch() + pSurface->crop().e.left;
-        if (m_sourceHWMem) {
-            for (uint32_t j = 0; j < pSurface->height(); j++) {
-                uint8_t *ptrBuf = m_readBuffer.get();
-                uint8_t *ptrSrc = pSurface->ptrY() + (pSurface->crop().e.up + j) * pSurface->pitch();
-                loadLineToBuffer(ptrBuf, ptrSrc, pSurface->pitch());
-                WRITE_CHECK(fwrite(ptrBuf + pSurface->crop().e.left, 1, lumaWidthBytes, m_fDest.get()), lumaWidthBytes);
-            }
-        } else {
-            for (uint32_t j = 0; j < pSurface->height(); j++) {
-                WRITE_CHECK(fwrite(pSurface->ptrY() + cropOffset + j * pSurface->pitch(), 1, lumaWidthBytes, m_fDest.get()), lumaWidthBytes);
-            }
+        for (uint32_t j = 0; j < pSurface->height(); j++, ptrDst += lumaWidthBytes) {
+            const uint8_t *ptrSrc = loadLine(pSurface->ptrY() + (crop.up + j) * pSurface->pitch(), pSurface->pitch());
+            memcpy(ptrDst, ptrSrc + crop.left, lumaWidthBytes);
         }
     }
 
-    uint32_t frameSize = 0;
     if (pSurface->csp() == RGY_CSP_YV12) {
-        frameSize = lumaWidthBytes * pSurface->height() * 3 / 2;
-
-        uint32_t uvPitch = pSurface->pitch() >> 1;
-        uint32_t uvWidth = pSurface->width() >> 1;
-        uint32_t uvHeight = pSurface->height() >> 1;
-        uint8_t *ptrBuf = m_readBuffer.get();
-        for (uint32_t i = 0; i < uvHeight; i++) {
-            loadLineToBuffer(ptrBuf, pSurface->ptrU() + (pSurface->crop().e.up + i) * uvPitch, uvPitch);
-            WRITE_CHECK(fwrite(ptrBuf + (pSurface->crop().e.left >> 1), 1, uvWidth, m_fDest.get()), uvWidth);
+        const uint32_t uvPitch = pSurface->pitch() >> 1;
+        for (uint32_t i = 0; i < uvHeight; i++, ptrDst += uvWidth) {
+            const uint8_t *ptrSrc = loadLine(pSurface->ptrU() + (crop.up + i) * uvPitch, uvPitch);
+            memcpy(ptrDst, ptrSrc + (crop.left >> 1), uvWidth);
         }
-        for (uint32_t i = 0; i < uvHeight; i++) {
-            loadLineToBuffer(ptrBuf, pSurface->ptrV() + (pSurface->crop().e.up + i) * uvPitch, uvPitch);
-            WRITE_CHECK(fwrite(ptrBuf + (pSurface->crop().e.left >> 1), 1, uvWidth, m_fDest.get()), uvWidth);
+        for (uint32_t i = 0; i < uvHeight; i++, ptrDst += uvWidth) {
+            const uint8_t *ptrSrc = loadLine(pSurface->ptrV() + (crop.up + i) * uvPitch, uvPitch);
+            memcpy(ptrDst, ptrSrc + (crop.left >> 1), uvWidth);
         }
     } else if (pSurface->csp() == RGY_CSP_NV12) {
-        frameSize = lumaWidthBytes * pSurface->height() * 3 / 2;
-        uint32_t uvWidth = pSurface->width() >> 1;
-        //uint32_t nv12Width = pSurface->width();
-        uint32_t uvHeight = pSurface->height() >> 1;
-        uint32_t uvFrameOffset = ALIGN16(uvWidth * uvHeight + 16);
-        if (m_UVBuffer.get() == nullptr) {
-            m_UVBuffer.reset((uint8_t *)_aligned_malloc(uvFrameOffset << 1, 32));
-        }
-
-        alignas(16) static const uint16_t MASK_LOW8[] = {
-            0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff
-        };
-        const __m128i xMaskLow8 = _mm_load_si128((__m128i *)MASK_LOW8);
-
-        for (uint32_t j = 0; j < uvHeight; j++) {
-            uint8_t *ptrBuf = m_readBuffer.get();
-            uint8_t *ptrSrc = pSurface->ptrUV() + (pSurface->crop().e.up + j) * pSurface->pitch();
-            if (m_sourceHWMem) {
-                loadLineToBuffer(ptrBuf, ptrSrc, pSurface->pitch());
-            } else {
-                ptrBuf = ptrSrc;
-            }
-
-            uint8_t *ptrUV = ptrBuf + pSurface->crop().e.left;
-            uint8_t *ptrU = m_UVBuffer.get() + j * uvWidth;
-            uint8_t *ptrV = ptrU + uvFrameOffset;
-            for (uint32_t i = 0; i < uvWidth; i += 16, ptrUV += 32, ptrU += 16, ptrV += 16) {
-                __m128i x0 = _mm_loadu_si128((__m128i *)(ptrUV +  0));
-                __m128i x1 = _mm_loadu_si128((__m128i *)(ptrUV + 16));
-                _mm_storeu_si128((__m128i *)ptrU, _mm_packus_epi16(_mm_and_si128(x0, xMaskLow8), _mm_and_si128(x1, xMaskLow8)));
-                _mm_storeu_si128((__m128i *)ptrV, _mm_packus_epi16(_mm_srli_epi16(x0, 8), _mm_srli_epi16(x1, 8)));
-            }
+        //U, Vの各平面に直接分離する
+        uint8_t *ptrDstU = ptrDst;
+        uint8_t *ptrDstV = ptrDst + uvWidth * uvHeight;
+        for (uint32_t j = 0; j < uvHeight; j++, ptrDstU += uvWidth, ptrDstV += uvWidth) {
+            const uint8_t *ptrSrc = loadLine(pSurface->ptrUV() + (crop.up + j) * pSurface->pitch(), pSurface->pitch());
+            deinterleave_uv_line(ptrDstU, ptrDstV, ptrSrc + crop.left, uvWidth);
         }
-        WRITE_CHECK(fwrite(m_UVBuffer.get(), 1, uvWidth * uvHeight, m_fDest.get()), uvWidth * uvHeight);
-        WRITE_CHECK(fwrite(m_UVBuffer.get() + uvFrameOffset, 1, uvWidth * uvHeight, m_fDest.get()), uvWidth * uvHeight);
+        ptrDst = ptrDstV;
     } else if (pSurface->csp() == RGY_CSP_P010) {
-        frameSize = lumaWidthBytes * pSurface->height() * 3 / 2;
-        uint8_t *ptrBuf = m_readBuffer.get();
-        for (uint32_t i = 0; i < (uint32_t)(pSurface->height() >> 1); i++) {
-            loadLineToBuffer(ptrBuf, pSurface->ptrUV() + pSurface->crop().e.up * (pSurface->pitch() >> 1) + i * pSurface->pitch(), pSurface->pitch());
-            WRITE_CHECK(fwrite(ptrBuf + pSurface->crop().e.left, 1, (uint32_t)pSurface->width() << 1, m_fDest.get()), (uint32_t)pSurface->width() << 1);
-        }
-    } else if (pSurface->csp() == RGY_CSP_RGB32R
-        || pSurface->csp() == 100 //DXGI_FORMAT_AYUV
-        /*|| pSurface->csp() == RGY_CSP_A2RGB10*/) {
-        frameSize = lumaWidthBytes * pSurface->height() * 4;
-        uint32_t w = pSurface->width();
-        uint32_t h = pSurface->height();
-
-        uint8_t *ptr = pSurface->ptrRGB() + pSurface->crop().e.left + pSurface->crop().e.up * pSurface->pitch();
-
-        for (uint32_t i = 0; i < h; i++) {
-            WRITE_CHECK(fwrite(ptr + i * pSurface->pitch(), 1, 4*w, m_fDest.get()), 4*w);
+        const uint32_t uvWidthBytes = (uint32_t)pSurface->width() << 1;
+        for (uint32_t i = 0; i < uvHeight; i++, ptrDst += uvWidthBytes) {
+            const uint8_t *ptrSrc = loadLine(pSurface->ptrUV() + crop.up * (pSurface->pitch() >> 1) + i * pSurface->pitch(), pSurface->pitch());
+            memcpy(ptrDst, ptrSrc + crop.left, uvWidthBytes);
         }
     } else {
-        return RGY_ERR_INVALID_COLOR_FORMAT;
+        const uint32_t rgbWidthBytes = pSurface->width() * 4;
+        const uint8_t *ptrSrc = pSurface->ptrRGB() + crop.left + crop.up * pSurface->pitch();
+        for (uint32_t i = 0; i < pSurface->height(); i++, ptrDst += rgbWidthBytes) {
+            memcpy(ptrDst, ptrSrc + i * pSurface->pitch(), rgbWidthBytes);
+        }
     }
 
+    const size_t writeSize = ptrDst - m_frameBuffer.get();
+    WRITE_CHECK(writeData(m_frameBuffer.get(), writeSize), writeSize);
+
     m_encSatusInfo->SetOutputData(frametype_enc_to_rgy(MFX_FRAMETYPE_IDR | MFX_FRAMETYPE_I), frameSize, 0);
     return RGY_ERR_NONE;
 }
@@ -627,6 +698,7 @@ RGY_ERR initWriters(
         writerPrm.threadOutput           = ctrl->threadOutput;
         writerPrm.threadAudio            = ctrl->threadAudio;
         writerPrm.bufSizeMB              = common->outputBufSizeMB;
+        writerPrm.asyncWrite             = common->outputAsync;
         writerPrm.audioResampler         = common->audioResampler;
         writerPrm.audioIgnoreDecodeError = common->audioIgnoreDecodeError;
         writerPrm.queueInfo = (pPerfMonitor) ? pPerfMonitor->GetQueueInfoPtr() : nullptr;
@@ -636,6 +708,7 @@ RGY_ERR initWriters(
         writerPrm.videoCodecTag           = common->videoCodecTag;
         writerPrm.afs                     = isAfs;
         writerPrm.disableMp4Opt           = common->disableMp4Opt;
+        writerPrm.mp4Fragment             = common->mp4Fragment;
         if (common->muxOpt > 0) {
             writerPrm.muxOpt = *common->muxOpt;
         }
@@ -880,6 +953,9 @@ RGY_ERR initWriters(
             pFileWriter = std::make_shared<RGYOutFrame>();
             YUVWriterParam param;
             param.bY4m = true;
+            param.bufSizeMB = common->outputBufSizeMB;
+            param.asyncWrite = common->outputAsync;
+            param.queueInfo = (pPerfMonitor) ? pPerfMonitor->GetQueueInfoPtr() : nullptr;
             auto sts = pFileWriter->Init(common->outputFilename.c_str(), &outputVideoInfo, &param, log, pStatus);
             if (sts != RGY_ERR_NONE) {
                 log->write(RGY_LOG_ERROR, pFileWriter->GetOutputMessage());
@@ -893,6 +969,8 @@ RGY_ERR initWriters(
             pFileWriter = std::make_shared<RGYOutputRaw>();
             RGYOutputRawPrm rawPrm;
             rawPrm.bufSizeMB = common->outputBufSizeMB;
+            rawPrm.asyncWrite = common->outputAsync;
+            rawPrm.queueInfo = (pPerfMonitor) ? pPerfMonitor->GetQueueInfoPtr() : nullptr;
             rawPrm.benchmark = benchmark;
             rawPrm.codecId = outputVideoInfo.codec;
             rawPrm.seiNal = hedrsei.gen_nal();
@@ -954,6 +1032,7 @@ RGY_ERR initWriters(
                 writerAudioPrm.threadOutput   = ctrl->threadOutput;
                 writerAudioPrm.threadAudio    = ctrl->threadAudio;
                 writerAudioPrm.bufSizeMB      = common->outputBufSizeMB;
+                writerAudioPrm.asyncWrite     = common->outputAsync;
                 writerAudioPrm.outputFormat   = pAudioSelect->extractFormat;
                 writerAudioPrm.audioIgnoreDecodeError = common->audioIgnoreDecodeError;
                 writerAudioPrm.audioResampler = common->audioResampler;
@@ -39,6 +39,8 @@
 #include "rgy_status.h"
 #include "rgy_avutil.h"
 #include "rgy_input.h"
+#include "rgy_bitstream.h"
+#include "rgy_async_writer.h"
 #if ENCODER_NVENC
 #include "NVEncUtil.h"
 #endif //#if ENCODER_NVENC
@@ -162,6 +164,12 @@ public:
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) = 0;
 
+    //出力ファイルを非同期書き込みで開く
+    RGY_ERR openAsyncWriter(const TCHAR *strFileName, int bufSizeMB, PerfQueueInfo *queueInfo);
+    void closeAsyncWriter();
+    //非同期書き込みを使用している場合はそちらに、そうでなければm_fDestに書き込む
+    size_t writeData(const void *data, size_t size);
+
     shared_ptr<EncodeStatus> m_encSatusInfo;
     unique_ptr<FILE, fp_deleter>  m_fDest;
     bool        m_outputIsStdout;
@@ -176,12 +184,14 @@ protected:
     shared_ptr<RGYLog> m_printMes;  //ログ出力
     unique_ptr<char, malloc_deleter>            m_outputBuffer;
     unique_ptr<uint8_t, aligned_malloc_deleter> m_readBuffer;
-    unique_ptr<uint8_t, aligned_malloc_deleter> m_UVBuffer;
+    unique_ptr<RGYAsyncFileWriter> m_asyncWriter; //非同期書き込み (使用しない場合はnullptr)
 };
 
 struct RGYOutputRawPrm {
     bool benchmark;
     int bufSizeMB;
+    bool asyncWrite;            //書き込みスレッドで非同期に書き込む
+    PerfQueueInfo *queueInfo;   //キューの情報を格納する構造体
     RGY_CODEC codecId;
     vector<uint8_t> seiNal;
 };
@@ -198,6 +208,7 @@ protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) override;
 
     vector<uint8_t> m_seiNal;
+    RGYNalList m_nalList; //NALの解析結果 (フレームごとに再利用する)
 #if ENABLE_AVSW_READER
     unique_ptr<AVBSFContext, RGYAVDeleter<AVBSFContext>> m_pBsfc;
 #endif //#if ENABLE_AVSW_READER
@@ -229,6 +240,9 @@ RGY_ERR initWriters(
 
 struct YUVWriterParam {
     bool bY4m;
+    int bufSizeMB;
+    bool asyncWrite;            //書き込みスレッドで非同期に書き込む
+    PerfQueueInfo *queueInfo;   //キューの情報を格納する構造体
 };
 
 class RGYOutFrame : public RGYOutput {
@@ -239,10 +253,13 @@ public:
 
     virtual RGY_ERR WriteNextFrame(RGYBitstream *pBitstream) override;
     virtual RGY_ERR WriteNextFrame(RGYFrame *pSurface) override;
+    virtual void Close() override;
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) override;
 
     bool m_bY4m;
+    unique_ptr<uint8_t, aligned_malloc_deleter> m_frameBuffer; //1フレーム分の出力データ (y4mのヘッダを含む)
+    size_t m_frameBufferSize;
 };
 
 #endif //#if ENCODER_QSV
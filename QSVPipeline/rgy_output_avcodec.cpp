@@ -30,6 +30,8 @@
 #include <cctype>
 #include <cmath>
 #include <memory>
+#include <queue>
+#include <functional>
 #include "rgy_osdep.h"
 #include "rgy_util.h"
 #include "rgy_output_avcodec.h"
@@ -54,6 +56,134 @@ static int64_t funcSeek(void *opaque, int64_t offset, int whence) {
 
 const AVRational RGYOutputAvcodec::QUEUE_DTS_TIMEBASE = av_make_q(1, 90000);
 
+#if ENABLE_AVCODEC_OUT_THREAD
+//トラック並列処理時に、このスレッドで処理中のパケット
+//設定されていれば、AddAudQueueは出力キューではなく、このパケットの処理結果に追加する
+static thread_local AVMuxAudioProcessItem *t_audProcessItem = nullptr;
+
+RGYBitstreamPool::RGYBitstreamPool() :
+    m_mtx(),
+    m_free(),
+    m_leases(),
+    m_leaseFree(),
+    m_maxBytesOut(0),
+    m_maxFree(0),
+    m_bytesOut(0),
+    m_peakBytesOut(0),
+    m_countAlloc(0),
+    m_countSwapped(0),
+    m_countCopied(0) {
+}
+
+RGYBitstreamPool::~RGYBitstreamPool() {
+    close();
+}
+
+void RGYBitstreamPool::init(size_t maxBytesOut, int maxFree) {
+    close();
+    m_maxBytesOut = maxBytesOut;
+    m_maxFree = maxFree;
+    m_free.reserve(maxFree);
+}
+
+void RGYBitstreamPool::close() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    for (auto& buf : m_free) {
+        _aligned_free(buf.first);
+    }
+    m_free.clear();
+    //AVBufferRefから参照されているバッファは、参照がなくなった時点で解放される
+    //そのためm_leasesは解放せずに残しておく
+    m_bytesOut = 0;
+    m_peakBytesOut = 0;
+    m_countAlloc = 0;
+    m_countSwapped = 0;
+    m_countCopied = 0;
+}
+
+RGY_ERR RGYBitstreamPool::get(RGYBitstream *pBitstream, size_t bufsize, int *lease) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    //bufsize以上で、最も小さい空きバッファを使用する
+    auto target = m_free.end();
+    for (auto it = m_free.begin(); it != m_free.end(); it++) {
+        if (it->second >= bufsize && (target == m_free.end() || it->second < target->second)) {
+            target = it;
+        }
+    }
+    if (target != m_free.end()) {
+        pBitstream->attach(target->first, target->second);
+        m_free.erase(target);
+    } else {
+        //足りないサイズの空きバッファが残り続けないよう、一つ解放しておく
+        if (m_free.size() > 0) {
+            _aligned_free(m_free.front().first);
+            m_free.erase(m_free.begin());
+        }
+        auto ptr = (uint8_t *)_aligned_malloc(bufsize, 32);
+        if (ptr == nullptr) {
+            return RGY_ERR_NULL_PTR;
+        }
+        pBitstream->attach(ptr, bufsize);
+        m_countAlloc++;
+    }
+    if (m_leaseFree.size() > 0) {
+        *lease = m_leaseFree.back();
+        m_leaseFree.pop_back();
+    } else {
+        *lease = (int)m_leases.size();
+        m_leases.push_back(std::unique_ptr<Lease>(new Lease()));
+        m_leases.back()->pool = this;
+        m_leases.back()->index = *lease;
+    }
+    //返却時にはバッファのサイズが変わっている可能性があるので、ここで計上したサイズを記録しておく
+    m_leases[*lease]->bytesOut = pBitstream->bufsize();
+    m_leases[*lease]->bufsize = 0;
+    m_bytesOut += pBitstream->bufsize();
+    m_peakBytesOut = (std::max)(m_peakBytesOut, m_bytesOut);
+    return RGY_ERR_NONE;
+}
+
+bool RGYBitstreamPool::canSwap(size_t bufsize) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_bytesOut + bufsize <= m_maxBytesOut;
+}
+
+void RGYBitstreamPool::releaseBuffer(uint8_t *bufptr, size_t bufsize, int lease) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_bytesOut -= (std::min)(m_bytesOut, m_leases[lease]->bytesOut);
+    m_leaseFree.push_back(lease);
+    if (bufptr == nullptr) {
+        return;
+    }
+    if ((int)m_free.size() < m_maxFree) {
+        m_free.push_back(std::make_pair(bufptr, bufsize));
+    } else {
+        //あまり多すぎると無駄にメモリを使用するので減らす
+        _aligned_free(bufptr);
+    }
+}
+
+void RGYBitstreamPool::release(RGYBitstream *pBitstream, int lease) {
+    releaseBuffer(pBitstream->bufptr(), pBitstream->bufsize(), lease);
+    pBitstream->detach();
+}
+
+AVBufferRef *RGYBitstreamPool::wrap(RGYBitstream *pBitstream, int lease) {
+    Lease *pLease = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        pLease = m_leases[lease].get();
+        pLease->bufsize = pBitstream->bufsize();
+    }
+    return av_buffer_create(pBitstream->bufptr(), (int)pBitstream->bufsize(), releaseAVBuffer, pLease, 0);
+}
+
+void RGYBitstreamPool::releaseAVBuffer(void *opaque, uint8_t *data) {
+    auto lease = reinterpret_cast<Lease *>(opaque);
+    lease->pool->releaseBuffer(data, lease->bufsize, lease->index);
+}
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
+
 RGYOutputAvcodec::RGYOutputAvcodec() {
     memset(&m_Mux.format, 0, sizeof(m_Mux.format));
     memset(&m_Mux.video,  0, sizeof(m_Mux.video));
@@ -127,6 +257,8 @@ void RGYOutputAvcodec::CloseVideo(AVMuxVideo *muxVideo) {
     if (m_Mux.video.bsfc) {
         av_bsf_free(&m_Mux.video.bsfc);
     }
+    AddMessage(RGY_LOG_DEBUG, _T("nal list: capacity %d, heap allocations %d.\n"), (int)m_nalList.capacity(), m_nalList.allocCount());
+    m_nalList.clear();
     memset(muxVideo, 0, sizeof(muxVideo[0]));
     AddMessage(RGY_LOG_DEBUG, _T("Closed video.\n"));
 }
@@ -137,7 +269,7 @@ void RGYOutputAvcodec::CloseFormat(AVMuxFormat *muxFormat) {
             av_write_trailer(muxFormat->formatCtx);
         }
 #if USE_CUSTOM_IO
-        if (!muxFormat->fpOutput) {
+        if (!muxFormat->fpOutput && !muxFormat->asyncWriter) {
 #endif
             avio_close(muxFormat->formatCtx->pb);
             AddMessage(RGY_LOG_DEBUG, _T("Closed AVIO Context.\n"));
@@ -153,6 +285,16 @@ void RGYOutputAvcodec::CloseFormat(AVMuxFormat *muxFormat) {
         fclose(muxFormat->fpOutput);
         AddMessage(RGY_LOG_DEBUG, _T("Closed File Pointer.\n"));
     }
+    if (muxFormat->asyncWriter) {
+        if (muxFormat->asyncWriter->close() != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("Error writing file.\nNot enough disk space!\n"));
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("async writer: %.2f MB written (direct %.2f MB), waited for free block %d times, %.3f ms.\n"),
+            muxFormat->asyncWriter->bytesWritten() / (double)(1024 * 1024), muxFormat->asyncWriter->bytesWrittenDirect() / (double)(1024 * 1024),
+            (int)muxFormat->asyncWriter->waitCount(), muxFormat->asyncWriter->waitTimeUs() / 1000.0);
+        delete muxFormat->asyncWriter;
+        AddMessage(RGY_LOG_DEBUG, _T("Closed async writer.\n"));
+    }
 
     if (muxFormat->AVOutBuffer) {
         av_free(muxFormat->AVOutBuffer);
@@ -171,9 +313,7 @@ void RGYOutputAvcodec::CloseQueues() {
     m_Mux.thread.thAudEncodeAbort = true;
     m_Mux.thread.thAudProcessAbort = true;
     m_Mux.thread.abortOutput = true;
-    m_Mux.thread.qVideobitstream.close();
-    m_Mux.thread.qVideobitstreamFreeI.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
-    m_Mux.thread.qVideobitstreamFreePB.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
+    m_Mux.thread.qVideobitstream.close([this](AVMuxVideoBitstream *pVideo) { m_bitstreamPool.release(&pVideo->bitstream, pVideo->poolLease); });
     m_Mux.thread.qAudioPacketOut.close();
     m_Mux.thread.qAudioFrameEncode.close();
     m_Mux.thread.qAudioPacketProcess.close();
@@ -203,10 +343,36 @@ void RGYOutputAvcodec::CloseThread() {
             SetEvent(m_Mux.thread.heEventPktAddedAudProcess);
         }
         m_Mux.thread.thAudProcess.join();
+        //音声処理スレッドの終了時に待機済みだが、念のためトラック並列処理のタスクの完了を待ってからイベントを閉じる
+        m_Mux.thread.audTrackTasks.wait();
         CloseEvent(m_Mux.thread.heEventPktAddedAudProcess);
         CloseEvent(m_Mux.thread.heEventClosingAudProcess);
         AddMessage(RGY_LOG_DEBUG, _T("closed audio process thread...\n"));
     }
+    if (m_Mux.thread.audTrackWorkers.size() > 0) {
+        for (const auto& worker : m_Mux.thread.audTrackWorkers) {
+            AddMessage(RGY_LOG_DEBUG, _T("audio track #%d: processed %lld packets, peak queue %d.\n"),
+                trackID(worker->inTrackId), (lls)worker->processed, (int)worker->peakQueue);
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("audio track parallel: peak pending packets %d.\n"), (int)m_Mux.thread.audProcessPendingPeak);
+    }
+    //中断した場合に残っているパケットを解放する
+    //処理済みのパケットは処理前のパケットの所有権が結果に移っているので、結果のみを解放する
+    for (auto& item : m_Mux.thread.audProcessPending) {
+        if (!item->done && item->pktData.type == MUX_DATA_TYPE_PACKET) {
+            av_packet_unref(&item->pktData.pkt);
+        }
+        for (auto& result : item->results) {
+            if (result.type == MUX_DATA_TYPE_FRAME) {
+                av_frame_free(&result.frame);
+            } else {
+                av_packet_unref(&result.pkt);
+            }
+        }
+    }
+    m_Mux.thread.audProcessPending.clear();
+    m_Mux.thread.audTrackWorkers.clear();
+    m_Mux.thread.enableAudTrackParallel = false;
     m_Mux.thread.abortOutput = true;
     if (m_Mux.thread.thOutput.joinable()) {
         //ここに来た時に、まだメインスレッドがループ中の可能性がある
@@ -243,6 +409,14 @@ void RGYOutputAvcodec::Close() {
     }
     m_Mux.other.clear();
     CloseVideo(&m_Mux.video);
+#if ENABLE_AVCODEC_OUT_THREAD
+    //AVPacketから参照されていたバッファは、CloseFormatで返却済み
+    if (m_bitstreamPool.countSwapped() + m_bitstreamPool.countCopied() > 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("video bitstream pool: %lld frames passed without copy, %lld frames copied, %d buffers allocated, peak %.1f MB.\n"),
+            (lls)m_bitstreamPool.countSwapped(), (lls)m_bitstreamPool.countCopied(), m_bitstreamPool.countAlloc(), m_bitstreamPool.peakBytesOut() / (double)(1024 * 1024));
+    }
+    m_bitstreamPool.close();
+#endif
     m_strOutputInfo.clear();
     m_encSatusInfo.reset();
     AddMessage(RGY_LOG_DEBUG, _T("Closed.\n"));
@@ -1548,6 +1722,7 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
     }
     m_Mux.format.isMatroska = 0 == strcmp(m_Mux.format.formatCtx->oformat->name, "matroska");
     m_Mux.format.disableMp4Opt = prm->disableMp4Opt;
+    m_Mux.format.mp4Fragment = prm->mp4Fragment;
 
 #if USE_CUSTOM_IO
     if (m_Mux.format.isPipe || usingAVProtocols(filename, 1) || (m_Mux.format.formatCtx->oformat->flags & (AVFMT_NEEDNUMBER | AVFMT_NOFILE))) {
@@ -1597,6 +1772,19 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
             }
         }
 
+        //faststartでは、muxerが最後に出力ファイルを開きなおして読み込むため、非同期書き込みは使用しない
+        const bool useFaststart = videoOutputInfo && !prm->disableMp4Opt && prm->mp4Fragment < 0
+            && (   0 == strcmp(m_Mux.format.formatCtx->oformat->name, "mp4")
+                || 0 == strcmp(m_Mux.format.formatCtx->oformat->name, "mov"));
+        const bool useAsyncWrite = prm->asyncWrite && !useFaststart;
+        if (prm->asyncWrite && useFaststart) {
+            AddMessage(RGY_LOG_DEBUG, _T("async write disabled, as faststart requires reading back the output file.\n"));
+        }
+        if (useAsyncWrite) {
+            //非同期書き込みでは大きなブロックにまとめてから書き出すので、libavformat用の内部バッファは小さくてよい
+            m_Mux.format.AVOutBufferSize = (std::min)(m_Mux.format.AVOutBufferSize, (uint32_t)(1024 * 1024));
+        }
+
         if (NULL == (m_Mux.format.AVOutBuffer = (uint8_t *)av_malloc(m_Mux.format.AVOutBufferSize))) {
             AddMessage(RGY_LOG_ERROR, _T("failed to allocate muxer buffer of %d MB.\n"), m_Mux.format.AVOutBufferSize / (1024 * 1024));
             return RGY_ERR_MEMORY_ALLOC;
@@ -1604,16 +1792,27 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
         AddMessage(RGY_LOG_DEBUG, _T("allocated internal buffer %d MB.\n"), m_Mux.format.AVOutBufferSize / (1024 * 1024));
         CreateDirectoryRecursive(PathRemoveFileSpecFixed(strFileName).second.c_str());
 
-        //"movflags:faststart"にするには、共有モードで開けるようにする必要がある
-        m_Mux.format.fpOutput = _tfsopen(strFileName, _T("wb"), _SH_DENYWR);
-        if (m_Mux.format.fpOutput == NULL) {
-            errno_t error = errno;
-            AddMessage(RGY_LOG_ERROR, _T("failed to open %soutput file \"%s\": %s.\n"), (videoOutputInfo) ? _T("") : _T("audio "), strFileName, _tcserror(error));
-            return RGY_ERR_FILE_OPEN; // Couldn't open file
-        }
-        if (0 < (m_Mux.format.outputBufferSize = (uint32_t)malloc_degeneracy((void **)&m_Mux.format.outputBuffer, m_Mux.format.outputBufferSize, 1024 * 1024))) {
-            setvbuf(m_Mux.format.fpOutput, m_Mux.format.outputBuffer, _IOFBF, m_Mux.format.outputBufferSize);
-            AddMessage(RGY_LOG_DEBUG, _T("set external output buffer %d MB.\n"), m_Mux.format.outputBufferSize / (1024 * 1024));
+        if (useAsyncWrite) {
+            m_Mux.format.asyncWriter = new RGYAsyncFileWriter();
+            if (m_Mux.format.asyncWriter->open(strFileName, m_Mux.format.outputBufferSize, (videoOutputInfo) ? prm->queueInfo : nullptr) != RGY_ERR_NONE) {
+                errno_t error = errno;
+                AddMessage(RGY_LOG_ERROR, _T("failed to open %soutput file \"%s\": %s.\n"), (videoOutputInfo) ? _T("") : _T("audio "), strFileName, _tcserror(error));
+                return RGY_ERR_FILE_OPEN; // Couldn't open file
+            }
+            AddMessage(RGY_LOG_DEBUG, _T("opened output file with async writer, %d blocks x %d KB.\n"),
+                m_Mux.format.asyncWriter->blockCount(), (int)(m_Mux.format.asyncWriter->blockSize() / 1024));
+        } else {
+            //"movflags:faststart"にするには、共有モードで開けるようにする必要がある
+            m_Mux.format.fpOutput = _tfsopen(strFileName, _T("wb"), _SH_DENYWR);
+            if (m_Mux.format.fpOutput == NULL) {
+                errno_t error = errno;
+                AddMessage(RGY_LOG_ERROR, _T("failed to open %soutput file \"%s\": %s.\n"), (videoOutputInfo) ? _T("") : _T("audio "), strFileName, _tcserror(error));
+                return RGY_ERR_FILE_OPEN; // Couldn't open file
+            }
+            if (0 < (m_Mux.format.outputBufferSize = (uint32_t)malloc_degeneracy((void **)&m_Mux.format.outputBuffer, m_Mux.format.outputBufferSize, 1024 * 1024))) {
+                setvbuf(m_Mux.format.fpOutput, m_Mux.format.outputBuffer, _IOFBF, m_Mux.format.outputBufferSize);
+                AddMessage(RGY_LOG_DEBUG, _T("set external output buffer %d MB.\n"), m_Mux.format.outputBufferSize / (1024 * 1024));
+            }
         }
         if (NULL == (m_Mux.format.formatCtx->pb = avio_alloc_context(m_Mux.format.AVOutBuffer, m_Mux.format.AVOutBufferSize, 1, this, funcReadPacket, funcWritePacket, funcSeek))) {
             AddMessage(RGY_LOG_ERROR, _T("failed to alloc avio context.\n"));
@@ -1720,11 +1919,22 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
         prm->threadOutput = 1;
     }
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    //音声を変換する入力トラックの数 (サブトラックは入力トラックのデコーダを共有するので数えない)
+    int audioTranscodeTracks = 0;
+    for (const auto& audio : m_Mux.audio) {
+        if (audio.outCodecDecodeCtx && audio.inSubStream == 0) {
+            audioTranscodeTracks++;
+        }
+    }
     if (prm->threadAudio == RGY_AUDIO_THREAD_AUTO) {
-        prm->threadAudio = 0;
+        //複数のトラックを変換する場合は、トラックごとに並列に処理できるよう音声処理スレッドを使用する
+        prm->threadAudio = (audioTranscodeTracks > 1) ? 1 : 0;
     }
     m_Mux.thread.enableAudProcessThread = prm->threadOutput > 0 && prm->threadAudio > 0;
-    m_Mux.thread.enableAudEncodeThread  = prm->threadOutput > 0 && prm->threadAudio > 1;
+    //複数のトラックを変換する場合は、トラックごとにデコード/フィルタ/エンコードをスレッドプールで並列に処理する
+    //この場合、エンコードもトラックごとのワーカーで行うので、音声エンコードスレッドは使用しない
+    m_Mux.thread.enableAudTrackParallel = m_Mux.thread.enableAudProcessThread && audioTranscodeTracks > 1;
+    m_Mux.thread.enableAudEncodeThread  = prm->threadOutput > 0 && prm->threadAudio > 1 && !m_Mux.thread.enableAudTrackParallel;
 #endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
     m_Mux.thread.enableOutputThread     = prm->threadOutput > 0;
     if (m_Mux.thread.enableOutputThread) {
@@ -1734,8 +1944,7 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
         m_Mux.thread.thAudEncodeAbort = false;
         m_Mux.thread.qAudioPacketOut.init(8192, 256 * std::max(1, (int)m_Mux.audio.size())); //字幕のみコピーするときのため、最低でもある程度は確保する
         m_Mux.thread.qVideobitstream.init(4096, (std::max)(256, (m_Mux.video.outputFps.den) ? m_Mux.video.outputFps.num * 4 / m_Mux.video.outputFps.den : 0));
-        m_Mux.thread.qVideobitstreamFreeI.init(256);
-        m_Mux.thread.qVideobitstreamFreePB.init(3840);
+        m_bitstreamPool.init(VID_BITSTREAM_POOL_MAX_BYTES, VID_BITSTREAM_POOL_MAX_FREE);
         m_Mux.thread.heEventPktAddedOutput = CreateEvent(NULL, TRUE, FALSE, NULL);
         m_Mux.thread.heEventClosingOutput  = CreateEvent(NULL, TRUE, FALSE, NULL);
         m_Mux.thread.thOutput = std::thread(&RGYOutputAvcodec::WriteThreadFunc, this);
@@ -1745,6 +1954,16 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
             m_Mux.thread.qAudioPacketProcess.init(8192, 512, 4);
             m_Mux.thread.heEventPktAddedAudProcess = CreateEvent(NULL, TRUE, FALSE, NULL);
             m_Mux.thread.heEventClosingAudProcess  = CreateEvent(NULL, TRUE, FALSE, NULL);
+            if (m_Mux.thread.enableAudTrackParallel) {
+                for (const auto& audio : m_Mux.audio) {
+                    if (audio.outCodecDecodeCtx && audio.inSubStream == 0) {
+                        m_Mux.thread.audTrackWorkers.push_back(std::unique_ptr<AVMuxAudioTrackWorker>(new AVMuxAudioTrackWorker(audio.inTrackId)));
+                    }
+                }
+                m_Mux.thread.audProcessPendingMax = (std::max)((size_t)256, 64 * m_Mux.thread.audTrackWorkers.size());
+                m_Mux.thread.audProcessPendingPeak = 0;
+                AddMessage(RGY_LOG_DEBUG, _T("audio track parallel enabled: %d tracks.\n"), (int)m_Mux.thread.audTrackWorkers.size());
+            }
             m_Mux.thread.thAudProcess = std::thread(&RGYOutputAvcodec::ThreadFuncAudThread, this);
             if (m_Mux.thread.enableAudEncodeThread) {
                 AddMessage(RGY_LOG_DEBUG, _T("starting audio encode thread...\n"));
@@ -1763,16 +1982,22 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
             return sts;
         }
         m_Mux.format.fileHeaderWritten = true;
+#if ENABLE_AVCODEC_OUT_THREAD
+        //出力スレッドはヘッダーの書き出しをイベントで待機しているので、通知する
+        if (m_Mux.thread.thOutput.joinable()) {
+            SetEvent(m_Mux.thread.heEventPktAddedOutput);
+        }
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
     }
     m_inited = true;
     return RGY_ERR_NONE;
 }
 
 RGY_ERR RGYOutputAvcodec::AddH264HeaderToExtraData(const RGYBitstream *bitstream) {
-    std::vector<nal_info> nal_list = parse_nal_unit_h264(bitstream->data(), bitstream->size());
-    const auto h264_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_SPS; });
-    const auto h264_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_PPS; });
-    const bool header_check = (nal_list.end() != h264_sps_nal) && (nal_list.end() != h264_pps_nal);
+    parse_nal_unit_h264(bitstream->data(), bitstream->size(), m_nalList);
+    const auto h264_sps_nal = m_nalList.find(NALU_H264_SPS);
+    const auto h264_pps_nal = m_nalList.find(NALU_H264_PPS);
+    const bool header_check = h264_sps_nal && h264_pps_nal;
     if (header_check) {
         m_Mux.video.streamOut->codecpar->extradata_size = (int)(h264_sps_nal->size + h264_pps_nal->size);
         uint8_t *new_ptr = (uint8_t *)av_malloc(m_Mux.video.streamOut->codecpar->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
@@ -1788,11 +2013,11 @@ RGY_ERR RGYOutputAvcodec::AddH264HeaderToExtraData(const RGYBitstream *bitstream
 
 //extradataにHEVCのヘッダーを追加する
 RGY_ERR RGYOutputAvcodec::AddHEVCHeaderToExtraData(const RGYBitstream *bitstream) {
-    std::vector<nal_info> nal_list = parse_nal_unit_hevc(bitstream->data(), bitstream->size());
-    const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
-    const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
-    const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
-    const bool header_check = (nal_list.end() != hevc_vps_nal) && (nal_list.end() != hevc_sps_nal) && (nal_list.end() != hevc_pps_nal);
+    parse_nal_unit_hevc(bitstream->data(), bitstream->size(), m_nalList);
+    const auto hevc_vps_nal = m_nalList.find(NALU_HEVC_VPS);
+    const auto hevc_sps_nal = m_nalList.find(NALU_HEVC_SPS);
+    const auto hevc_pps_nal = m_nalList.find(NALU_HEVC_PPS);
+    const bool header_check = hevc_vps_nal && hevc_sps_nal && hevc_pps_nal;
     if (header_check) {
         m_Mux.video.streamOut->codecpar->extradata_size = (int)(hevc_vps_nal->size + hevc_sps_nal->size + hevc_pps_nal->size);
         uint8_t *new_ptr = (uint8_t *)av_malloc(m_Mux.video.streamOut->codecpar->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
@@ -1839,10 +2064,23 @@ RGY_ERR RGYOutputAvcodec::WriteFileHeader(const RGYBitstream *bitstream) {
     if (m_Mux.video.streamOut) {
         if (   0 == strcmp(m_Mux.format.formatCtx->oformat->name, "mp4")
             || 0 == strcmp(m_Mux.format.formatCtx->oformat->name, "mov")) {
-            av_dict_set(&m_Mux.format.headerOptions, "brand", "mp42", 0);
-            AddMessage(RGY_LOG_DEBUG, _T("set format brand \"mp42\".\n"));
+            if (m_Mux.format.mp4Fragment >= 0) {
+                //fragmented mp4 (CMAF互換)
+                //moovを先頭に空で書き出し、以降はキーフレームごと(GOPごと)にmoof+mdatを書き出していく
+                //書き出し中のファイルもそのまま再生・配信でき、終了時のfaststartによるファイルの書き直しも発生しない
+                //brandはdefault_base_moofに合わせてmuxerに選択させる(iso5)
+                av_dict_set(&m_Mux.format.headerOptions, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+                if (m_Mux.format.mp4Fragment > 0) {
+                    //フラグメントが指定の長さ以上になってから、次のキーフレームで区切る
+                    av_dict_set_int(&m_Mux.format.headerOptions, "min_frag_duration", (int64_t)m_Mux.format.mp4Fragment * 1000, 0);
+                }
+                AddMessage(RGY_LOG_DEBUG, _T("set fragmented mp4, min fragment duration %d ms.\n"), m_Mux.format.mp4Fragment);
+            } else {
+                av_dict_set(&m_Mux.format.headerOptions, "brand", "mp42", 0);
+                AddMessage(RGY_LOG_DEBUG, _T("set format brand \"mp42\".\n"));
+            }
 
-            if (!m_Mux.format.disableMp4Opt) {
+            if (!m_Mux.format.disableMp4Opt && m_Mux.format.mp4Fragment < 0) {
                 //moovを先頭に
                 av_dict_set(&m_Mux.format.headerOptions, "movflags", "faststart", 0);
                 AddMessage(RGY_LOG_DEBUG, _T("set faststart.\n"));
@@ -2012,20 +2250,20 @@ uint32_t RGYOutputAvcodec::getH264PAFFFieldLength(const uint8_t *ptr, uint32_t s
 RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *bitstream) {
 #if ENABLE_AVCODEC_OUT_THREAD
     if (m_Mux.thread.thOutput.joinable()) {
-        RGYBitstream copyStream = RGYBitstreamInit();
+        AVMuxVideoBitstream video;
+        video.bitstream = RGYBitstreamInit();
+        video.poolLease = -1;
+        RGYBitstream& copyStream = video.bitstream;
         bool bFrameI = (bitstream->frametype() & RGY_FRAMETYPE_I) != 0;
         bool bFrameP = (bitstream->frametype() & RGY_FRAMETYPE_P) != 0;
-        //IフレームかPBフレームかでサイズが大きく違うため、空きのmfxBistreamは異なるキューで管理する
-        auto& qVideoQueueFree = (bFrameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
-        //空いているmfxBistreamを取り出す
-        if (!qVideoQueueFree.front_copy_and_pop_no_lock(&copyStream) || copyStream.bufsize() < bitstream->size()) {
-            //空いているmfxBistreamがない、あるいはそのバッファサイズが小さい場合は、領域を取り直す
-            const auto allocate_bytes = bitstream->size() * ((bFrameI | bFrameP) ? 2 : 8);
-            if (RGY_ERR_NONE != copyStream.init(allocate_bytes)) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream output buffer, %sB.\n"), allocate_bytes);
-                m_Mux.format.streamError = true;
-                return RGY_ERR_MEMORY_ALLOC;
-            }
+        //エンコーダのバッファと同じサイズのバッファをプールから取り出し、バッファを入れ替えてコピーせずに出力スレッドに渡す
+        //出力スレッドに渡したバッファの合計が上限に達している場合は、必要なサイズのバッファにコピーして渡す
+        const bool swapBuffer = m_bitstreamPool.canSwap(bitstream->bufsize());
+        const auto allocate_bytes = (swapBuffer) ? bitstream->bufsize() : bitstream->size() * ((bFrameI | bFrameP) ? 2 : 8);
+        if (RGY_ERR_NONE != m_bitstreamPool.get(&copyStream, allocate_bytes, &video.poolLease)) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream output buffer, %lldB.\n"), (lls)allocate_bytes);
+            m_Mux.format.streamError = true;
+            return RGY_ERR_MEMORY_ALLOC;
         }
         //必要な情報をコピー
         copyStream.setDataflag(bitstream->dataflag());
@@ -2033,13 +2271,20 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *bitstream) {
         copyStream.setDts(bitstream->dts());
         copyStream.setDuration(bitstream->duration());
         copyStream.setFrametype(bitstream->frametype());
-        copyStream.setSize(bitstream->size());
         copyStream.setAvgQP(bitstream->avgQP());
-        copyStream.setOffset(0);
-        memcpy(copyStream.bufptr(), bitstream->data(), copyStream.size());
+        if (swapBuffer) {
+            copyStream.swapBuffer(bitstream);
+            m_bitstreamPool.addSwapped();
+        } else {
+            copyStream.setSize(bitstream->size());
+            copyStream.setOffset(0);
+            memcpy(copyStream.bufptr(), bitstream->data(), copyStream.size());
+            m_bitstreamPool.addCopied();
+        }
         //キューに押し込む
-        if (!m_Mux.thread.qVideobitstream.push(copyStream)) {
+        if (!m_Mux.thread.qVideobitstream.push(video)) {
             AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream queue.\n"));
+            m_bitstreamPool.release(&copyStream, video.poolLease);
             m_Mux.format.streamError = true;
         }
         bitstream->setSize(0);
@@ -2049,7 +2294,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *bitstream) {
     }
 #endif
     int64_t dts = 0;
-    return WriteNextFrameInternal(bitstream, &dts);
+    return WriteNextFrameInternal(bitstream, &dts, -1);
 }
 
 #if ENCODER_VCEENC
@@ -2089,7 +2334,11 @@ RGY_ERR RGYOutputAvcodec::VidCheckStreamAVParser(RGYBitstream *pBitstream) {
 
 #pragma warning (push)
 #pragma warning (disable: 4127) //warning C4127: 条件式が定数です。
-RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_t *writtenDts) {
+RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_t *writtenDts, int poolLease) {
+#if ENABLE_AVCODEC_OUT_THREAD
+    //プールから貸し出されたバッファは、エラー等で途中で抜けた場合も含め、必ずプールに返却する
+    RGYBitstreamPoolGuard poolGuard(&m_bitstreamPool, bitstream, poolLease);
+#endif
     if (!m_Mux.format.fileHeaderWritten) {
 #if ENCODER_QSV
         //HEVCエンコードでは、DecodeTimeStampが正しく設定されない
@@ -2102,11 +2351,11 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_
         if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC && m_Mux.video.seiNal.size() > 0) {
             RGYBitstream bsCopy = RGYBitstreamInit();
             bsCopy.copy(bitstream);
-            std::vector<nal_info> nal_list = parse_nal_unit_hevc(bsCopy.data(), bsCopy.size());
-            const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
-            const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
-            const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
-            const bool header_check = (nal_list.end() != hevc_vps_nal) && (nal_list.end() != hevc_sps_nal) && (nal_list.end() != hevc_pps_nal);
+            parse_nal_unit_hevc(bsCopy.data(), bsCopy.size(), m_nalList);
+            const auto hevc_vps_nal = m_nalList.find(NALU_HEVC_VPS);
+            const auto hevc_sps_nal = m_nalList.find(NALU_HEVC_SPS);
+            const auto hevc_pps_nal = m_nalList.find(NALU_HEVC_PPS);
+            const bool header_check = hevc_vps_nal && hevc_sps_nal && hevc_pps_nal;
             if (header_check) {
                 bitstream->setSize(0);
                 bitstream->setOffset(0);
@@ -2114,7 +2363,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_
                 bitstream->append(hevc_sps_nal->ptr, hevc_sps_nal->size);
                 bitstream->append(hevc_pps_nal->ptr, hevc_pps_nal->size);
                 bitstream->append(&m_Mux.video.seiNal);
-                for (const auto& nal : nal_list) {
+                for (const auto& nal : m_nalList) {
                     if (nal.type != NALU_HEVC_VPS && nal.type != NALU_HEVC_SPS && nal.type != NALU_HEVC_PPS) {
                         bitstream->append(nal.ptr, nal.size);
                     }
@@ -2160,18 +2409,18 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_
     VidCheckStreamAVParser(bitstream);
 #endif //#if ENCODER_VCEENC
 
-    std::vector<nal_info> nal_list;
+    m_nalList.clear();
     if (m_Mux.video.bsfc) {
-        int target_nal = 0;
+        uint8_t target_nal = 0;
         if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
             target_nal = NALU_HEVC_SPS;
-            nal_list = parse_nal_unit_hevc(bitstream->data(), bitstream->size());
+            parse_nal_unit_hevc(bitstream->data(), bitstream->size(), m_nalList);
         } else if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
             target_nal = NALU_H264_SPS;
-            nal_list = parse_nal_unit_h264(bitstream->data(), bitstream->size());
+            parse_nal_unit_h264(bitstream->data(), bitstream->size(), m_nalList);
         }
-        auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [target_nal](nal_info info) { return info.type == target_nal; });
-        if (sps_nal != nal_list.end()) {
+        const nal_info *sps_nal = m_nalList.find(target_nal);
+        if (sps_nal) {
             AVPacket pkt = { 0 };
             av_init_packet(&pkt);
             av_new_packet(&pkt, (int)sps_nal->size);
@@ -2211,12 +2460,12 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_
     bool isIDR = (bitstream->frametype() & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_I)) != 0;
     if (m_Mux.video.streamOut->codecpar->field_order != AV_FIELD_PROGRESSIVE) {
         if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
-            if (nal_list.size() == 0) {
-                nal_list = parse_nal_unit_h264(bitstream->data(), bitstream->size());
+            if (m_nalList.size() == 0) {
+                parse_nal_unit_h264(bitstream->data(), bitstream->size(), m_nalList);
             }
             //インタレ保持の際、IDRかどうかのフラグが正しく設定されていないことがある
             //どちらかのフィールドがIDRならIDRのフラグを立てる
-            isIDR = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_IDR; }) != nal_list.end();
+            isIDR = m_nalList.find(NALU_H264_IDR) != nullptr;
         } else if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
             AddMessage(RGY_LOG_ERROR, _T("Interlaced HEVC encoding not supported!\n"));
             return RGY_ERR_UNSUPPORTED;
@@ -2225,9 +2474,24 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_
 
     AVPacket pkt = { 0 };
     av_init_packet(&pkt);
-    av_new_packet(&pkt, (int)bitstream->size());
-    memcpy(pkt.data, bitstream->data(), bitstream->size());
-    pkt.size = (int)bitstream->size();
+#if ENABLE_AVCODEC_OUT_THREAD
+    //出力スレッドに渡されたバッファは、paddingの領域があればそのままAVPacketのバッファとして使用する
+    bool bitstreamWrapped = false;
+    if (poolLease >= 0
+        && bitstream->bufsize() >= bitstream->offset() + bitstream->size() + AV_INPUT_BUFFER_PADDING_SIZE
+        && nullptr != (pkt.buf = m_bitstreamPool.wrap(bitstream, poolLease))) {
+        poolGuard.dismiss();
+        memset(bitstream->data() + bitstream->size(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        pkt.data = bitstream->data();
+        pkt.size = (int)bitstream->size();
+        bitstreamWrapped = true;
+    } else
+#endif
+    {
+        av_new_packet(&pkt, (int)bitstream->size());
+        memcpy(pkt.data, bitstream->data(), bitstream->size());
+        pkt.size = (int)bitstream->size();
+    }
 
     const AVRational streamTimebase = m_Mux.video.streamOut->codec->pkt_timebase;
     pkt.stream_index = m_Mux.video.streamOut->index;
@@ -2268,25 +2532,14 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_
     }
     m_encSatusInfo->SetOutputData(frameType, bitstream->size(), bitstream->avgQP());
 #if ENABLE_AVCODEC_OUT_THREAD
-    //最初のヘッダーを書いたパケットはコピーではないので、キューに入れない
-    if (m_Mux.thread.thOutput.joinable()) {
-        //確保したメモリ領域を使いまわすためにキューに格納
-        const auto frameI = (frameType & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_I)) != 0;
-        auto& qVideoQueueFree = (frameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
-        auto queueFavoredSize = (frameI) ? VID_BITSTREAM_QUEUE_SIZE_I : VID_BITSTREAM_QUEUE_SIZE_PB;
-        if ((int64_t)qVideoQueueFree.size() > queueFavoredSize) {
-            //あまり多すぎると無駄にメモリを使用するので減らす
-            bitstream->clear();
-        } else {
-            qVideoQueueFree.push(*bitstream);
-        }
-    } else {
-#endif
-        bitstream->setSize(0);
-        bitstream->setOffset(0);
-#if ENABLE_AVCODEC_OUT_THREAD
+    if (bitstreamWrapped) {
+        //バッファはAVPacketから参照されなくなった時点でプールに返却される
+        bitstream->detach();
     }
+    //それ以外のプールのバッファは、poolGuardにより使いまわすためにプールに返却される
 #endif
+    bitstream->setSize(0);
+    bitstream->setOffset(0);
     m_Mux.format.fileHeaderWritten = true;
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
@@ -2822,6 +3075,11 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacket(AVPacket *pkt) {
 //指定された音声キューに追加する
 RGY_ERR RGYOutputAvcodec::AddAudQueue(AVPktMuxData *pktData, int type) {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    if (t_audProcessItem && type != AUD_QUEUE_PROCESS) {
+        //トラック並列処理中は、処理結果として保持しておき、受け取った順に音声処理スレッドから出力キューに渡す
+        t_audProcessItem->results.push_back(*pktData);
+        return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+    }
     if (m_Mux.thread.thAudProcess.joinable()) {
         //出力キューに追加する
         auto& qAudio       = (type == AUD_QUEUE_OUT) ? m_Mux.thread.qAudioPacketOut       : ((type == AUD_QUEUE_PROCESS) ? m_Mux.thread.qAudioPacketProcess       : m_Mux.thread.qAudioFrameEncode);
@@ -3113,6 +3371,7 @@ RGY_ERR RGYOutputAvcodec::ThreadFuncAudEncodeThread() {
 
 RGY_ERR RGYOutputAvcodec::ThreadFuncAudThread() {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
+    const bool bTrackParallel = m_Mux.thread.enableAudTrackParallel;
     WaitForSingleObject(m_Mux.thread.heEventPktAddedAudProcess, INFINITE);
     while (!m_Mux.thread.thAudProcessAbort) {
         if (!m_Mux.format.fileHeaderWritten) {
@@ -3121,7 +3380,15 @@ RGY_ERR RGYOutputAvcodec::ThreadFuncAudThread() {
             AVPktMuxData pktData = { 0 };
             while (m_Mux.thread.qAudioPacketProcess.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_proc : nullptr)) {
                 //音声処理を実行、出力キューに追加する
-                WriteNextPacketInternal(&pktData, INT64_MAX);
+                if (bTrackParallel) {
+                    WriteNextPacketAudioParallel(&pktData);
+                } else {
+                    WriteNextPacketInternal(&pktData, INT64_MAX);
+                }
+            }
+            if (bTrackParallel) {
+                //ワーカーで処理の完了したものを出力キューに渡す
+                WriteAudioProcessedItems(false);
             }
         }
         ResetEvent(m_Mux.thread.heEventPktAddedAudProcess);
@@ -3131,7 +3398,16 @@ RGY_ERR RGYOutputAvcodec::ThreadFuncAudThread() {
         AVPktMuxData pktData = { 0 };
         while (m_Mux.thread.qAudioPacketProcess.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_proc : nullptr)) {
             //音声処理を実行、出力キューに追加する
-            WriteNextPacketInternal(&pktData, INT64_MAX);
+            if (bTrackParallel) {
+                WriteNextPacketAudioParallel(&pktData);
+            } else {
+                WriteNextPacketInternal(&pktData, INT64_MAX);
+            }
+        }
+        if (bTrackParallel) {
+            //ワーカーの処理がすべて完了するのを待って出力キューに渡す
+            WriteAudioProcessedItems(true);
+            m_Mux.thread.audTrackTasks.wait();
         }
     }
     SetEvent(m_Mux.thread.heEventClosingAudProcess);
@@ -3139,20 +3415,132 @@ RGY_ERR RGYOutputAvcodec::ThreadFuncAudThread() {
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
+#if ENABLE_AVCODEC_OUT_THREAD
+AVMuxAudioTrackWorker *RGYOutputAvcodec::getAudioTrackWorker(int inTrackId) {
+    for (const auto& worker : m_Mux.thread.audTrackWorkers) {
+        if (worker->inTrackId == inTrackId) {
+            return worker.get();
+        }
+    }
+    return nullptr;
+}
+
+//音声処理スレッドによって処理される
+//変換する音声トラックのパケットは担当のワーカーに渡し、それ以外 (コピーする音声、字幕、終端のパケット) はこのスレッドで処理する
+//いずれも受け取った順に並べておき、WriteAudioProcessedItemsで受け取った順に出力キューに渡す
+void RGYOutputAvcodec::WriteNextPacketAudioParallel(AVPktMuxData *pktData) {
+    AVMuxAudioTrackWorker *worker = nullptr;
+    if (pktData->pkt.data != nullptr
+        && trackMediaType((uint32_t)pktData->pkt.flags >> 16) == AVMEDIA_TYPE_AUDIO
+        && pktData->muxAudio && pktData->muxAudio->outCodecDecodeCtx) {
+        worker = getAudioTrackWorker(pktData->muxAudio->inTrackId);
+    }
+    //処理中のパケットが多すぎる場合は、先頭のパケットの処理の完了を待つ
+    WriteAudioProcessedItems(false);
+
+    m_Mux.thread.audProcessPending.push_back(std::unique_ptr<AVMuxAudioProcessItem>(new AVMuxAudioProcessItem(*pktData)));
+    m_Mux.thread.audProcessPendingPeak = (std::max)(m_Mux.thread.audProcessPendingPeak, m_Mux.thread.audProcessPending.size());
+    AVMuxAudioProcessItem *item = m_Mux.thread.audProcessPending.back().get();
+    if (worker) {
+        bool startTask = false;
+        {
+            std::lock_guard<std::mutex> lock(worker->mtx);
+            worker->queue.push_back(item);
+            worker->peakQueue = (std::max)(worker->peakQueue, worker->queue.size());
+            //ワーカーのタスクが実行中でなければ、新たにタスクを投入する
+            //1つのトラックのタスクは同時に1つしか実行しないので、トラック内の処理順は保たれる
+            startTask = !worker->running;
+            worker->running = true;
+        }
+        if (startTask) {
+            RGYThreadPool::get().submit([this, worker]() { ThreadFuncAudTrackWorker(worker); }, RGY_THREAD_POOL_STAGE_AUDIO, &m_Mux.thread.audTrackTasks);
+        }
+    } else {
+        t_audProcessItem = item;
+        WriteNextPacketInternal(&item->pktData, INT64_MAX);
+        t_audProcessItem = nullptr;
+        item->done = true;
+    }
+    WriteAudioProcessedItems(false);
+}
+
+//音声処理スレッドによって処理される
+void RGYOutputAvcodec::WriteAudioProcessedItems(bool waitAll) {
+    auto& pending = m_Mux.thread.audProcessPending;
+    while (!pending.empty()) {
+        auto& item = pending.front();
+        if (!item->done) {
+            if (!waitAll && pending.size() < m_Mux.thread.audProcessPendingMax) {
+                break;
+            }
+            //ワーカーはパケットの処理を完了するとheEventPktAddedAudProcessをセットする
+            //ResetEventの後に完了を確認することで、通知を取りこぼさないようにする
+            ResetEvent(m_Mux.thread.heEventPktAddedAudProcess);
+            if (!item->done) {
+                WaitForSingleObject(m_Mux.thread.heEventPktAddedAudProcess, 16);
+            }
+            continue;
+        }
+        for (auto& pktData : item->results) {
+            AddAudQueue(&pktData, AUD_QUEUE_OUT);
+        }
+        pending.pop_front();
+    }
+}
+
+//スレッドプール上で実行される
+//担当する入力トラックのパケットを順にデコード/フィルタ/エンコードし、結果を各パケットに格納する
+void RGYOutputAvcodec::ThreadFuncAudTrackWorker(AVMuxAudioTrackWorker *worker) {
+    for (;;) {
+        AVMuxAudioProcessItem *item = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(worker->mtx);
+            if (worker->queue.empty()) {
+                worker->running = false;
+                return;
+            }
+            item = worker->queue.front();
+            worker->queue.pop_front();
+            worker->processed++;
+        }
+        t_audProcessItem = item;
+        WriteNextPacketAudio(&item->pktData);
+        t_audProcessItem = nullptr;
+        //doneをセットした後は、itemは音声処理スレッドにより解放されうるので触らないこと
+        item->done = true;
+        SetEvent(m_Mux.thread.heEventPktAddedAudProcess);
+    }
+}
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
+
+//出力キューの音声パケットのdtsを書き出し前に見積もる (QUEUE_DTS_TIMEBASE)
+//processed ... 音声処理済み (エンコード済み) のパケットかどうか
+int64_t RGYOutputAvcodec::AudioPacketQueueDts(const AVPktMuxData *pktData, bool processed, int64_t *duration) {
+    const AVMuxAudio *muxAudio = pktData->muxAudio;
+    const AVRational timebase = (processed && muxAudio->outCodecEncodeCtx) ? muxAudio->outCodecEncodeCtx->time_base : muxAudio->streamIn->time_base;
+    *duration = av_rescale_q(pktData->pkt.duration, timebase, QUEUE_DTS_TIMEBASE);
+    const int64_t pts = (pktData->pkt.pts != AV_NOPTS_VALUE) ? pktData->pkt.pts : pktData->pkt.dts;
+    if (pts == AV_NOPTS_VALUE) {
+        return AV_NOPTS_VALUE;
+    }
+    int64_t dts = av_rescale_q(pts, timebase, QUEUE_DTS_TIMEBASE);
+    if (m_Mux.video.streamOut && m_Mux.video.inputFirstKeyPts != 0) {
+        dts -= av_rescale_q(m_Mux.video.inputFirstKeyPts, m_Mux.video.inputStreamTimebase, QUEUE_DTS_TIMEBASE);
+    }
+    return dts;
+}
+
 RGY_ERR RGYOutputAvcodec::WriteThreadFunc() {
 #if ENABLE_AVCODEC_OUT_THREAD
-    //映像と音声の同期をとる際に、それをあきらめるまでの閾値
-    const int nWaitThreshold = 32;
-    //キューにデータが存在するか
-    bool bAudioExists = false;
-    bool bVideoExists = false;
+    //映像と音声のdts順での書き出し
+    //ストリームごとに次に書き出すパケットのdts (データがなければ、次に来るはずのパケットのdtsの見込み = watermark) を持ち、
+    //これをキーとしたmin-heapから最小のストリームを選んで書き出す
+    //最小のストリームにデータがなければ、そのストリームにデータが来るまで待機する
+    //ただし、ほかのストリームのデータがたまりすぎた場合には、そのストリームを同期の対象から外す (音声が途中までしかない場合など)
     const auto fpsTimebase = av_inv_q(m_Mux.video.outputFps);
-    const auto dtsThreshold = std::max<int64_t>(av_rescale_q(4, fpsTimebase, QUEUE_DTS_TIMEBASE), 4);
-    //syncIgnoreDtsは映像と音声の同期を行う必要がないことを意味する
-    //dtsThresholdを加算したときにオーバーフローしないよう、dtsThresholdを引いておく
-    const int64_t syncIgnoreDts = INT64_MAX - dtsThreshold;
-    int64_t audioDts = (m_Mux.audio.size()) ? 0 : syncIgnoreDts;
-    int64_t videoDts = (m_Mux.video.streamOut) ? 0 : syncIgnoreDts;
+    const int64_t videoFrameDts = std::max<int64_t>(av_rescale_q(1, fpsTimebase, QUEUE_DTS_TIMEBASE), 1);
+    //同期の対象から外すまでに、映像キューにためるフレーム数
+    const size_t videoPacketThreshold = std::min<size_t>(3072, m_Mux.thread.qVideobitstream.capacity()) - 32;
     WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, INFINITE);
     //bThAudProcessは出力開始した後で取得する(この前だとまだ起動していないことがある)
     const bool bThAudProcess = m_Mux.thread.thAudProcess.joinable();
@@ -3160,139 +3548,249 @@ RGY_ERR RGYOutputAvcodec::WriteThreadFunc() {
         //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
         auto sts = RGY_ERR_NONE;
         const int trackFullID = ((uint32_t)pktData->pkt.flags >> 16);
-        if (trackMediaType(trackFullID) == AVMEDIA_TYPE_AUDIO) {
+        if (pktData->pkt.data == nullptr || trackMediaType(trackFullID) == AVMEDIA_TYPE_AUDIO) {
+            //終端のパケット(pkt.data == nullptr)もWriteNextPacketProcessedで処理する
             WriteNextPacketProcessed(pktData);
         } else {
             sts = WriteOtherPacket(&pktData->pkt);
         }
         return sts;
     };
+    auto writeAudioPacket = [&](AVPktMuxData *pktData) {
+        return (bThAudProcess) ? writeProcessedPacket(pktData) : WriteNextPacketInternal(pktData, INT64_MAX);
+    };
+
+    //ストリームの一覧 (映像があれば先頭が映像、以降は音声)
+    std::vector<AVMuxInterleaveStream> streams;
+    if (m_Mux.video.streamOut) {
+        streams.push_back(AVMuxInterleaveStream(nullptr));
+    }
+    const int audioStreamOffset = (int)streams.size();
+    for (auto& audio : m_Mux.audio) {
+        streams.push_back(AVMuxInterleaveStream(&audio));
+        //音声処理スレッドがない場合、サブストリームは入力ストリームの処理の中で書き出されるので、同期の対象としない
+        if (!bThAudProcess && audio.inSubStream != 0) {
+            streams.back().finished = true;
+        }
+    }
+    const int videoIdx = (m_Mux.video.streamOut) ? 0 : -1;
+    auto audioStreamIdx = [&](const AVPktMuxData *pktData) {
+        if (pktData->muxAudio == nullptr
+            || trackMediaType((uint32_t)pktData->pkt.flags >> 16) != AVMEDIA_TYPE_AUDIO) {
+            return -1;
+        }
+        const int idx = (int)(pktData->muxAudio - m_Mux.audio.data());
+        return (0 <= idx && idx < (int)m_Mux.audio.size()) ? audioStreamOffset + idx : -1;
+    };
+
+    //dtsをキーとしたmin-heap
+    //キーが変わるたびにgenerationを更新して新たに追加し、古いものは取り出したときに捨てる
+    std::priority_queue<AVMuxInterleaveKey, std::vector<AVMuxInterleaveKey>, std::greater<AVMuxInterleaveKey>> heap;
+    auto updateHeap = [&](int idx) {
+        auto& stream = streams[idx];
+        stream.generation++;
+        //同期の対象外で、データもなければheapには入れない
+        if (stream.pending.empty() && (stream.idle || stream.finished) && idx != videoIdx) {
+            return;
+        }
+        if (idx == videoIdx && (stream.idle || stream.finished) && m_Mux.thread.qVideobitstream.empty()) {
+            return;
+        }
+        const int64_t key = (stream.pending.size() > 0) ? stream.pending.front().dts : stream.nextDts;
+        heap.push(AVMuxInterleaveKey(key, idx, stream.generation));
+    };
+    for (int i = 0; i < (int)streams.size(); i++) {
+        updateHeap(i);
+    }
+
+    //出力キューの音声/字幕パケットをストリームごとに振り分ける
     int audPacketsPerSec = 64;
-    int nWaitAudio = 0;
-    int nWaitVideo = 0;
-    while (!m_Mux.thread.abortOutput) {
-        do {
-            if (!m_Mux.format.fileHeaderWritten) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                //ヘッダー取得前に音声キューのサイズが足りず、エンコードが進まなくなってしまうことがある
-                //キューのcapcityを増やすことでこれを回避する
-                auto type = (m_Mux.thread.thAudEncode.joinable()) ? AUD_QUEUE_ENCODE : AUD_QUEUE_OUT;
-                auto& qAudio = (type == AUD_QUEUE_OUT) ? m_Mux.thread.qAudioPacketOut : m_Mux.thread.qAudioFrameEncode;
-                const auto nQueueCapacity = qAudio.capacity();
-                if (qAudio.size() >= nQueueCapacity) {
-                    qAudio.set_capacity(nQueueCapacity * 3 / 2);
-                }
-                //動画キューになにもなかったら再度待機する
-                if (m_Mux.thread.qVideobitstream.size() == 0) {
-                    break;
+    size_t audioPending = 0;
+    bool flushPending = false;
+    AVPktMuxData flushPkt = { 0 };
+    auto drainAudio = [&](bool drainAll) {
+        AVPktMuxData pktData = { 0 };
+        while (!flushPending
+            && (drainAll || audioPending < std::min<size_t>(6144, m_Mux.thread.qAudioPacketOut.capacity()))
+            && m_Mux.thread.qAudioPacketOut.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr)) {
+            if (pktData.pkt.data == nullptr) {
+                //終端のパケットは、それまでの音声をすべて書き出してから処理する
+                flushPending = true;
+                flushPkt = pktData;
+                break;
+            }
+            if (pktData.muxAudio && pktData.muxAudio->streamIn) {
+                audPacketsPerSec = std::max(audPacketsPerSec, (int)(1.0 / (av_q2d(pktData.muxAudio->streamIn->time_base) * pktData.pkt.duration) + 0.5));
+                if ((int)m_Mux.thread.qAudioPacketOut.capacity() < audPacketsPerSec * 4) {
+                    m_Mux.thread.qAudioPacketOut.set_capacity(audPacketsPerSec * 4);
                 }
             }
-            //映像・音声の同期待ちが必要な場合、falseとなってループから抜けるよう、ここでfalseに設定する
-            bAudioExists = false;
-            bVideoExists = false;
-            RGYBitstream bitstream = RGYBitstreamInit();
-            while ((audioDts < 0 || videoDts <= audioDts + dtsThreshold)
-                && false != (bVideoExists = m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr))) {
-                WriteNextFrameInternal(&bitstream, &videoDts);
-                nWaitVideo = 0;
-                //AddMessage(RGY_LOG_TRACE, _T("videoDts=%8lld.\n"), videoDts);
+            const int idx = audioStreamIdx(&pktData);
+            if (idx < 0) {
+                //字幕などは同期の対象とせず、そのまま書き出す
+                writeAudioPacket(&pktData);
+                continue;
             }
-            AVPktMuxData pktData = { 0 };
-            while ((videoDts < 0 || audioDts <= videoDts + dtsThreshold)
-                && false != (bAudioExists = m_Mux.thread.qAudioPacketOut.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr))) {
-                if (pktData.muxAudio && pktData.muxAudio->streamIn) {
-                    audPacketsPerSec = std::max(audPacketsPerSec, (int)(1.0 / (av_q2d(pktData.muxAudio->streamIn->time_base) * pktData.pkt.duration) + 0.5));
-                    if ((int)m_Mux.thread.qAudioPacketOut.capacity() < audPacketsPerSec * 4) {
-                        m_Mux.thread.qAudioPacketOut.set_capacity(audPacketsPerSec * 4);
-                    }
-                }
-                const int64_t maxDts = (videoDts >= 0) ? videoDts + dtsThreshold : syncIgnoreDts;
-                //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-                (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, maxDts);
-                //複数のstreamがあり得るので最大値をとる
-                audioDts = (std::max)(audioDts, pktData.dts);
-                nWaitAudio = 0;
-                //AddMessage(RGY_LOG_TRACE, _T("audioDts=%8lld, maxDst=%8lld.\n"), audioDts, maxDts);
-            }
-            //一定以上の動画フレームがキューにたまっており、音声キューになにもなければ、
-            //音声を無視して動画フレームの処理を開始させる
-            //音声が途中までしかなかったり、途中からしかなかったりする場合にこうした処理が必要
-            const size_t videoPacketThreshold = std::min<size_t>(3072, m_Mux.thread.qVideobitstream.capacity()) - nWaitThreshold;
-            if (m_Mux.thread.qAudioPacketOut.size() == 0 && m_Mux.thread.qVideobitstream.size() > videoPacketThreshold) {
-                nWaitAudio++;
-                if (nWaitAudio <= nWaitThreshold) {
-                    //時折まだパケットが来ているのにタイミングによってsize() == 0が成立することがある
-                    //なのである程度連続でパケットが来ていないときのみ無視するようにする
-                    //このようにすることで適切に同期がとれる
-                    break;
-                }
-                audioDts = videoDts;
-                //AddMessage(RGY_LOG_TRACE, _T("audio not coming.\n"));
-            }
-            //一定以上の音声フレームがキューにたまっており、動画キューになにもなければ、
-            //動画を無視して音声フレームの処理を開始させる
-            const size_t audioPacketThreshold = std::min<size_t>(6144, m_Mux.thread.qAudioPacketOut.capacity()) - nWaitThreshold;
-            if (m_Mux.thread.qVideobitstream.size() == 0 && m_Mux.thread.qAudioPacketOut.size() > audioPacketThreshold) {
-                nWaitVideo++;
-                if (nWaitVideo <= nWaitThreshold) {
-                    //時折まだパケットが来ているのにタイミングによってsize() == 0が成立することがある
-                    //なのである程度連続でパケットが来ていないときのみ無視するようにする
-                    //このようにすることで適切に同期がとれる
-                    break;
+            auto& stream = streams[idx];
+            int64_t duration = 0;
+            const int64_t dts = AudioPacketQueueDts(&pktData, bThAudProcess, &duration);
+            //dtsが得られなければ、直前のパケットの続きとする
+            pktData.dts = (dts != AV_NOPTS_VALUE) ? dts : stream.nextDts;
+            stream.pending.push_back(pktData);
+            audioPending++;
+            if (stream.pending.size() == 1) {
+                stream.idle = false;
+                updateHeap(idx);
+            }
+        }
+    };
+    auto writeVideo = [&]() {
+        AVMuxVideoBitstream video;
+        if (!m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&video, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr)) {
+            return false;
+        }
+        int64_t videoDts = 0;
+        WriteNextFrameInternal(&video.bitstream, &videoDts, video.poolLease);
+        if (videoIdx >= 0) {
+            streams[videoIdx].nextDts = videoDts + videoFrameDts;
+            streams[videoIdx].idle = false;
+        }
+        return true;
+    };
+    auto writeAudio = [&](int idx) {
+        auto& stream = streams[idx];
+        AVPktMuxData pktData = stream.pending.front();
+        stream.pending.pop_front();
+        audioPending--;
+        const int64_t dtsEstimated = pktData.dts;
+        int64_t duration = 0;
+        AudioPacketQueueDts(&pktData, bThAudProcess, &duration);
+        writeAudioPacket(&pktData);
+        //音声処理スレッドがない場合、エンコードする音声のdtsは書き出し後も見積もりのまま
+        stream.nextDts = std::max(stream.nextDts, std::max(dtsEstimated, pktData.dts) + duration);
+    };
+    //終端のパケットを処理する、以降、音声は同期の対象としない
+    auto writeFlush = [&]() {
+        flushPending = false;
+        writeAudioPacket(&flushPkt);
+        for (int i = audioStreamOffset; i < (int)streams.size(); i++) {
+            streams[i].finished = true;
+            updateHeap(i);
+        }
+    };
+    //heapから最小のストリームを取り出す、なければ-1
+    auto topStream = [&]() {
+        while (!heap.empty()) {
+            const auto top = heap.top();
+            if (top.generation == streams[top.idx].generation) {
+                return top.idx;
+            }
+            heap.pop();
+        }
+        return -1;
+    };
+    auto streamHasData = [&](int idx) {
+        return (idx == videoIdx) ? !m_Mux.thread.qVideobitstream.empty() : !streams[idx].pending.empty();
+    };
+    //ストリームidxのデータを待つ代わりに、同期の対象から外すべきか
+    auto streamShouldSkip = [&](int idx) {
+        if (idx == videoIdx) {
+            return audioPending >= std::min<size_t>(6144, m_Mux.thread.qAudioPacketOut.capacity());
+        }
+        //終端のパケットが来ていれば、これ以上データは来ない
+        return flushPending
+            || m_Mux.thread.qVideobitstream.size() > videoPacketThreshold
+            || audioPending >= std::min<size_t>(6144, m_Mux.thread.qAudioPacketOut.capacity());
+    };
+
+    int64_t waitCount = 0;
+    int skipCount = 0;
+    while (!m_Mux.thread.abortOutput) {
+        if (!m_Mux.format.fileHeaderWritten) {
+            //ヘッダーを書き出すまでは映像のみを処理する
+            //ヘッダー取得前に音声キューのサイズが足りず、エンコードが進まなくなってしまうことがある
+            //キューのcapcityを増やすことでこれを回避する
+            auto type = (m_Mux.thread.thAudEncode.joinable()) ? AUD_QUEUE_ENCODE : AUD_QUEUE_OUT;
+            auto& qAudio = (type == AUD_QUEUE_OUT) ? m_Mux.thread.qAudioPacketOut : m_Mux.thread.qAudioFrameEncode;
+            const auto nQueueCapacity = qAudio.capacity();
+            if (qAudio.size() >= nQueueCapacity) {
+                qAudio.set_capacity(nQueueCapacity * 3 / 2);
+            }
+            if (!writeVideo()) {
+                ResetEvent(m_Mux.thread.heEventPktAddedOutput);
+                if (m_Mux.thread.qVideobitstream.empty() && !m_Mux.format.fileHeaderWritten) {
+                    WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, INFINITE);
                 }
-                videoDts = audioDts;
-                //AddMessage(RGY_LOG_TRACE, _T("video not coming.\n"));
-            }
-        } while (bAudioExists || bVideoExists); //両方のキューがひとまず空になるか、映像・音声の同期待ちが必要になるまで回す
-                                                //次のフレーム・パケットが送られてくるまで待機する
-        //キューの容量が両方とも半分以下なら、すこし待ってみる
-        //一方、どちらかのキューが半分以上使われていれば、なるべく早く処理する必要がある
-        if (   m_Mux.thread.qVideobitstream.size() / (double)m_Mux.thread.qVideobitstream.capacity() < 0.5
-            && m_Mux.thread.qAudioPacketOut.size() / (double)m_Mux.thread.qAudioPacketOut.capacity() < 0.5) {
-            ResetEvent(m_Mux.thread.heEventPktAddedOutput);
-            WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, 16);
-        } else {
-            std::this_thread::yield();
+            } else if (videoIdx >= 0) {
+                updateHeap(videoIdx);
+            }
+            continue;
+        }
+        drainAudio(false);
+        if (flushPending && audioPending == 0) {
+            writeFlush();
+            continue;
+        }
+        //同期の対象外になっていた映像にデータが来ていれば戻す
+        if (videoIdx >= 0 && streams[videoIdx].idle && !m_Mux.thread.qVideobitstream.empty()) {
+            streams[videoIdx].idle = false;
+            updateHeap(videoIdx);
+        }
+        const int idx = topStream();
+        if (idx >= 0 && streamHasData(idx)) {
+            (idx == videoIdx) ? (void)writeVideo() : writeAudio(idx);
+            updateHeap(idx);
+            continue;
+        }
+        if (idx >= 0 && streamShouldSkip(idx)) {
+            //データが来ないストリームは、次にデータが来るまで同期の対象から外す
+            streams[idx].idle = true;
+            updateHeap(idx);
+            skipCount++;
+            continue;
+        }
+        //最小のストリームにデータが来るまで待機する
+        //キューへの追加側はpushのあとにSetEventするので、ResetEventのあとでキューを確認してから待機すれば通知を取りこぼさない
+        //終了時はCloseThreadがheEventClosingOutputがセットされるまでSetEventを繰り返すので、タイムアウトは不要
+        ResetEvent(m_Mux.thread.heEventPktAddedOutput);
+        if (idx == videoIdx && idx >= 0) {
+            if (m_Mux.thread.qVideobitstream.empty()) {
+                waitCount++;
+                WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, INFINITE);
+            }
+        } else if (m_Mux.thread.qAudioPacketOut.empty()) {
+            waitCount++;
+            WaitForSingleObject(m_Mux.thread.heEventPktAddedOutput, INFINITE);
         }
     }
     //メインループを抜けたことを通知する
     SetEvent(m_Mux.thread.heEventClosingOutput);
     m_Mux.thread.qAudioPacketOut.set_keep_length(0);
     m_Mux.thread.qVideobitstream.set_keep_length(0);
-    bAudioExists = !m_Mux.thread.qAudioPacketOut.empty();
-    bVideoExists = !m_Mux.thread.qVideobitstream.empty();
-    //まずは映像と音声の同期をとって出力するためのループ
-    while (bAudioExists && bVideoExists) {
-        AVPktMuxData pktData = { 0 };
-        while (audioDts <= videoDts + dtsThreshold
-            && false != (bAudioExists = m_Mux.thread.qAudioPacketOut.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr))) {
-            //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-            const int64_t maxDts = (videoDts >= 0) ? videoDts + dtsThreshold : INT64_MAX;
-            (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, maxDts);
-            //複数のstreamがあり得るので最大値をとる
-            audioDts = (std::max)(audioDts, pktData.dts);
-        }
-        RGYBitstream bitstream = RGYBitstreamInit();
-        while (videoDts <= audioDts + dtsThreshold
-            && false != (bVideoExists = m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr))) {
-            WriteNextFrameInternal(&bitstream, &videoDts);
-        }
-        bAudioExists = !m_Mux.thread.qAudioPacketOut.empty();
-        bVideoExists = !m_Mux.thread.qVideobitstream.empty();
-    }
-    { //音声を書き出す
-        AVPktMuxData pktData = { 0 };
-        while (m_Mux.thread.qAudioPacketOut.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr)) {
-            //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-            (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, INT64_MAX);
+    //残りをすべてdts順に書き出す、もう待機はしない
+    for (;;) {
+        drainAudio(true);
+        if (flushPending && audioPending == 0) {
+            writeFlush();
+            continue;
         }
-    }
-    { //動画を書き出す
-        RGYBitstream bitstream = RGYBitstreamInit();
-        while (m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr)) {
-            WriteNextFrameInternal(&bitstream, &videoDts);
+        if (videoIdx >= 0 && streams[videoIdx].idle && !m_Mux.thread.qVideobitstream.empty()) {
+            streams[videoIdx].idle = false;
+            updateHeap(videoIdx);
         }
+        const int idx = topStream();
+        if (idx < 0) {
+            break;
+        }
+        if (!streamHasData(idx)) {
+            streams[idx].finished = true;
+            updateHeap(idx);
+            continue;
+        }
+        (idx == videoIdx) ? (void)writeVideo() : writeAudio(idx);
+        updateHeap(idx);
     }
+    AddMessage(RGY_LOG_DEBUG, _T("output thread: waited %lld times, skipped %d times.\n"), (lls)waitCount, skipCount);
 #endif
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
@@ -3327,10 +3825,15 @@ HANDLE RGYOutputAvcodec::getThreadHandleAudEncode() {
 
 #if USE_CUSTOM_IO
 int RGYOutputAvcodec::readPacket(uint8_t *buf, int buf_size) {
+    if (m_Mux.format.asyncWriter) {
+        return (int)m_Mux.format.asyncWriter->read(buf, buf_size);
+    }
     return (int)_fread_nolock(buf, 1, buf_size, m_Mux.format.fpOutput);
 }
 int RGYOutputAvcodec::writePacket(uint8_t *buf, int buf_size) {
-    int res = (int)_fwrite_nolock(buf, 1, buf_size, m_Mux.format.fpOutput);
+    int res = (m_Mux.format.asyncWriter)
+        ? (int)m_Mux.format.asyncWriter->write(buf, buf_size)
+        : (int)_fwrite_nolock(buf, 1, buf_size, m_Mux.format.fpOutput);
     if (res < buf_size) {
         AddMessage(RGY_LOG_ERROR, _T("Error writing file.\nNot enough disk space!\""));
         m_Mux.format.streamError = true;
@@ -3338,6 +3841,9 @@ int RGYOutputAvcodec::writePacket(uint8_t *buf, int buf_size) {
     return res;
 }
 int64_t RGYOutputAvcodec::seek(int64_t offset, int whence) {
+    if (m_Mux.format.asyncWriter) {
+        return m_Mux.format.asyncWriter->seek(offset, whence);
+    }
     return _fseeki64(m_Mux.format.fpOutput, offset, whence);
 }
 #endif //USE_CUSTOM_IO
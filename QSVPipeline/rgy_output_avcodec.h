@@ -35,12 +35,14 @@
 #if ENABLE_AVSW_READER
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include <cstdint>
 #include "rgy_avutil.h"
 #include "rgy_bitstream.h"
 #include "rgy_input_avcodec.h"
 #include "rgy_output.h"
 #include "rgy_perf_monitor.h"
+#include "rgy_thread_pool.h"
 #include "rgy_util.h"
 #if ENCODER_NVENC
 #include "NVEncUtil.h"
@@ -58,8 +60,8 @@ using std::vector;
 
 static const int SUB_ENC_BUF_MAX_SIZE = 1024 * 1024;
 
-static const int VID_BITSTREAM_QUEUE_SIZE_I  = 4;
-static const int VID_BITSTREAM_QUEUE_SIZE_PB = 64;
+static const int VID_BITSTREAM_POOL_MAX_FREE = 64;                     //プールに保持しておく空きバッファの最大数
+static const size_t VID_BITSTREAM_POOL_MAX_BYTES = 256 * 1024 * 1024;   //エンコーダのバッファと入れ替えて出力スレッドに渡すバッファの合計サイズの上限
 
 struct AVMuxTimestamp {
     int64_t timestamp_list[8];
@@ -107,6 +109,7 @@ typedef struct AVMuxFormat {
     FILE                 *fpOutput;             //出力ファイルポインタ
     char                 *outputBuffer;         //出力ファイルポインタ用のバッファ
     uint32_t              outputBufferSize;     //出力ファイルポインタ用のバッファサイズ
+    RGYAsyncFileWriter   *asyncWriter;          //非同期書き込み (使用しない場合はnullptr)
 #endif //USE_CUSTOM_IO
     bool                  streamError;          //エラーが発生
     bool                  isMatroska;           //mkvかどうか
@@ -114,6 +117,7 @@ typedef struct AVMuxFormat {
     bool                  fileHeaderWritten;    //ファイルヘッダを出力したかどうか
     AVDictionary         *headerOptions;        //ヘッダオプション
     bool                  disableMp4Opt;        //mp4出力時のmuxの最適化(faststart)を無効にする
+    int                   mp4Fragment;          //fragmented mp4で出力する際のフラグメントの最短の長さ(ms) (-1: 無効, 0: GOPごと)
 } AVMuxFormat;
 
 typedef struct AVMuxVideo {
@@ -222,29 +226,159 @@ enum {
 };
 
 #if ENABLE_AVCODEC_OUT_THREAD
+//映像のbitstreamのバッファを使いまわすためのプール
+//出力スレッド使用時には、エンコーダのバッファをプールのバッファと入れ替えてコピーせずに出力スレッドに渡す
+//出力スレッドではバッファをそのままAVPacketの参照するバッファとし、参照されなくなった時点でプールに回収する
+class RGYBitstreamPool {
+public:
+    RGYBitstreamPool();
+    ~RGYBitstreamPool();
+
+    void init(size_t maxBytesOut, int maxFree);
+    void close();
+
+    //bufsize以上のバッファをpBitstreamに割り当て、貸し出し番号をleaseに返す
+    RGY_ERR get(RGYBitstream *pBitstream, size_t bufsize, int *lease);
+    //エンコーダのバッファとの入れ替えに使用できるか (貸し出し中のバッファの合計が上限を超えないか)
+    bool canSwap(size_t bufsize);
+    //pBitstreamのバッファを返却する
+    //途中でchangeSize等によりバッファが置き換わっていてもよく、get()時に計上したサイズを差し引く
+    void release(RGYBitstream *pBitstream, int lease);
+    //pBitstreamのバッファを参照するAVBufferRefを作成する
+    //pBitstreamのバッファの所有権はAVBufferRefに移り、参照されなくなった時点でプールに返却される
+    AVBufferRef *wrap(RGYBitstream *pBitstream, int lease);
+
+    int64_t countSwapped() const { return m_countSwapped; }
+    int64_t countCopied() const { return m_countCopied; }
+    void addSwapped() { m_countSwapped++; }
+    void addCopied() { m_countCopied++; }
+    int countAlloc() const { return m_countAlloc; }
+    size_t peakBytesOut() const { return m_peakBytesOut; }
+protected:
+    //貸し出し中のバッファの情報
+    //AVBufferRefのopaqueとして渡すため、アドレスが変わらないようにunique_ptrで保持する
+    struct Lease {
+        RGYBitstreamPool *pool;
+        int index;       //m_leases内の位置
+        size_t bytesOut; //get()時にm_bytesOutに計上したサイズ
+        size_t bufsize;  //AVBufferRefに渡したバッファのサイズ
+    };
+    static void releaseAVBuffer(void *opaque, uint8_t *data);
+    void releaseBuffer(uint8_t *bufptr, size_t bufsize, int lease);
+
+    std::mutex m_mtx;
+    std::vector<std::pair<uint8_t *, size_t>> m_free;   //空きバッファ
+    std::vector<std::unique_ptr<Lease>> m_leases;       //貸し出し情報
+    std::vector<int> m_leaseFree;                       //使用されていないm_leasesの位置
+    size_t m_maxBytesOut;  //貸し出し中のバッファの合計サイズの上限
+    int m_maxFree;         //保持する空きバッファの最大数
+    size_t m_bytesOut;     //貸し出し中のバッファの合計サイズ
+    size_t m_peakBytesOut; //貸し出し中のバッファの合計サイズの最大値
+    int m_countAlloc;      //バッファを確保した回数
+    std::atomic<int64_t> m_countSwapped; //コピーせずに出力スレッドに渡したフレーム数
+    std::atomic<int64_t> m_countCopied;  //コピーして出力スレッドに渡したフレーム数
+};
+
+//RGYBitstreamPoolから貸し出されたバッファを、どの経路で抜けても返却する
+class RGYBitstreamPoolGuard {
+public:
+    RGYBitstreamPoolGuard(RGYBitstreamPool *pool, RGYBitstream *bitstream, int lease) : m_pool(pool), m_bitstream(bitstream), m_lease(lease) {};
+    ~RGYBitstreamPoolGuard() {
+        if (m_lease >= 0) {
+            m_pool->release(m_bitstream, m_lease);
+        }
+    }
+    //バッファの所有権が他に移ったので、返却しない
+    void dismiss() { m_lease = -1; }
+private:
+    RGYBitstreamPoolGuard(const RGYBitstreamPoolGuard&) = delete;
+    RGYBitstreamPoolGuard& operator=(const RGYBitstreamPoolGuard&) = delete;
+    RGYBitstreamPool *m_pool;
+    RGYBitstream *m_bitstream;
+    int m_lease;
+};
+
+//出力スレッドに渡す映像のbitstream
+struct AVMuxVideoBitstream {
+    RGYBitstream bitstream;
+    int          poolLease; //RGYBitstreamPoolの貸し出し番号
+};
+
+//音声処理スレッドが受け取ったパケット1つ分の処理単位
+//トラック並列処理時には、音声処理スレッドが受け取った順 (=demuxerのdts順) に並べておき、
+//処理の完了したものから順に結果を出力キューに渡すことで、トラックごとに並列に処理しても出力順を保つ
+struct AVMuxAudioProcessItem {
+    AVPktMuxData              pktData;  //処理前のパケット
+    std::vector<AVPktMuxData> results;  //処理結果 (出力キューに渡すパケット)
+    std::atomic<bool>         done;     //処理が完了したか
+
+    AVMuxAudioProcessItem(const AVPktMuxData& data) : pktData(data), results(), done(false) {};
+};
+
+//トラック並列処理時の入力トラックごとのワーカー
+//入力トラック (とそのサブトラック) のデコード/フィルタ/エンコードをスレッドプール上で順に処理する
+struct AVMuxAudioTrackWorker {
+    int                                 inTrackId;  //担当する入力トラック番号
+    std::mutex                          mtx;
+    std::deque<AVMuxAudioProcessItem *> queue;      //処理待ちのパケット
+    bool                                running;    //スレッドプールでタスクが実行中か
+    uint64_t                            processed;  //処理したパケット数
+    size_t                              peakQueue;  //処理待ちのパケット数の最大値
+
+    AVMuxAudioTrackWorker(int trackId) : inTrackId(trackId), mtx(), queue(), running(false), processed(0), peakQueue(0) {};
+};
+
+//出力スレッドでdts順に書き出すためのストリームごとの情報
+struct AVMuxInterleaveStream {
+    AVMuxAudio              *muxAudio;   //音声ストリーム (映像ならnullptr)
+    std::deque<AVPktMuxData> pending;    //書き出し待ちの音声パケット (dtsには書き出し前に見積もったdtsを格納)
+    int64_t                  nextDts;    //次のパケットのdtsの見込み (QUEUE_DTS_TIMEBASE)
+    bool                     idle;       //データが来ないため、次にデータが来るまで同期の対象から外している
+    bool                     finished;   //終端に達したため、同期の対象から外している
+    uint32_t                 generation; //heapに追加したキーの世代 (キーを更新するたびに増やす)
+
+    AVMuxInterleaveStream(AVMuxAudio *audio) : muxAudio(audio), pending(), nextDts(0), idle(false), finished(false), generation(0) {};
+};
+
+//出力スレッドのmin-heapのキー
+struct AVMuxInterleaveKey {
+    int64_t  dts;        //ストリームの次のパケットのdts
+    int      idx;        //ストリームのindex
+    uint32_t generation; //追加した時点のストリームの世代 (一致しなければ古いキー)
+
+    AVMuxInterleaveKey(int64_t dts_, int idx_, uint32_t generation_) : dts(dts_), idx(idx_), generation(generation_) {};
+    bool operator>(const AVMuxInterleaveKey& x) const {
+        return (dts != x.dts) ? dts > x.dts : idx > x.idx;
+    }
+};
+
 typedef struct AVMuxThread {
-    bool                           enableOutputThread;        //出力スレッドを使用する
-    bool                           enableAudProcessThread;    //音声処理スレッドを使用する
-    bool                           enableAudEncodeThread;     //音声エンコードスレッドを使用する
-    std::atomic<bool>              abortOutput;               //出力スレッドに停止を通知する
-    std::thread                    thOutput;                  //出力スレッド(mux部分を担当)
-    std::atomic<bool>              thAudProcessAbort;         //音声処理スレッドに停止を通知する
-    std::thread                    thAudProcess;              //音声処理スレッド(デコード/thAudEncodeがなければエンコードも担当)
-    std::atomic<bool>              thAudEncodeAbort;          //音声エンコードスレッドに停止を通知する
-    std::thread                    thAudEncode;               //音声エンコードスレッド(エンコードを担当)
-    HANDLE                         heEventPktAddedOutput;     //キューのいずれかにデータが追加されたことを通知する
-    HANDLE                         heEventClosingOutput;      //出力スレッドが停止処理を開始したことを通知する
-    HANDLE                         heEventPktAddedAudProcess; //キューのいずれかにデータが追加されたことを通知する
-    HANDLE                         heEventClosingAudProcess;  //音声処理スレッドが停止処理を開始したことを通知する
-    HANDLE                         heEventPktAddedAudEncode;  //キューのいずれかにデータが追加されたことを通知する
-    HANDLE                         heEventClosingAudEncode;   //音声処理スレッドが停止処理を開始したことを通知する
-    RGYQueueSPSP<RGYBitstream, 64> qVideobitstreamFreeI;      //映像 Iフレーム用に空いているデータ領域を格納する
-    RGYQueueSPSP<RGYBitstream, 64> qVideobitstreamFreePB;     //映像 P/Bフレーム用に空いているデータ領域を格納する
-    RGYQueueSPSP<RGYBitstream, 64> qVideobitstream;           //映像パケットを出力スレッドに渡すためのキュー
-    RGYQueueSPSP<AVPktMuxData, 64> qAudioPacketProcess;       //処理前音声パケットをデコード/エンコードスレッドに渡すためのキュー
-    RGYQueueSPSP<AVPktMuxData, 64> qAudioFrameEncode;         //デコード済み音声フレームをエンコードスレッドに渡すためのキュー
-    RGYQueueSPSP<AVPktMuxData, 64> qAudioPacketOut;           //音声パケットを出力スレッドに渡すためのキュー
-    PerfQueueInfo                 *queueInfo;                //キューの情報を格納する構造体
+    bool                               enableOutputThread;        //出力スレッドを使用する
+    bool                               enableAudProcessThread;    //音声処理スレッドを使用する
+    bool                               enableAudEncodeThread;     //音声エンコードスレッドを使用する
+    bool                               enableAudTrackParallel;    //音声をトラックごとに並列に処理する
+    std::atomic<bool>                  abortOutput;               //出力スレッドに停止を通知する
+    std::thread                        thOutput;                  //出力スレッド(mux部分を担当)
+    std::atomic<bool>                  thAudProcessAbort;         //音声処理スレッドに停止を通知する
+    std::thread                        thAudProcess;              //音声処理スレッド(デコード/thAudEncodeがなければエンコードも担当)
+    std::atomic<bool>                  thAudEncodeAbort;          //音声エンコードスレッドに停止を通知する
+    std::thread                        thAudEncode;               //音声エンコードスレッド(エンコードを担当)
+    HANDLE                             heEventPktAddedOutput;     //キューのいずれかにデータが追加されたことを通知する
+    HANDLE                             heEventClosingOutput;      //出力スレッドが停止処理を開始したことを通知する
+    HANDLE                             heEventPktAddedAudProcess; //キューのいずれかにデータが追加されたことを通知する
+    HANDLE                             heEventClosingAudProcess;  //音声処理スレッドが停止処理を開始したことを通知する
+    HANDLE                             heEventPktAddedAudEncode;  //キューのいずれかにデータが追加されたことを通知する
+    HANDLE                             heEventClosingAudEncode;   //音声処理スレッドが停止処理を開始したことを通知する
+    RGYQueueSPSPRing<AVMuxVideoBitstream, 64> qVideobitstream;    //映像パケットを出力スレッドに渡すためのキュー
+    RGYQueueSPSPRing<AVPktMuxData, 64> qAudioPacketProcess;       //処理前音声パケットをデコード/エンコードスレッドに渡すためのキュー
+    RGYQueueSPSPRing<AVPktMuxData, 64> qAudioFrameEncode;         //デコード済み音声フレームをエンコードスレッドに渡すためのキュー
+    RGYQueueSPSPRing<AVPktMuxData, 64> qAudioPacketOut;           //音声パケットを出力スレッドに渡すためのキュー
+    std::vector<std::unique_ptr<AVMuxAudioTrackWorker>> audTrackWorkers;          //トラック並列処理時の入力トラックごとのワーカー
+    std::deque<std::unique_ptr<AVMuxAudioProcessItem>>  audProcessPending;        //トラック並列処理時の処理中のパケット (受け取った順、音声処理スレッドのみが操作する)
+    size_t                                              audProcessPendingMax;     //audProcessPendingの上限 (これを超えたら先頭の完了を待つ)
+    size_t                                              audProcessPendingPeak;    //audProcessPendingの最大値
+    RGYTaskGroup                                        audTrackTasks;            //トラック並列処理のタスクの完了待ち用
+    PerfQueueInfo                     *queueInfo;                 //キューの情報を格納する構造体
 } AVMuxThread;
 #endif
 
@@ -298,6 +432,7 @@ struct AvcodecWriterPrm {
     int                          audioResampler;          //音声のresamplerの選択
     uint32_t                     audioIgnoreDecodeError;  //音声デコード時に発生したエラーを無視して、無音に置き換える
     int                          bufSizeMB;               //出力バッファサイズ
+    bool                         asyncWrite;              //出力ファイルへの書き込みを書き込みスレッドで非同期に行う
     int                          threadOutput;            //出力スレッド数
     int                          threadAudio;             //音声処理スレッド数
     muxOptList                   muxOpt;                  //mux時に使用するオプション
@@ -308,6 +443,7 @@ struct AvcodecWriterPrm {
     std::string                  videoCodecTag;           //動画タグ
     bool                         afs;                     //入力が自動フィールドシフト
     bool                         disableMp4Opt;           //mp4出力時のmuxの最適化を無効にする
+    int                          mp4Fragment;             //fragmented mp4で出力する際のフラグメントの最短の長さ(ms) (-1: 無効)
 
     AvcodecWriterPrm() :
         inputFormatMetadata(nullptr),
@@ -323,6 +459,7 @@ struct AvcodecWriterPrm {
         audioResampler(0),
         audioIgnoreDecodeError(0),
         bufSizeMB(0),
+        asyncWrite(false),
         threadOutput(0),
         threadAudio(0),
         muxOpt(),
@@ -332,7 +469,8 @@ struct AvcodecWriterPrm {
         vidTimestamp(nullptr),
         videoCodecTag(),
         afs(false),
-        disableMp4Opt(false) {
+        disableMp4Opt(false),
+        mp4Fragment(-1) {
     }
 };
 
@@ -375,6 +513,21 @@ protected:
     //別のスレッドで実行する場合のスレッド関数 (音声エンコード処理)
     RGY_ERR ThreadFuncAudEncodeThread();
 
+#if ENABLE_AVCODEC_OUT_THREAD
+    //トラック並列処理時に、パケットを担当するワーカーに渡す (担当のないパケットはその場で処理する)
+    void WriteNextPacketAudioParallel(AVPktMuxData *pktData);
+
+    //トラック並列処理時に、処理の完了したパケットの結果を受け取った順に出力キューに渡す
+    //waitAll = trueなら、処理中のパケットがなくなるまで待機する
+    void WriteAudioProcessedItems(bool waitAll);
+
+    //トラック並列処理のワーカーのタスク (スレッドプール上で実行される)
+    void ThreadFuncAudTrackWorker(AVMuxAudioTrackWorker *worker);
+
+    //入力トラックを担当するワーカーを取得する
+    AVMuxAudioTrackWorker *getAudioTrackWorker(int inTrackId);
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
+
     //音声出力キューに追加 (音声処理スレッドが有効な場合のみ有効)
     RGY_ERR AddAudQueue(AVPktMuxData *pktData, int type);
 
@@ -385,7 +538,8 @@ protected:
     AVPktMuxData pktMuxData(AVFrame *frame);
 
     //WriteNextFrameの本体
-    RGY_ERR WriteNextFrameInternal(RGYBitstream *bitstream, int64_t *writtenDts);
+    //poolLease >= 0 なら、bitstreamのバッファはm_bitstreamPoolから貸し出されたもので、処理後に返却する
+    RGY_ERR WriteNextFrameInternal(RGYBitstream *bitstream, int64_t *writtenDts, int poolLease);
 
     //WriteNextPacketの本体
     RGY_ERR WriteNextPacketInternal(AVPktMuxData *pktData, int64_t maxDtsToWrite);
@@ -494,6 +648,9 @@ protected:
     //パケットを実際に書き出す
     void WriteNextPacketProcessed(AVMuxAudio *muxAudio, AVPacket *pkt, int samples, int64_t *writtenDts);
 
+    //出力キューの音声パケットのdtsを書き出し前に見積もる
+    int64_t AudioPacketQueueDts(const AVPktMuxData *pktData, bool processed, int64_t *duration);
+
     //extradataにH264のヘッダーを追加する
     RGY_ERR AddH264HeaderToExtraData(const RGYBitstream *pBitstream);
 
@@ -522,6 +679,10 @@ protected:
     static const AVRational QUEUE_DTS_TIMEBASE;
     AVMux m_Mux;
     vector<AVPktMuxData> m_AudPktBufFileHead; //ファイルヘッダを書く前にやってきた音声パケットのバッファ
+    RGYNalList m_nalList; //映像のNALの解析結果 (フレームごとに再利用する)
+#if ENABLE_AVCODEC_OUT_THREAD
+    RGYBitstreamPool m_bitstreamPool; //出力スレッドに渡す映像のbitstreamのバッファ
+#endif
 };
 
 #endif //ENABLE_AVSW_READER
@@ -44,6 +44,10 @@
 #include <psapi.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -54,6 +58,52 @@ extern char _binary_PerfMonitor_perf_monitor_pyw_end[];
 extern char _binary_PerfMonitor_perf_monitor_pyw_size[];
 }
 
+
+//単調増加する現在時刻 (100ns単位)
+static int64_t getMonotonicTime100ns() {
+    struct timespec ts = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 10000000 + ts.tv_nsec / 100;
+}
+
+//開いたままの/procのファイルを先頭から読み込む
+///procのファイルは先頭からのpreadで最新の内容が再生成されるので、サンプリングごとに開きなおす必要はない
+static bool readProcFile(int fd, char *buffer, size_t bufferSize) {
+    if (fd < 0) {
+        return false;
+    }
+    const ssize_t len = pread(fd, buffer, bufferSize - 1, 0);
+    if (len <= 0) {
+        return false;
+    }
+    buffer[len] = '\0';
+    return true;
+}
+
+//"key: value"の形式の行からvalueを取得する
+static bool getProcValue(const char *buffer, const char *key, long long *value) {
+    const char *ptr = strstr(buffer, key);
+    if (ptr == nullptr) {
+        return false;
+    }
+    *value = strtoll(ptr + strlen(key), nullptr, 10);
+    return true;
+}
+
+//スレッドのCPU時間(us)を取得する
+//joinされたpthread_tは別スレッドに再利用されうるので、
+//呼び出し側はjoin前にSetThreadHandlesで登録を解除しておく必要がある
+static bool getThreadActiveUs(HANDLE thread, int64_t *time_us) {
+    const pthread_t th = (pthread_t)thread;
+    clockid_t clock_id;
+    struct timespec ts = { 0 };
+    if (pthread_getcpuclockid(th, &clock_id) != 0
+        || clock_gettime(clock_id, &ts) != 0) {
+        return false;
+    }
+    *time_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    return true;
+}
 #endif //#if defined(_WIN32) || defined(_WIN64)
 
 #if ENABLE_METRIC_FRAMEWORK
@@ -494,7 +544,12 @@ CPerfMonitor::CPerfMonitor() :
     m_nSelectOutputLog(0),
     m_nSelectOutputPlot(0),
     m_QueueInfo(),
+    m_nSurfWaitUs(0),
     m_pRGYLog(),
+#if !(defined(_WIN32) || defined(_WIN64))
+    m_fdProcStatus(-1),
+    m_fdProcIO(-1),
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 #if ENABLE_METRIC_FRAMEWORK
     m_pLoader(nullptr),
     m_pManager(),
@@ -534,6 +589,7 @@ void CPerfMonitor::clear() {
     }
     memset(m_info, 0, sizeof(m_info));
     memset(&m_QueueInfo, 0, sizeof(m_QueueInfo));
+    m_nSurfWaitUs = 0;
 #if ENABLE_METRIC_FRAMEWORK
     if (m_pManager) {
         const auto metricsUsed = m_Consumer.getMetricUsed();
@@ -551,6 +607,16 @@ void CPerfMonitor::clear() {
     m_thOutThread = NULL;
     m_bAbort = false;
     m_bEncStarted = false;
+#if !(defined(_WIN32) || defined(_WIN64))
+    if (m_fdProcStatus >= 0) {
+        close(m_fdProcStatus);
+        m_fdProcStatus = -1;
+    }
+    if (m_fdProcIO >= 0) {
+        close(m_fdProcIO);
+        m_fdProcIO = -1;
+    }
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
     if (m_fpLog) {
         fprintf(m_fpLog.get(), "\n\n");
     }
@@ -651,6 +717,9 @@ void CPerfMonitor::write_header(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_QUEUE_VID_IN) {
         str += ",queue vid in";
     }
+    if (nSelect & PERF_MONITOR_QUEUE_VID_DEC) {
+        str += ",queue vid dec,vid dec stall (ms)";
+    }
     if (nSelect & PERF_MONITOR_QUEUE_AUD_IN) {
         str += ",queue aud in";
     }
@@ -660,6 +729,12 @@ void CPerfMonitor::write_header(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_QUEUE_AUD_OUT) {
         str += ",queue aud out";
     }
+    if (nSelect & PERF_MONITOR_QUEUE_WRITE) {
+        str += ",queue write,async write (MB/s)";
+    }
+    if (nSelect & PERF_MONITOR_SURF_WAIT) {
+        str += ",surface wait (ms)";
+    }
     if (nSelect & PERF_MONITOR_MEM_PRIVATE) {
         str += ",mem private (MB)";
     }
@@ -702,7 +777,15 @@ int CPerfMonitor::init(tstring filename, const TCHAR *pPythonPath,
     clear();
     m_pRGYLog = pRGYLog;
 
+#if defined(_WIN32) || defined(_WIN64)
     m_nCreateTime100ns = (int64_t)(clock() * (1e7 / CLOCKS_PER_SEC) + 0.5);
+#else
+    //clock()はプロセスのCPU時間なので、経過時間には単調増加する時刻を使用する
+    m_nCreateTime100ns = getMonotonicTime100ns();
+    //サンプリングごとにプロセスを起動したりファイルを開きなおしたりしないよう、開いたままにしておく
+    m_fdProcStatus = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+    m_fdProcIO = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+#endif //#if defined(_WIN32) || defined(_WIN64)
     m_sMonitorFilename = filename;
     m_nInterval = interval;
     m_nSelectOutputPlot = nSelectOutputPlot;
@@ -853,12 +936,6 @@ int CPerfMonitor::init(tstring filename, const TCHAR *pPythonPath,
 
     //未実装
 #if !(defined(_WIN32) || defined(_WIN64))
-    m_nSelectCheck &= (~PERF_MONITOR_THREAD_MAIN);
-    m_nSelectCheck &= (~PERF_MONITOR_THREAD_ENC);
-    m_nSelectCheck &= (~PERF_MONITOR_THREAD_AUDP);
-    m_nSelectCheck &= (~PERF_MONITOR_THREAD_AUDE);
-    m_nSelectCheck &= (~PERF_MONITOR_THREAD_OUT);
-    m_nSelectCheck &= (~PERF_MONITOR_THREAD_IN);
     m_nSelectCheck &= (~PERF_MONITOR_GPU_CLOCK);
     m_nSelectCheck &= (~PERF_MONITOR_GPU_LOAD);
     m_nSelectCheck &= (~PERF_MONITOR_MFX_LOAD);
@@ -896,6 +973,8 @@ void CPerfMonitor::SetEncStatus(std::shared_ptr<EncodeStatus> encStatus) {
 }
 
 void CPerfMonitor::SetThreadHandles(HANDLE thEncThread, HANDLE thInThread, HANDLE thOutThread, HANDLE thAudProcThread, HANDLE thAudEncThread) {
+    //check()がスレッドCPU時間を取得中の場合は、それが終わるまで待機する
+    std::lock_guard<std::mutex> lock(m_mtxThread);
     m_thEncThread = thEncThread;
     m_thInThread = thInThread;
     m_thOutThread = thOutThread;
@@ -1004,46 +1083,27 @@ void CPerfMonitor::check() {
     getrusage(RUSAGE_SELF, &usage);
 
     //現在時間
-    uint64_t current_time = clock() * (1e7 / CLOCKS_PER_SEC);
+    const int64_t current_time = getMonotonicTime100ns();
 
-    std::string proc_dir = strsprintf("/proc/%d/", (int)getpid());
+    char buffer[4096];
+    long long value = 0;
     //メモリ情報
-    FILE *fp_mem = popen((std::string("cat ") + proc_dir + std::string("status")).c_str(), "r");
-    if (fp_mem) {
-        char buffer[2048] = { 0 };
-        while (NULL != fgets(buffer, _countof(buffer), fp_mem)) {
-            if (nullptr != strstr(buffer, "VmSize")) {
-                long long i = 0;
-                if (1 == sscanf(buffer, "VmSize: %lld kB", &i)) {
-                    pInfoNew->mem_virtual = i << 10;
-                }
-            } else if (nullptr != strstr(buffer, "VmRSS")) {
-                long long i = 0;
-                if (1 == sscanf(buffer, "VmRSS: %lld kB", &i)) {
-                    pInfoNew->mem_private = i << 10;
-                }
-            }
+    if (readProcFile(m_fdProcStatus, buffer, sizeof(buffer))) {
+        if (getProcValue(buffer, "VmSize:", &value)) {
+            pInfoNew->mem_virtual = value << 10;
+        }
+        if (getProcValue(buffer, "VmRSS:", &value)) {
+            pInfoNew->mem_private = value << 10;
         }
-        fclose(fp_mem);
     }
     //IO情報
-    FILE *fp_io = popen((std::string("cat ") + proc_dir + std::string("io")).c_str(), "r");
-    if (fp_io) {
-        char buffer[2048] = { 0 };
-        while (NULL != fgets(buffer, _countof(buffer), fp_io)) {
-            if (nullptr != strstr(buffer, "rchar:")) {
-                long long i = 0;
-                if (1 == sscanf(buffer, "rchar: %lld", &i)) {
-                    pInfoNew->io_total_read = i;
-                }
-            } else if (nullptr != strstr(buffer, "wchar")) {
-                long long i = 0;
-                if (1 == sscanf(buffer, "wchar: %lld", &i)) {
-                    pInfoNew->io_total_write = i;
-                }
-            }
+    if (readProcFile(m_fdProcIO, buffer, sizeof(buffer))) {
+        if (getProcValue(buffer, "rchar:", &value)) {
+            pInfoNew->io_total_read = value;
+        }
+        if (getProcValue(buffer, "wchar:", &value)) {
+            pInfoNew->io_total_write = value;
         }
-        fclose(fp_io);
     }
 
     //CPU情報
@@ -1070,7 +1130,11 @@ void CPerfMonitor::check() {
         //IO情報
         pInfoNew->io_read_per_sec = (pInfoNew->io_total_read - pInfoOld->io_total_read) * time_diff_inv * 1e6;
         pInfoNew->io_write_per_sec = (pInfoNew->io_total_write - pInfoOld->io_total_write) * time_diff_inv * 1e6;
+        pInfoNew->write_async_total = m_QueueInfo.write_async_bytes;
+        pInfoNew->write_async_per_sec = (pInfoNew->write_async_total - pInfoOld->write_async_total) * time_diff_inv * 1e6;
 
+        //スレッドのハンドルはSetThreadHandlesで解除されるまで有効
+        std::lock_guard<std::mutex> lock(m_mtxThread);
 #if defined(_WIN32) || defined(_WIN64)
         //スレッドCPU使用率
         if (m_thMainThread) {
@@ -1133,6 +1197,31 @@ void CPerfMonitor::check() {
                 pInfoNew->out_thread_percent = 0.0;
             }
         }
+#else
+        //スレッドCPU使用率
+        struct ThreadCheck {
+            HANDLE thread;
+            int64_t *total_active_us;
+            double *percent;
+            int64_t prev_active_us;
+        };
+        const ThreadCheck threadChecks[] = {
+            { m_thMainThread.get(), &pInfoNew->main_thread_total_active_us,     &pInfoNew->main_thread_percent,     pInfoOld->main_thread_total_active_us },
+            { m_thEncThread,        &pInfoNew->enc_thread_total_active_us,      &pInfoNew->enc_thread_percent,      pInfoOld->enc_thread_total_active_us },
+            { m_thAudProcThread,    &pInfoNew->aud_proc_thread_total_active_us, &pInfoNew->aud_proc_thread_percent, pInfoOld->aud_proc_thread_total_active_us },
+            { m_thAudEncThread,     &pInfoNew->aud_enc_thread_total_active_us,  &pInfoNew->aud_enc_thread_percent,  pInfoOld->aud_enc_thread_total_active_us },
+            { m_thInThread,         &pInfoNew->in_thread_total_active_us,       &pInfoNew->in_thread_percent,       pInfoOld->in_thread_total_active_us },
+            { m_thOutThread,        &pInfoNew->out_thread_total_active_us,      &pInfoNew->out_thread_percent,      pInfoOld->out_thread_total_active_us },
+        };
+        for (const auto& check : threadChecks) {
+            if (check.thread) {
+                if (getThreadActiveUs(check.thread, check.total_active_us)) {
+                    *check.percent = (*check.total_active_us - check.prev_active_us) * 100.0 * logical_cpu_inv * time_diff_inv;
+                } else {
+                    *check.percent = 0.0;
+                }
+            }
+        }
 #endif //defined(_WIN32) || defined(_WIN64)
     }
 
@@ -1228,6 +1317,9 @@ void CPerfMonitor::write(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_QUEUE_VID_IN) {
         str += strsprintf(",%d", (int)m_QueueInfo.usage_vid_in);
     }
+    if (nSelect & PERF_MONITOR_QUEUE_VID_DEC) {
+        str += strsprintf(",%d,%.3lf", (int)m_QueueInfo.usage_vid_dec, m_QueueInfo.vid_dec_stall_us / 1000.0);
+    }
     if (nSelect & PERF_MONITOR_QUEUE_AUD_IN) {
         str += strsprintf(",%d", (int)m_QueueInfo.usage_aud_in);
     }
@@ -1237,6 +1329,12 @@ void CPerfMonitor::write(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_QUEUE_AUD_OUT) {
         str += strsprintf(",%d", (int)m_QueueInfo.usage_aud_out);
     }
+    if (nSelect & PERF_MONITOR_QUEUE_WRITE) {
+        str += strsprintf(",%d,%lf", (int)m_QueueInfo.usage_write_async, pInfo->write_async_per_sec / (double)(1024 * 1024));
+    }
+    if (nSelect & PERF_MONITOR_SURF_WAIT) {
+        str += strsprintf(",%.3lf", m_nSurfWaitUs.load() / 1000.0);
+    }
     if (nSelect & PERF_MONITOR_MEM_PRIVATE) {
         str += strsprintf(",%.2lf", pInfo->mem_private / (double)(1024 * 1024));
     }
@@ -30,6 +30,8 @@
 #define __RGY_PERF_MONITOR_H__
 
 #include <thread>
+#include <mutex>
+#include <atomic>
 #include <cstdint>
 #include <climits>
 #include <memory>
@@ -91,6 +93,9 @@ enum : int {
     PERF_MONITOR_VEE_LOAD      = 0x04000000,
     PERF_MONITOR_VED_LOAD      = 0x08000000,
     PERF_MONITOR_PCIE_LOAD     = 0x10000000,
+    PERF_MONITOR_SURF_WAIT     = 0x20000000,
+    PERF_MONITOR_QUEUE_VID_DEC = 0x40000000,
+    PERF_MONITOR_QUEUE_WRITE   = (int)0x80000000,
     PERF_MONITOR_ALL         = (int)UINT_MAX,
 };
 
@@ -127,7 +132,9 @@ static const CX_DESC list_pref_monitor[] = {
     { _T("ved_load"),    PERF_MONITOR_VEE_LOAD },
     { _T("pcie_load"),   PERF_MONITOR_PCIE_LOAD },
     { _T("ve_clock"),    PERF_MONITOR_VE_CLOCK },
-    { _T("queue"),       PERF_MONITOR_QUEUE_VID_IN | PERF_MONITOR_QUEUE_VID_OUT | PERF_MONITOR_QUEUE_AUD_IN | PERF_MONITOR_QUEUE_AUD_OUT },
+    { _T("queue"),       PERF_MONITOR_QUEUE_VID_IN | PERF_MONITOR_QUEUE_VID_DEC | PERF_MONITOR_QUEUE_VID_OUT | PERF_MONITOR_QUEUE_AUD_IN | PERF_MONITOR_QUEUE_AUD_OUT | PERF_MONITOR_QUEUE_WRITE },
+    { _T("queue_write"), PERF_MONITOR_QUEUE_WRITE },
+    { _T("surf_wait"),   PERF_MONITOR_SURF_WAIT },
     { nullptr, 0 }
 };
 
@@ -162,6 +169,9 @@ struct PerfInfo {
     double  io_read_per_sec;
     double  io_write_per_sec;
 
+    int64_t write_async_total;
+    double  write_async_per_sec;
+
     double  cpu_percent;
     double  cpu_kernel_percent;
 
@@ -196,11 +206,15 @@ struct PerfOutputInfo {
 
 struct PerfQueueInfo {
     size_t usage_vid_in;
+    size_t usage_vid_dec;   //デコード済みフレームのキューの長さ
+    int64_t vid_dec_stall_us; //デコード済みフレームを待機した時間の累積 (us)
     size_t usage_aud_in;
     size_t usage_vid_out;
     size_t usage_aud_out;
     size_t usage_aud_enc;
     size_t usage_aud_proc;
+    size_t usage_write_async;  //非同期書き込みの書き出し待ちのブロック数
+    int64_t write_async_bytes; //非同期書き込みで書き出したバイト数の累積
 };
 
 #if ENABLE_METRIC_FRAMEWORK
@@ -370,6 +384,9 @@ public:
     PerfQueueInfo *GetQueueInfoPtr() {
         return &m_QueueInfo;
     }
+    std::atomic<int64_t> *GetSurfWaitUsPtr() {
+        return &m_nSurfWaitUs;
+    }
 #if ENABLE_METRIC_FRAMEWORK
     bool GetQSVInfo(QSVGPUInfo *info) {
         return m_Consumer.getMFXLoad(info);
@@ -407,6 +424,7 @@ protected:
     std::unique_ptr<void, handle_deleter> m_thMainThread;
     std::unique_ptr<RGYPipeProcess> m_pProcess;
     ProcessPipe m_pipes;
+    std::mutex m_mtxThread; //m_thXXXThreadの登録・解除とスレッドCPU時間の取得を排他する
     HANDLE m_thEncThread;
     HANDLE m_thInThread;
     HANDLE m_thOutThread;
@@ -427,7 +445,12 @@ protected:
     int m_nSelectOutputLog;
     int m_nSelectOutputPlot;
     PerfQueueInfo m_QueueInfo;
+    std::atomic<int64_t> m_nSurfWaitUs; //空きサーフェスの待機時間の累積 (us)、エンコードスレッドから加算される
     std::shared_ptr<RGYLog> m_pRGYLog;
+#if !(defined(_WIN32) || defined(_WIN64))
+    int m_fdProcStatus; // /proc/self/status
+    int m_fdProcIO;     // /proc/self/io
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 
 #if ENABLE_METRIC_FRAMEWORK
     IExtensionLoader *m_pLoader;
@@ -0,0 +1,233 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "rgy_perf_telemetry.h"
+
+//記録を行うスレッドごとのリングのスロット数
+static const size_t PERF_TELEMETRY_RING_SIZE = 4096;
+//書き出しスレッドがリングを確認する間隔 (ms)
+static const int PERF_TELEMETRY_WRITE_INTERVAL = 10;
+
+RGYPerfTelemetry::Producer::Producer(RGYPerfTelemetry *parent, size_t ringSize) :
+    m_parent(parent),
+    m_ring(),
+    m_frame(0),
+    m_dropped(0) {
+    m_ring.init(ringSize, ringSize);
+}
+
+void RGYPerfTelemetry::Producer::push(const RGYPerfFrameTimes& times, uint32_t bytes) {
+    RGYPerfFrameRecord rec;
+    rec.frame = m_frame++;
+    rec.bytes = bytes;
+    int64_t start = INT64_MAX;
+    for (int i = 0; i < RGY_PERF_STAGE_MAX; i++) {
+        const bool valid = times.begin[i] > 0 && times.end[i] >= times.begin[i];
+        rec.durationUs[i] = (valid) ? (uint32_t)std::min<int64_t>((times.end[i] - times.begin[i]) / 1000, UINT32_MAX) : 0;
+        if (valid) {
+            start = std::min(start, times.begin[i]);
+        }
+    }
+    rec.timeUs = (start == INT64_MAX) ? 0 : start / 1000;
+    //リングが一杯でも記録側は待機しない
+    if (m_ring.size() >= m_ring.capacity()) {
+        m_dropped++;
+        return;
+    }
+    m_ring.push(rec);
+}
+
+RGYPerfTelemetry::RGYPerfTelemetry() :
+    m_start(std::chrono::steady_clock::now()),
+    m_format(RGY_PERF_TELEMETRY_JSON),
+    m_fp(),
+    m_log(),
+    m_producers(),
+    m_durations(),
+    m_recordCount(0),
+    m_thWrite(),
+    m_mtx(),
+    m_cvAbort(),
+    m_abort(false) {
+}
+
+RGYPerfTelemetry::~RGYPerfTelemetry() {
+    close();
+}
+
+RGY_ERR RGYPerfTelemetry::init(const tstring& filename, RGYPerfTelemetryFormat format, std::shared_ptr<RGYLog> log) {
+    close();
+    m_log = log;
+    m_format = format;
+
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, filename.c_str(), (format == RGY_PERF_TELEMETRY_BIN) ? _T("wb") : _T("w")) || fp == nullptr) {
+        m_log->write(RGY_LOG_ERROR, _T("perf telemetry: failed to open \"%s\".\n"), filename.c_str());
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_fp.reset(fp);
+    if (format == RGY_PERF_TELEMETRY_BIN) {
+        RGYPerfTelemetryHeader header = { 0 };
+        memcpy(header.magic, "RGYPTLM", 8);
+        header.version = 1;
+        header.stageCount = RGY_PERF_STAGE_MAX;
+        header.recordSize = sizeof(RGYPerfFrameRecord);
+        fwrite(&header, 1, sizeof(header), m_fp.get());
+    }
+    m_start = std::chrono::steady_clock::now();
+    m_abort = false;
+    m_thWrite = std::thread(&RGYPerfTelemetry::threadFuncWrite, this);
+    m_log->write(RGY_LOG_DEBUG, _T("perf telemetry: output to \"%s\" (%s).\n"),
+        filename.c_str(), get_chr_from_value(list_perf_telemetry_format, format));
+    return RGY_ERR_NONE;
+}
+
+RGYPerfTelemetry::Producer *RGYPerfTelemetry::addProducer() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_producers.push_back(std::unique_ptr<Producer>(new Producer(this, PERF_TELEMETRY_RING_SIZE)));
+    return m_producers.back().get();
+}
+
+void RGYPerfTelemetry::close() {
+    if (m_thWrite.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_abort = true;
+        }
+        m_cvAbort.notify_all();
+        m_thWrite.join();
+        printStats();
+    }
+    m_fp.reset();
+    m_producers.clear();
+    for (auto& durations : m_durations) {
+        durations.clear();
+    }
+    m_recordCount = 0;
+    m_log.reset();
+}
+
+void RGYPerfTelemetry::threadFuncWrite() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cvAbort.wait_for(lock, std::chrono::milliseconds(PERF_TELEMETRY_WRITE_INTERVAL), [this]() { return m_abort; });
+            if (m_abort) {
+                break;
+            }
+        }
+        drain();
+    }
+    //終了時には、残っている記録をすべて書き出す
+    while (drain() > 0);
+    fflush(m_fp.get());
+}
+
+size_t RGYPerfTelemetry::drain() {
+    std::vector<Producer *> producers;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (const auto& producer : m_producers) {
+            producers.push_back(producer.get());
+        }
+    }
+    size_t count = 0;
+    RGYPerfFrameRecord rec;
+    for (auto producer : producers) {
+        while (producer->ring().front_copy_and_pop_no_lock(&rec)) {
+            writeRecord(rec);
+            count++;
+        }
+    }
+    return count;
+}
+
+void RGYPerfTelemetry::writeRecord(const RGYPerfFrameRecord& rec) {
+    for (int i = 0; i < RGY_PERF_STAGE_MAX; i++) {
+        m_durations[i].add(rec.durationUs[i]);
+    }
+    m_recordCount++;
+    if (m_format == RGY_PERF_TELEMETRY_BIN) {
+        fwrite(&rec, 1, sizeof(rec), m_fp.get());
+        return;
+    }
+    char buffer[512];
+    int len = sprintf_s(buffer, "{\"frame\":%u,\"t_us\":%lld,\"bytes\":%u", rec.frame, (long long)rec.timeUs, rec.bytes);
+    for (int i = 0; i < RGY_PERF_STAGE_MAX; i++) {
+        len += sprintf_s(buffer + len, sizeof(buffer) - len, ",\"%s_us\":%u", RGY_PERF_STAGE_NAME[i], rec.durationUs[i]);
+    }
+    len += sprintf_s(buffer + len, sizeof(buffer) - len, "}\n");
+    fwrite(buffer, 1, len, m_fp.get());
+}
+
+void RGYPerfTelemetry::printStats() {
+    if (!m_log) {
+        return;
+    }
+    uint64_t dropped = 0;
+    for (const auto& producer : m_producers) {
+        dropped += producer->dropped();
+    }
+    m_log->write(RGY_LOG_INFO, _T("perf telemetry: %llu frames recorded, %llu dropped.\n"), (unsigned long long)m_recordCount, (unsigned long long)dropped);
+    if (m_recordCount == 0) {
+        return;
+    }
+    //queue以外の段階はエンコードスレッドが順に処理するので(syncはGPUでのエンコードの完了待ち)、
+    //1フレームあたりの時間の合計がエンコードスレッドの1フレームあたりの処理時間となり、
+    //そのうち最も大きな割合を占める段階が処理速度を律速している
+    //queueはエンコーダに投入されてから同期を開始するまでパイプライン内で待っている時間で、
+    //他のフレームの処理と重なっているので、処理時間には含めない
+    double busyTotal = 0.0;
+    for (int i = 0; i < RGY_PERF_STAGE_MAX; i++) {
+        if (i != RGY_PERF_STAGE_QUEUE) {
+            busyTotal += m_durations[i].avg();
+        }
+    }
+    int slowest = -1;
+    double slowestAvg = 0.0;
+    m_log->write(RGY_LOG_INFO, _T("perf telemetry:   stage      avg(ms)    p50(ms)    p99(ms)    max(ms)   share\n"));
+    for (int i = 0; i < RGY_PERF_STAGE_MAX; i++) {
+        const auto& durations = m_durations[i];
+        const uint64_t n = durations.n;
+        const double avg = durations.avg();
+        const uint32_t p50 = durations.value_at(n / 2);
+        const uint32_t p99 = durations.value_at(std::min<uint64_t>(n - 1, n * 99 / 100));
+        const tstring share = (i == RGY_PERF_STAGE_QUEUE || busyTotal <= 0.0) ? _T("     -") : strsprintf(_T("%5.1f%%"), avg * 100.0 / busyTotal);
+        m_log->write(RGY_LOG_INFO, _T("perf telemetry:   %-8s %9.3f  %9.3f  %9.3f  %9.3f  %s\n"),
+            char_to_tstring(RGY_PERF_STAGE_NAME[i]).c_str(), avg * 1e-3, p50 * 1e-3, p99 * 1e-3, durations.max * 1e-3, share.c_str());
+        if (i != RGY_PERF_STAGE_QUEUE && avg > slowestAvg) {
+            slowestAvg = avg;
+            slowest = i;
+        }
+    }
+    if (slowest >= 0) {
+        m_log->write(RGY_LOG_INFO, _T("perf telemetry: busy %.3f ms/frame (excluding queue), bottleneck: %s (%.1f%%)%s\n"),
+            busyTotal * 1e-3, char_to_tstring(RGY_PERF_STAGE_NAME[slowest]).c_str(), slowestAvg * 100.0 / busyTotal,
+            (slowest == RGY_PERF_STAGE_SYNC) ? _T(", waiting for the encoder (GPU)") : _T(""));
+    }
+}
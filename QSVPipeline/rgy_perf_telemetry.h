@@ -0,0 +1,221 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_PERF_TELEMETRY_H__
+#define __RGY_PERF_TELEMETRY_H__
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include "rgy_osdep.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_def.h"
+#include "rgy_util.h"
+#include "rgy_log.h"
+#include "rgy_queue.h"
+
+enum RGYPerfTelemetryFormat {
+    RGY_PERF_TELEMETRY_JSON = 0, //1フレーム1行のJSON
+    RGY_PERF_TELEMETRY_BIN,      //RGYPerfTelemetryHeader + RGYPerfFrameRecordの配列
+};
+
+const CX_DESC list_perf_telemetry_format[] = {
+    { _T("json"), RGY_PERF_TELEMETRY_JSON },
+    { _T("bin"),  RGY_PERF_TELEMETRY_BIN  },
+    { NULL, 0 }
+};
+
+//フレームの処理段階
+enum RGYPerfStage {
+    RGY_PERF_STAGE_DECODE = 0, //入力フレームの取得とデコード
+    RGY_PERF_STAGE_FILTER,     //checkpts, vppプラグイン, vpp
+    RGY_PERF_STAGE_SUBMIT,     //エンコーダへの投入 (EncodeFrameAsync)
+    RGY_PERF_STAGE_QUEUE,      //エンコーダへの投入から同期開始まで
+    RGY_PERF_STAGE_SYNC,       //エンコードの完了待ち (SyncOperation)
+    RGY_PERF_STAGE_WRITE,      //出力 (WriteBitstream)
+    RGY_PERF_STAGE_MAX
+};
+
+static const char *const RGY_PERF_STAGE_NAME[RGY_PERF_STAGE_MAX] = {
+    "decode", "filter", "submit", "queue", "sync", "write"
+};
+
+//タスクごとに保持する各段階の開始・終了時刻 (ns, 0は未記録)
+struct RGYPerfFrameTimes {
+    int64_t begin[RGY_PERF_STAGE_MAX];
+    int64_t end[RGY_PERF_STAGE_MAX];
+
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+    //データ待ちなどで同じ段階を繰り返した場合は、最初の開始時刻を残す
+    void setBegin(RGYPerfStage stage, int64_t t) {
+        if (begin[stage] == 0) {
+            begin[stage] = t;
+        }
+    }
+    void setEnd(RGYPerfStage stage, int64_t t) {
+        end[stage] = t;
+    }
+};
+
+//処理時間(us)の分布
+//2のべき乗ごとにSUB_BUCKET_BITS分に区切ったバケットで数えるので、フレーム数によらずメモリ量は一定
+//パーセンタイルの誤差はバケットの幅 (値の1/32以下) に収まる
+struct RGYPerfHistogram {
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKETS = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    uint64_t count[BUCKETS];
+    uint64_t n;
+    double sum;
+    uint32_t max;
+
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+    void add(uint32_t value) {
+        count[index(value)]++;
+        n++;
+        sum += value;
+        max = (std::max)(max, value);
+    }
+    double avg() const {
+        return (n) ? sum / n : 0.0;
+    }
+    //小さいほうからrank番目(0始まり)の値を含むバケットの中央値を返す
+    uint32_t value_at(uint64_t rank) const {
+        uint64_t cum = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            cum += count[i];
+            if (cum > rank) {
+                return (std::min)(bucket_mid(i), max);
+            }
+        }
+        return max;
+    }
+    static int index(uint32_t value) {
+        if (value < SUB_BUCKETS) {
+            return (int)value;
+        }
+        int e = SUB_BUCKET_BITS;
+        while (e < 31 && (value >> (e + 1))) {
+            e++;
+        }
+        return ((e - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + (int)((value >> (e - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    }
+    static uint32_t bucket_mid(int idx) {
+        if (idx < SUB_BUCKETS) {
+            return (uint32_t)idx;
+        }
+        const int shift = (idx >> SUB_BUCKET_BITS) - 1;
+        const uint64_t lower = (uint64_t)(SUB_BUCKETS + (idx & (SUB_BUCKETS - 1))) << shift;
+        return (uint32_t)(lower + (((uint64_t)1 << shift) - 1) / 2);
+    }
+};
+
+//書き出す1フレーム分の記録
+struct RGYPerfFrameRecord {
+    uint32_t frame;  //出力順のフレーム番号
+    uint32_t bytes;  //出力サイズ (byte)
+    int64_t timeUs;  //最初に記録された段階の開始時刻 (us, 計測開始基準)
+    uint32_t durationUs[RGY_PERF_STAGE_MAX]; //各段階の所要時間 (us)
+};
+
+//バイナリ出力のファイルの先頭
+struct RGYPerfTelemetryHeader {
+    char magic[8];       //"RGYPTLM"
+    uint32_t version;
+    uint32_t stageCount; //RGY_PERF_STAGE_MAX
+    uint32_t recordSize; //sizeof(RGYPerfFrameRecord)
+    uint32_t reserved;
+};
+
+//フレームごとの各段階の処理時間を記録し、書き出しスレッドからファイルに出力する
+//記録側はスレッドごとのリング(RGYPerfTelemetry::Producer)に詰めるだけで、ロックや書き込みを待たない
+//リングが一杯の場合は、その記録を捨てて数だけ数える
+class RGYPerfTelemetry {
+public:
+    //記録を行うスレッドごとに1つ作成する
+    class Producer {
+    public:
+        Producer(RGYPerfTelemetry *parent, size_t ringSize);
+        //計測開始からの時刻 (ns)
+        int64_t now() const { return m_parent->now(); }
+        //1フレーム分の記録をリングに詰める
+        void push(const RGYPerfFrameTimes& times, uint32_t bytes);
+        RGYQueueSPSPRing<RGYPerfFrameRecord>& ring() { return m_ring; }
+        uint64_t dropped() const { return m_dropped; }
+    protected:
+        RGYPerfTelemetry *m_parent;
+        RGYQueueSPSPRing<RGYPerfFrameRecord> m_ring;
+        uint32_t m_frame;
+        std::atomic<uint64_t> m_dropped;
+    };
+
+    RGYPerfTelemetry();
+    ~RGYPerfTelemetry();
+
+    RGY_ERR init(const tstring& filename, RGYPerfTelemetryFormat format, std::shared_ptr<RGYLog> log);
+    //残りの記録をすべて書き出してから閉じ、各段階の処理時間の統計をログに出力する
+    void close();
+
+    Producer *addProducer();
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    }
+protected:
+    void threadFuncWrite();
+    //すべてのリングから記録を取り出して書き出す、書き出した数を返す
+    size_t drain();
+    void writeRecord(const RGYPerfFrameRecord& rec);
+    void printStats();
+
+    std::chrono::steady_clock::time_point m_start;
+    RGYPerfTelemetryFormat m_format;
+    std::unique_ptr<FILE, fp_deleter> m_fp;
+    std::shared_ptr<RGYLog> m_log;
+    std::vector<std::unique_ptr<Producer>> m_producers;
+    RGYPerfHistogram m_durations[RGY_PERF_STAGE_MAX]; //統計用 (書き出しスレッドのみが使用)
+    uint64_t m_recordCount;
+
+    std::thread m_thWrite;
+    std::mutex m_mtx;
+    std::condition_variable m_cvAbort;
+    bool m_abort;
+};
+
+#endif //__RGY_PERF_TELEMETRY_H__
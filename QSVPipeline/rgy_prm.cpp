@@ -107,10 +107,12 @@ RGYParamCommon::RGYParamCommon() :
     audioIgnoreDecodeError(DEFAULT_IGNORE_DECODE_ERROR),
     muxOpt(nullptr),
     disableMp4Opt(false),
+    mp4Fragment(-1),
     chapterFile(),
     AVInputFormat(nullptr),
     AVSyncMode(RGY_AVSYNC_ASSUME_CFR),     //avsyncの方法 (RGY_AVSYNC_xxx)
-    outputBufSizeMB(8) {
+    outputBufSizeMB(8),
+    outputAsync(false) {
 
 }
 
@@ -126,10 +128,16 @@ RGYParamControl::RGYParamControl() :
     threadOutput(RGY_OUTPUT_THREAD_AUTO),
     threadAudio(RGY_AUDIO_THREAD_AUTO),
     threadInput(RGY_INPUT_THREAD_AUTO),
+    threadPool(0),
+    threadPoolAffinity(0),
+    avsPrefetch(0),
+    avsPrefetchThreads(1),
     procSpeedLimit(0),      //処理速度制限 (0で制限なし)
     perfMonitorSelect(0),
     perfMonitorSelectMatplot(0),
-    perfMonitorInterval(RGY_DEFAULT_PERF_MONITOR_INTERVAL) {
+    perfMonitorInterval(RGY_DEFAULT_PERF_MONITOR_INTERVAL),
+    perfTelemetryFile(),
+    perfTelemetryFormat(0) {
 
 }
 RGYParamControl::~RGYParamControl() {};
@@ -186,22 +194,20 @@ bool rearrange_trim_list(int frame, int offset, std::vector<sTrim> &trimList) {
     return false;
 }
 
-#if !FOR_AUO && (defined(_WIN32) || defined(_WIN64))
+#if !FOR_AUO
 unique_ptr<RGYHDR10Plus> initDynamicHDR10Plus(const tstring &dynamicHdr10plusJson, shared_ptr<RGYLog> log) {
     unique_ptr<RGYHDR10Plus> hdr10plus;
     if (!PathFileExists(dynamicHdr10plusJson.c_str())) {
         log->write(RGY_LOG_ERROR, _T("Cannot find the file specified : %s.\n"), dynamicHdr10plusJson.c_str());
     } else {
         hdr10plus = std::unique_ptr<RGYHDR10Plus>(new RGYHDR10Plus());
-        auto ret = hdr10plus->init(dynamicHdr10plusJson);
-        if (ret == RGY_ERR_NOT_FOUND) {
-            log->write(RGY_LOG_ERROR, _T("Cannot find \"%s\" required for --dhdr10-info.\n"), RGYHDR10Plus::HDR10PLUS_GEN_EXE_NAME);
-            hdr10plus.reset();
-        } else if (ret != RGY_ERR_NONE) {
+        auto ret = hdr10plus->init(dynamicHdr10plusJson, log);
+        if (ret != RGY_ERR_NONE) {
             log->write(RGY_LOG_ERROR, _T("Failed to initialize hdr10plus reader: %s.\n"), get_err_mes((RGY_ERR)ret));
             hdr10plus.reset();
+        } else {
+            log->write(RGY_LOG_DEBUG, _T("initialized hdr10plus reader: %s\n"), dynamicHdr10plusJson.c_str());
         }
-        log->write(RGY_LOG_DEBUG, _T("initialized hdr10plus reader: %s\n"), dynamicHdr10plusJson.c_str());
     }
     return hdr10plus;
 }
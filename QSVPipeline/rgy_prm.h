@@ -123,6 +123,7 @@ struct RGYParamCommon {
     int audioIgnoreDecodeError;
     muxOptList *muxOpt;
     bool disableMp4Opt;
+    int mp4Fragment;          //fragmented mp4で出力する際のフラグメントの最短の長さ(ms) (-1: 無効, 0: GOPごと)
     tstring chapterFile;
     tstring keyFile;
     TCHAR *AVInputFormat;
@@ -130,6 +131,7 @@ struct RGYParamCommon {
 
 
     int outputBufSizeMB;         //出力バッファサイズ
+    bool outputAsync;            //出力ファイルへの書き込みを書き込みスレッドで非同期に行う
 
     RGYParamCommon();
     ~RGYParamCommon();
@@ -145,10 +147,16 @@ struct RGYParamControl {
     int threadOutput;
     int threadAudio;
     int threadInput;
+    int threadPool;               //共有スレッドプールのスレッド数 (0で自動)
+    uint64_t threadPoolAffinity;  //共有スレッドプールのaffinity (0で制限なし)
+    int avsPrefetch;              //Avisynthの先読みフレーム数 (0で無効)
+    int avsPrefetchThreads;       //Avisynthの先読みスレッド数
     int procSpeedLimit;      //処理速度制限 (0で制限なし)
     int64_t perfMonitorSelect;
     int64_t perfMonitorSelectMatplot;
     int     perfMonitorInterval;
+    tstring perfTelemetryFile;    //フレームごとの処理時間の出力先
+    int     perfTelemetryFormat;  //RGYPerfTelemetryFormat
 
     RGYParamControl();
     ~RGYParamControl();
@@ -167,6 +175,7 @@ const CX_DESC list_simd[] = {
     { _T("sse41"),    SSE41|SSSE3|SSE3|SSE2 },
     { _T("avx"),      AVX|SSE42|SSE41|SSSE3|SSE3|SSE2 },
     { _T("avx2"),     AVX2|AVX|SSE42|SSE41|SSSE3|SSE3|SSE2 },
+    { _T("avx512"),   AVX512BW|AVX512VL|AVX512DQ|AVX512F|AVX2|AVX|SSE42|SSE41|SSSE3|SSE3|SSE2 },
     { NULL, 0 }
 };
 
@@ -34,6 +34,10 @@
 #include <atomic>
 #include <climits>
 #include <memory>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
 #include "rgy_osdep.h"
 #include "rgy_event.h"
 
@@ -326,4 +330,282 @@ protected:
     std::atomic<int> m_bUsingData; //キューから読み出し中のスレッドの数
 };
 
+//RGYQueueSPSPの固定長リングバッファ版
+//  - スロット数は2のべき乗で、push時にバッファの再確保とmemcpyを行わない
+//  - 押し込み位置(head)と取り出し位置(tail)は別のキャッシュラインに配置し、false sharingを回避する
+//  - 待機はタイマーによるポーリングではなく、相手側からの通知で即座に起床する
+//    待機しているスレッドがいない場合は、通知のためのロックやシステムコールは発生しない
+//maxCapacityがスロット数を超える場合(SIZE_MAXなど)に限り、スロットがすべて埋まった時点で
+//スロット数を倍にする。古いバッファは取り出し側が参照している可能性があるので、close/initまで保持する
+template<typename Type, size_t align_byte = sizeof(Type)>
+class RGYQueueSPSPRing {
+    union queueData {
+        Type data;
+        char pad[((sizeof(Type) + (align_byte-1)) & (~(align_byte-1)))];
+    };
+    struct ringBuffer {
+        size_t mask; //スロット数 - 1
+        queueData *slot;
+    };
+    static const size_t CACHE_LINE_SIZE = 64;
+public:
+    RGYQueueSPSPRing() :
+        m_nMallocAlign(32),
+        m_nMaxCapacity(SIZE_MAX),
+        m_nKeepLength(0),
+        m_pRing(nullptr),
+        m_ringList(),
+        m_nHead(0),
+        m_nWaitPush(0),
+        m_nTail(0),
+        m_nWaitPop(0),
+        m_mtx(),
+        m_cvPushed(),
+        m_cvPoped() {
+        static_assert(std::is_pod<Type>::value == true, "RGYQueueSPSPRing is only for POD type.");
+        for (uint32_t i = 4; i < sizeof(i) * 8; i++) {
+            int test = 1 << i;
+            if (test == align_byte) {
+                m_nMallocAlign = test;
+                break;
+            }
+        }
+    }
+    ~RGYQueueSPSPRing() {
+        close();
+    }
+    //indexの位置への参照を返す
+    // !! push側のスレッドからのみ有効 !!
+    queueData& operator[](uint32_t index) {
+        return *get(index);
+    }
+    //indexの位置へのポインタを返す
+    // !! push側のスレッドからのみ有効 !!
+    queueData *get(uint32_t index = 0) {
+        const ringBuffer *ring = m_pRing.load();
+        return ring->slot + ((m_nTail.load() + index) & ring->mask);
+    }
+    //キューが一定の長さに達しないとfront_copy/popできないように設定する
+    void set_keep_length(size_t keepLength) {
+        m_nKeepLength = keepLength;
+        notify(m_nWaitPop, m_cvPushed);
+    }
+    size_t get_keep_length() {
+        return m_nKeepLength;
+    }
+    //キューを初期化する
+    //bufSizeは2のべき乗に切り上げたものがスロット数となる
+    //maxCapacityはキューに格納できる最大のデータ数
+    //nPushRestartはRGYQueueSPSPとの互換のためのもの
+    //押し込み側が待機している時だけ通知が発生するので、取り出しのたびに通知しても負荷にならず、ここでは使用しない
+    void init(size_t bufSize = 1024, size_t maxCapacity = SIZE_MAX, int nPushRestart = 1) {
+        close();
+        size_t slots = 16;
+        while (slots < bufSize) {
+            slots <<= 1;
+        }
+        alloc(slots);
+        m_nMaxCapacity = maxCapacity;
+        m_nKeepLength = 0;
+    }
+    //キューのデータをクリアする
+    void clear() {
+        m_nTail = m_nHead.load();
+        notify(m_nWaitPush, m_cvPoped);
+    }
+    //キューのデータをクリアする際に、指定した関数で内部データを開放してから、データをクリアする
+    template<typename Func>
+    void clear(Func deleter) {
+        if (m_pRing) {
+            const ringBuffer *ring = m_pRing.load();
+            const size_t head = m_nHead.load();
+            for (size_t i = m_nTail.load(); i != head; i++) {
+                deleter(&ring->slot[i & ring->mask].data);
+            }
+        }
+        clear();
+    }
+    //キューのデータをクリアし、リソースを破棄する
+    void close() {
+        m_pRing = nullptr;
+        m_ringList.clear();
+        m_nHead = 0;
+        m_nTail = 0;
+    }
+    //キューのデータをクリアする際に、指定した関数で内部データを開放してから、リソースを破棄する
+    template<typename Func>
+    void close(Func deleter) {
+        clear(deleter);
+        close();
+    }
+    //データをキューにコピーし押し込む
+    //キューのデータ量があらかじめ設定した上限に達した場合は、キューに空きができるまで待機する
+    bool push(const Type& in) {
+        if (size() >= m_nMaxCapacity) {
+            wait(m_nWaitPush, m_cvPoped, [this]() { return size() < m_nMaxCapacity; });
+        }
+        const size_t head = m_nHead.load(std::memory_order_relaxed);
+        const ringBuffer *ring = m_pRing.load(std::memory_order_relaxed);
+        if (head - m_nTail.load() > ring->mask) {
+            //スロットがすべて埋まっているが、maxCapacityがそれより大きい場合のみここに来る
+            if (nullptr == (ring = grow(head))) {
+                return false;
+            }
+        }
+        memcpy(&ring->slot[head & ring->mask], &in, sizeof(Type));
+        m_nHead.store(head + 1);
+        notify(m_nWaitPop, m_cvPushed);
+        return true;
+    }
+    //キューのsizeを取得する
+    size_t size() const {
+        const size_t tail = m_nTail.load();
+        return m_nHead.load() - tail;
+    }
+    //キューが空ならtrueを返す
+    bool empty() const {
+        return size() == 0;
+    }
+    //キューの最大サイズを取得する
+    size_t capacity() const {
+        return m_nMaxCapacity;
+    }
+    //キューの最大サイズを設定する
+    void set_capacity(size_t capacity) {
+        m_nMaxCapacity = capacity;
+        notify(m_nWaitPush, m_cvPoped);
+    }
+    //indexの位置のコピーを取得する
+    bool copy(Type *out, uint32_t index, size_t *pnSize = nullptr) {
+        const auto nSize = size();
+        const bool bCopy = index < nSize;
+        if (bCopy) {
+            const ringBuffer *ring = m_pRing.load();
+            memcpy(out, &ring->slot[(m_nTail.load(std::memory_order_relaxed) + index) & ring->mask], sizeof(Type));
+        }
+        if (pnSize) {
+            *pnSize = nSize;
+        }
+        return bCopy;
+    }
+    //キューの先頭のデータを取り出す (outにコピーする)
+    //キューが空ならなにもせずfalseを返す
+    bool front_copy_no_lock(Type *out, size_t *pnSize = nullptr) {
+        const auto nSize = size();
+        const bool bCopy = nSize > m_nKeepLength;
+        if (bCopy) {
+            const ringBuffer *ring = m_pRing.load();
+            memcpy(out, &ring->slot[m_nTail.load(std::memory_order_relaxed) & ring->mask], sizeof(Type));
+        }
+        if (pnSize) {
+            *pnSize = nSize;
+        }
+        return bCopy;
+    }
+    //キューの先頭のデータを取り出しながら(outにコピーする)、キューから取り除く
+    //キューが空ならなにもせずfalseを返す
+    bool front_copy_and_pop_no_lock(Type *out, size_t *pnSize = nullptr) {
+        const auto nSize = size();
+        const bool bCopy = nSize > m_nKeepLength;
+        if (bCopy) {
+            const size_t tail = m_nTail.load(std::memory_order_relaxed);
+            const ringBuffer *ring = m_pRing.load();
+            memcpy(out, &ring->slot[tail & ring->mask], sizeof(Type));
+            m_nTail.store(tail + 1);
+            notify(m_nWaitPush, m_cvPoped);
+        }
+        if (pnSize) {
+            *pnSize = nSize;
+        }
+        return bCopy;
+    }
+    //キューの先頭のデータを取り除く
+    //キューが空ならfalseを返す
+    bool pop() {
+        const auto nSize = size();
+        const bool bCopy = nSize > m_nKeepLength;
+        if (bCopy) {
+            m_nTail.store(m_nTail.load(std::memory_order_relaxed) + 1);
+            notify(m_nWaitPush, m_cvPoped);
+        }
+        return bCopy;
+    }
+    //要素が追加されるまで待機する
+    //RGYQueueSPSPと同様、取り出し側が状態を再確認できるよう16ms以内には戻る
+    void wait_for_push() {
+        wait(m_nWaitPop, m_cvPushed, [this]() { return size() > m_nKeepLength; }, 16);
+    }
+protected:
+    //slots分の内部領域を確保する (slotsは2のべき乗)
+    ringBuffer *alloc(size_t slots) {
+        std::unique_ptr<queueData, aligned_malloc_deleter> buf(
+            (queueData *)_aligned_malloc(sizeof(queueData) * slots, (std::max)(16, m_nMallocAlign)), aligned_malloc_deleter());
+        if (!buf) {
+            return nullptr;
+        }
+        std::unique_ptr<ringBuffer> ring(new ringBuffer());
+        ring->mask = slots - 1;
+        ring->slot = buf.get();
+        m_ringList.push_back(std::make_pair(std::move(ring), std::move(buf)));
+        m_pRing = m_ringList.back().first.get();
+        return m_pRing.load();
+    }
+    //スロット数を倍にする (push側からのみ呼ばれる)
+    //データのindex(head/tail)は変わらないので、取り出し側は新旧どちらのバッファから読んでも同じデータを得る
+    const ringBuffer *grow(size_t head) {
+        const ringBuffer *ringOld = m_pRing.load();
+        const size_t slotsNew = (ringOld->mask + 1) * 2;
+        std::unique_ptr<queueData, aligned_malloc_deleter> buf(
+            (queueData *)_aligned_malloc(sizeof(queueData) * slotsNew, (std::max)(16, m_nMallocAlign)), aligned_malloc_deleter());
+        if (!buf) {
+            return nullptr;
+        }
+        for (size_t i = m_nTail.load(); i != head; i++) {
+            memcpy(&buf.get()[i & (slotsNew - 1)], &ringOld->slot[i & ringOld->mask], sizeof(queueData));
+        }
+        std::unique_ptr<ringBuffer> ring(new ringBuffer());
+        ring->mask = slotsNew - 1;
+        ring->slot = buf.get();
+        m_ringList.push_back(std::make_pair(std::move(ring), std::move(buf)));
+        m_pRing = m_ringList.back().first.get();
+        return m_pRing.load();
+    }
+    //待機しているスレッドがあれば起床させる
+    void notify(std::atomic<int>& waiting, std::condition_variable& cv) {
+        if (waiting.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            cv.notify_all();
+        }
+    }
+    //predがtrueになるまで待機する
+    //waitingのインクリメントとpredの確認は、相手側のデータ更新とwaitingの確認に対して逐次一貫なので、通知を取りこぼさない
+    template<typename Pred>
+    void wait(std::atomic<int>& waiting, std::condition_variable& cv, Pred pred, uint32_t millisec = INFINITE) {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        waiting++;
+        if (millisec == INFINITE) {
+            cv.wait(lock, pred);
+        } else {
+            cv.wait_for(lock, std::chrono::milliseconds(millisec), pred);
+        }
+        waiting--;
+    }
+
+    int m_nMallocAlign; //メモリのアライメント
+    std::atomic<size_t> m_nMaxCapacity; //キューに詰められる有効なデータの最大数
+    std::atomic<size_t> m_nKeepLength; //ある一定の長さを常にキュー内に保持するようにする
+    std::atomic<ringBuffer *> m_pRing; //現在のリングバッファ
+    std::vector<std::pair<std::unique_ptr<ringBuffer>, std::unique_ptr<queueData, aligned_malloc_deleter>>> m_ringList; //確保したバッファ (拡張前のものも含む)
+    char m_pad0[CACHE_LINE_SIZE];
+    std::atomic<size_t> m_nHead; //次にデータを格納する位置 (push側のみが更新)
+    std::atomic<int> m_nWaitPush; //空き待ちで待機しているスレッドの数
+    char m_pad1[CACHE_LINE_SIZE];
+    std::atomic<size_t> m_nTail; //次に取り出すデータの位置 (取り出し側のみが更新)
+    std::atomic<int> m_nWaitPop; //データ追加待ちで待機しているスレッドの数
+    char m_pad2[CACHE_LINE_SIZE];
+    std::mutex m_mtx;
+    std::condition_variable m_cvPushed; //キューにデータが追加されたときに通知する
+    std::condition_variable m_cvPoped; //キューからデータを取り出したときに通知する
+};
+
 #endif //__RGY_QUEUE_H__
@@ -112,6 +112,67 @@ public:
         shared_size = 0;
     }
 };
+#else //#if defined(_WIN32) || defined(_WIN64)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+class RGYSharedMemPosix : public RGYSharedMem {
+public:
+    RGYSharedMemPosix() {
+        shared_size = 0;
+        handle = nullptr;
+        buffer = nullptr;
+    };
+    RGYSharedMemPosix(const char *pipename, uint64_t size) : RGYSharedMemPosix() {
+        open(pipename, size);
+    };
+    virtual ~RGYSharedMemPosix() {
+        close();
+    };
+
+    //size > 0 なら作成する (既にある場合はsizeまで拡張する)
+    //size == 0 なら既にあるものを開き、そのサイズを使用する
+    //shm_openで開けない名前は、ファイルのパスとして開く (memfdを/proc/<pid>/fd/<fd>で渡す場合など)
+    void open(const char *pipename, uint64_t size) override {
+        close();
+        int fd = shm_open(pipename, O_RDWR | ((size > 0) ? O_CREAT : 0), 0600);
+        if (fd < 0 && size == 0) {
+            fd = ::open(pipename, O_RDWR);
+        }
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0
+            || (size == 0 && st.st_size <= 0)
+            || (size > 0 && (uint64_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0)) {
+            ::close(fd);
+            return;
+        }
+        if (size == 0) {
+            size = (uint64_t)st.st_size;
+        }
+        void *ptr = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        //マッピング後はfdは不要
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            return;
+        }
+        shared_size = size;
+        buffer = ptr;
+        handle = ptr;
+    }
+    void close() override {
+        if (buffer != nullptr) {
+            munmap(buffer, (size_t)shared_size);
+            buffer = nullptr;
+        }
+        handle = nullptr;
+        shared_size = 0;
+    }
+};
 #endif //#if defined(_WIN32) || defined(_WIN64)
 
 #endif //__RGY_SHARED_MEM_H__
@@ -55,5 +55,12 @@ unsigned int get_availableSIMD() {
     __cpuid(CPUInfo, 7);
     if ((simd & AVX) && (CPUInfo[1] & 0x00000020))
         simd |= AVX2;
+    //AVX512はopmask/ZMMの状態保存(XCR0のbit5-7)もOSが有効にしている必要がある
+    if ((simd & AVX2) && (xgetbv & 0xE6) == 0xE6) {
+        if (CPUInfo[1] & 0x00010000) simd |= AVX512F;
+        if (CPUInfo[1] & 0x00020000) simd |= AVX512DQ;
+        if (CPUInfo[1] & 0x40000000) simd |= AVX512BW;
+        if (CPUInfo[1] & 0x80000000) simd |= AVX512VL;
+    }
     return simd;
 }
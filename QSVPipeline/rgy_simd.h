@@ -62,8 +62,27 @@ enum {
     AVX    = 0x0040,
     AVX2   = 0x0080,
     FMA3   = 0x0100,
+    AVX512F  = 0x0200,
+    AVX512DQ = 0x0400,
+    AVX512BW = 0x0800,
+    AVX512VL = 0x1000,
 };
 
 unsigned int get_availableSIMD();
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif //#ifdef _MSC_VER
+
+//立っている最下位ビットの位置を返す (v != 0であること)
+static inline int rgy_ctz(unsigned int v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return (int)index;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
 #endif //__RGY_SIMD_H__
@@ -43,7 +43,9 @@
 #include "gpuz_info.h"
 #include "rgy_status.h"
 
-EncodeStatus::EncodeStatus() {
+EncodeStatus::EncodeStatus() :
+    m_inputReadTimeUs(0),
+    m_inputWaitTimeUs(0) {
     memset(&m_sData, 0, sizeof(m_sData));
 
     m_sStartTime = std::unique_ptr<PROCESS_TIME>(new PROCESS_TIME());
@@ -372,6 +374,16 @@ void EncodeStatus::WriteResults() {
 #endif
     WriteLineDirect(mes);
 
+    const int64_t inputReadTimeUs = m_inputReadTimeUs.load();
+    if (inputReadTimeUs > 0) {
+        //入力の先読みで、読み込み時間のうちどれだけを色変換/エンコードの裏に隠せたか
+        const double readSec = inputReadTimeUs * 1e-6;
+        const double waitSec = m_inputWaitTimeUs.load() * 1e-6;
+        _stprintf_s(mes, _countof(mes), _T("input read %.2f s, waited %.2f s, hidden by read-ahead %.2f s"),
+            readSec, waitSec, (std::max)(readSec - waitSec, 0.0));
+        WriteLine(mes);
+    }
+
     uint32_t maxCount = (std::max)(m_sData.frameOutI, (std::max)(m_sData.frameOutP, m_sData.frameOutB));
     uint64_t maxFrameSize = (std::max)(m_sData.frameOutISize, (std::max)(m_sData.frameOutPSize, m_sData.frameOutBSize));
 
@@ -397,7 +409,10 @@ void EncodeStatus::SetPrivData(void *pPrivateData) {
 }
 #pragma warning(pop)
 EncodeStatusData EncodeStatus::GetEncodeData() {
-    return m_sData;
+    EncodeStatusData data = m_sData;
+    data.inputReadTimeUs = m_inputReadTimeUs.load();
+    data.inputWaitTimeUs = m_inputWaitTimeUs.load();
+    return data;
 }
 
 void EncodeStatus::WriteLine(const TCHAR *mes) {
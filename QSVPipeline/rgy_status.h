@@ -37,6 +37,7 @@
 #include <string>
 #include <chrono>
 #include <memory>
+#include <atomic>
 #include <vector>
 #include <cmath>
 #include <algorithm>
@@ -88,6 +89,8 @@ typedef struct EncodeStatusData {
     double VEDLoadPercentTotal;
     double VEClockTotal;
     double GPUClockTotal;
+    int64_t inputReadTimeUs;   //入力の先読みで読み込みにかかった時間(us) (GetEncodeData()の時点の値)
+    int64_t inputWaitTimeUs;   //入力の先読みを待った時間(us) (GetEncodeData()の時点の値)
 } EncodeStatusData;
 
 class EncodeStatus {
@@ -108,6 +111,11 @@ public:
     int64_t getStartTimeMicroSec();
     bool getEncStarted();
     virtual void SetPrivData(void *pPrivateData);
+    //入力の先読みの統計を更新する (読み込み側のスレッドから呼ばれる)
+    void SetInputReadTime(int64_t readTimeUs, int64_t waitTimeUs) {
+        m_inputReadTimeUs = readTimeUs;
+        m_inputWaitTimeUs = waitTimeUs;
+    }
     EncodeStatusData GetEncodeData();
     EncodeStatusData m_sData;
 protected:
@@ -123,6 +131,9 @@ protected:
     std::chrono::system_clock::time_point m_tmLastUpdate;     //最終更新時刻
     bool m_bStdErrWriteToConsole;
     bool m_bEncStarted;
+    //読み込み側のスレッドが更新し、パフォーマンスモニタのスレッドからも読まれるのでatomicとする
+    std::atomic<int64_t> m_inputReadTimeUs; //入力の先読みで読み込みにかかった時間(us)
+    std::atomic<int64_t> m_inputWaitTimeUs; //入力の先読みを待った時間(us)
 };
 
 class CProcSpeedControl {
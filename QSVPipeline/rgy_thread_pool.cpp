@@ -0,0 +1,311 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include "rgy_thread_pool.h"
+#include "rgy_util.h"
+#include "cpu_info.h"
+
+//ワーカースレッドのid (ワーカー以外は-1)
+static thread_local int t_workerId = -1;
+
+const TCHAR *get_thread_pool_stage_name(RGYThreadPoolStage stage) {
+    switch (stage) {
+    case RGY_THREAD_POOL_STAGE_CSP:    return _T("csp");
+    case RGY_THREAD_POOL_STAGE_AUDIO:  return _T("audio");
+    case RGY_THREAD_POOL_STAGE_FILTER: return _T("filter");
+    case RGY_THREAD_POOL_STAGE_OTHER:
+    default:                           return _T("other");
+    }
+}
+
+void RGYTaskGroup::wait() {
+    const int self = t_workerId;
+    while (m_pending > 0) {
+        //ワーカーから呼ばれた場合は、全ワーカーが待機して処理が止まってしまわないよう、待機中も他のタスクを処理する
+        if (self >= 0) {
+            if (!RGYThreadPool::get().runOneTask(self)) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv.wait(lock, [this]() { return m_pending == 0; });
+    }
+}
+
+void RGYTaskGroup::done() {
+    if (--m_pending == 0) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_cv.notify_all();
+    }
+}
+
+RGYThreadPool& RGYThreadPool::get() {
+    //ワーカーはプロセス終了まで生かしておく
+    //(dllとして読み込まれた場合、終了時にjoinしようとするとデッドロックするため、意図的に破棄しない)
+    static RGYThreadPool *pool = new RGYThreadPool();
+    return *pool;
+}
+
+RGYThreadPool::RGYThreadPool() :
+    m_mtxInit(),
+    m_started(false),
+    m_nThreads(0),
+    m_affinityMask(0),
+    m_queues(),
+    m_threads(),
+    m_nextQueue(0),
+    m_pending(0),
+    m_sleeping(0),
+    m_mtxSleep(),
+    m_cvSleep(),
+    m_tmStart(std::chrono::steady_clock::now()) {
+    for (int i = 0; i < RGY_THREAD_POOL_STAGE_MAX; i++) {
+        m_stageTasks[i] = 0;
+        m_stageBusyNs[i] = 0;
+    }
+}
+
+RGYThreadPool::~RGYThreadPool() {
+    for (auto& th : m_threads) {
+        th.detach();
+    }
+}
+
+bool RGYThreadPool::setParam(int threads, uint64_t affinityMask) {
+    std::lock_guard<std::mutex> lock(m_mtxInit);
+    if (m_started) {
+        return threads == 0 || threads == m_nThreads;
+    }
+    m_nThreads = threads;
+    m_affinityMask = affinityMask;
+    return true;
+}
+
+int RGYThreadPool::threads() {
+    start();
+    return m_nThreads;
+}
+
+void RGYThreadPool::start() {
+    if (m_started) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mtxInit);
+    if (m_started) {
+        return;
+    }
+    if (m_nThreads <= 0) {
+        m_nThreads = std::max(1, (int)get_cpu_info().physical_cores);
+    }
+    for (int i = 0; i < m_nThreads; i++) {
+        m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+    for (int i = 0; i < m_nThreads; i++) {
+        m_threads.push_back(std::thread(&RGYThreadPool::workerFunc, this, i));
+    }
+    m_tmStart = std::chrono::steady_clock::now();
+    m_started = true;
+}
+
+void RGYThreadPool::workerFunc(int id) {
+    t_workerId = id;
+    if (m_affinityMask) {
+        SetThreadAffinityMask(GetCurrentThread(), (size_t)m_affinityMask);
+    }
+    for (;;) {
+        if (runOneTask(id)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mtxSleep);
+        m_sleeping++;
+        m_cvSleep.wait(lock, [this]() { return m_pending > 0; });
+        m_sleeping--;
+    }
+}
+
+void RGYThreadPool::submit(std::function<void()> func, RGYThreadPoolStage stage, RGYTaskGroup *group) {
+    start();
+    if (group) {
+        group->add();
+    }
+    //ワーカーから投入されたものは自分のキューに、それ以外は順番に割り振る
+    const int target = (t_workerId >= 0) ? t_workerId : (int)(m_nextQueue++ % (uint32_t)m_nThreads);
+    {
+        Task task = { std::move(func), stage, group };
+        auto& queue = m_queues[target];
+        std::lock_guard<std::mutex> lock(queue->mtx);
+        queue->tasks.push_back(std::move(task));
+    }
+    m_pending++;
+    if (m_sleeping > 0) {
+        std::lock_guard<std::mutex> lock(m_mtxSleep);
+        m_cvSleep.notify_one();
+    }
+}
+
+bool RGYThreadPool::popTask(int self, Task& task) {
+    //まず自分のキューの末尾から
+    if (self >= 0) {
+        auto& queue = m_queues[self];
+        std::lock_guard<std::mutex> lock(queue->mtx);
+        if (!queue->tasks.empty()) {
+            task = std::move(queue->tasks.back());
+            queue->tasks.pop_back();
+            m_pending--;
+            return true;
+        }
+    }
+    //他のキューの先頭から奪う
+    const int start = (self >= 0) ? self + 1 : 0;
+    for (int i = 0; i < m_nThreads; i++) {
+        auto& queue = m_queues[(start + i) % m_nThreads];
+        std::lock_guard<std::mutex> lock(queue->mtx);
+        if (!queue->tasks.empty()) {
+            task = std::move(queue->tasks.front());
+            queue->tasks.pop_front();
+            m_pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RGYThreadPool::runOneTask(int self) {
+    if (m_pending <= 0) {
+        return false;
+    }
+    Task task;
+    if (!popTask(self, task)) {
+        return false;
+    }
+    runTask(task);
+    return true;
+}
+
+void RGYThreadPool::runTask(Task& task) {
+    const auto start = std::chrono::steady_clock::now();
+    task.func();
+    addStageTime(task.stage, start);
+    if (task.group) {
+        task.group->done();
+    }
+}
+
+void RGYThreadPool::addStageTime(RGYThreadPoolStage stage, std::chrono::steady_clock::time_point start) {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    m_stageTasks[stage]++;
+    m_stageBusyNs[stage] += (uint64_t)elapsed;
+}
+
+void RGYThreadPool::parallel_for(int count, std::function<void(int)> func, RGYThreadPoolStage stage, int maxParallel) {
+    if (count <= 0) {
+        return;
+    }
+    int parallel = std::min(count, threads() + 1);
+    if (maxParallel > 0) {
+        parallel = std::min(parallel, maxParallel);
+    }
+    if (parallel <= 1) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) {
+            func(i);
+        }
+        addStageTime(stage, start);
+        return;
+    }
+    //投入したタスクの開始が呼び出し側の処理完了より遅れることがあるので、状態は共有して保持する
+    //その場合、そのタスクはなにもせずに終了する
+    struct ParallelForState {
+        std::atomic<int> next;
+        std::atomic<int> finished;
+        int count;
+        std::function<void(int)> func;
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+    auto state = std::make_shared<ParallelForState>();
+    state->next = 0;
+    state->finished = 0;
+    state->count = count;
+    state->func = std::move(func);
+    auto body = [state]() {
+        int i = 0;
+        while ((i = state->next++) < state->count) {
+            state->func(i);
+            if (++state->finished == state->count) {
+                std::lock_guard<std::mutex> lock(state->mtx);
+                state->cv.notify_all();
+            }
+        }
+    };
+    for (int i = 1; i < parallel; i++) {
+        submit(body, stage);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    addStageTime(stage, start);
+    if (state->finished < count) {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        state->cv.wait(lock, [&state, count]() { return state->finished == count; });
+    }
+}
+
+RGYThreadPoolStageInfo RGYThreadPool::stageInfo(RGYThreadPoolStage stage) {
+    RGYThreadPoolStageInfo info;
+    info.tasks = m_stageTasks[stage];
+    info.busySec = m_stageBusyNs[stage] * 1e-9;
+    info.usage = 0.0;
+    if (m_started) {
+        const double elapsedSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tmStart).count();
+        if (elapsedSec > 0.0) {
+            info.usage = info.busySec * 100.0 / (elapsedSec * m_nThreads);
+        }
+    }
+    return info;
+}
+
+tstring RGYThreadPool::printStageInfo() {
+    if (!m_started) {
+        return _T("thread pool: not used\n");
+    }
+    tstring str = strsprintf(_T("thread pool: %d threads"), m_nThreads);
+    if (m_affinityMask) {
+        str += strsprintf(_T(", affinity 0x%llx"), (unsigned long long)m_affinityMask);
+    }
+    str += _T("\n");
+    for (int i = 0; i < RGY_THREAD_POOL_STAGE_MAX; i++) {
+        const auto info = stageInfo((RGYThreadPoolStage)i);
+        if (info.tasks) {
+            str += strsprintf(_T("  %-6s: %10llu tasks, %9.3f sec, %5.1f%%\n"),
+                get_thread_pool_stage_name((RGYThreadPoolStage)i), (unsigned long long)info.tasks, info.busySec, info.usage);
+        }
+    }
+    return str;
+}
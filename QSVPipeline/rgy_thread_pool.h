@@ -0,0 +1,145 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+
+#pragma once
+#ifndef __RGY_THREAD_POOL_H__
+#define __RGY_THREAD_POOL_H__
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "rgy_osdep.h"
+#include "rgy_tchar.h"
+#include "rgy_def.h"
+
+//スレッドプールで処理するタスクの種類 (利用率の集計に使用)
+enum RGYThreadPoolStage {
+    RGY_THREAD_POOL_STAGE_CSP = 0,
+    RGY_THREAD_POOL_STAGE_AUDIO,
+    RGY_THREAD_POOL_STAGE_FILTER,
+    RGY_THREAD_POOL_STAGE_OTHER,
+    RGY_THREAD_POOL_STAGE_MAX
+};
+
+const TCHAR *get_thread_pool_stage_name(RGYThreadPoolStage stage);
+
+struct RGYThreadPoolStageInfo {
+    uint64_t tasks;   //実行したタスクの数
+    double busySec;   //タスクの実行に要した時間の合計 (秒)
+    double usage;     //プール全体の処理能力に対する利用率 (%)
+};
+
+//submitしたタスクの完了を待機するためのもの
+class RGYTaskGroup {
+public:
+    RGYTaskGroup() : m_pending(0), m_mtx(), m_cv() {};
+    ~RGYTaskGroup() { wait(); };
+    //すべてのタスクの完了を待機する
+    void wait();
+protected:
+    friend class RGYThreadPool;
+    void add() { m_pending++; }
+    void done();
+
+    std::atomic<int> m_pending;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+};
+
+//プロセス全体で共有するwork-stealing型のスレッドプール
+//各ワーカーは自分のキューの末尾からタスクを取り出し、空なら他のワーカーのキューの先頭から奪う
+class RGYThreadPool {
+public:
+    //プロセスで共有するインスタンスを取得する
+    static RGYThreadPool& get();
+
+    //スレッド数とaffinityを設定する
+    //threads = 0 なら物理コア数、affinityMask = 0 なら制限なし
+    //ワーカーは最初のタスク投入時に起動するので、それ以降の変更は反映されずfalseを返す
+    bool setParam(int threads, uint64_t affinityMask);
+    int threads();
+
+    //タスクを投入する、groupを指定するとRGYTaskGroup::wait()で完了を待機できる
+    void submit(std::function<void()> task, RGYThreadPoolStage stage, RGYTaskGroup *group = nullptr);
+
+    //[0, count)の各indexについてfuncを呼び出し、すべて完了するまで待機する
+    //indexは空いているスレッドから順に動的に割り当てられ、呼び出し側のスレッドも処理に参加する
+    //maxParallelで同時に処理するスレッド数を制限できる (0なら制限なし)
+    void parallel_for(int count, std::function<void(int)> func, RGYThreadPoolStage stage, int maxParallel = 0);
+
+    RGYThreadPoolStageInfo stageInfo(RGYThreadPoolStage stage);
+    tstring printStageInfo();
+protected:
+    struct Task {
+        std::function<void()> func;
+        RGYThreadPoolStage stage;
+        RGYTaskGroup *group;
+    };
+    struct WorkerQueue {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+    friend class RGYTaskGroup;
+
+    RGYThreadPool();
+    ~RGYThreadPool();
+    RGYThreadPool(const RGYThreadPool&) = delete;
+    void operator =(const RGYThreadPool&) = delete;
+
+    void start();
+    void workerFunc(int id);
+    //タスクを1つ取り出して実行する、なにも実行しなければfalseを返す
+    bool runOneTask(int self);
+    bool popTask(int self, Task& task);
+    void runTask(Task& task);
+    void addStageTime(RGYThreadPoolStage stage, std::chrono::steady_clock::time_point start);
+
+    std::mutex m_mtxInit;
+    std::atomic<bool> m_started;
+    int m_nThreads;
+    uint64_t m_affinityMask;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<uint32_t> m_nextQueue;   //外部から投入する際のキューの選択用
+    std::atomic<int> m_pending;          //キューにあるタスクの数
+    std::atomic<int> m_sleeping;         //待機中のワーカーの数
+    std::mutex m_mtxSleep;
+    std::condition_variable m_cvSleep;
+    std::chrono::steady_clock::time_point m_tmStart;
+    std::atomic<uint64_t> m_stageTasks[RGY_THREAD_POOL_STAGE_MAX];
+    std::atomic<uint64_t> m_stageBusyNs[RGY_THREAD_POOL_STAGE_MAX];
+};
+
+#endif //__RGY_THREAD_POOL_H__
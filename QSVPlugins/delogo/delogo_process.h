@@ -33,71 +33,50 @@
 class DelogoProcessSSE41 : public ProcessorDelogo
 {
 public:
-    DelogoProcessSSE41();
+    DelogoProcessSSE41(bool d3dSurface);
     virtual ~DelogoProcessSSE41();
 
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
+protected:
+    virtual void ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) override;
 };
 
 class DelogoProcessAddSSE41 : public ProcessorDelogo {
 public:
-    DelogoProcessAddSSE41();
+    DelogoProcessAddSSE41(bool d3dSurface);
     virtual ~DelogoProcessAddSSE41();
 
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
+protected:
+    virtual void ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) override;
 };
 
 class DelogoProcessAVX : public ProcessorDelogo
 {
 public:
-    DelogoProcessAVX();
+    DelogoProcessAVX(bool d3dSurface);
     virtual ~DelogoProcessAVX();
 
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
+protected:
+    virtual void ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) override;
 };
 
 class DelogoProcessAVX2 : public ProcessorDelogo
 {
 public:
-    DelogoProcessAVX2();
+    DelogoProcessAVX2(bool d3dSurface);
     virtual ~DelogoProcessAVX2();
 
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
+protected:
+    virtual void ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) override;
 };
 
-class DelogoProcessD3DSSE41 : public ProcessorDelogo
+class DelogoProcessAVX512 : public ProcessorDelogo
 {
 public:
-    DelogoProcessD3DSSE41();
-    virtual ~DelogoProcessD3DSSE41();
+    DelogoProcessAVX512(bool d3dSurface);
+    virtual ~DelogoProcessAVX512();
 
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
-};
-
-class DelogoProcessAddD3DSSE41 : public ProcessorDelogo {
-public:
-    DelogoProcessAddD3DSSE41();
-    virtual ~DelogoProcessAddD3DSSE41();
-
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
-};
-
-class DelogoProcessD3DAVX : public ProcessorDelogo
-{
-public:
-    DelogoProcessD3DAVX();
-    virtual ~DelogoProcessD3DAVX();
-
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
-};
-
-class DelogoProcessD3DAVX2 : public ProcessorDelogo
-{
-public:
-    DelogoProcessD3DAVX2();
-    virtual ~DelogoProcessD3DAVX2();
-
-    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
+protected:
+    virtual void ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) override;
 };
 
 #endif // __DELOGO_PROCESS_H__
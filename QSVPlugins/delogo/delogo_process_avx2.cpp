@@ -40,78 +40,24 @@
 static_assert(false, "do not forget to set /arch:AVX or /arch:AVX2 for this file.");
 #endif
 
-static RGY_NOINLINE void process_delogo_frame_avx2(mfxU8 *dst, const mfxU32 dst_pitch, mfxU8 *buffer,
-    mfxU8 *src, const mfxU32 src_pitch, const mfxU32 width, const mfxU32 height_start, const mfxU32 height_fin, const ProcessDataDelogo *data) {
-    process_delogo_frame(dst, dst_pitch, buffer, src, src_pitch, width, height_start, height_fin, data);
+template<typename Type>
+static RGY_NOINLINE void process_delogo_avx2(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
+    process_delogo<Type>(ptr, pitch, buffer, width, height_start, height_fin, data);
 }
 
-template<mfxU32 step>
-static RGY_NOINLINE void process_delogo_avx2(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
-    process_delogo<step>(ptr, pitch, buffer, height_start, height_fin, data);
-}
-
-DelogoProcessAVX2::DelogoProcessAVX2() : ProcessorDelogo() {
+DelogoProcessAVX2::DelogoProcessAVX2(bool d3dSurface) : ProcessorDelogo(d3dSurface) {
 }
 
 DelogoProcessAVX2::~DelogoProcessAVX2() {
 }
 
-mfxStatus DelogoProcessAVX2::Process(DataChunk *chunk, mfxU8 *pBuffer) {
-    if (chunk == nullptr || pBuffer == nullptr) {
-        return MFX_ERR_NULL_PTR;
-    }
-
-    if (m_pIn->Info.FourCC != MFX_FOURCC_NV12) {
-        return MFX_ERR_UNSUPPORTED;
-    }
-
-    mfxStatus sts = MFX_ERR_NONE;
+void DelogoProcessAVX2::ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) {
     rgy_avx_dummy_if_avail(AVX2);
-    
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pIn))) return sts;
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pOut))) {
-        return UnlockFrame(m_pIn);
+    if (highbit) {
+        process_delogo_avx2<uint16_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
+    } else {
+        process_delogo_avx2<uint8_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
     }
-
-    process_delogo_frame_avx2(m_pOut->Data.Y,  m_pOut->Data.Pitch, pBuffer, m_pIn->Data.Y,  m_pIn->Data.Pitch, m_pIn->Info.CropW, 0, m_pIn->Info.CropH,      m_sData[0]);
-    process_delogo_frame_avx2(m_pOut->Data.UV, m_pOut->Data.Pitch, pBuffer, m_pIn->Data.UV, m_pIn->Data.Pitch, m_pIn->Info.CropW, 0, m_pIn->Info.CropH >> 1, m_sData[1]);
-
-    if (MFX_ERR_NONE != (sts = UnlockFrame(m_pIn)))  return sts;
-    if (MFX_ERR_NONE != (sts = UnlockFrame(m_pOut))) return sts;
-
-    return sts;
-}
-
-DelogoProcessD3DAVX2::DelogoProcessD3DAVX2() : ProcessorDelogo() {
-}
-
-DelogoProcessD3DAVX2::~DelogoProcessD3DAVX2() {
-}
-
-mfxStatus DelogoProcessD3DAVX2::Process(DataChunk *chunk, mfxU8 *pBuffer) {
-    if (chunk == nullptr || pBuffer == nullptr) {
-        return MFX_ERR_NULL_PTR;
-    }
-
-    if (m_pIn->Info.FourCC != MFX_FOURCC_NV12) {
-        return MFX_ERR_UNSUPPORTED;
-    }
-
-    mfxStatus sts = MFX_ERR_NONE;
-    rgy_avx_dummy_if_avail(AVX2);
-
-    if (MFX_ERR_NONE != (sts = CopyD3DFrameGPU(m_pIn, m_pOut))) {
-        return sts;
-    }
-    
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pOut))) {
-        return sts;
-    }
-
-    process_delogo_avx2<64>(m_pOut->Data.Y,  m_pOut->Data.Pitch, pBuffer, 0, m_pIn->Info.CropH,      m_sData[0]);
-    process_delogo_avx2<32>(m_pOut->Data.UV, m_pOut->Data.Pitch, pBuffer, 0, m_pIn->Info.CropH >> 1, m_sData[1]);
-
-    return UnlockFrame(m_pOut);
 }
 
 #endif //#if defined(_MSC_VER) || defined(__AVX__)
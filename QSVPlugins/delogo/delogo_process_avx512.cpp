@@ -0,0 +1,72 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2011-2016 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#define USE_SSE2   1
+#define USE_SSSE3  1
+#define USE_SSE41  1
+#define USE_AVX    1
+#define USE_AVX2   1
+#define USE_FMA3   1
+#define USE_POPCNT 1
+#define USE_AVX512 1
+#if defined(_MSC_VER) || defined(__AVX512BW__)
+//gcc 12以降では、immintrin.h内部の_mm512_undefined_*に対して-Wmaybe-uninitializedの誤検知が出るので抑制する
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include "delogo_process_simd.h"
+#include "delogo_process.h"
+
+#if _MSC_VER >= 1800 && !defined(__AVX512BW__) && !defined(_DEBUG)
+static_assert(false, "do not forget to set /arch:AVX512 for this file.");
+#endif
+
+template<typename Type>
+static RGY_NOINLINE void process_delogo_avx512(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
+    process_delogo<Type>(ptr, pitch, buffer, width, height_start, height_fin, data);
+}
+
+DelogoProcessAVX512::DelogoProcessAVX512(bool d3dSurface) : ProcessorDelogo(d3dSurface) {
+}
+
+DelogoProcessAVX512::~DelogoProcessAVX512() {
+}
+
+void DelogoProcessAVX512::ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) {
+    rgy_avx_dummy_if_avail(AVX2);
+    if (highbit) {
+        process_delogo_avx512<uint16_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
+    } else {
+        process_delogo_avx512<uint8_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
+    }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif //#if defined(_MSC_VER) || defined(__AVX512BW__)
@@ -364,17 +364,22 @@ static __forceinline void store_line_from_buffer(mfxU8 *dst, mfxU8 *buffer, mfxU
 }
 
 
-#if USE_AVX2
+#if USE_AVX512
+#define CONST_M const __m512i
+#define CONST_MR(x) const __m512i& zC_ ## x
+#define SET_EPI16 _mm512_set1_epi16
+#define SET_EPI32 _mm512_set1_epi32
+#elif USE_AVX2
 #define CONST_M const __m256i
 #define CONST_MR(x) const __m256i& yC_ ## x
 #define SET_EPI16 _mm256_set1_epi16
 #define SET_EPI32 _mm256_set1_epi32
-#else //#if USE_AVX2
+#else //#if USE_AVX512
 #define CONST_MR(x) const __m128i& xC_ ## x
 #define CONST_M const __m128i
 #define SET_EPI16 _mm_set1_epi16
 #define SET_EPI32 _mm_set1_epi32
-#endif //#if USE_AVX2
+#endif //#if USE_AVX512
 
 #define DEPTH_MUL_OPTIM (1)
 #define USE_SIMPLE_RCPPS (1)
@@ -385,12 +390,211 @@ static __forceinline void store_line_from_buffer(mfxU8 *dst, mfxU8 *buffer, mfxU
 #define delogo_rcpps256 _mm256_rcp_ps_hp
 #define delogo_rcpps    _mm_rcp_ps_hp
 #endif
+#if USE_AVX512
+#define delogo_rcpps512 _mm512_rcp14_ps
+#endif
+
+//以下のtemplate引数Typeは画素の型
+//uint8_t : NV12
+//uint16_t: P010 (上位10bitに値が入っている)
+
+//バッファから画素を読み込み、YC48に変換する
+//P010は>>2して、NV12の場合(<<6)と同じスケールにそろえる
+template<typename Type>
+static __forceinline void load_pix_to_yc48(__m128i& xSrc0, __m128i& xSrc1, const Type *ptr_buf, const __m128i& xC_nv12_2_yc48_mul, const __m128i& xC_nv12_2_yc48_sub) {
+    if (sizeof(Type) == 1) {
+        xSrc0 = _mm_load_si128((const __m128i *)(ptr_buf));
+        xSrc1 = _mm_unpackhi_epi8(xSrc0, _mm_setzero_si128());
+        xSrc0 = _mm_unpacklo_epi8(xSrc0, _mm_setzero_si128());
+        xSrc0 = _mm_slli_epi16(xSrc0, 6);
+        xSrc1 = _mm_slli_epi16(xSrc1, 6);
+    } else {
+        xSrc0 = _mm_srli_epi16(_mm_load_si128((const __m128i *)(ptr_buf + 0)), 2);
+        xSrc1 = _mm_srli_epi16(_mm_load_si128((const __m128i *)(ptr_buf + 8)), 2);
+    }
+    xSrc0 = _mm_mulhi_epi16(xSrc0, xC_nv12_2_yc48_mul);
+    xSrc1 = _mm_mulhi_epi16(xSrc1, xC_nv12_2_yc48_mul);
+    xSrc0 = _mm_sub_epi16(xSrc0, xC_nv12_2_yc48_sub);
+    xSrc1 = _mm_sub_epi16(xSrc1, xC_nv12_2_yc48_sub);
+}
+
+//YC48から画素に変換し、バッファに書き込む
+//P010ではyc48_2_nv12_mulを4倍にして10bitの値を得ているので、クランプして上位10bitに格納する
+//YC48の値はロゴの除去で大きくなりうるので、加算は飽和させる (ラップすると白が黒になる)
+template<typename Type>
+static __forceinline void store_yc48_to_pix(Type *ptr_buf, __m128i x0, __m128i x1, const __m128i& xC_yc48_2_nv12_mul, const __m128i& xC_yc48_2_nv12_add) {
+    x0 = _mm_adds_epi16(x0, xC_yc48_2_nv12_add);
+    x1 = _mm_adds_epi16(x1, xC_yc48_2_nv12_add);
+
+    x0 = _mm_mulhi_epi16(x0, xC_yc48_2_nv12_mul);
+    x1 = _mm_mulhi_epi16(x1, xC_yc48_2_nv12_mul);
+
+    if (sizeof(Type) == 1) {
+        _mm_store_si128((__m128i *)(ptr_buf), _mm_packus_epi16(x0, x1));
+    } else {
+        const __m128i xMax = _mm_set1_epi16(1023);
+        x0 = _mm_slli_epi16(_mm_min_epi16(_mm_max_epi16(x0, _mm_setzero_si128()), xMax), 6);
+        x1 = _mm_slli_epi16(_mm_min_epi16(_mm_max_epi16(x1, _mm_setzero_si128()), xMax), 6);
+        _mm_store_si128((__m128i *)(ptr_buf + 0), x0);
+        _mm_store_si128((__m128i *)(ptr_buf + 8), x1);
+    }
+}
+
+#if USE_AVX2
+template<typename Type>
+static __forceinline void load_pix_to_yc48(__m256i& ySrc0, __m256i& ySrc1, const Type *ptr_buf, const __m256i& yC_nv12_2_yc48_mul, const __m256i& yC_nv12_2_yc48_sub) {
+    if (sizeof(Type) == 1) {
+        ySrc0 = _mm256_load_si256((const __m256i *)(ptr_buf));
+        ySrc1 = _mm256_unpackhi_epi8(ySrc0, _mm256_setzero_si256());
+        ySrc0 = _mm256_unpacklo_epi8(ySrc0, _mm256_setzero_si256());
+        ySrc0 = _mm256_slli_epi16(ySrc0, 6);
+        ySrc1 = _mm256_slli_epi16(ySrc1, 6);
+    } else {
+        //8bitの場合のunpacklo/unpackhiと同じ画素の並びにする
+        __m256i y0 = _mm256_load_si256((const __m256i *)(ptr_buf +  0));
+        __m256i y1 = _mm256_load_si256((const __m256i *)(ptr_buf + 16));
+        ySrc0 = _mm256_srli_epi16(_mm256_permute2x128_si256(y0, y1, (0x02<<4) + 0x00), 2);
+        ySrc1 = _mm256_srli_epi16(_mm256_permute2x128_si256(y0, y1, (0x03<<4) + 0x01), 2);
+    }
+    ySrc0 = _mm256_mulhi_epi16(ySrc0, yC_nv12_2_yc48_mul);
+    ySrc1 = _mm256_mulhi_epi16(ySrc1, yC_nv12_2_yc48_mul);
+    ySrc0 = _mm256_sub_epi16(ySrc0, yC_nv12_2_yc48_sub);
+    ySrc1 = _mm256_sub_epi16(ySrc1, yC_nv12_2_yc48_sub);
+}
+
+template<typename Type>
+static __forceinline void store_yc48_to_pix(Type *ptr_buf, __m256i y0, __m256i y1, const __m256i& yC_yc48_2_nv12_mul, const __m256i& yC_yc48_2_nv12_add) {
+    y0 = _mm256_adds_epi16(y0, yC_yc48_2_nv12_add);
+    y1 = _mm256_adds_epi16(y1, yC_yc48_2_nv12_add);
+
+    y0 = _mm256_mulhi_epi16(y0, yC_yc48_2_nv12_mul);
+    y1 = _mm256_mulhi_epi16(y1, yC_yc48_2_nv12_mul);
+
+    if (sizeof(Type) == 1) {
+        _mm256_store_si256((__m256i *)(ptr_buf), _mm256_packus_epi16(y0, y1));
+    } else {
+        const __m256i yMax = _mm256_set1_epi16(1023);
+        y0 = _mm256_slli_epi16(_mm256_min_epi16(_mm256_max_epi16(y0, _mm256_setzero_si256()), yMax), 6);
+        y1 = _mm256_slli_epi16(_mm256_min_epi16(_mm256_max_epi16(y1, _mm256_setzero_si256()), yMax), 6);
+        //load_pix_to_yc48で入れ替えた並びを戻す
+        _mm256_store_si256((__m256i *)(ptr_buf +  0), _mm256_permute2x128_si256(y0, y1, (0x02<<4) + 0x00));
+        _mm256_store_si256((__m256i *)(ptr_buf + 16), _mm256_permute2x128_si256(y0, y1, (0x03<<4) + 0x01));
+    }
+}
+#endif //#if USE_AVX2
+
+#if USE_AVX512
+static __forceinline __m512i cvtlo512_epi16_epi32(__m512i z0) {
+    return _mm512_srai_epi32(_mm512_unpacklo_epi16(z0, z0), 16);
+}
+
+static __forceinline __m512i cvthi512_epi16_epi32(__m512i z0) {
+    return _mm512_srai_epi32(_mm512_unpackhi_epi16(z0, z0), 16);
+}
+
+//2つの32bit x 16を16bit x 32に詰める (画素の並びは変わらない)
+static __forceinline __m512i cvt512_2x_epi32_epi16(__m512i z0, __m512i z1) {
+    return _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi32_epi16(z0)), _mm512_cvtepi32_epi16(z1), 1);
+}
+
+//AVX512では、8bitからの拡張と8bitへの縮小を画素の並びを変えずに行う
+template<typename Type>
+static __forceinline void load_pix_to_yc48(__m512i& zSrc0, __m512i& zSrc1, const Type *ptr_buf, const __m512i& zC_nv12_2_yc48_mul, const __m512i& zC_nv12_2_yc48_sub) {
+    if (sizeof(Type) == 1) {
+        zSrc0 = _mm512_slli_epi16(_mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)(ptr_buf +  0))), 6);
+        zSrc1 = _mm512_slli_epi16(_mm512_cvtepu8_epi16(_mm256_load_si256((const __m256i *)(ptr_buf + 32))), 6);
+    } else {
+        zSrc0 = _mm512_srli_epi16(_mm512_load_si512((const __m512i *)(ptr_buf +  0)), 2);
+        zSrc1 = _mm512_srli_epi16(_mm512_load_si512((const __m512i *)(ptr_buf + 32)), 2);
+    }
+    zSrc0 = _mm512_mulhi_epi16(zSrc0, zC_nv12_2_yc48_mul);
+    zSrc1 = _mm512_mulhi_epi16(zSrc1, zC_nv12_2_yc48_mul);
+    zSrc0 = _mm512_sub_epi16(zSrc0, zC_nv12_2_yc48_sub);
+    zSrc1 = _mm512_sub_epi16(zSrc1, zC_nv12_2_yc48_sub);
+}
+
+template<typename Type>
+static __forceinline void store_yc48_to_pix(Type *ptr_buf, __m512i z0, __m512i z1, const __m512i& zC_yc48_2_nv12_mul, const __m512i& zC_yc48_2_nv12_add) {
+    z0 = _mm512_adds_epi16(z0, zC_yc48_2_nv12_add);
+    z1 = _mm512_adds_epi16(z1, zC_yc48_2_nv12_add);
+
+    z0 = _mm512_mulhi_epi16(z0, zC_yc48_2_nv12_mul);
+    z1 = _mm512_mulhi_epi16(z1, zC_yc48_2_nv12_mul);
+
+    z0 = _mm512_max_epi16(z0, _mm512_setzero_si512());
+    z1 = _mm512_max_epi16(z1, _mm512_setzero_si512());
+    if (sizeof(Type) == 1) {
+        _mm256_store_si256((__m256i *)(ptr_buf +  0), _mm512_cvtusepi16_epi8(z0));
+        _mm256_store_si256((__m256i *)(ptr_buf + 32), _mm512_cvtusepi16_epi8(z1));
+    } else {
+        const __m512i zMax = _mm512_set1_epi16(1023);
+        z0 = _mm512_slli_epi16(_mm512_min_epi16(z0, zMax), 6);
+        z1 = _mm512_slli_epi16(_mm512_min_epi16(z1, zMax), 6);
+        _mm512_store_si512((__m512i *)(ptr_buf +  0), z0);
+        _mm512_store_si512((__m512i *)(ptr_buf + 32), z1);
+    }
+}
+#endif //#if USE_AVX512
 
-static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_i_width,
+template<typename Type>
+static __forceinline void delogo_line(Type *ptr_buf, short *ptr_logo, int logo_i_width,
     CONST_MR(nv12_2_yc48_mul), CONST_MR(nv12_2_yc48_sub), CONST_MR(yc48_2_nv12_mul), CONST_MR(yc48_2_nv12_add),
     CONST_MR(offset), CONST_MR(depth_mul_fade_slft_3)) {
-    mfxU8 *ptr_buf_fin = ptr_buf + logo_i_width;
-#if USE_AVX2
+    Type *ptr_buf_fin = ptr_buf + logo_i_width;
+#if USE_AVX512
+    static_assert(DEPTH_MUL_OPTIM, "AVX512 delogo requires DEPTH_MUL_OPTIM.");
+    for (; ptr_buf < ptr_buf_fin; ptr_buf += 64, ptr_logo += 128) {
+        __m512i z0, z1, z2, z3;
+        __m512i zDp0, zDp1;
+        __m512i zSrc0, zSrc1;
+        z0 = _mm512_loadu_si512((const __m512i *)(ptr_logo +  0));
+        z1 = _mm512_loadu_si512((const __m512i *)(ptr_logo + 32));
+        z2 = _mm512_loadu_si512((const __m512i *)(ptr_logo + 64));
+        z3 = _mm512_loadu_si512((const __m512i *)(ptr_logo + 96));
+
+        // 不透明度情報のみ取り出し (下位16bit)
+        zDp0 = cvt512_2x_epi32_epi16(z0, z1);
+        zDp1 = cvt512_2x_epi32_epi16(z2, z3);
+        //ロゴ色データの取り出し (上位16bit)
+        z0 = cvt512_2x_epi32_epi16(_mm512_srai_epi32(z0, 16), _mm512_srai_epi32(z1, 16));
+        z1 = cvt512_2x_epi32_epi16(_mm512_srai_epi32(z2, 16), _mm512_srai_epi32(z3, 16));
+
+        z0 = _mm512_add_epi16(z0, zC_offset); //lgp->y + py_offset
+        z1 = _mm512_add_epi16(z1, zC_offset); //lgp->y + py_offset
+
+        zDp0 = _mm512_slli_epi16(zDp0, 4);
+        zDp1 = _mm512_slli_epi16(zDp1, 4);
+
+        zDp0 = _mm512_mulhi_epi16(zDp0, zC_depth_mul_fade_slft_3);
+        zDp1 = _mm512_mulhi_epi16(zDp1, zC_depth_mul_fade_slft_3);
+
+        //dp -= (dp==LOGO_MAX_DP)
+        //dp = -dp
+        zDp0 = _mm512_sub_epi16(_mm512_setzero_si512(), _mm512_mask_sub_epi16(zDp0, _mm512_cmpeq_epi16_mask(zDp0, _mm512_set1_epi16(LOGO_MAX_DP)), zDp0, _mm512_set1_epi16(1)));
+        zDp1 = _mm512_sub_epi16(_mm512_setzero_si512(), _mm512_mask_sub_epi16(zDp1, _mm512_cmpeq_epi16_mask(zDp1, _mm512_set1_epi16(LOGO_MAX_DP)), zDp1, _mm512_set1_epi16(1)));
+
+        //ソースをロードしてNV12/P010->YC48
+        load_pix_to_yc48(zSrc0, zSrc1, ptr_buf, zC_nv12_2_yc48_mul, zC_nv12_2_yc48_sub);
+
+        z3 = _mm512_madd_epi16(_mm512_unpackhi_epi16(zSrc1, z1), _mm512_unpackhi_epi16(_mm512_set1_epi16(LOGO_MAX_DP), zDp1));
+        z2 = _mm512_madd_epi16(_mm512_unpacklo_epi16(zSrc1, z1), _mm512_unpacklo_epi16(_mm512_set1_epi16(LOGO_MAX_DP), zDp1));
+        z1 = _mm512_madd_epi16(_mm512_unpackhi_epi16(zSrc0, z0), _mm512_unpackhi_epi16(_mm512_set1_epi16(LOGO_MAX_DP), zDp0)); //zSrc0 * LOGO_MAX_DP + z0 * zDp0(-dp)
+        z0 = _mm512_madd_epi16(_mm512_unpacklo_epi16(zSrc0, z0), _mm512_unpacklo_epi16(_mm512_set1_epi16(LOGO_MAX_DP), zDp0)); //zSrc0 * LOGO_MAX_DP + z0 * zDp0(-dp)
+
+        zDp0 = _mm512_adds_epi16(_mm512_set1_epi16(LOGO_MAX_DP), zDp0); // LOGO_MAX_DP + (-dp)
+        zDp1 = _mm512_adds_epi16(_mm512_set1_epi16(LOGO_MAX_DP), zDp1); // LOGO_MAX_DP + (-dp)
+
+        //(ycp->y * LOGO_MAX_DP + yc * (-dp)) / (LOGO_MAX_DP +(-dp));
+        z0 = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(z0), delogo_rcpps512(_mm512_cvtepi32_ps(cvtlo512_epi16_epi32(zDp0)))));
+        z1 = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(z1), delogo_rcpps512(_mm512_cvtepi32_ps(cvthi512_epi16_epi32(zDp0)))));
+        z2 = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(z2), delogo_rcpps512(_mm512_cvtepi32_ps(cvtlo512_epi16_epi32(zDp1)))));
+        z3 = _mm512_cvtps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(z3), delogo_rcpps512(_mm512_cvtepi32_ps(cvthi512_epi16_epi32(zDp1)))));
+        z0 = _mm512_packs_epi32(z0, z1);
+        z1 = _mm512_packs_epi32(z2, z3);
+
+        //YC48->NV12/P010
+        store_yc48_to_pix(ptr_buf, z0, z1, zC_yc48_2_nv12_mul, zC_yc48_2_nv12_add);
+#elif USE_AVX2
     for (; ptr_buf < ptr_buf_fin; ptr_buf += 32, ptr_logo += 64) {
         __m256i y0, y1, y2, y3;
         __m256i yDp0, yDp1, yDp2, yDp3;
@@ -426,7 +630,7 @@ static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_
         yDp1 = _mm256_sub_epi32(_mm256_add_epi16(yDp1, _mm256_load_si256((__m256i *)ARRAY_0x00008000)), _mm256_load_si256((__m256i *)ARRAY_0x00008000));
         yDp2 = _mm256_sub_epi32(_mm256_add_epi16(yDp2, _mm256_load_si256((__m256i *)ARRAY_0x00008000)), _mm256_load_si256((__m256i *)ARRAY_0x00008000));
         yDp3 = _mm256_sub_epi32(_mm256_add_epi16(yDp3, _mm256_load_si256((__m256i *)ARRAY_0x00008000)), _mm256_load_si256((__m256i *)ARRAY_0x00008000));
-            
+
         //lgp->dp_y * logo_depth_mul_fade)/128 /LOGO_FADE_MAX;
         yDp0 = _mm256_srai_epi32(_mm256_mullo_epi32(yDp0, yC_depth_mul_fade), 15);
         yDp1 = _mm256_srai_epi32(_mm256_mullo_epi32(yDp1, yC_depth_mul_fade), 15);
@@ -439,17 +643,8 @@ static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_
         yDp0 = _mm256_neg_epi16(_mm256_add_epi16(yDp0, _mm256_cmpeq_epi16(yDp0, _mm256_set1_epi16(LOGO_MAX_DP)))); // -dp
         yDp1 = _mm256_neg_epi16(_mm256_add_epi16(yDp1, _mm256_cmpeq_epi16(yDp1, _mm256_set1_epi16(LOGO_MAX_DP)))); // -dp
 
-        //ソースをロードしてNV12->YC48
-        ySrc0 = _mm256_load_si256((__m256i *)(ptr_buf));
-        ySrc1 = _mm256_unpackhi_epi8(ySrc0, _mm256_setzero_si256());
-        ySrc0 = _mm256_unpacklo_epi8(ySrc0, _mm256_setzero_si256());
-
-        ySrc0 = _mm256_slli_epi16(ySrc0, 6);
-        ySrc1 = _mm256_slli_epi16(ySrc1, 6);
-        ySrc0 = _mm256_mulhi_epi16(ySrc0, yC_nv12_2_yc48_mul);
-        ySrc1 = _mm256_mulhi_epi16(ySrc1, yC_nv12_2_yc48_mul);
-        ySrc0 = _mm256_sub_epi16(ySrc0, yC_nv12_2_yc48_sub);
-        ySrc1 = _mm256_sub_epi16(ySrc1, yC_nv12_2_yc48_sub);
+        //ソースをロードしてNV12/P010->YC48
+        load_pix_to_yc48(ySrc0, ySrc1, ptr_buf, yC_nv12_2_yc48_mul, yC_nv12_2_yc48_sub);
 
         y3 = _mm256_madd_epi16(_mm256_unpackhi_epi16(ySrc1, y1), _mm256_unpackhi_epi16(_mm256_set1_epi16(LOGO_MAX_DP), yDp1));
         y2 = _mm256_madd_epi16(_mm256_unpacklo_epi16(ySrc1, y1), _mm256_unpacklo_epi16(_mm256_set1_epi16(LOGO_MAX_DP), yDp1));
@@ -467,16 +662,8 @@ static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_
         y0 = _mm256_packs_epi32(y0, y1);
         y1 = _mm256_packs_epi32(y2, y3);
 
-        //YC48->NV12
-        y0 = _mm256_add_epi16(y0, yC_yc48_2_nv12_add);
-        y1 = _mm256_add_epi16(y1, yC_yc48_2_nv12_add);
-
-        y0 = _mm256_mulhi_epi16(y0, yC_yc48_2_nv12_mul);
-        y1 = _mm256_mulhi_epi16(y1, yC_yc48_2_nv12_mul);
-
-        y0 = _mm256_packus_epi16(y0, y1);
-
-        _mm256_store_si256((__m256i *)(ptr_buf), y0);
+        //YC48->NV12/P010
+        store_yc48_to_pix(ptr_buf, y0, y1, yC_yc48_2_nv12_mul, yC_yc48_2_nv12_add);
 #else
     for (; ptr_buf < ptr_buf_fin; ptr_buf += 16, ptr_logo += 32) {
         __m128i x0, x1, x2, x3;
@@ -487,13 +674,13 @@ static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_
         x1   = _mm_load_si128((__m128i *)(ptr_logo +  8));
         x2   = _mm_load_si128((__m128i *)(ptr_logo + 16));
         x3   = _mm_load_si128((__m128i *)(ptr_logo + 24));
-            
+
         // 不透明度情報のみ取り出し
         xDp0 = _mm_and_si128(x0, _mm_load_si128((__m128i *)MASK_16BIT));
         xDp1 = _mm_and_si128(x1, _mm_load_si128((__m128i *)MASK_16BIT));
         xDp2 = _mm_and_si128(x2, _mm_load_si128((__m128i *)MASK_16BIT));
         xDp3 = _mm_and_si128(x3, _mm_load_si128((__m128i *)MASK_16BIT));
-            
+
         //ロゴ色データの取り出し
         x0   = _mm_packs_epi32(_mm_srai_epi32(x0, 16), _mm_srai_epi32(x1, 16));
         x1   = _mm_packs_epi32(_mm_srai_epi32(x2, 16), _mm_srai_epi32(x3, 16));
@@ -525,23 +712,14 @@ static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_
         xDp0 = _mm_packs_epi32(xDp0, xDp1);
         xDp1 = _mm_packs_epi32(xDp2, xDp3);
 #endif
-            
+
         //dp -= (dp==LOGO_MAX_DP)
         //dp = -dp
         xDp0 = _mm_neg_epi16(_mm_add_epi16(xDp0, _mm_cmpeq_epi16(xDp0, _mm_set1_epi16(LOGO_MAX_DP)))); // -dp
         xDp1 = _mm_neg_epi16(_mm_add_epi16(xDp1, _mm_cmpeq_epi16(xDp1, _mm_set1_epi16(LOGO_MAX_DP)))); // -dp
 
-        //ソースをロードしてNV12->YC48
-        xSrc0 = _mm_load_si128((__m128i *)(ptr_buf));
-        xSrc1 = _mm_unpackhi_epi8(xSrc0, _mm_setzero_si128());
-        xSrc0 = _mm_unpacklo_epi8(xSrc0, _mm_setzero_si128());
-
-        xSrc0 = _mm_slli_epi16(xSrc0, 6);
-        xSrc1 = _mm_slli_epi16(xSrc1, 6);
-        xSrc0 = _mm_mulhi_epi16(xSrc0, xC_nv12_2_yc48_mul);
-        xSrc1 = _mm_mulhi_epi16(xSrc1, xC_nv12_2_yc48_mul);
-        xSrc0 = _mm_sub_epi16(xSrc0, xC_nv12_2_yc48_sub);
-        xSrc1 = _mm_sub_epi16(xSrc1, xC_nv12_2_yc48_sub);
+        //ソースをロードしてNV12/P010->YC48
+        load_pix_to_yc48(xSrc0, xSrc1, ptr_buf, xC_nv12_2_yc48_mul, xC_nv12_2_yc48_sub);
 
         x3 = _mm_madd_epi16(_mm_unpackhi_epi16(xSrc1, x1), _mm_unpackhi_epi16(_mm_set1_epi16(LOGO_MAX_DP), xDp1));
         x2 = _mm_madd_epi16(_mm_unpacklo_epi16(xSrc1, x1), _mm_unpacklo_epi16(_mm_set1_epi16(LOGO_MAX_DP), xDp1));
@@ -550,7 +728,7 @@ static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_
 
         xDp0 = _mm_adds_epi16(_mm_set1_epi16(LOGO_MAX_DP), xDp0); // LOGO_MAX_DP + (-dp)
         xDp1 = _mm_adds_epi16(_mm_set1_epi16(LOGO_MAX_DP), xDp1); // LOGO_MAX_DP + (-dp)
-            
+
         //(ycp->y * LOGO_MAX_DP + yc * (-dp)) / (LOGO_MAX_DP +(-dp));
         x0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(x0), delogo_rcpps(_mm_cvtepi32_ps(cvtlo_epi16_epi32(xDp0)))));
         x1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(x1), delogo_rcpps(_mm_cvtepi32_ps(cvthi_epi16_epi32(xDp0)))));
@@ -560,63 +738,17 @@ static __forceinline void delogo_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_
         x0 = _mm_packs_epi32(x0, x1);
         x1 = _mm_packs_epi32(x2, x3);
 
-        //YC48->NV12
-        x0 = _mm_add_epi16(x0, xC_yc48_2_nv12_add);
-        x1 = _mm_add_epi16(x1, xC_yc48_2_nv12_add);
-
-        x0 = _mm_mulhi_epi16(x0, xC_yc48_2_nv12_mul);
-        x1 = _mm_mulhi_epi16(x1, xC_yc48_2_nv12_mul);
-
-        x0 = _mm_packus_epi16(x0, x1);
-
-        _mm_store_si128((__m128i *)(ptr_buf), x0);
+        //YC48->NV12/P010
+        store_yc48_to_pix(ptr_buf, x0, x1, xC_yc48_2_nv12_mul, xC_yc48_2_nv12_add);
 #endif
     }
 }
 
-//dstで示される画像フレームをsrcにコピーしつつ、ロゴ部分を消去する
-//height_start, height_finは処理する範囲(NV12なら、色差を処理するときは、高さは半分になることに注意する)
-static __forceinline void process_delogo_frame(mfxU8 *dst, const mfxU32 dst_pitch, mfxU8 *buffer, 
-    mfxU8 *src, const mfxU32 src_pitch, const mfxU32 width, const mfxU32 height_start, const mfxU32 height_fin, const ProcessDataDelogo *data) {
-    mfxU8 *src_line = src;
-    mfxU8 *dst_line = dst;
-    short *data_ptr = data->pLogoPtr.get();
-    const mfxU32 logo_j_start  = data->j_start;
-    const mfxU32 logo_j_height = data->height;
-    const mfxU32 logo_i_start  = data->i_start;
-    const mfxU32 logo_i_width  = data->pitch;
-    CONST_M c_nv12_2_yc48_mul  = SET_EPI16(data->nv12_2_yc48_mul);
-    CONST_M c_nv12_2_yc48_sub  = SET_EPI16(data->nv12_2_yc48_sub);
-    CONST_M c_yc48_2_nv12_mul  = SET_EPI16(data->yc48_2_nv12_mul);
-    CONST_M c_yc48_2_nv12_add  = SET_EPI16(data->yc48_2_nv12_add);
-    CONST_M c_offset           = SET_EPI32(data->offset[0] | (data->offset[1] << 16));
-#if DEPTH_MUL_OPTIM
-    CONST_M c_depth_mul_fade_slft_3 = SET_EPI16((short)((data->depth * data->fade) >> 3));
-#else //#if DEPTH_MUL_OPTIM
-    CONST_M c_depth_mul_fade        = SET_EPI32(data->depth * data->fade);
-#endif //#if DEPTH_MUL_OPTIM
-
-    for (mfxU32 j = height_start; j < height_fin; j++, dst_line += dst_pitch, src_line += src_pitch) {
-        load_line_to_buffer<256, false>(buffer, src_line, width);
-        //if (logo_j_start <= j && j < logo_j_start + logo_j_height) {
-        if (j - logo_j_start < logo_j_height) {
-            mfxU8 *ptr_buf = buffer + logo_i_start;
-            short *ptr_logo = data_ptr + (j - logo_j_start) * (logo_i_width << 1);
-            delogo_line(ptr_buf, ptr_logo, logo_i_width, c_nv12_2_yc48_mul, c_nv12_2_yc48_sub, c_yc48_2_nv12_mul, c_yc48_2_nv12_add, c_offset, c_depth_mul_fade_slft_3);
-        }
-        store_line_from_buffer<256, false>(dst_line, buffer, width);
-    }
-#if USE_AVX
-    _mm256_zeroupper();
-#endif
-}
-
 //ptrで示される画像フレーム内のロゴ部分を消去して上書きする
-//template引数stepはロゴ部分を一時バッファにロードする単位
-//height_start, height_finは処理する範囲(NV12なら、色差を処理するときは、高さは半分になることに注意する)
-template<mfxU32 step>
-static __forceinline void process_delogo(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
-    mfxU8 *ptr_line = ptr;
+//height_start, height_finは処理する範囲(NV12/P010なら、色差を処理するときは、高さは半分になることに注意する)
+//widthはロゴ部分のうちフレーム内にある幅(byte, 16の倍数)で、この範囲のみを読み書きする
+template<typename Type>
+static __forceinline void process_delogo(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
     short *data_ptr = data->pLogoPtr.get();
     const mfxU32 logo_j_start  = data->j_start;
     const mfxU32 logo_j_height = data->height;
@@ -636,15 +768,15 @@ static __forceinline void process_delogo(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *
     height_start = (std::max)(height_start, logo_j_start);
     height_fin   = (std::min)(height_fin, logo_j_start + logo_j_height);
 
-    ptr_line += logo_j_start * pitch;
+    mfxU8 *ptr_line = ptr + height_start * pitch + logo_i_start * sizeof(Type);
 
     for (mfxU32 j = height_start; j < height_fin; j++, ptr_line += pitch) {
-        load_line_to_buffer<step, true>(buffer, ptr_line + logo_i_start, logo_i_width);
+        load_line_to_buffer<64, false>(buffer, ptr_line, width);
 
         short *ptr_logo = data_ptr + (j - logo_j_start) * (logo_i_width << 1);
-        delogo_line(buffer, ptr_logo, logo_i_width, c_nv12_2_yc48_mul, c_nv12_2_yc48_sub, c_yc48_2_nv12_mul, c_yc48_2_nv12_add, c_offset, c_depth_mul_fade_slft_3);
+        delogo_line((Type *)buffer, ptr_logo, logo_i_width, c_nv12_2_yc48_mul, c_nv12_2_yc48_sub, c_yc48_2_nv12_mul, c_yc48_2_nv12_add, c_offset, c_depth_mul_fade_slft_3);
 
-        store_line_from_buffer<step, true>(ptr_line + logo_i_start, buffer, logo_i_width);
+        store_line_from_buffer<64, false>(ptr_line, buffer, width);
     }
 #if USE_AVX
     _mm256_zeroupper();
@@ -652,10 +784,11 @@ static __forceinline void process_delogo(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *
 }
 
 #if !USE_AVX
-static __forceinline void logo_add_line(mfxU8 *ptr_buf, short *ptr_logo, int logo_i_width,
+template<typename Type>
+static __forceinline void logo_add_line(Type *ptr_buf, short *ptr_logo, int logo_i_width,
     CONST_MR(nv12_2_yc48_mul), CONST_MR(nv12_2_yc48_sub), CONST_MR(yc48_2_nv12_mul), CONST_MR(yc48_2_nv12_add),
     CONST_MR(offset), CONST_MR(depth_mul_fade_slft_3)) {
-    mfxU8 *ptr_buf_fin = ptr_buf + logo_i_width;
+    Type *ptr_buf_fin = ptr_buf + logo_i_width;
     for (; ptr_buf < ptr_buf_fin; ptr_buf += 16, ptr_logo += 32) {
         __m128i x0, x1, x2, x3;
         __m128i xDp0, xDp1, xDp2, xDp3;
@@ -704,17 +837,8 @@ static __forceinline void logo_add_line(mfxU8 *ptr_buf, short *ptr_logo, int log
         xDp1 = _mm_packs_epi32(xDp2, xDp3);
 #endif
 
-        //ソースをロードしてNV12->YC48
-        xSrc0 = _mm_load_si128((__m128i *)(ptr_buf));
-        xSrc1 = _mm_unpackhi_epi8(xSrc0, _mm_setzero_si128());
-        xSrc0 = _mm_unpacklo_epi8(xSrc0, _mm_setzero_si128());
-
-        xSrc0 = _mm_slli_epi16(xSrc0, 6);
-        xSrc1 = _mm_slli_epi16(xSrc1, 6);
-        xSrc0 = _mm_mulhi_epi16(xSrc0, xC_nv12_2_yc48_mul);
-        xSrc1 = _mm_mulhi_epi16(xSrc1, xC_nv12_2_yc48_mul);
-        xSrc0 = _mm_sub_epi16(xSrc0, xC_nv12_2_yc48_sub);
-        xSrc1 = _mm_sub_epi16(xSrc1, xC_nv12_2_yc48_sub);
+        //ソースをロードしてNV12/P010->YC48
+        load_pix_to_yc48(xSrc0, xSrc1, ptr_buf, xC_nv12_2_yc48_mul, xC_nv12_2_yc48_sub);
 
         xDp2 = _mm_subs_epi16(_mm_set1_epi16(LOGO_MAX_DP), xDp0);
         xDp3 = _mm_subs_epi16(_mm_set1_epi16(LOGO_MAX_DP), xDp1);
@@ -724,7 +848,7 @@ static __forceinline void logo_add_line(mfxU8 *ptr_buf, short *ptr_logo, int log
         x0 = _mm_madd_epi16(_mm_unpacklo_epi16(xSrc0, x0), _mm_unpacklo_epi16(xDp2, xDp0)); //xSrc0 * (LOGO_MAX_DP-logo_depth[i]) + x0 * xDp0
 
         //(ycp->y * (LOGO_MAX_DP-logo_depth[i]) + yc * (-dp)) / (LOGO_MAX_DP);
-        // 1 / LOGO_MAX_DP = 131 / 131072 = 131 / (1<<17) 
+        // 1 / LOGO_MAX_DP = 131 / 131072 = 131 / (1<<17)
         x0 = _mm_srai_epi32(_mm_mullo_epi32_simd(x0, _mm_set1_epi32(131)), 17);
         x1 = _mm_srai_epi32(_mm_mullo_epi32_simd(x1, _mm_set1_epi32(131)), 17);
         x2 = _mm_srai_epi32(_mm_mullo_epi32_simd(x2, _mm_set1_epi32(131)), 17);
@@ -733,25 +857,16 @@ static __forceinline void logo_add_line(mfxU8 *ptr_buf, short *ptr_logo, int log
         x0 = _mm_packs_epi32(x0, x1);
         x1 = _mm_packs_epi32(x2, x3);
 
-        //YC48->NV12
-        x0 = _mm_add_epi16(x0, xC_yc48_2_nv12_add);
-        x1 = _mm_add_epi16(x1, xC_yc48_2_nv12_add);
-
-        x0 = _mm_mulhi_epi16(x0, xC_yc48_2_nv12_mul);
-        x1 = _mm_mulhi_epi16(x1, xC_yc48_2_nv12_mul);
-
-        x0 = _mm_packus_epi16(x0, x1);
-
-        _mm_store_si128((__m128i *)(ptr_buf), x0);
+        //YC48->NV12/P010
+        store_yc48_to_pix(ptr_buf, x0, x1, xC_yc48_2_nv12_mul, xC_yc48_2_nv12_add);
     }
 }
 
-//dstで示される画像フレームをsrcにコピーしつつ、ロゴ部分を消去する
-//height_start, height_finは処理する範囲(NV12なら、色差を処理するときは、高さは半分になることに注意する)
-static __forceinline void process_logo_add_frame(mfxU8 *dst, const mfxU32 dst_pitch, mfxU8 *buffer,
-    mfxU8 *src, const mfxU32 src_pitch, const mfxU32 width, const mfxU32 height_start, const mfxU32 height_fin, const ProcessDataDelogo *data) {
-    mfxU8 *src_line = src;
-    mfxU8 *dst_line = dst;
+//ptrで示される画像フレーム内のロゴを付加して上書きする
+//height_start, height_finは処理する範囲(NV12/P010なら、色差を処理するときは、高さは半分になることに注意する)
+//widthはロゴ部分のうちフレーム内にある幅(byte, 16の倍数)で、この範囲のみを読み書きする
+template<typename Type>
+static __forceinline void process_logo_add(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
     short *data_ptr = data->pLogoPtr.get();
     const mfxU32 logo_j_start  = data->j_start;
     const mfxU32 logo_j_height = data->height;
@@ -768,55 +883,18 @@ static __forceinline void process_logo_add_frame(mfxU8 *dst, const mfxU32 dst_pi
     CONST_M c_depth_mul_fade        = SET_EPI32(data->depth * data->fade);
 #endif //#if DEPTH_MUL_OPTIM
 
-    for (mfxU32 j = height_start; j < height_fin; j++, dst_line += dst_pitch, src_line += src_pitch) {
-        load_line_to_buffer<256, false>(buffer, src_line, width);
-        //if (logo_j_start <= j && j < logo_j_start + logo_j_height) {
-        if (j - logo_j_start < logo_j_height) {
-            mfxU8 *ptr_buf = buffer + logo_i_start;
-            short *ptr_logo = data_ptr + (j - logo_j_start) * (logo_i_width << 1);
-            logo_add_line(ptr_buf, ptr_logo, logo_i_width, c_nv12_2_yc48_mul, c_nv12_2_yc48_sub, c_yc48_2_nv12_mul, c_yc48_2_nv12_add, c_offset, c_depth_mul_fade_slft_3);
-        }
-        store_line_from_buffer<256, false>(dst_line, buffer, width);
-    }
-#if USE_AVX
-    _mm256_zeroupper();
-#endif
-}
-
-//ptrで示される画像フレーム内のロゴを付加して上書きする
-//template引数stepはロゴ部分を一時バッファにロードする単位
-//height_start, height_finは処理する範囲(NV12なら、色差を処理するときは、高さは半分になることに注意する)
-template<uint32_t step>
-static __forceinline void process_logo_add(mfxU8 *ptr, const uint32_t pitch, mfxU8 *buffer, uint32_t height_start, uint32_t height_fin, const ProcessDataDelogo *data) {
-    mfxU8 *ptr_line = ptr;
-    short *data_ptr = data->pLogoPtr.get();
-    const uint32_t logo_j_start  = data->j_start;
-    const uint32_t logo_j_height = data->height;
-    const uint32_t logo_i_start  = data->i_start;
-    const uint32_t logo_i_width  = data->pitch;
-    CONST_M c_nv12_2_yc48_mul  = SET_EPI16(data->nv12_2_yc48_mul);
-    CONST_M c_nv12_2_yc48_sub  = SET_EPI16(data->nv12_2_yc48_sub);
-    CONST_M c_yc48_2_nv12_mul  = SET_EPI16(data->yc48_2_nv12_mul);
-    CONST_M c_yc48_2_nv12_add  = SET_EPI16(data->yc48_2_nv12_add);
-    CONST_M c_offset           = SET_EPI32(data->offset[0] | (data->offset[1] << 16));
-#if DEPTH_MUL_OPTIM
-    CONST_M c_depth_mul_fade_slft_3 = SET_EPI16((short)((data->depth * data->fade) >> 3));
-#else //#if DEPTH_MUL_OPTIM
-    CONST_M c_depth_mul_fade        = SET_EPI32(data->depth * data->fade);
-#endif //#if DEPTH_MUL_OPTIM
-
     height_start = (std::max)(height_start, logo_j_start);
     height_fin   = (std::min)(height_fin, logo_j_start + logo_j_height);
 
-    ptr_line += logo_j_start * pitch;
+    mfxU8 *ptr_line = ptr + height_start * pitch + logo_i_start * sizeof(Type);
 
     for (mfxU32 j = height_start; j < height_fin; j++, ptr_line += pitch) {
-        load_line_to_buffer<step, true>(buffer, ptr_line + logo_i_start, logo_i_width);
+        load_line_to_buffer<64, false>(buffer, ptr_line, width);
 
         short *ptr_logo = data_ptr + (j - logo_j_start) * (logo_i_width << 1);
-        logo_add_line(buffer, ptr_logo, logo_i_width, c_nv12_2_yc48_mul, c_nv12_2_yc48_sub, c_yc48_2_nv12_mul, c_yc48_2_nv12_add, c_offset, c_depth_mul_fade_slft_3);
+        logo_add_line((Type *)buffer, ptr_logo, logo_i_width, c_nv12_2_yc48_mul, c_nv12_2_yc48_sub, c_yc48_2_nv12_mul, c_yc48_2_nv12_add, c_offset, c_depth_mul_fade_slft_3);
 
-        store_line_from_buffer<step, true>(ptr_line + logo_i_start, buffer, logo_i_width);
+        store_line_from_buffer<64, false>(ptr_line, buffer, width);
     }
 }
 #endif
@@ -35,145 +35,40 @@
 #include "delogo_process_simd.h"
 #include "delogo_process.h"
 
-static RGY_NOINLINE void process_delogo_frame_sse41(mfxU8 *dst, const mfxU32 dst_pitch, mfxU8 *buffer,
-    mfxU8 *src, const mfxU32 src_pitch, const mfxU32 width, const mfxU32 height_start, const mfxU32 height_fin, const ProcessDataDelogo *data) {
-    process_delogo_frame(dst, dst_pitch, buffer, src, src_pitch, width, height_start, height_fin, data);
+template<typename Type>
+static RGY_NOINLINE void process_delogo_sse41(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
+    process_delogo<Type>(ptr, pitch, buffer, width, height_start, height_fin, data);
 }
 
-static RGY_NOINLINE void process_logo_add_frame_sse41(mfxU8 *dst, const mfxU32 dst_pitch, mfxU8 *buffer,
-    mfxU8 *src, const mfxU32 src_pitch, const mfxU32 width, const mfxU32 height_start, const mfxU32 height_fin, const ProcessDataDelogo *data) {
-    process_logo_add_frame(dst, dst_pitch, buffer, src, src_pitch, width, height_start, height_fin, data);
-}
-
-template<mfxU32 step>
-static RGY_NOINLINE void process_delogo_sse41(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
-    process_delogo<step>(ptr, pitch, buffer, height_start, height_fin, data);
-}
-
-template<mfxU32 step>
-static RGY_NOINLINE void process_logo_add_sse41(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
-    process_logo_add<step>(ptr, pitch, buffer, height_start, height_fin, data);
-}
-
-DelogoProcessSSE41::DelogoProcessSSE41() : ProcessorDelogo() {
+DelogoProcessSSE41::DelogoProcessSSE41(bool d3dSurface) : ProcessorDelogo(d3dSurface) {
 }
 
 DelogoProcessSSE41::~DelogoProcessSSE41() {
 }
 
-mfxStatus DelogoProcessSSE41::Process(DataChunk *chunk, mfxU8 *pBuffer) {
-    if (chunk == nullptr || pBuffer == nullptr) {
-        return MFX_ERR_NULL_PTR;
+void DelogoProcessSSE41::ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) {
+    if (highbit) {
+        process_delogo_sse41<uint16_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
+    } else {
+        process_delogo_sse41<uint8_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
     }
-
-    if (m_pIn->Info.FourCC != MFX_FOURCC_NV12) {
-        return MFX_ERR_UNSUPPORTED;
-    }
-
-    mfxStatus sts = MFX_ERR_NONE;
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pIn))) return sts;
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pOut))) {
-        return UnlockFrame(m_pIn);
-    }
-
-    process_delogo_frame_sse41(m_pOut->Data.Y,  m_pOut->Data.Pitch, pBuffer, m_pIn->Data.Y,  m_pIn->Data.Pitch, m_pIn->Info.CropW, 0, m_pIn->Info.CropH,      m_sData[0]);
-    process_delogo_frame_sse41(m_pOut->Data.UV, m_pOut->Data.Pitch, pBuffer, m_pIn->Data.UV, m_pIn->Data.Pitch, m_pIn->Info.CropW, 0, m_pIn->Info.CropH >> 1, m_sData[1]);
-
-    if (MFX_ERR_NONE != (sts = UnlockFrame(m_pIn)))  return sts;
-    if (MFX_ERR_NONE != (sts = UnlockFrame(m_pOut))) return sts;
-
-    return sts;
 }
 
-DelogoProcessD3DSSE41::DelogoProcessD3DSSE41() : ProcessorDelogo() {
-}
-
-DelogoProcessD3DSSE41::~DelogoProcessD3DSSE41() {
-}
-
-mfxStatus DelogoProcessD3DSSE41::Process(DataChunk *chunk, mfxU8 *pBuffer) {
-    if (chunk == nullptr || pBuffer == nullptr) {
-        return MFX_ERR_NULL_PTR;
-    }
-
-    if (m_pIn->Info.FourCC != MFX_FOURCC_NV12) {
-        return MFX_ERR_UNSUPPORTED;
-    }
-
-    mfxStatus sts = MFX_ERR_NONE;
-
-    if (MFX_ERR_NONE != (sts = CopyD3DFrameGPU(m_pIn, m_pOut))) {
-        return sts;
-    }
-    
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pOut))) {
-        return sts;
-    }
-
-    process_delogo_sse41<64>(m_pOut->Data.Y,  m_pOut->Data.Pitch, pBuffer, 0, m_pIn->Info.CropH,      m_sData[0]);
-    process_delogo_sse41<32>(m_pOut->Data.UV, m_pOut->Data.Pitch, pBuffer, 0, m_pIn->Info.CropH >> 1, m_sData[1]);
-
-    return UnlockFrame(m_pOut);
+template<typename Type>
+static RGY_NOINLINE void process_logo_add_sse41(mfxU8 *ptr, const mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 height_start, mfxU32 height_fin, const ProcessDataDelogo *data) {
+    process_logo_add<Type>(ptr, pitch, buffer, width, height_start, height_fin, data);
 }
 
-
-DelogoProcessAddSSE41::DelogoProcessAddSSE41() : ProcessorDelogo() {
+DelogoProcessAddSSE41::DelogoProcessAddSSE41(bool d3dSurface) : ProcessorDelogo(d3dSurface) {
 }
 
 DelogoProcessAddSSE41::~DelogoProcessAddSSE41() {
 }
 
-mfxStatus DelogoProcessAddSSE41::Process(DataChunk *chunk, mfxU8 *pBuffer) {
-    if (chunk == nullptr || pBuffer == nullptr) {
-        return MFX_ERR_NULL_PTR;
-    }
-
-    if (m_pIn->Info.FourCC != MFX_FOURCC_NV12) {
-        return MFX_ERR_UNSUPPORTED;
+void DelogoProcessAddSSE41::ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) {
+    if (highbit) {
+        process_logo_add_sse41<uint16_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
+    } else {
+        process_logo_add_sse41<uint8_t>(ptr, pitch, buffer, width, y_start, y_fin, data);
     }
-
-    mfxStatus sts = MFX_ERR_NONE;
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pIn))) return sts;
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pOut))) {
-        return UnlockFrame(m_pIn);
-    }
-
-    process_logo_add_frame_sse41(m_pOut->Data.Y, m_pOut->Data.Pitch, pBuffer, m_pIn->Data.Y, m_pIn->Data.Pitch, m_pIn->Info.CropW, 0, m_pIn->Info.CropH, m_sData[0]);
-    process_logo_add_frame_sse41(m_pOut->Data.UV, m_pOut->Data.Pitch, pBuffer, m_pIn->Data.UV, m_pIn->Data.Pitch, m_pIn->Info.CropW, 0, m_pIn->Info.CropH >> 1, m_sData[1]);
-
-    if (MFX_ERR_NONE != (sts = UnlockFrame(m_pIn)))  return sts;
-    if (MFX_ERR_NONE != (sts = UnlockFrame(m_pOut))) return sts;
-
-    return sts;
-}
-
-DelogoProcessAddD3DSSE41::DelogoProcessAddD3DSSE41() : ProcessorDelogo() {
-}
-
-DelogoProcessAddD3DSSE41::~DelogoProcessAddD3DSSE41() {
-}
-
-mfxStatus DelogoProcessAddD3DSSE41::Process(DataChunk *chunk, mfxU8 *pBuffer) {
-    if (chunk == nullptr || pBuffer == nullptr) {
-        return MFX_ERR_NULL_PTR;
-    }
-
-    if (m_pIn->Info.FourCC != MFX_FOURCC_NV12) {
-        return MFX_ERR_UNSUPPORTED;
-    }
-
-    mfxStatus sts = MFX_ERR_NONE;
-
-    if (MFX_ERR_NONE != (sts = CopyD3DFrameGPU(m_pIn, m_pOut))) {
-        return sts;
-    }
-
-    if (MFX_ERR_NONE != (sts = LockFrame(m_pOut))) {
-        return sts;
-    }
-
-    process_logo_add_sse41<64>(m_pOut->Data.Y, m_pOut->Data.Pitch, pBuffer, 0, m_pIn->Info.CropH, m_sData[0]);
-    process_logo_add_sse41<32>(m_pOut->Data.UV, m_pOut->Data.Pitch, pBuffer, 0, m_pIn->Info.CropH >> 1, m_sData[1]);
-
-    return UnlockFrame(m_pOut);
 }
@@ -35,6 +35,7 @@
 #include "rgy_simd.h"
 #include "rgy_osdep.h"
 #include "rgy_ini.h"
+#include "rgy_thread_pool.h"
 
 // disable "unreferenced formal parameter" warning -
 // not all formal parameters of interface functions will be used by sample plugin
@@ -102,24 +103,29 @@ mfxStatus Delogo::Submit(const mfxHDL *in, mfxU32 in_num, const mfxHDL *out, mfx
         bool d3dSurface = !!(m_DelogoParam.memType & D3D9_MEMORY);
         if (m_DelogoParam.add) {
             if (m_nSimdAvail & SSE41) {
-                m_sTasks[ind].pProcessor.reset((d3dSurface) ? static_cast<Processor *>(new DelogoProcessAddD3DSSE41) : new DelogoProcessAddSSE41);
+                m_sTasks[ind].pProcessor.reset(new DelogoProcessAddSSE41(d3dSurface));
             } else {
                 m_message += _T("vpp-delogo requires SSE4.1 support.\n");
                 return MFX_ERR_UNSUPPORTED;
             }
         } else {
+#if defined(_MSC_VER) || defined(__AVX512BW__)
+            if ((m_nSimdAvail & (AVX512F | AVX512BW)) == (AVX512F | AVX512BW)) {
+                m_sTasks[ind].pProcessor.reset(new DelogoProcessAVX512(d3dSurface));
+            } else
+#endif //#if defined(_MSC_VER) || defined(__AVX512BW__)
 #if defined(_MSC_VER) || defined(__AVX2__)
             if ((m_nSimdAvail & (AVX2 | FMA3)) == (AVX2 | FMA3)) {
-                m_sTasks[ind].pProcessor.reset((d3dSurface) ? static_cast<Processor *>(new DelogoProcessD3DAVX2) : new DelogoProcessAVX2);
+                m_sTasks[ind].pProcessor.reset(new DelogoProcessAVX2(d3dSurface));
             } else
 #endif //#if defined(_MSC_VER) || defined(__AVX2__)
 #if defined(_MSC_VER) || defined(__AVX__)
             if (m_nSimdAvail & AVX) {
-                m_sTasks[ind].pProcessor.reset((d3dSurface) ? static_cast<Processor *>(new DelogoProcessD3DAVX) : new DelogoProcessAVX);
+                m_sTasks[ind].pProcessor.reset(new DelogoProcessAVX(d3dSurface));
             } else
 #endif //#ifdefined(_MSC_VER) || defined(__AVX__)
             if (m_nSimdAvail & SSE41) {
-                m_sTasks[ind].pProcessor.reset((d3dSurface) ? static_cast<Processor *>(new DelogoProcessD3DSSE41) : new DelogoProcessSSE41);
+                m_sTasks[ind].pProcessor.reset(new DelogoProcessSSE41(d3dSurface));
             } else {
                 m_message += _T("vpp-delogo requires SSE4.1 support.\n");
                 return MFX_ERR_UNSUPPORTED;
@@ -337,139 +343,102 @@ mfxStatus Delogo::Init(mfxVideoParam *mfxParam) {
         m_sChunks[i].EndLine = (i < remainder_lines) ? (i + 1) * num_lines_in_chunk : (i + 1) * num_lines_in_chunk - 1;
     }
 
-    for (mfxU32 i = 0; i < m_sTasks.size(); i++) {
-        m_sTasks[i].pBuffer.reset((mfxU8 *)_aligned_malloc(((std::max)(mfxParam->mfx.FrameInfo.Width, mfxParam->mfx.FrameInfo.CropW) + 255 + 16) & ~255, 32));
-        if (m_sTasks[i].pBuffer.get() == nullptr) {
-            m_message += _T("failed to allocate buffer.\n");
-            return MFX_ERR_NULL_PTR;
-        }
-    }
-
+    //一時バッファはロゴのサイズと分割数が決まってから、SetAuxParamsで確保する
     m_bInited = true;
 
     return MFX_ERR_NONE;
 }
 
-mfxStatus Delogo::SetAuxParams(void *auxParam, int auxParamSize) {
-    DelogoParam *pDelogoPar = (DelogoParam *)auxParam;
-    if (pDelogoPar == nullptr) {
-        return MFX_ERR_NULL_PTR;
-    }
-
-    // check validity of parameters
-    mfxStatus sts = CheckParam(&m_VideoParam);
-    if (sts < MFX_ERR_NONE) return sts;
-
-    memcpy(&m_DelogoParam, pDelogoPar, sizeof(m_DelogoParam));
-
-    if (MFX_ERR_NONE != (sts = readLogoFile())) {
-        return sts;
-    }
-    if (0 > (m_nLogoIdx = selectLogo(m_DelogoParam.logoSelect))) {
-        if (m_nLogoIdx == LOGO_AUTO_SELECT_NOHIT) {
-            m_message += strsprintf(_T("no logo was selected by auto select \"%s\".\n"), m_DelogoParam.logoSelect);
-            return MFX_ERR_ABORTED;
-        } else {
-            m_message += strsprintf(_T("could not select logo by \"%s\".\n"), m_DelogoParam.logoSelect);
-            m_message += char_to_tstring(logoNameList());
-            return MFX_ERR_UNKNOWN;
-        }
-    }
-
-    auto& logoData = m_sLogoDataList[m_nLogoIdx];
-    if (m_DelogoParam.posX || m_DelogoParam.posY) {
-        LogoData origData;
-        origData.header = logoData.header;
-        origData.logoPixel = logoData.logoPixel;
-
-        logoData.logoPixel = std::vector<LOGO_PIXEL>((logoData.header.w + 1) * (logoData.header.h + 1), { 0 });
-
-        create_adj_exdata(logoData.logoPixel.data(), &logoData.header, origData.logoPixel.data(), &origData.header, m_DelogoParam.posX, m_DelogoParam.posY);
+//ロゴデータから、frameWidth x frameHeightのフレームのロゴ部分を処理するためのデータを作成する
+//slices, buffer_sizeは設定しない
+bool create_delogo_process_data(ProcessDataDelogo data[2], const LogoData& logoData, const DelogoParam *param, int frameWidth, int frameHeight, bool highbit) {
+    if (logoData.header.x >= frameWidth || logoData.header.y >= frameHeight) {
+        return false;
     }
 
-    const int frameWidth  = m_VideoParam.mfx.FrameInfo.CropW;
-    const int frameHeight = m_VideoParam.mfx.FrameInfo.CropH;
-
-    m_sProcessData[0].offset[0] = pDelogoPar->Y  << 4;
-    m_sProcessData[0].offset[1] = pDelogoPar->Y  << 4;
-    m_sProcessData[1].offset[0] = pDelogoPar->Cb << 4;
-    m_sProcessData[1].offset[1] = pDelogoPar->Cr << 4;
+    data[0].offset[0] = param->Y  << 4;
+    data[0].offset[1] = param->Y  << 4;
+    data[1].offset[0] = param->Cb << 4;
+    data[1].offset[1] = param->Cr << 4;
 
-    m_sProcessData[0].fade = 256;
-    m_sProcessData[1].fade = 256;
+    data[0].fade = 256;
+    data[1].fade = 256;
 
-    m_sProcessData[0].depth = pDelogoPar->depth;
-    m_sProcessData[1].depth = pDelogoPar->depth;
+    data[0].depth = param->depth;
+    data[1].depth = param->depth;
 
     //nv12->YC48パラメータ
-    m_sProcessData[0].nv12_2_yc48_mul = 19152;
-    m_sProcessData[0].nv12_2_yc48_sub = 299;
-    m_sProcessData[1].nv12_2_yc48_mul = 18725;
-    m_sProcessData[1].nv12_2_yc48_sub = 2340;
+    data[0].nv12_2_yc48_mul = 19152;
+    data[0].nv12_2_yc48_sub = 299;
+    data[1].nv12_2_yc48_mul = 18725;
+    data[1].nv12_2_yc48_sub = 2340;
     
     //YC48->nv12パラメータ
-    m_sProcessData[0].yc48_2_nv12_mul = 3504;
-    m_sProcessData[0].yc48_2_nv12_add = 301;
-    m_sProcessData[1].yc48_2_nv12_mul = 3584;
-    m_sProcessData[1].yc48_2_nv12_add = 2350;
-
-    m_sProcessData[0].i_start = (std::min)(logoData.header.x & ~63, frameWidth);
-    m_sProcessData[0].pitch   = (((std::min)(logoData.header.x + logoData.header.w, frameWidth) + 63) & ~63) - m_sProcessData[0].i_start;
-    m_sProcessData[1].i_start = m_sProcessData[0].i_start;
-    m_sProcessData[1].pitch   = m_sProcessData[0].pitch;
-    const int yWidthOffset = logoData.header.x - m_sProcessData[0].i_start;
-
-    m_sProcessData[0].j_start = (std::min)((int)logoData.header.y, frameHeight);
-    m_sProcessData[0].height  = (std::min)(logoData.header.y + logoData.header.h, frameHeight) - m_sProcessData[0].j_start;
-    m_sProcessData[1].j_start = logoData.header.y >> 1;
-    m_sProcessData[1].height  = (((logoData.header.y + logoData.header.h + 1) & ~1) - (m_sProcessData[1].j_start << 1)) >> 1;
-
-    if (logoData.header.x >= frameWidth || logoData.header.y >= frameHeight) {
-        m_message += strsprintf(_T("\"%s\" was not included in frame size %dx%d.\ndelogo disabled.\n"), m_DelogoParam.logoSelect, frameWidth, frameHeight);
-        m_message += strsprintf(_T("logo pos x=%d, y=%d, including pos offset value %d:%d.\n"), logoData.header.x, logoData.header.y, m_DelogoParam.posX, m_DelogoParam.posY);
-        return MFX_ERR_ABORTED;
-    }
-
-    m_sProcessData[0].pLogoPtr.reset((mfxI16 *)_aligned_malloc(sizeof(mfxI16) * 2 * m_sProcessData[0].pitch * m_sProcessData[0].height, 32));
-    m_sProcessData[1].pLogoPtr.reset((mfxI16 *)_aligned_malloc(sizeof(mfxI16) * 2 * m_sProcessData[1].pitch * m_sProcessData[1].height, 32));
-
-    memset(m_sProcessData[0].pLogoPtr.get(), 0, sizeof(mfxI16) * 2 * m_sProcessData[0].pitch * m_sProcessData[0].height);
-    memset(m_sProcessData[1].pLogoPtr.get(), 0, sizeof(mfxI16) * 2 * m_sProcessData[1].pitch * m_sProcessData[1].height);
+    data[0].yc48_2_nv12_mul = 3504;
+    data[0].yc48_2_nv12_add = 301;
+    data[1].yc48_2_nv12_mul = 3584;
+    data[1].yc48_2_nv12_add = 2350;
+    if (highbit) {
+        //P010では4倍して10bitの値を得る
+        data[0].yc48_2_nv12_mul *= 4;
+        data[1].yc48_2_nv12_mul *= 4;
+        //色差は4倍したままでは10bit->YC48->10bitで値が戻らない (+2ずれる) ので、戻るように調整する
+        data[1].yc48_2_nv12_add = 2342;
+    }
+
+    data[0].i_start = (std::min)(logoData.header.x & ~63, frameWidth);
+    data[0].pitch   = (((std::min)(logoData.header.x + logoData.header.w, frameWidth) + 63) & ~63) - data[0].i_start;
+    data[1].i_start = data[0].i_start;
+    data[1].pitch   = data[0].pitch;
+    const int yWidthOffset = logoData.header.x - data[0].i_start;
+    //ロゴのうちフレーム内にある幅 (フレームの右端からはみ出す部分はpitchに収まらないので処理しない)
+    const int logoWidth = (std::min)((int)logoData.header.w, frameWidth - logoData.header.x);
+
+    data[0].j_start = (std::min)((int)logoData.header.y, frameHeight);
+    data[0].height  = (std::min)(logoData.header.y + logoData.header.h, frameHeight) - data[0].j_start;
+    data[1].j_start = logoData.header.y >> 1;
+    data[1].height  = (((logoData.header.y + logoData.header.h + 1) & ~1) - (data[1].j_start << 1)) >> 1;
+
+    data[0].pLogoPtr.reset((mfxI16 *)_aligned_malloc(sizeof(mfxI16) * 2 * data[0].pitch * data[0].height, 32));
+    data[1].pLogoPtr.reset((mfxI16 *)_aligned_malloc(sizeof(mfxI16) * 2 * data[1].pitch * data[1].height, 32));
+
+    memset(data[0].pLogoPtr.get(), 0, sizeof(mfxI16) * 2 * data[0].pitch * data[0].height);
+    memset(data[1].pLogoPtr.get(), 0, sizeof(mfxI16) * 2 * data[1].pitch * data[1].height);
 
     //まず輝度成分をコピーしてしまう
-    for (mfxU32 j = 0; j < m_sProcessData[0].height; j++) {
+    for (mfxU32 j = 0; j < data[0].height; j++) {
         //輝度成分はそのままコピーするだけ
-        for (int i = 0; i < logoData.header.w; i++) {
+        for (int i = 0; i < logoWidth; i++) {
             mfxI16Pair logoY = *(mfxI16Pair *)&logoData.logoPixel[j * logoData.header.w + i].dp_y;
-            *(mfxI16Pair *)&m_sProcessData[0].pLogoPtr.get()[(j * m_sProcessData[0].pitch + i + yWidthOffset) * 2] = logoY;
+            *(mfxI16Pair *)&data[0].pLogoPtr.get()[(j * data[0].pitch + i + yWidthOffset) * 2] = logoY;
         }
     }
     //まずは4:4:4->4:2:0処理時に端を気にしなくていいよう、縦横ともに2の倍数となるよう拡張する
     //CbCrの順番に並べていく
     //0で初期化しておく
-    std::vector<mfxI16Pair> bufferCbCr444ForShrink(2 * m_sProcessData[1].height * 2 * m_sProcessData[0].pitch, { 0, 0 });
+    std::vector<mfxI16Pair> bufferCbCr444ForShrink(2 * data[1].height * 2 * data[0].pitch, { 0, 0 });
     int j_src = 0; //読み込み側の行
     int j_dst = 0; //書き込み側の行
     auto copyUVLineForShrink = [&]() {
-        for (int i = 0; i < logoData.header.w; i++) {
+        for (int i = 0; i < logoWidth; i++) {
             mfxI16Pair logoCb = *(mfxI16Pair *)&logoData.logoPixel[j_src * logoData.header.w + i].dp_cb;
             mfxI16Pair logoCr = *(mfxI16Pair *)&logoData.logoPixel[j_src * logoData.header.w + i].dp_cr;
-            bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + i + yWidthOffset) * 2 + 0] = logoCb;
-            bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + i + yWidthOffset) * 2 + 1] = logoCr;
+            bufferCbCr444ForShrink[(j_dst * data[1].pitch + i + yWidthOffset) * 2 + 0] = logoCb;
+            bufferCbCr444ForShrink[(j_dst * data[1].pitch + i + yWidthOffset) * 2 + 1] = logoCr;
         }
         if (yWidthOffset & 1) {
             //奇数列はじまりなら、それをその前の偶数列に拡張する
-            mfxI16Pair logoCb = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + 0 + yWidthOffset) * 2 + 0];
-            mfxI16Pair logoCr = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + 0 + yWidthOffset) * 2 + 1];
-            bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + 0 + yWidthOffset - 1) * 2 + 0] = logoCb;
-            bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + 0 + yWidthOffset - 1) * 2 + 1] = logoCr;
+            mfxI16Pair logoCb = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * data[1].pitch + 0 + yWidthOffset) * 2 + 0];
+            mfxI16Pair logoCr = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * data[1].pitch + 0 + yWidthOffset) * 2 + 1];
+            bufferCbCr444ForShrink[(j_dst * data[1].pitch + 0 + yWidthOffset - 1) * 2 + 0] = logoCb;
+            bufferCbCr444ForShrink[(j_dst * data[1].pitch + 0 + yWidthOffset - 1) * 2 + 1] = logoCr;
         }
-        if ((yWidthOffset + logoData.header.w) & 1) {
+        if ((yWidthOffset + logoWidth) & 1) {
             //偶数列おわりなら、それをその次の奇数列に拡張する
-            mfxI16Pair logoCb = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + logoData.header.w + yWidthOffset) * 2 + 0];
-            mfxI16Pair logoCr = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + logoData.header.w + yWidthOffset) * 2 + 1];
-            bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + logoData.header.w + yWidthOffset + 1) * 2 + 0] = logoCb;
-            bufferCbCr444ForShrink[(j_dst * m_sProcessData[1].pitch + logoData.header.w + yWidthOffset + 1) * 2 + 1] = logoCr;
+            mfxI16Pair logoCb = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * data[1].pitch + logoWidth - 1 + yWidthOffset) * 2 + 0];
+            mfxI16Pair logoCr = *(mfxI16Pair *)&bufferCbCr444ForShrink[(j_dst * data[1].pitch + logoWidth - 1 + yWidthOffset) * 2 + 1];
+            bufferCbCr444ForShrink[(j_dst * data[1].pitch + logoWidth + yWidthOffset) * 2 + 0] = logoCb;
+            bufferCbCr444ForShrink[(j_dst * data[1].pitch + logoWidth + yWidthOffset) * 2 + 1] = logoCr;
         }
     };
     if (logoData.header.y & 1) {
@@ -486,16 +455,17 @@ mfxStatus Delogo::SetAuxParams(void *auxParam, int auxParamSize) {
 
     //実際に縮小処理を行う
     //2x2->1x1の処理なのでインクリメントはそれぞれ2ずつ
-    for (mfxU32 j = 0; j < m_sProcessData[0].height; j += 2) {
-        for (mfxU32 i = 0; i < m_sProcessData[1].pitch; i += 2) {
-            mfxI16Pair logoCb0 = bufferCbCr444ForShrink[((j + 0) * m_sProcessData[1].pitch + i + 0) * 2 + 0];
-            mfxI16Pair logoCr0 = bufferCbCr444ForShrink[((j + 0) * m_sProcessData[1].pitch + i + 0) * 2 + 1];
-            mfxI16Pair logoCb1 = bufferCbCr444ForShrink[((j + 0) * m_sProcessData[1].pitch + i + 1) * 2 + 0];
-            mfxI16Pair logoCr1 = bufferCbCr444ForShrink[((j + 0) * m_sProcessData[1].pitch + i + 1) * 2 + 1];
-            mfxI16Pair logoCb2 = bufferCbCr444ForShrink[((j + 1) * m_sProcessData[1].pitch + i + 0) * 2 + 0];
-            mfxI16Pair logoCr2 = bufferCbCr444ForShrink[((j + 1) * m_sProcessData[1].pitch + i + 0) * 2 + 1];
-            mfxI16Pair logoCb3 = bufferCbCr444ForShrink[((j + 1) * m_sProcessData[1].pitch + i + 1) * 2 + 0];
-            mfxI16Pair logoCr3 = bufferCbCr444ForShrink[((j + 1) * m_sProcessData[1].pitch + i + 1) * 2 + 1];
+    //ロゴの開始行が奇数の場合は輝度より1行多くなるので、色差の行数分処理する
+    for (mfxU32 j = 0; j < data[1].height * 2; j += 2) {
+        for (mfxU32 i = 0; i < data[1].pitch; i += 2) {
+            mfxI16Pair logoCb0 = bufferCbCr444ForShrink[((j + 0) * data[1].pitch + i + 0) * 2 + 0];
+            mfxI16Pair logoCr0 = bufferCbCr444ForShrink[((j + 0) * data[1].pitch + i + 0) * 2 + 1];
+            mfxI16Pair logoCb1 = bufferCbCr444ForShrink[((j + 0) * data[1].pitch + i + 1) * 2 + 0];
+            mfxI16Pair logoCr1 = bufferCbCr444ForShrink[((j + 0) * data[1].pitch + i + 1) * 2 + 1];
+            mfxI16Pair logoCb2 = bufferCbCr444ForShrink[((j + 1) * data[1].pitch + i + 0) * 2 + 0];
+            mfxI16Pair logoCr2 = bufferCbCr444ForShrink[((j + 1) * data[1].pitch + i + 0) * 2 + 1];
+            mfxI16Pair logoCb3 = bufferCbCr444ForShrink[((j + 1) * data[1].pitch + i + 1) * 2 + 0];
+            mfxI16Pair logoCr3 = bufferCbCr444ForShrink[((j + 1) * data[1].pitch + i + 1) * 2 + 1];
 
             mfxI16Pair logoCb, logoCr;
             logoCb.x = (logoCb0.x + logoCb1.x + logoCb2.x + logoCb3.x + 2) >> 2;
@@ -504,11 +474,87 @@ mfxStatus Delogo::SetAuxParams(void *auxParam, int auxParamSize) {
             logoCr.y = (logoCr0.y + logoCr1.y + logoCr2.y + logoCr3.y + 2) >> 2;
 
             //単純平均により4:4:4->4:2:0に
-            *(mfxI16Pair *)&m_sProcessData[1].pLogoPtr.get()[(j >> 1) * m_sProcessData[1].pitch * 2 + (i >> 1) * 4 + 0] = logoCb;
-            *(mfxI16Pair *)&m_sProcessData[1].pLogoPtr.get()[(j >> 1) * m_sProcessData[1].pitch * 2 + (i >> 1) * 4 + 2] = logoCr;
+            *(mfxI16Pair *)&data[1].pLogoPtr.get()[(j >> 1) * data[1].pitch * 2 + (i >> 1) * 4 + 0] = logoCb;
+            *(mfxI16Pair *)&data[1].pLogoPtr.get()[(j >> 1) * data[1].pitch * 2 + (i >> 1) * 4 + 2] = logoCr;
         }
     }
+    return true;
+}
 
+mfxStatus Delogo::SetAuxParams(void *auxParam, int auxParamSize) {
+    DelogoParam *pDelogoPar = (DelogoParam *)auxParam;
+    if (pDelogoPar == nullptr) {
+        return MFX_ERR_NULL_PTR;
+    }
+
+    // check validity of parameters
+    // delogoはNV12とP010に対応する
+    mfxStatus sts = MFX_ERR_NONE;
+    const mfxU32 fourcc = m_VideoParam.vpp.In.FourCC;
+    if ((fourcc != MFX_FOURCC_NV12 && fourcc != MFX_FOURCC_P010) || fourcc != m_VideoParam.vpp.Out.FourCC) {
+        m_message += _T("Only NV12 / P010 color format is supported.\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+    const bool highbit = (fourcc == MFX_FOURCC_P010);
+
+    memcpy(&m_DelogoParam, pDelogoPar, sizeof(m_DelogoParam));
+
+    if (MFX_ERR_NONE != (sts = readLogoFile())) {
+        return sts;
+    }
+    if (0 > (m_nLogoIdx = selectLogo(m_DelogoParam.logoSelect))) {
+        if (m_nLogoIdx == LOGO_AUTO_SELECT_NOHIT) {
+            m_message += strsprintf(_T("no logo was selected by auto select \"%s\".\n"), m_DelogoParam.logoSelect);
+            return MFX_ERR_ABORTED;
+        } else {
+            m_message += strsprintf(_T("could not select logo by \"%s\".\n"), m_DelogoParam.logoSelect);
+            m_message += char_to_tstring(logoNameList());
+            return MFX_ERR_UNKNOWN;
+        }
+    }
+
+    auto& logoData = m_sLogoDataList[m_nLogoIdx];
+    if (m_DelogoParam.posX || m_DelogoParam.posY) {
+        LogoData origData;
+        origData.header = logoData.header;
+        origData.logoPixel = logoData.logoPixel;
+
+        logoData.logoPixel = std::vector<LOGO_PIXEL>((logoData.header.w + 1) * (logoData.header.h + 1), { 0 });
+
+        create_adj_exdata(logoData.logoPixel.data(), &logoData.header, origData.logoPixel.data(), &origData.header, m_DelogoParam.posX, m_DelogoParam.posY);
+    }
+
+    const int frameWidth  = m_VideoParam.mfx.FrameInfo.CropW;
+    const int frameHeight = m_VideoParam.mfx.FrameInfo.CropH;
+    if (!create_delogo_process_data(m_sProcessData, logoData, &m_DelogoParam, frameWidth, frameHeight, highbit)) {
+        m_message += strsprintf(_T("\"%s\" was not included in frame size %dx%d.\ndelogo disabled.\n"), m_DelogoParam.logoSelect, frameWidth, frameHeight);
+        m_message += strsprintf(_T("logo pos x=%d, y=%d, including pos offset value %d:%d.\n"), logoData.header.x, logoData.header.y, m_DelogoParam.posX, m_DelogoParam.posY);
+        return MFX_ERR_ABORTED;
+    }
+
+    //ロゴ部分の行を分割して並列処理する
+    //ロゴが小さい場合はスレッドの起動・同期のコストのほうが大きいので、分割あたりの画素数が一定以上になるようにする
+    const int logoPixels = (int)(m_sProcessData[0].pitch * m_sProcessData[0].height);
+    const int slices = (std::max)(1, (std::min)((std::min)(logoPixels / DELOGO_SLICE_MIN_PIXELS, RGYThreadPool::get().threads() + 1), (int)m_sProcessData[0].height));
+    //分割ごとに、ロゴ部分の1行分の一時バッファを使用する
+    const mfxU32 bufferSize = m_sProcessData[0].pitch * (highbit ? 2 : 1);
+    for (int i = 0; i < 2; i++) {
+        m_sProcessData[i].slices = slices;
+        m_sProcessData[i].buffer_size = bufferSize;
+    }
+    for (mfxU32 i = 0; i < m_sTasks.size(); i++) {
+        m_sTasks[i].pBuffer.reset((mfxU8 *)_aligned_malloc(bufferSize * slices, 64));
+        if (m_sTasks[i].pBuffer.get() == nullptr) {
+            m_message += _T("failed to allocate buffer.\n");
+            return MFX_ERR_NULL_PTR;
+        }
+    }
+
+#if defined(_MSC_VER) || defined(__AVX512BW__)
+    if (!m_DelogoParam.add && (m_nSimdAvail & (AVX512F | AVX512BW)) == (AVX512F | AVX512BW)) {
+        m_pluginName = _T("delogo[AVX512]");
+    } else
+#endif //#if defined(_MSC_VER) || defined(__AVX512BW__)
     if ((m_nSimdAvail & (AVX2 | FMA3)) == (AVX2 | FMA3)) {
         m_pluginName = _T("delogo[AVX2]");
     } else if (m_nSimdAvail & AVX) {
@@ -580,6 +626,12 @@ mfxStatus Delogo::Close() {
     return MFX_ERR_NONE;
 }
 
+ProcessorDelogo::ProcessorDelogo(bool d3dSurface) :
+    Processor(),
+    m_bD3DSurface(d3dSurface),
+    m_sData() {
+}
+
 mfxStatus ProcessorDelogo::Init(mfxFrameSurface1 *frame_in, mfxFrameSurface1 *frame_out, const void *data) {
     if (frame_in == nullptr || frame_out == nullptr || data == nullptr) {
         return MFX_ERR_NULL_PTR;
@@ -595,3 +647,93 @@ mfxStatus ProcessorDelogo::Init(mfxFrameSurface1 *frame_in, mfxFrameSurface1 *fr
 
     return MFX_ERR_NONE;
 }
+
+//srcからdstへ、y_start～y_finの行をコピーする
+static void copy_plane_rows(mfxU8 *dst, mfxU32 dst_pitch, const mfxU8 *src, mfxU32 src_pitch, mfxU32 width, mfxU32 y_start, mfxU32 y_fin) {
+    if (y_start >= y_fin) {
+        return;
+    }
+    if (dst_pitch == src_pitch) {
+        memcpy(dst + y_start * dst_pitch, src + y_start * src_pitch, (y_fin - y_start) * dst_pitch);
+        return;
+    }
+    for (mfxU32 y = y_start; y < y_fin; y++) {
+        memcpy(dst + y * dst_pitch, src + y * src_pitch, width);
+    }
+}
+
+mfxStatus ProcessorDelogo::Process(DataChunk *chunk, mfxU8 *pBuffer) {
+    if (chunk == nullptr || pBuffer == nullptr) {
+        return MFX_ERR_NULL_PTR;
+    }
+
+    if (m_pIn->Info.FourCC != MFX_FOURCC_NV12 && m_pIn->Info.FourCC != MFX_FOURCC_P010) {
+        return MFX_ERR_UNSUPPORTED;
+    }
+    const bool highbit = (m_pIn->Info.FourCC == MFX_FOURCC_P010);
+    const mfxU32 pixelBytes = (highbit) ? 2 : 1;
+
+    mfxStatus sts = MFX_ERR_NONE;
+    if (m_bD3DSurface) {
+        //D3Dサーフェスの場合は、GPUでフレーム全体をコピーしてから、出力フレームのロゴ部分のみを処理する
+        if (MFX_ERR_NONE != (sts = CopyD3DFrameGPU(m_pIn, m_pOut))) {
+            return sts;
+        }
+    } else {
+        if (MFX_ERR_NONE != (sts = LockFrame(m_pIn))) return sts;
+    }
+    if (MFX_ERR_NONE != (sts = LockFrame(m_pOut))) {
+        if (!m_bD3DSurface) {
+            UnlockFrame(m_pIn);
+        }
+        return sts;
+    }
+
+    const mfxU32 planeHeight[2] = { m_pIn->Info.CropH, (mfxU32)(m_pIn->Info.CropH >> 1) };
+    mfxU8 *planeIn[2]  = { m_pIn->Data.Y,  m_pIn->Data.UV };
+    mfxU8 *planeOut[2] = { m_pOut->Data.Y, m_pOut->Data.UV };
+    const mfxU32 pitchIn  = m_pIn->Data.Pitch;
+    const mfxU32 pitchOut = m_pOut->Data.Pitch;
+    const mfxU32 rowBytes = m_pIn->Info.CropW * pixelBytes;
+
+    //ロゴ部分の行の範囲 (フレーム内に制限する)
+    mfxU32 logoStart[2], logoFin[2];
+    for (int i = 0; i < 2; i++) {
+        logoStart[i] = (std::min)(m_sData[i]->j_start, planeHeight[i]);
+        logoFin[i]   = (std::min)(m_sData[i]->j_start + m_sData[i]->height, planeHeight[i]);
+        if (!m_bD3DSurface) {
+            //ロゴ部分以外の行はそのままコピーする
+            copy_plane_rows(planeOut[i], pitchOut, planeIn[i], pitchIn, rowBytes, 0, logoStart[i]);
+            copy_plane_rows(planeOut[i], pitchOut, planeIn[i], pitchIn, rowBytes, logoFin[i], planeHeight[i]);
+        }
+    }
+    //ロゴ部分のうちフレーム内にある幅 (byte)
+    const mfxU32 logoWidth = (std::min)(m_sData[0]->pitch, (mfxU32)m_pIn->Info.CropW - (std::min)(m_sData[0]->i_start, (mfxU32)m_pIn->Info.CropW));
+    const mfxU32 widthBytes = ALIGN16(logoWidth * pixelBytes);
+
+    //ロゴ部分の行を分割して並列処理する
+    //各分割は、自分の担当する行のコピーと処理のみを行う
+    const int slices = (std::max)(1, m_sData[0]->slices);
+    auto process_slice = [&](int islice) {
+        mfxU8 *buffer = pBuffer + islice * m_sData[0]->buffer_size;
+        for (int i = 0; i < 2; i++) {
+            const mfxU32 rows = logoFin[i] - logoStart[i];
+            const mfxU32 y_start = logoStart[i] + (mfxU32)((uint64_t)rows *  islice      / slices);
+            const mfxU32 y_fin   = logoStart[i] + (mfxU32)((uint64_t)rows * (islice + 1) / slices);
+            if (!m_bD3DSurface) {
+                copy_plane_rows(planeOut[i], pitchOut, planeIn[i], pitchIn, rowBytes, y_start, y_fin);
+            }
+            ProcessLogo(planeOut[i], pitchOut, buffer, widthBytes, y_start, y_fin, m_sData[i], highbit);
+        }
+    };
+    if (slices > 1) {
+        RGYThreadPool::get().parallel_for(slices, process_slice, RGY_THREAD_POOL_STAGE_FILTER, slices);
+    } else {
+        process_slice(0);
+    }
+
+    if (!m_bD3DSurface) {
+        if (MFX_ERR_NONE != (sts = UnlockFrame(m_pIn))) return sts;
+    }
+    return UnlockFrame(m_pOut);
+}
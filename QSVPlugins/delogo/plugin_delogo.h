@@ -50,14 +50,29 @@ typedef struct {
     short  yc48_2_nv12_add;
     short  offset[2];
     int    fade;
+    int    slices;      //ロゴ部分を分割して並列処理する数
+    mfxU32 buffer_size; //分割ごとの一時バッファのサイズ (byte)
 } ProcessDataDelogo;
 
+//ロゴ部分を分割して並列処理する際の、分割あたりの最小の画素数
+static const int DELOGO_SLICE_MIN_PIXELS = 16384;
+
 class ProcessorDelogo : public Processor
 {
 public:
+    ProcessorDelogo(bool d3dSurface);
     virtual mfxStatus Init(mfxFrameSurface1 *frame_in, mfxFrameSurface1 *frame_out, const void *data) override;
+    //ロゴ部分のみを処理する
+    //入力フレームのコピーとロゴ部分の分割・並列処理は共通で行い、
+    //各SIMDの実装ではProcessLogoのみを実装する
+    virtual mfxStatus Process(DataChunk *chunk, mfxU8 *pBuffer) override;
 
 protected:
+    //ptrで示される画面内の、y_start～y_finの行にあるロゴ部分を処理する
+    //widthはロゴ部分のうちフレーム内にある幅(byte, 16の倍数)
+    virtual void ProcessLogo(mfxU8 *ptr, mfxU32 pitch, mfxU8 *buffer, mfxU32 width, mfxU32 y_start, mfxU32 y_fin, const ProcessDataDelogo *data, bool highbit) = 0;
+
+    bool m_bD3DSurface; //D3Dサーフェスの場合、GPUでフレーム全体をコピーしてからロゴ部分を処理する
     const ProcessDataDelogo *m_sData[2];
 };
 
@@ -112,6 +127,10 @@ typedef struct LogoData {
     vector<LOGO_PIXEL> logoPixel;
 } LogoData;
 
+//ロゴデータから、frameWidth x frameHeightのフレームのロゴ部分を処理するためのデータを作成する
+//ロゴがフレーム内に含まれない場合はfalseを返す
+bool create_delogo_process_data(ProcessDataDelogo data[2], const LogoData& logoData, const DelogoParam *param, int frameWidth, int frameHeight, bool highbit);
+
 typedef struct LOGO_SELECT_KEY {
     std::string key;
     char logoname[LOGO_MAX_NAME];
@@ -1,4 +1,4 @@
-﻿// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
 // QSVEnc by rigaya
 // -----------------------------------------------------------------------------------------
 // The MIT License
@@ -38,6 +38,7 @@
 #include "rgy_osdep.h"
 #include "rgy_ini.h"
 #include "rgy_log.h"
+#include "cpu_info.h"
 #include "plugin_subburn.h"
 #include "subburn_process.h"
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
@@ -228,10 +229,44 @@ static void ass_log_error_only(int ass_level, const char *fmt, va_list args, voi
     }
 }
 
+//時刻nTimeMsに表示する字幕の数を返す
+//あわせて、表示する字幕の組み合わせが変わらない区間[*pStart, *pEnd)を返す
+static int ass_active_events(const ASS_Track *track, int64_t nTimeMs, int64_t *pStart, int64_t *pEnd) {
+    int64_t nStart = INT64_MIN;
+    int64_t nEnd = INT64_MAX;
+    int nActive = 0;
+    for (int i = 0; i < track->n_events; i++) {
+        const int64_t nEventStart = track->events[i].Start;
+        const int64_t nEventEnd   = track->events[i].Start + track->events[i].Duration;
+        if (nTimeMs < nEventStart) {
+            nEnd = (std::min)(nEnd, nEventStart);
+        } else if (nEventEnd <= nTimeMs) {
+            nStart = (std::max)(nStart, nEventEnd);
+        } else {
+            nActive++;
+            nStart = (std::max)(nStart, nEventStart);
+            nEnd = (std::min)(nEnd, nEventEnd);
+        }
+    }
+    *pStart = nStart;
+    *pEnd = nEnd;
+    return nActive;
+}
+
+//1コアあたりのL2キャッシュサイズ
+static int get_l2_cache_size_per_core() {
+    const auto cpu = get_cpu_info();
+    if (cpu.caches[1].count > 0 && cpu.caches[1].size > 0) {
+        return (int)(cpu.caches[1].size / cpu.caches[1].count);
+    }
+    return 256 * 1024;
+}
+
 // SubBurn class implementation
 SubBurn::SubBurn() :
     m_nCpuGen(getCPUGenCpuid()),
     m_nSimdAvail(get_availableSIMD()),
+    m_nCacheSize(get_l2_cache_size_per_core()),
     m_SubBurnParam(),
     m_vProcessData() {
     m_pluginName = _T("subburn");
@@ -713,6 +748,7 @@ mfxStatus SubBurn::SetAuxParams(void *auxParam, int auxParamSize) {
         m_vProcessData[i].pStreamIn = m_SubBurnParam.src.stream;
         m_vProcessData[i].pVideoInputStream = m_SubBurnParam.pVideoInputStream;
         m_vProcessData[i].nSimdAvail = m_nSimdAvail;
+        m_vProcessData[i].nCacheSize = m_nCacheSize;
         m_vProcessData[i].qSubPackets.init();
 
         AddMessage(RGY_LOG_DEBUG, _T("initializing task %d/%d...\n"), i, (uint32_t)m_sTasks.size());
@@ -772,6 +808,10 @@ mfxStatus SubBurn::Close() {
 
 
     for (uint32_t i = 0; i < m_sTasks.size(); i++) {
+        if (m_vProcessData[i].pAssTrack) {
+            AddMessage(RGY_LOG_DEBUG, _T("task %d: rendered %d frames (unchanged %d), skipped rendering %d frames without subtitles.\n"),
+                i, m_vProcessData[i].nAssRenderCount, m_vProcessData[i].nAssReuseCount, m_vProcessData[i].nAssSkipCount);
+        }
         //close decoder
         if (m_vProcessData[i].pOutCodecDecodeCtx) {
             avcodec_close(m_vProcessData[i].pOutCodecDecodeCtx);
@@ -865,6 +905,41 @@ mfxStatus ProcessorSubBurn::Init(mfxFrameSurface1 *frame_in, mfxFrameSurface1 *f
     return MFX_ERR_NONE;
 }
 
+//フレーム全体をコピーし、字幕を焼きこむ行の範囲[nBlendTop, nBlendBottom)にblendを行う
+//字幕のない[0, nBlendTop)と[nBlendBottom, h)はコピーのみ行い、
+//字幕のある範囲はL2キャッシュに収まる程度の行ごとに、コピーした直後、キャッシュに残っているうちにblendする
+//blend(forUV, yStart, yEnd)は、[yStart, yEnd)の行に重なる字幕のみを焼きこむ
+//system memory mode の時のみコピーを行う, d3d9 memoryの時はCopyD3DFrameGPUですでにコピーされている
+//blendがエラーを返した場合は、そこで処理を中断してそのエラーを返す
+template<typename BlendFunc>
+mfxStatus ProcessorSubBurn::CopyFrameWithBlendRange(int nBlendTop, int nBlendBottom, BlendFunc blend) {
+    const int h = m_pIn->Info.CropH;
+    if (nBlendTop >= nBlendBottom) {
+        CopyFrameY(0, h);
+        CopyFrameUV(0, h);
+        return MFX_ERR_NONE;
+    }
+    //UVは2行単位で処理する
+    const int nTop    = (std::max)(0, (std::min)(h, nBlendTop & ~1));
+    const int nBottom = (std::max)(nTop, (std::min)(h, (nBlendBottom + 1) & ~1));
+    //1行あたり、Yの入出力で2行分、UVの入出力で1行分をキャッシュに載せることになる
+    const int nStripRows = (std::max)(16, (m_pProcData->nCacheSize / 2 / (m_pIn->Data.Pitch * 3)) & ~1);
+
+    CopyFrameY(0, nTop);
+    CopyFrameUV(0, nTop);
+    mfxStatus sts = MFX_ERR_NONE;
+    for (int y = nTop; y < nBottom; y += nStripRows) {
+        const int yEnd = (std::min)(nBottom, y + nStripRows);
+        CopyFrameY(y, yEnd);
+        if (MFX_ERR_NONE != (sts = blend(false, y, yEnd))) return sts;
+        CopyFrameUV(y, yEnd);
+        if (MFX_ERR_NONE != (sts = blend(true, y, yEnd))) return sts;
+    }
+    CopyFrameY(nBottom, h);
+    CopyFrameUV(nBottom, h);
+    return MFX_ERR_NONE;
+}
+
 mfxStatus ProcessorSubBurn::ProcessSubText(uint8_t *pBuffer) {
     const uint32_t nSimdAvail = m_pProcData->nSimdAvail;
     rgy_avx_dummy_if_avail(nSimdAvail & (AVX|AVX2));
@@ -906,8 +981,42 @@ mfxStatus ProcessorSubBurn::ProcessSubText(uint8_t *pBuffer) {
     const auto frameTimebase = (m_pProcData->pVideoInputStream) ? m_pProcData->pVideoInputStream->time_base : HW_NATIVE_TIMEBASE;
     const double dTimeMs = (m_pIn->Data.TimeStamp - m_pProcData->nVideoInputFirstKeyPts) * av_q2d(frameTimebase) * 1000.0;
 
-    int nDetectChange = 0;
-    auto pFrameImages = ass_render_frame(m_pProcData->pAssRenderer, m_pProcData->pAssTrack, (int64_t)dTimeMs, &nDetectChange);
+    const int64_t nTimeMs = (int64_t)dTimeMs;
+
+    //表示する字幕の組み合わせが変わらない区間では、表示する字幕の数を再計算しない
+    //新たな字幕が追加された場合は再計算する
+    if (m_pProcData->nAssCheckedEvents != m_pProcData->pAssTrack->n_events
+        || nTimeMs < m_pProcData->nAssActiveStart || m_pProcData->nAssActiveEnd <= nTimeMs) {
+        m_pProcData->nAssActiveEvents = ass_active_events(m_pProcData->pAssTrack, nTimeMs, &m_pProcData->nAssActiveStart, &m_pProcData->nAssActiveEnd);
+        m_pProcData->nAssCheckedEvents = m_pProcData->pAssTrack->n_events;
+    }
+
+    //表示する字幕がなければ、ass_render_frameを呼ぶ必要はない
+    ASS_Image *pFrameImages = nullptr;
+    //字幕を焼きこむ行の範囲
+    int nBlendTop = m_pOut->Info.CropH;
+    int nBlendBottom = 0;
+    if (m_pProcData->nAssActiveEvents > 0) {
+        int nDetectChange = 0;
+        pFrameImages = ass_render_frame(m_pProcData->pAssRenderer, m_pProcData->pAssTrack, nTimeMs, &nDetectChange);
+        m_pProcData->nAssRenderCount++;
+        //字幕画像が前回のass_render_frameから変化していなければ、焼きこむ行の範囲も前回と同じ
+        if (nDetectChange == 0 && m_pProcData->nAssBlendBottom >= 0) {
+            nBlendTop = m_pProcData->nAssBlendTop;
+            nBlendBottom = m_pProcData->nAssBlendBottom;
+            m_pProcData->nAssReuseCount++;
+        } else {
+            for (auto pImage = pFrameImages; pImage; pImage = pImage->next) {
+                const int y = pImage->dst_y + m_pProcData->sCrop.e.up;
+                nBlendTop = (std::min)(nBlendTop, y);
+                nBlendBottom = (std::max)(nBlendBottom, y + pImage->h);
+            }
+            m_pProcData->nAssBlendTop = nBlendTop;
+            m_pProcData->nAssBlendBottom = nBlendBottom;
+        }
+    } else {
+        m_pProcData->nAssSkipCount++;
+    }
 
     if (d3dSurface) {
         if (MFX_ERR_NONE != (sts = CopyD3DFrameGPU(m_pIn, m_pOut))) {
@@ -920,14 +1029,14 @@ mfxStatus ProcessorSubBurn::ProcessSubText(uint8_t *pBuffer) {
         }
     }
 
-    CopyFrameY(); //system memory mode の時のみ有効, d3d9 memoryの時はCopyD3DFrameGPUですでにコピーされている
-    for (auto pImage = pFrameImages; pImage; pImage = pImage->next) {
-        if (MFX_ERR_NONE != (sts = SubBurn<false>(pImage, pBuffer))) return sts;
-    }
-    CopyFrameUV(); //system memory mode の時のみ有効, d3d9 memoryの時はCopyD3DFrameGPUですでにコピーされている
-    for (auto pImage = pFrameImages; pImage; pImage = pImage->next) {
-        if (MFX_ERR_NONE != (sts = SubBurn<true>(pImage, pBuffer))) return sts;
-    }
+    sts = CopyFrameWithBlendRange(nBlendTop, nBlendBottom, [&](bool forUV, int yStart, int yEnd) -> mfxStatus {
+        mfxStatus blendSts = MFX_ERR_NONE;
+        for (auto pImage = pFrameImages; pImage; pImage = pImage->next) {
+            blendSts = (forUV) ? SubBurn<true>(pImage, pBuffer, yStart, yEnd) : SubBurn<false>(pImage, pBuffer, yStart, yEnd);
+            if (MFX_ERR_NONE != blendSts) break;
+        }
+        return blendSts;
+    });
 
     if (!d3dSurface) {
         UnlockFrame(m_pIn);
@@ -1003,14 +1112,29 @@ mfxStatus ProcessorSubBurn::ProcessSubBitmap(uint8_t *pBuffer) {
             }
         }
     }
-    CopyFrameY(); //system memory mode の時のみ有効, d3d9 memoryの時はCopyD3DFrameGPUですでにコピーされている
+    //字幕を焼きこむ行の範囲
+    int nBlendTop = m_pOut->Info.CropH;
+    int nBlendBottom = 0;
     for (uint32_t i = 0; i < m_pProcData->subtitle.num_rects; i++) {
-        SubBurn<false>(m_pProcData->subtitle.rects[i], pBuffer);
-    }
-
-    CopyFrameUV(); //system memory mode の時のみ有効, d3d9 memoryの時はCopyD3DFrameGPUですでにコピーされている
+        const int y = m_pProcData->subtitle.rects[i]->y + m_pProcData->sCrop.e.up;
+        nBlendTop = (std::min)(nBlendTop, y);
+        nBlendBottom = (std::max)(nBlendBottom, y + m_pProcData->subtitle.rects[i]->h);
+    }
+    //使用された色のインデックスの最大値は、すべての行を焼きこんでから反映する
+    //(途中で反映すると、残りの行で使われる色がテーブルから外れてしまう)
+    std::vector<int> vMaxIndex(m_pProcData->subtitle.num_rects, -1);
+    sts = CopyFrameWithBlendRange(nBlendTop, nBlendBottom, [&](bool forUV, int yStart, int yEnd) -> mfxStatus {
+        mfxStatus blendSts = MFX_ERR_NONE;
+        for (uint32_t i = 0; i < m_pProcData->subtitle.num_rects; i++) {
+            blendSts = (forUV) ? SubBurn<true>(m_pProcData->subtitle.rects[i], pBuffer, yStart, yEnd, &vMaxIndex[i]) : SubBurn<false>(m_pProcData->subtitle.rects[i], pBuffer, yStart, yEnd, &vMaxIndex[i]);
+            if (MFX_ERR_NONE != blendSts) break;
+        }
+        return blendSts;
+    });
     for (uint32_t i = 0; i < m_pProcData->subtitle.num_rects; i++) {
-        SubBurn<true>(m_pProcData->subtitle.rects[i], pBuffer);
+        if (vMaxIndex[i] >= 0) {
+            m_pProcData->subtitle.rects[i]->nb_colors = (std::min)(m_pProcData->subtitle.rects[i]->nb_colors, vMaxIndex[i]);
+        }
     }
 
     if (!d3dSurface) {
@@ -1035,24 +1159,22 @@ mfxStatus ProcessorSubBurn::Process(DataChunk *chunk, uint8_t *pBuffer) {
     return (m_pProcData->nType & AV_CODEC_PROP_TEXT_SUB) ? ProcessSubText(pBuffer) : ProcessSubBitmap(pBuffer);
 }
 
-void ProcessorSubBurn::CopyFrameY() {
-    const uint8_t *pFrameSrc = m_pIn->Data.Y;
-    uint8_t *pFrameOut = m_pOut->Data.Y;
+void ProcessorSubBurn::CopyFrameY(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y++, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.Y + yStart * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.Y + yStart * pitch;
+    for (int y = yStart; y < yEnd; y++, pFrameSrc += pitch, pFrameOut += pitch) {
         memcpy(pFrameOut, pFrameSrc, w);
     }
 }
 
-void ProcessorSubBurn::CopyFrameUV() {
-    const uint8_t *pFrameSrc = m_pIn->Data.UV;
-    uint8_t *pFrameOut = m_pOut->Data.UV;
+void ProcessorSubBurn::CopyFrameUV(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.UV + (yStart >> 1) * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.UV + (yStart >> 1) * pitch;
+    for (int y = yStart; y < yEnd; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
         memcpy(pFrameOut, pFrameSrc, w);
     }
 }
@@ -1098,8 +1220,28 @@ void ProcessorSubBurn::BlendSubUV(const uint8_t *pAlpha, int bufX, int bufY, int
     }
 }
 
+//字幕画像の行のうち、フレームの[yStart, yEnd)の行に重なる範囲[*pRowStart, *pRowEnd)を求める
+//UVは字幕画像の偶数行のみを使用するので、開始行を偶数にそろえる
+//重なる行がなければfalseを返す
+template<bool forUV>
+static bool sub_rows_in_range(int subY, int subH, int yStart, int yEnd, int *pRowStart, int *pRowEnd) {
+    int rowStart = (std::max)(0, yStart - subY);
+    if (forUV) {
+        rowStart = (rowStart + 1) & ~1;
+    }
+    const int rowEnd = (std::min)(subH, yEnd - subY);
+    *pRowStart = rowStart;
+    *pRowEnd = rowEnd;
+    return rowStart < rowEnd;
+}
+
 template<bool forUV>
-mfxStatus ProcessorSubBurn::SubBurn(ASS_Image *pImage, uint8_t *pBuffer) {
+mfxStatus ProcessorSubBurn::SubBurn(ASS_Image *pImage, uint8_t *pBuffer, int yStart, int yEnd) {
+    const int imageY = pImage->dst_y + m_pProcData->sCrop.e.up;
+    int rowStart = 0, rowEnd = 0;
+    if (!sub_rows_in_range<forUV>(imageY, pImage->h, yStart, yEnd, &rowStart, &rowEnd)) {
+        return MFX_ERR_NONE;
+    }
     const uint32_t nSubColor = pImage->color;
     const uint8_t subR = (uint8_t) (nSubColor >> 24);
     const uint8_t subG = (uint8_t)((nSubColor >> 16) & 0xff);
@@ -1110,10 +1252,11 @@ mfxStatus ProcessorSubBurn::SubBurn(ASS_Image *pImage, uint8_t *pBuffer) {
     const uint8_t subU = (uint8_t)clamp(((-38 * subR -  74 * subG + 112 * subB + 128) >> 8) + 128, 0, 255);
     const uint8_t subV = (uint8_t)clamp(((112 * subR -  94 * subG -  18 * subB + 128) >> 8) + 128, 0, 255);
 
+    const uint8_t *pBitmap = pImage->bitmap + rowStart * pImage->stride;
     if (!forUV)
-        BlendSubY( pImage->bitmap, pImage->dst_x + m_pProcData->sCrop.e.left, pImage->dst_y + m_pProcData->sCrop.e.up, pImage->w, pImage->stride, pImage->h, subY, subA, pBuffer);
+        BlendSubY( pBitmap, pImage->dst_x + m_pProcData->sCrop.e.left, imageY + rowStart, pImage->w, pImage->stride, rowEnd - rowStart, subY, subA, pBuffer);
     else
-        BlendSubUV(pImage->bitmap, pImage->dst_x + m_pProcData->sCrop.e.left, pImage->dst_y + m_pProcData->sCrop.e.up, pImage->w, pImage->stride, pImage->h, subU, subV, subA, pBuffer);
+        BlendSubUV(pBitmap, pImage->dst_x + m_pProcData->sCrop.e.left, imageY + rowStart, pImage->w, pImage->stride, rowEnd - rowStart, subU, subV, subA, pBuffer);
 
     return MFX_ERR_NONE;
 }
@@ -1126,7 +1269,12 @@ int ProcessorSubBurn::BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLU
 }
 
 template<bool forUV>
-mfxStatus ProcessorSubBurn::SubBurn(AVSubtitleRect *pRect, uint8_t *pBuffer) {
+mfxStatus ProcessorSubBurn::SubBurn(AVSubtitleRect *pRect, uint8_t *pBuffer, int yStart, int yEnd, int *pMaxIndex) {
+    const int rectY = pRect->y + m_pProcData->sCrop.e.up;
+    int rowStart = 0, rowEnd = 0;
+    if (!sub_rows_in_range<forUV>(rectY, pRect->h, yStart, yEnd, &rowStart, &rowEnd)) {
+        return MFX_ERR_NONE;
+    }
     uint32_t nColorTableSize = pRect->nb_colors;
 #define INT(b) ((b) ? 1 : 0)
     alignas(32) uint8_t pColor[256 << (INT(forUV))];
@@ -1152,10 +1300,11 @@ mfxStatus ProcessorSubBurn::SubBurn(AVSubtitleRect *pRect, uint8_t *pBuffer) {
         }
         pAlpha[ic] = subA >> 1;
     }
+    const uint8_t *pSubColorIdx = pRect->data[0] + rowStart * pRect->linesize[0];
     int nMaxIndex = (forUV)
-        ? BlendSubUVBitmap(pRect->data[0], pRect->nb_colors, pColor, pAlpha, pRect->x + m_pProcData->sCrop.e.left, pRect->y + m_pProcData->sCrop.e.up, pRect->w, pRect->linesize[0], pRect->h, pBuffer)
-        : BlendSubYBitmap(pRect->data[0], pRect->nb_colors, pColor, pAlpha, pRect->x + m_pProcData->sCrop.e.left, pRect->y + m_pProcData->sCrop.e.up, pRect->w, pRect->linesize[0], pRect->h, pBuffer);
-    pRect->nb_colors = (std::min)(pRect->nb_colors, nMaxIndex);
+        ? BlendSubUVBitmap(pSubColorIdx, pRect->nb_colors, pColor, pAlpha, pRect->x + m_pProcData->sCrop.e.left, rectY + rowStart, pRect->w, pRect->linesize[0], rowEnd - rowStart, pBuffer)
+        : BlendSubYBitmap(pSubColorIdx, pRect->nb_colors, pColor, pAlpha, pRect->x + m_pProcData->sCrop.e.left, rectY + rowStart, pRect->w, pRect->linesize[0], rowEnd - rowStart, pBuffer);
+    *pMaxIndex = (std::max)(*pMaxIndex, nMaxIndex);
     return MFX_ERR_NONE;
 }
 
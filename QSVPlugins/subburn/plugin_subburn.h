@@ -1,4 +1,4 @@
-﻿// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
 // QSVEnc by rigaya
 // -----------------------------------------------------------------------------------------
 // The MIT License
@@ -73,6 +73,16 @@ struct ProcessDataSubBurn {
     ASS_Library          *pAssLibrary;            //libassのコンテキスト
     ASS_Renderer         *pAssRenderer;           //libassのレンダラ
     ASS_Track            *pAssTrack;              //libassのトラック
+    int64_t               nAssActiveStart;        //表示する字幕の組み合わせが変わらない区間の開始 (ms)
+    int64_t               nAssActiveEnd;          //表示する字幕の組み合わせが変わらない区間の終了 (ms)
+    int                   nAssActiveEvents;       //上記区間で表示する字幕の数
+    int                   nAssCheckedEvents;      //上記区間を求めた時点のトラックの字幕の数 (-1で未計算)
+    int                   nAssRenderCount;        //ass_render_frameを呼んだフレーム数
+    int                   nAssSkipCount;          //表示する字幕がなくass_render_frameを省略したフレーム数
+    int                   nAssReuseCount;         //字幕画像が前回から変化せず、焼きこむ行の範囲を再利用したフレーム数
+    int                   nAssBlendTop;           //前回ass_render_frameで得た字幕画像を焼きこむ行の範囲の開始
+    int                   nAssBlendBottom;        //前回ass_render_frameで得た字幕画像を焼きこむ行の範囲の終了 (-1で未計算)
+    int                   nCacheSize;             //コピーとblendをまとめて行う行数の目安とするキャッシュサイズ (byte)
     
     RGYQueueSPSP<AVPacket>  qSubPackets;            //入力から得られた字幕パケット
 
@@ -103,6 +113,16 @@ struct ProcessDataSubBurn {
         pAssLibrary(nullptr),
         pAssRenderer(nullptr),
         pAssTrack(nullptr),
+        nAssActiveStart(0),
+        nAssActiveEnd(0),
+        nAssActiveEvents(0),
+        nAssCheckedEvents(-1),
+        nAssRenderCount(0),
+        nAssSkipCount(0),
+        nAssReuseCount(0),
+        nAssBlendTop(0),
+        nAssBlendBottom(-1),
+        nCacheSize(256 * 1024),
         qSubPackets(),
         nSimdAvail(0) {
         qSubPackets.init();
@@ -119,14 +139,18 @@ protected:
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
     mfxStatus ProcessSubText(uint8_t *pBuffer);
     mfxStatus ProcessSubBitmap(uint8_t *pBuffer);
-    virtual void CopyFrameY();
-    virtual void CopyFrameUV();
+    //yStart～yEndの行をコピーする (UVも輝度の行数で指定する)
+    virtual void CopyFrameY(int yStart, int yEnd);
+    virtual void CopyFrameUV(int yStart, int yEnd);
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf);
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf);
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf);
     virtual void BlendSubUV(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcoloru, uint8_t subcolorv, uint8_t subTransparency, uint8_t *pBuf);
-    template<bool forUV> mfxStatus SubBurn(ASS_Image *pImage, uint8_t *pBuffer);
-    template<bool forUV> mfxStatus SubBurn(AVSubtitleRect *pRect, uint8_t *pBuffer);
+    //字幕画像のうち、フレームの[yStart, yEnd)の行に重なる部分のみを焼きこむ
+    template<bool forUV> mfxStatus SubBurn(ASS_Image *pImage, uint8_t *pBuffer, int yStart, int yEnd);
+    //pMaxIndexには、焼きこんだ部分で使用された色のインデックスの最大値を加味した値を返す
+    template<bool forUV> mfxStatus SubBurn(AVSubtitleRect *pRect, uint8_t *pBuffer, int yStart, int yEnd, int *pMaxIndex);
+    template<typename BlendFunc> mfxStatus CopyFrameWithBlendRange(int nBlendTop, int nBlendBottom, BlendFunc blend);
 #endif
     ProcessDataSubBurn *m_pProcData;
 };
@@ -195,6 +219,7 @@ protected:
 
     int m_nCpuGen;
     uint32_t m_nSimdAvail;
+    int m_nCacheSize;
     SubBurnParam m_SubBurnParam;
     vector<ProcessDataSubBurn> m_vProcessData;
 };
@@ -39,8 +39,8 @@ public:
     virtual ~ProcessorSubBurnSSE41();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -55,8 +55,8 @@ public:
     virtual ~ProcessorSubBurnSSE41PshufbSlow();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -71,8 +71,8 @@ public:
     virtual ~ProcessorSubBurnAVX();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -87,8 +87,8 @@ public:
     virtual ~ProcessorSubBurnAVX2();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -103,8 +103,8 @@ public:
     virtual ~ProcessorSubBurnD3DSSE41();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -119,8 +119,8 @@ public:
     virtual ~ProcessorSubBurnD3DSSE41PshufbSlow();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -135,8 +135,8 @@ public:
     virtual ~ProcessorSubBurnD3DAVX();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -151,8 +151,8 @@ public:
     virtual ~ProcessorSubBurnD3DAVX2();
 
 #if ENABLE_AVSW_READER && ENABLE_LIBASS_SUBBURN
-    virtual void CopyFrameY() override;
-    virtual void CopyFrameUV() override;
+    virtual void CopyFrameY(int yStart, int yEnd) override;
+    virtual void CopyFrameUV(int yStart, int yEnd) override;
     virtual int BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual int BlendSubUVBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int bufH, uint8_t *pBuf) override;
     virtual void BlendSubY(const uint8_t *pAlpha, int bufX, int bufY, int bufW, int bufStride, int bufH, uint8_t subcolory, uint8_t subTransparency, uint8_t *pBuf) override;
@@ -49,24 +49,22 @@ ProcessorSubBurnAVX::ProcessorSubBurnAVX() : ProcessorSubBurn() {
 ProcessorSubBurnAVX::~ProcessorSubBurnAVX() {
 }
 
-void ProcessorSubBurnAVX::CopyFrameY() {
-    const uint8_t *pFrameSrc = m_pIn->Data.Y;
-    uint8_t *pFrameOut = m_pOut->Data.Y;
+void ProcessorSubBurnAVX::CopyFrameY(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y++, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.Y + yStart * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.Y + yStart * pitch;
+    for (int y = yStart; y < yEnd; y++, pFrameSrc += pitch, pFrameOut += pitch) {
         sse_memcpy(pFrameOut, pFrameSrc, w);
     }
 }
 
-void ProcessorSubBurnAVX::CopyFrameUV() {
-    const uint8_t *pFrameSrc = m_pIn->Data.UV;
-    uint8_t *pFrameOut = m_pOut->Data.UV;
+void ProcessorSubBurnAVX::CopyFrameUV(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.UV + (yStart >> 1) * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.UV + (yStart >> 1) * pitch;
+    for (int y = yStart; y < yEnd; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
         sse_memcpy(pFrameOut, pFrameSrc, w);
     }
 }
@@ -134,10 +132,10 @@ ProcessorSubBurnD3DAVX::ProcessorSubBurnD3DAVX() : ProcessorSubBurn() {
 ProcessorSubBurnD3DAVX::~ProcessorSubBurnD3DAVX() {
 }
 
-void ProcessorSubBurnD3DAVX::CopyFrameY() {
+void ProcessorSubBurnD3DAVX::CopyFrameY(int yStart, int yEnd) {
 }
 
-void ProcessorSubBurnD3DAVX::CopyFrameUV() {
+void ProcessorSubBurnD3DAVX::CopyFrameUV(int yStart, int yEnd) {
 }
 
 int ProcessorSubBurnD3DAVX::BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int subH, uint8_t *pBuf) {
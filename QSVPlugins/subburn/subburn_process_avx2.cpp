@@ -48,13 +48,12 @@ ProcessorSubBurnAVX2::ProcessorSubBurnAVX2() : ProcessorSubBurn() {
 ProcessorSubBurnAVX2::~ProcessorSubBurnAVX2() {
 }
 
-void ProcessorSubBurnAVX2::CopyFrameY() {
-    const uint8_t *pFrameSrc = m_pIn->Data.Y;
-    uint8_t *pFrameOut = m_pOut->Data.Y;
+void ProcessorSubBurnAVX2::CopyFrameY(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y++, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.Y + yStart * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.Y + yStart * pitch;
+    for (int y = yStart; y < yEnd; y++, pFrameSrc += pitch, pFrameOut += pitch) {
         const uint8_t *ptr_src = pFrameSrc;
         uint8_t *ptr_dst     = pFrameOut;
         uint8_t *ptr_dst_fin = ptr_dst + (w & ~127);
@@ -77,13 +76,12 @@ void ProcessorSubBurnAVX2::CopyFrameY() {
     _mm256_zeroupper();
 }
 
-void ProcessorSubBurnAVX2::CopyFrameUV() {
-    const uint8_t *pFrameSrc = m_pIn->Data.UV;
-    uint8_t *pFrameOut = m_pOut->Data.UV;
+void ProcessorSubBurnAVX2::CopyFrameUV(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.UV + (yStart >> 1) * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.UV + (yStart >> 1) * pitch;
+    for (int y = yStart; y < yEnd; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
         const uint8_t *ptr_src = pFrameSrc;
         uint8_t *ptr_dst     = pFrameOut;
         uint8_t *ptr_dst_fin = ptr_dst + (w & ~127);
@@ -169,10 +167,10 @@ ProcessorSubBurnD3DAVX2::ProcessorSubBurnD3DAVX2() : ProcessorSubBurn() {
 ProcessorSubBurnD3DAVX2::~ProcessorSubBurnD3DAVX2() {
 }
 
-void ProcessorSubBurnD3DAVX2::CopyFrameY() {
+void ProcessorSubBurnD3DAVX2::CopyFrameY(int yStart, int yEnd) {
 }
 
-void ProcessorSubBurnD3DAVX2::CopyFrameUV() {
+void ProcessorSubBurnD3DAVX2::CopyFrameUV(int yStart, int yEnd) {
 }
 
 int ProcessorSubBurnD3DAVX2::BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int subH, uint8_t *pBuf) {
@@ -43,24 +43,22 @@ ProcessorSubBurnSSE41::ProcessorSubBurnSSE41() : ProcessorSubBurn() {
 ProcessorSubBurnSSE41::~ProcessorSubBurnSSE41() {
 }
 
-void ProcessorSubBurnSSE41::CopyFrameY() {
-    const uint8_t *pFrameSrc = m_pIn->Data.Y;
-    uint8_t *pFrameOut = m_pOut->Data.Y;
+void ProcessorSubBurnSSE41::CopyFrameY(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y++, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.Y + yStart * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.Y + yStart * pitch;
+    for (int y = yStart; y < yEnd; y++, pFrameSrc += pitch, pFrameOut += pitch) {
         sse_memcpy(pFrameOut, pFrameSrc, w);
     }
 }
 
-void ProcessorSubBurnSSE41::CopyFrameUV() {
-    const uint8_t *pFrameSrc = m_pIn->Data.UV;
-    uint8_t *pFrameOut = m_pOut->Data.UV;
+void ProcessorSubBurnSSE41::CopyFrameUV(int yStart, int yEnd) {
     const int w = m_pIn->Info.CropW;
-    const int h = m_pIn->Info.CropH;
     const int pitch = m_pIn->Data.Pitch;
-    for (int y = 0; y < h; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
+    const uint8_t *pFrameSrc = m_pIn->Data.UV + (yStart >> 1) * pitch;
+    uint8_t *pFrameOut = m_pOut->Data.UV + (yStart >> 1) * pitch;
+    for (int y = yStart; y < yEnd; y += 2, pFrameSrc += pitch, pFrameOut += pitch) {
         sse_memcpy(pFrameOut, pFrameSrc, w);
     }
 }
@@ -126,10 +124,10 @@ ProcessorSubBurnD3DSSE41::ProcessorSubBurnD3DSSE41() : ProcessorSubBurn() {
 ProcessorSubBurnD3DSSE41::~ProcessorSubBurnD3DSSE41() {
 }
 
-void ProcessorSubBurnD3DSSE41::CopyFrameY() {
+void ProcessorSubBurnD3DSSE41::CopyFrameY(int yStart, int yEnd) {
 }
 
-void ProcessorSubBurnD3DSSE41::CopyFrameUV() {
+void ProcessorSubBurnD3DSSE41::CopyFrameUV(int yStart, int yEnd) {
 }
 
 int ProcessorSubBurnD3DSSE41::BlendSubYBitmap(const uint8_t *pSubColorIdx, int nColorLUT, const uint8_t *pSubColor, const uint8_t *pAlpha, int subX, int subY, int subW, int subStride, int subH, uint8_t *pBuf) {
@@ -0,0 +1,199 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+
+//avs読み込みの先読み (--avs-prefetch / --avs-prefetch-threads) の効果の測定
+//  bench_avs_prefetch <script.avs> [--frames <n>] [--work-ms <n>] [--prefetch <n>] [--threads <n>]
+//  エンコーダの処理の代わりに1フレームごとに--work-ms待機しながら読み込み、
+//  先読みなし/あり(1スレッド)/あり(複数スレッド)のそれぞれで、LoadNextFrameの1フレームあたりの時間を測定する
+//  先読みが効いていれば、スクリプトの処理が待機と並行して行われ、LoadNextFrameの時間は短くなる
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include "rgy_input_avs.h"
+#include "rgy_simd.h"
+
+#if ENABLE_AVISYNTH_READER
+
+struct BenchPrm {
+    std::string script;
+    int frames;     //読み込むフレーム数 (0ならすべて)
+    int workMs;     //1フレームごとのエンコーダ側の処理時間の代わりに待機する時間
+    int prefetch;
+    int threads;
+};
+
+//読み込み結果の格納先 (NV12)
+struct BenchSurface {
+    std::vector<uint8_t> buf;
+    RGYFrame frame;
+
+    BenchSurface(int w, int h) : buf(), frame(RGYFrameInit()) {
+        const int pitch = ALIGN(w, 64);
+        buf.resize((size_t)pitch * h * 3 / 2);
+        auto& surf = frame.frame();
+        surf.Info.FourCC = MFX_FOURCC_NV12;
+        surf.Info.Width = (mfxU16)w;
+        surf.Info.Height = (mfxU16)h;
+        surf.Info.CropW = (mfxU16)w;
+        surf.Info.CropH = (mfxU16)h;
+        surf.Data.Pitch = (mfxU16)pitch;
+        surf.Data.Y = buf.data();
+        surf.Data.UV = buf.data() + (size_t)pitch * h;
+    }
+};
+
+struct BenchResult {
+    int frames;
+    double sec;             //全体の時間
+    std::vector<double> ms; //フレームごとのLoadNextFrameの時間
+};
+
+static int bench_read(const BenchPrm& prm, int prefetch, int threads, BenchResult *result) {
+    VideoInfo info = VideoInfo();
+    info.type = RGY_INPUT_FMT_AVS;
+    info.csp = RGY_CSP_NV12;
+    RGYInputPrm basePrm;
+    basePrm.simdCsp = get_availableSIMD();
+    RGYInputAvsPrm inputPrm(basePrm);
+    inputPrm.prefetch = prefetch;
+    inputPrm.prefetchThreads = threads;
+    RGYInputAvs reader;
+    //Init(..., log, status)はRGYInputAvs側のInitに隠されているので、基底クラス経由で呼ぶ
+    if (static_cast<RGYInput&>(reader).Init(char_to_tstring(prm.script).c_str(), &info, &inputPrm, nullptr, std::make_shared<EncodeStatus>()) != RGY_ERR_NONE) {
+        fprintf(stderr, "failed to open %s.\n", prm.script.c_str());
+        return 1;
+    }
+    const auto inputInfo = reader.GetInputFrameInfo();
+    BenchSurface surf(inputInfo.srcWidth, inputInfo.srcHeight);
+    result->frames = 0;
+    result->ms.clear();
+    const auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        if (prm.frames > 0 && result->frames >= prm.frames) {
+            break;
+        }
+        const auto t0 = std::chrono::steady_clock::now();
+        if (reader.LoadNextFrame(&surf.frame) != RGY_ERR_NONE) {
+            break;
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        result->ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+        result->frames++;
+        if (prm.workMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(prm.workMs));
+        }
+    }
+    result->sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    reader.Close();
+    return 0;
+}
+
+static void print_result(const char *name, const BenchResult& result) {
+    if (result.ms.empty()) {
+        fprintf(stdout, "%s: no frames.\n", name);
+        return;
+    }
+    auto ms = result.ms;
+    std::sort(ms.begin(), ms.end());
+    double sum = 0.0;
+    for (auto t : ms) {
+        sum += t;
+    }
+    //1ms以上かかったフレームは、スクリプトの処理を待ったものとみなす
+    const int waited = (int)(ms.end() - std::lower_bound(ms.begin(), ms.end(), 1.0));
+    fprintf(stdout, "%s %8.2f  %8.3f %8.3f %8.3f %8.3f  %6d\n", name,
+        result.frames / result.sec,
+        sum / ms.size(), ms[ms.size() / 2], ms[ms.size() * 99 / 100], ms.back(), waited);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    BenchPrm prm;
+    prm.frames = 0;
+    prm.workMs = 10;
+    prm.prefetch = 8;
+    prm.threads = std::max(2, std::min(4, (int)std::thread::hardware_concurrency()));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            prm.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--work-ms") == 0 && i + 1 < argc) {
+            prm.workMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            prm.prefetch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            prm.threads = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && prm.script.empty()) {
+            prm.script = argv[i];
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (prm.script.empty() || prm.prefetch <= 0 || prm.threads <= 0) {
+        fprintf(stderr, "bench_avs_prefetch <script.avs> [--frames <n>] [--work-ms <n>] [--prefetch <n>] [--threads <n>]\n");
+        return 1;
+    }
+
+    struct BenchMode {
+        std::string name;
+        int prefetch, threads;
+    };
+    std::vector<BenchMode> modes;
+    modes.push_back({ "no prefetch           ", 0, 1 });
+    modes.push_back({ strsprintf("prefetch %3d, 1 thread ", prm.prefetch), prm.prefetch, 1 });
+    if (prm.threads > 1) {
+        modes.push_back({ strsprintf("prefetch %3d, %d threads", prm.prefetch, prm.threads), prm.prefetch, prm.threads });
+    }
+
+    fprintf(stdout, "%s, work %d ms/frame\n", prm.script.c_str(), prm.workMs);
+    fprintf(stdout, "                              fps   LoadNextFrame(ms)                     waited\n");
+    fprintf(stdout, "                                       avg   median      p99      max\n");
+    int ret = 0;
+    for (const auto& mode : modes) {
+        BenchResult result;
+        if (bench_read(prm, mode.prefetch, mode.threads, &result)) {
+            ret = 1;
+            continue;
+        }
+        print_result(mode.name.c_str(), result);
+    }
+    return ret;
+}
+
+#else
+int main(int argc, char **argv) {
+    fprintf(stderr, "avs reader is not supported in this build.\n");
+    return 1;
+}
+#endif //#if ENABLE_AVISYNTH_READER
@@ -0,0 +1,236 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+
+//mp4出力のfaststartとfragmented mp4 (--mp4-fragment) の比較
+//  bench_mp4_fragment [--frames <n>] [--gop <n>] [--kbps <n>] [--out <prefix>]
+//  RGYOutputAvcodecがmp4出力で設定するのと同じmovflagsで、ダミーのH.264パケットをmuxし、
+//  パケットの書き出し/終了処理(av_write_trailer)それぞれにかかる時間と出力サイズを測定する
+//  faststartでは終了処理でファイル全体を書き直すので、その分が終了処理の時間に現れる
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "rgy_version.h"
+
+#if ENABLE_AVSW_READER
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/opt.h>
+#include <libavformat/avformat.h>
+}
+
+struct BenchPrm {
+    int frames;
+    int gop;
+    int kbps;
+    std::string out;
+};
+
+struct BenchMode {
+    const char *name;
+    const char *brand;         //nullptrならmuxerに任せる
+    const char *movflags;
+    int minFragDurationMs;     //0なら設定しない
+};
+
+//RGYOutputAvcodec::WriteFileHeaderでの設定に合わせる
+static const BenchMode BENCH_MODES[] = {
+    { "no-mp4opt        ", "mp42",  nullptr, 0 },
+    { "faststart        ", "mp42",  "faststart", 0 },
+    { "fragment         ", nullptr, "frag_keyframe+empty_moov+default_base_moof", 0 },
+    { "fragment (2000ms)", nullptr, "frag_keyframe+empty_moov+default_base_moof", 2000 },
+};
+
+//High@4.0、SPS/PPSはダミーのavcC
+static const uint8_t AVCC[] = {
+    0x01, 0x64, 0x00, 0x28, 0xff, 0xe1, 0x00, 0x04, 0x67, 0x64, 0x00, 0x28,
+    0x01, 0x00, 0x04, 0x68, 0xee, 0x3c, 0x80
+};
+
+//長さ4byteのNALを1つ含むパケット (キーフレームはIDR、それ以外はnon-IDRスライス)
+static void make_packet(std::vector<uint8_t>& pkt, size_t size, bool key, std::mt19937& mt) {
+    pkt.resize(size);
+    const uint32_t nalSize = (uint32_t)(size - 4);
+    pkt[0] = (uint8_t)(nalSize >> 24);
+    pkt[1] = (uint8_t)(nalSize >> 16);
+    pkt[2] = (uint8_t)(nalSize >> 8);
+    pkt[3] = (uint8_t)(nalSize);
+    pkt[4] = (uint8_t)((key) ? 0x65 : 0x41);
+    for (size_t i = 5; i < size; i++) {
+        pkt[i] = (uint8_t)mt();
+    }
+}
+
+struct BenchResult {
+    double writeSec;    //ヘッダとパケットの書き出し
+    double trailerSec;  //av_write_trailer
+    int64_t fileSize;
+};
+
+static int bench_mux(const BenchPrm& prm, const BenchMode& mode, const std::string& filename, BenchResult *result) {
+    const int fps = 60;
+    //キーフレームはそれ以外の5倍のサイズとする
+    const size_t avgSize = (size_t)prm.kbps * 1000 / 8 / fps;
+    const size_t otherSize = std::max<size_t>(avgSize * prm.gop / (prm.gop + 4), 16);
+    const size_t keySize = otherSize * 5;
+    std::mt19937 mt(5489);
+    std::vector<uint8_t> keyPkt, otherPkt;
+    make_packet(keyPkt, keySize, true, mt);
+    make_packet(otherPkt, otherSize, false, mt);
+
+    AVFormatContext *ctx = nullptr;
+    if (avformat_alloc_output_context2(&ctx, nullptr, "mp4", filename.c_str()) < 0 || !ctx) {
+        fprintf(stderr, "failed to create mp4 muxer.\n");
+        return 1;
+    }
+    AVStream *st = avformat_new_stream(ctx, nullptr);
+    st->time_base = av_make_q(1, fps);
+    st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    st->codecpar->codec_id = AV_CODEC_ID_H264;
+    st->codecpar->width = 1920;
+    st->codecpar->height = 1080;
+    st->codecpar->extradata = (uint8_t *)av_mallocz(sizeof(AVCC) + AV_INPUT_BUFFER_PADDING_SIZE);
+    st->codecpar->extradata_size = sizeof(AVCC);
+    memcpy(st->codecpar->extradata, AVCC, sizeof(AVCC));
+
+    AVDictionary *opts = nullptr;
+    if (mode.brand) {
+        av_dict_set(&opts, "brand", mode.brand, 0);
+    }
+    if (mode.movflags) {
+        av_dict_set(&opts, "movflags", mode.movflags, 0);
+    }
+    if (mode.minFragDurationMs > 0) {
+        av_dict_set_int(&opts, "min_frag_duration", (int64_t)mode.minFragDurationMs * 1000, 0);
+    }
+    int ret = 0;
+    const auto start = std::chrono::steady_clock::now();
+    if (avio_open(&ctx->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0) {
+        fprintf(stderr, "failed to open %s.\n", filename.c_str());
+        ret = 1;
+    } else if (avformat_write_header(ctx, &opts) < 0) {
+        fprintf(stderr, "failed to write header.\n");
+        ret = 1;
+    }
+    av_dict_free(&opts);
+    for (int i = 0; ret == 0 && i < prm.frames; i++) {
+        const bool key = (i % prm.gop) == 0;
+        auto& src = (key) ? keyPkt : otherPkt;
+        AVPacket pkt;
+        av_init_packet(&pkt);
+        pkt.data = src.data();
+        pkt.size = (int)src.size();
+        pkt.stream_index = 0;
+        pkt.flags = (key) ? AV_PKT_FLAG_KEY : 0;
+        pkt.pts = av_rescale_q(i, av_make_q(1, fps), st->time_base);
+        pkt.dts = pkt.pts;
+        pkt.duration = av_rescale_q(1, av_make_q(1, fps), st->time_base);
+        if (av_write_frame(ctx, &pkt) < 0) {
+            fprintf(stderr, "failed to write frame %d.\n", i);
+            ret = 1;
+        }
+    }
+    const auto trailer = std::chrono::steady_clock::now();
+    if (ret == 0 && av_write_trailer(ctx) < 0) {
+        fprintf(stderr, "failed to write trailer.\n");
+        ret = 1;
+    }
+    if (ctx->pb) {
+        avio_closep(&ctx->pb);
+    }
+    const auto fin = std::chrono::steady_clock::now();
+    avformat_free_context(ctx);
+
+    result->writeSec = std::chrono::duration_cast<std::chrono::microseconds>(trailer - start).count() * 1e-6;
+    result->trailerSec = std::chrono::duration_cast<std::chrono::microseconds>(fin - trailer).count() * 1e-6;
+    result->fileSize = 0;
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        result->fileSize = (int64_t)ftello(fp);
+        fclose(fp);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    BenchPrm prm;
+    prm.frames = 3600;
+    prm.gop = 60;
+    prm.kbps = 20000;
+    prm.out = "bench_mp4_fragment";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            prm.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gop") == 0 && i + 1 < argc) {
+            prm.gop = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kbps") == 0 && i + 1 < argc) {
+            prm.kbps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            prm.out = argv[++i];
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (prm.frames <= 0 || prm.gop <= 0 || prm.kbps <= 0) {
+        fprintf(stderr, "invalid parameter.\n");
+        return 1;
+    }
+    av_register_all();
+    av_log_set_level(AV_LOG_ERROR);
+
+    fprintf(stdout, "%d frames @ 60fps, gop %d, %d kbps\n", prm.frames, prm.gop, prm.kbps);
+    fprintf(stdout, "                    write(s)  trailer(s)   total(s)   size(MB)\n");
+    int ret = 0;
+    for (const auto& mode : BENCH_MODES) {
+        const std::string filename = prm.out + ".mp4";
+        BenchResult result = { 0 };
+        if (bench_mux(prm, mode, filename, &result)) {
+            fprintf(stdout, "%s: failed.\n", mode.name);
+            ret = 1;
+        } else {
+            fprintf(stdout, "%s %9.3f  %9.3f  %9.3f  %9.2f\n", mode.name,
+                result.writeSec, result.trailerSec, result.writeSec + result.trailerSec, result.fileSize / (1024.0 * 1024.0));
+        }
+        remove(filename.c_str());
+    }
+    return ret;
+}
+
+#else
+int main(int argc, char **argv) {
+    fprintf(stderr, "avcodec muxer is not supported in this build.\n");
+    return 1;
+}
+#endif //#if ENABLE_AVSW_READER
@@ -0,0 +1,255 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+
+//共有メモリのリングバッファ (--sm) とパイプ経由のy4m (-i -) の読み込み速度の比較
+//  bench_sm_ring [--frames <n>] [--size <w>x<h>] [--slots <n>]
+//  上流のプロセスをforkし、同じ合成フレームをそれぞれの経路でエンコーダ側の読み込みに渡して、
+//  NV12への変換までを含めた読み込み速度を測定する
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "rgy_input_sm.h"
+#include "rgy_simd.h"
+
+#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct BenchPrm {
+    int w, h;
+    int frames;
+    int slots;
+};
+
+//読み込み結果の格納先 (NV12)
+struct BenchSurface {
+    std::vector<uint8_t> buf;
+    RGYFrame frame;
+
+    BenchSurface(int w, int h) : buf(), frame(RGYFrameInit()) {
+        const int pitch = ALIGN(w, 64);
+        buf.resize((size_t)pitch * h * 3 / 2);
+        auto& surf = frame.frame();
+        surf.Info.FourCC = MFX_FOURCC_NV12;
+        surf.Info.Width = (mfxU16)w;
+        surf.Info.Height = (mfxU16)h;
+        surf.Info.CropW = (mfxU16)w;
+        surf.Info.CropH = (mfxU16)h;
+        surf.Data.Pitch = (mfxU16)pitch;
+        surf.Data.Y = buf.data();
+        surf.Data.UV = buf.data() + (size_t)pitch * h;
+    }
+};
+
+//YV12の合成フレーム (pitchなし)
+static std::vector<uint8_t> gen_frame(int w, int h) {
+    std::vector<uint8_t> frame((size_t)w * h * 3 / 2);
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = (uint8_t)((i * 7) ^ (i >> 11));
+    }
+    return frame;
+}
+
+static bool write_all(int fd, const void *ptr, size_t size) {
+    const uint8_t *p = (const uint8_t *)ptr;
+    while (size > 0) {
+        const ssize_t ret = write(fd, p, size);
+        if (ret <= 0) {
+            return false;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+//読み込み側を最後まで回し、読み込めたフレーム数と経過時間(秒)を返す
+static int read_all(RGYInput *reader, const BenchPrm& prm, double *sec) {
+    BenchSurface surf(prm.w, prm.h);
+    const auto start = std::chrono::steady_clock::now();
+    int frames = 0;
+    while (reader->LoadNextFrame(&surf.frame) == RGY_ERR_NONE) {
+        frames++;
+    }
+    *sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return frames;
+}
+
+static int bench_ring(const BenchPrm& prm, const std::vector<uint8_t>& src, double *sec) {
+    const std::string name = strsprintf("/rgy_bench_sm_ring_%d", (int)getpid());
+    RGYInputSMRingWriter writer;
+    if (writer.open(name.c_str(), prm.w, prm.h, 30, 1, RGY_CSP_YV12, RGY_PICSTRUCT_FRAME, prm.frames, prm.slots) != RGY_ERR_NONE) {
+        fprintf(stderr, "failed to create shared memory.\n");
+        return -1;
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+        //上流: スロットのpitchに合わせて合成フレームをコピーする
+        const int pitch = writer.pitch();
+        for (int i = 0; i < prm.frames; i++) {
+            uint8_t *slot = writer.acquire();
+            if (slot == nullptr) {
+                _exit(1);
+            }
+            const uint8_t *ptr = src.data();
+            for (int y = 0; y < prm.h; y++, ptr += prm.w) {
+                memcpy(slot + (size_t)pitch * y, ptr, prm.w);
+            }
+            //UとVはpitch/2で連続しているので、まとめてh行としてコピーする
+            for (int y = 0; y < prm.h; y++, ptr += prm.w / 2) {
+                memcpy(slot + (size_t)pitch * prm.h + (size_t)(pitch / 2) * y, ptr, prm.w / 2);
+            }
+            writer.commit((int64_t)i * 4, 4);
+        }
+        writer.finish();
+        _exit(0);
+    }
+    VideoInfo info = VideoInfo();
+    info.type = RGY_INPUT_FMT_SM;
+    info.csp = RGY_CSP_NV12;
+    RGYInputPrm inputPrm;
+    inputPrm.simdCsp = get_availableSIMD();
+    int frames = -1;
+    RGYInputSM reader;
+    //Init(..., log, status)はRGYInputSM側のInitに隠されているので、基底クラス経由で呼ぶ
+    if (static_cast<RGYInput&>(reader).Init(name.c_str(), &info, &inputPrm, nullptr, std::make_shared<EncodeStatus>()) == RGY_ERR_NONE) {
+        frames = read_all(&reader, prm, sec);
+    }
+    reader.Close();
+    waitpid(pid, nullptr, 0);
+    writer.close();
+    return frames;
+}
+
+//Linux版ではRGYInputRawがビルドされないので、RGYInputRawと同じく
+//1フレームずつfreadしてRGYConvertCSPでNV12に変換する読み込みを行う
+static int read_y4m_pipe(FILE *fp, const BenchPrm& prm, double *sec) {
+    char line[256] = { 0 };
+    if (!fgets(line, sizeof(line), fp) || strncmp(line, "YUV4MPEG2", strlen("YUV4MPEG2")) != 0) {
+        return -1;
+    }
+    RGYConvertCSP convert(RGYInputPrm().threadCsp);
+    if (convert.getFunc(RGY_CSP_YV12, RGY_CSP_NV12, false, get_availableSIMD()) == nullptr) {
+        return -1;
+    }
+    BenchSurface surf(prm.w, prm.h);
+    std::vector<uint8_t> buf((size_t)prm.w * prm.h * 3 / 2);
+    int crop[4] = { 0 };
+    const auto start = std::chrono::steady_clock::now();
+    int frames = 0;
+    while (fgets(line, sizeof(line), fp) && strncmp(line, "FRAME", strlen("FRAME")) == 0
+        && fread(buf.data(), 1, buf.size(), fp) == buf.size()) {
+        void *dst_array[3];
+        surf.frame.ptrArray(dst_array, false);
+        const void *src_array[3];
+        src_array[0] = buf.data();
+        src_array[1] = buf.data() + (size_t)prm.w * prm.h;
+        src_array[2] = buf.data() + (size_t)prm.w * prm.h * 5 / 4;
+        convert.run(0, dst_array, src_array, prm.w, prm.w, prm.w / 2, surf.frame.pitch(), prm.h, prm.h, crop);
+        frames++;
+    }
+    *sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return frames;
+}
+
+static int bench_pipe(const BenchPrm& prm, const std::vector<uint8_t>& src, double *sec) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+        //上流: y4mとしてパイプに書き出す
+        close(fds[0]);
+        const std::string header = strsprintf("YUV4MPEG2 W%d H%d F30:1 Ip A1:1 C420jpeg\n", prm.w, prm.h);
+        bool ok = write_all(fds[1], header.c_str(), header.length());
+        for (int i = 0; ok && i < prm.frames; i++) {
+            ok = write_all(fds[1], "FRAME\n", strlen("FRAME\n"))
+                && write_all(fds[1], src.data(), src.size());
+        }
+        close(fds[1]);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    FILE *fp = fdopen(fds[0], "rb");
+    const int frames = read_y4m_pipe(fp, prm, sec);
+    fclose(fp);
+    waitpid(pid, nullptr, 0);
+    return frames;
+}
+
+int main(int argc, char **argv) {
+    BenchPrm prm = { 1920, 1080, 600, 4 };
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--frames") == 0) {
+            prm.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0) {
+            sscanf(argv[++i], "%dx%d", &prm.w, &prm.h);
+        } else if (strcmp(argv[i], "--slots") == 0) {
+            prm.slots = atoi(argv[++i]);
+        }
+    }
+    if (prm.w <= 0 || prm.h <= 0 || (prm.w & 1) || (prm.h & 1) || prm.frames <= 0 || prm.slots <= 0) {
+        fprintf(stderr, "invalid parameter.\n");
+        return 1;
+    }
+    const auto src = gen_frame(prm.w, prm.h);
+    const double frameMB = src.size() / (1024.0 * 1024.0);
+
+    fprintf(stdout, "%dx%d, %d frames, ring %d slots\n", prm.w, prm.h, prm.frames, prm.slots);
+    struct {
+        const char *name;
+        int (*func)(const BenchPrm&, const std::vector<uint8_t>&, double *);
+    } modes[] = {
+        { "sm ring  ", bench_ring },
+        { "y4m pipe ", bench_pipe },
+    };
+    int ret = 0;
+    for (const auto& mode : modes) {
+        double sec = 0.0;
+        const int frames = mode.func(prm, src, &sec);
+        if (frames != prm.frames) {
+            fprintf(stdout, "%s: failed (%d frames read).\n", mode.name, frames);
+            ret = 1;
+            continue;
+        }
+        fprintf(stdout, "%s: %8.1f fps, %8.1f MB/s\n", mode.name, frames / sec, frames * frameMB / sec);
+    }
+    return ret;
+}
+
+#else
+int main(int argc, char **argv) {
+    fprintf(stderr, "shared memory ring is not supported in this build.\n");
+    return 1;
+}
+#endif //#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
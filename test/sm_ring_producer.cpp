@@ -0,0 +1,142 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+
+//RGYInputSMRingWriterを使った上流プロセスの参照実装
+//  標準入力からy4m (8bit 4:2:0) を読み込み、共有メモリのリングバッファに書き込む
+//  sm_ring_producer <共有メモリ名> [スロット数] < input.y4m
+//  を起動しておき、エンコーダを "--sm -i <共有メモリ名>" で起動する
+//  エンコーダが終了・異常終了した場合はacquire()がnullptrを返すので、そこで書き込みを打ち切る
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rgy_input_sm.h"
+
+#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
+
+//y4mのヘッダ行から解像度とフレームレートを取得する (8bit 4:2:0のみ対応)
+static bool parse_y4m_header(const char *line, int *w, int *h, int *fpsN, int *fpsD) {
+    *w = *h = 0;
+    *fpsN = 30, *fpsD = 1;
+    std::string str(line);
+    size_t pos = 0;
+    while ((pos = str.find(' ', pos)) != std::string::npos) {
+        const char *p = str.c_str() + pos + 1;
+        switch (*p) {
+        case 'W': *w = atoi(p + 1); break;
+        case 'H': *h = atoi(p + 1); break;
+        case 'F': sscanf(p + 1, "%d:%d", fpsN, fpsD); break;
+        case 'C':
+            if (strncmp(p + 1, "420", 3) != 0 || (p[4] == 'p' && p[5] != 'a')) {
+                return false;
+            }
+            break;
+        default: break;
+        }
+        pos++;
+    }
+    return *w > 0 && *h > 0 && *fpsN > 0 && *fpsD > 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <name> [slots] < input.y4m\n", argv[0]);
+        return 1;
+    }
+    const int slots = (argc >= 3) ? atoi(argv[2]) : 4;
+
+    char line[256] = { 0 };
+    int w = 0, h = 0, fpsN = 0, fpsD = 0;
+    if (!fgets(line, sizeof(line), stdin)
+        || strncmp(line, "YUV4MPEG2", strlen("YUV4MPEG2")) != 0
+        || !parse_y4m_header(line, &w, &h, &fpsN, &fpsD)) {
+        fprintf(stderr, "unsupported y4m header (8bit 4:2:0 only).\n");
+        return 1;
+    }
+
+    RGYInputSMRingWriter writer;
+    if (writer.open(argv[1], w, h, fpsN, fpsD, RGY_CSP_YV12, RGY_PICSTRUCT_FRAME, 0, slots) != RGY_ERR_NONE) {
+        fprintf(stderr, "failed to create shared memory \"%s\".\n", argv[1]);
+        return 1;
+    }
+    fprintf(stderr, "%dx%d %d/%d, waiting for encoder: --sm -i %s\n", w, h, fpsN, fpsD, argv[1]);
+    //エンコーダが共有メモリをマッピングする前にclose()すると削除されてしまうので、接続を待ってから書き込む
+    while (!writer.readerConnected()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    //y4mはpitchなしで詰めて格納されているので、1フレーム分を読んでからスロットのpitchに合わせてコピーする
+    const int pitch = writer.pitch();
+    std::vector<uint8_t> frame((size_t)w * h * 3 / 2);
+    int ret = 0;
+    int64_t iframe = 0;
+    for (;;) {
+        if (!fgets(line, sizeof(line), stdin) || strncmp(line, "FRAME", strlen("FRAME")) != 0
+            || fread(frame.data(), 1, frame.size(), stdin) != frame.size()) {
+            break;
+        }
+        uint8_t *slot = writer.acquire();
+        if (slot == nullptr) {
+            fprintf(stderr, "encoder closed or died at frame %lld.\n", (long long)iframe);
+            ret = 1;
+            break;
+        }
+        //スロット内はY, U, Vの順 (UとVはpitch/2)
+        const uint8_t *src = frame.data();
+        for (int y = 0; y < h; y++, src += w) {
+            memcpy(slot + (size_t)pitch * y, src, w);
+        }
+        uint8_t *dstU = slot + (size_t)pitch * h;
+        uint8_t *dstV = dstU + (size_t)pitch * h / 4;
+        for (int y = 0; y < h / 2; y++, src += w / 2) {
+            memcpy(dstU + (size_t)(pitch / 2) * y, src, w / 2);
+        }
+        for (int y = 0; y < h / 2; y++, src += w / 2) {
+            memcpy(dstV + (size_t)(pitch / 2) * y, src, w / 2);
+        }
+        //読み込み側のtimebaseは(fpsN/fpsD)^-1 * 1/4
+        writer.commit(iframe * 4, 4);
+        iframe++;
+    }
+    writer.finish();
+    fprintf(stderr, "%lld frames written.\n", (long long)iframe);
+    //エンコーダは接続済みなので、削除しても残りのフレームは読み込める
+    writer.close();
+    return ret;
+}
+
+#else
+int main(int argc, char **argv) {
+    fprintf(stderr, "shared memory ring is not supported in this build.\n");
+    return 1;
+}
+#endif //#if ENABLE_SM_READER && !(defined(_WIN32) || defined(_WIN64))
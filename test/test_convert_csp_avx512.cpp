@@ -0,0 +1,360 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+//convert_csp_avx512.cppの各変換関数が、変換テーブル上のAVX512を使用しない関数 (AVX2など) と
+//ビット単位で一致するかを確認する
+//比較対象はget_convert_csp_funcにAVX512のビットを除いたSIMDを指定して取得するので、
+//テストのために別の参照実装を持たない
+//幅 (奇数を含む)・高さ・crop・pitch・先頭アドレスをランダムに変え、
+//出力範囲外 (行末・バッファ末尾を超えた位置) への書き込みがないことも確認する
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "rgy_simd.h"
+#include "convert_csp.h"
+
+#if defined(__AVX512BW__)
+
+static const uint32_t SIMD_AVX512 = AVX512F | AVX512DQ | AVX512BW | AVX512VL;
+
+struct PlaneInfo {
+    int row_bytes;
+    int rows;
+    bool uv_pitch; //src_uv_pitch_byteを使用するか
+};
+
+static bool is_16bit(RGY_CSP csp) {
+    return RGY_CSP_BIT_DEPTH[csp] > 8;
+}
+
+static std::vector<PlaneInfo> get_planes(RGY_CSP csp, int width, int height) {
+    const int pixel_size = is_16bit(csp) ? 2 : 1;
+    const int chroma_width = (width + 1) >> 1;
+    switch (csp) {
+    case RGY_CSP_NV12:
+    case RGY_CSP_P010:
+        return { { width * pixel_size, height, false }, { width * pixel_size, height >> 1, false } };
+    case RGY_CSP_P210:
+        return { { width * pixel_size, height, false }, { width * pixel_size, height, false } };
+    case RGY_CSP_YUY2:
+        return { { width * 2, height, false } };
+    case RGY_CSP_YV12:
+    case RGY_CSP_YV12_09:
+    case RGY_CSP_YV12_10:
+    case RGY_CSP_YV12_12:
+    case RGY_CSP_YV12_14:
+    case RGY_CSP_YV12_16:
+        return { { width * pixel_size, height, false }, { chroma_width * pixel_size, height >> 1, true }, { chroma_width * pixel_size, height >> 1, true } };
+    case RGY_CSP_YUV422:
+    case RGY_CSP_YUV422_09:
+    case RGY_CSP_YUV422_10:
+    case RGY_CSP_YUV422_12:
+    case RGY_CSP_YUV422_14:
+    case RGY_CSP_YUV422_16:
+        return { { width * pixel_size, height, false }, { chroma_width * pixel_size, height, true }, { chroma_width * pixel_size, height, true } };
+    case RGY_CSP_YUV444:
+    case RGY_CSP_YUV444_09:
+    case RGY_CSP_YUV444_10:
+    case RGY_CSP_YUV444_12:
+    case RGY_CSP_YUV444_14:
+    case RGY_CSP_YUV444_16:
+        return { { width * pixel_size, height, false }, { width * pixel_size, height, false }, { width * pixel_size, height, false } };
+    case RGY_CSP_RGB24:
+    case RGY_CSP_RGB24R:
+        return { { width * 3, height, false } };
+    case RGY_CSP_RGB32:
+    case RGY_CSP_RGB32R:
+        return { { width * 4, height, false } };
+    default:
+        return {};
+    }
+}
+
+//横方向に色差を間引く形式か (cropの左右は2の倍数とする)
+static bool is_chroma_subsampled_h(RGY_CSP csp) {
+    const auto chromafmt = RGY_CSP_CHROMA_FORMAT[csp];
+    return chromafmt == RGY_CHROMAFMT_YUV420 || chromafmt == RGY_CHROMAFMT_YUV422 || csp == RGY_CSP_YUY2;
+}
+
+struct ConvertTest {
+    RGY_CSP csp_from, csp_to;
+    bool uv_only;
+    int height_align; //高さ・上下cropの単位 (420は2, 422/444/RGBは1、インタレの場合は4)
+};
+
+//convert_csp.cppの変換テーブルでAVX512版の登録されている変換
+static const ConvertTest CONVERT_TESTS[] = {
+    { RGY_CSP_NV12,      RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_P010,      RGY_CSP_P010,      false, 2 },
+    { RGY_CSP_YUY2,      RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_YV12,      RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_YV12,      RGY_CSP_NV12,      true,  2 },
+    { RGY_CSP_RGB24,     RGY_CSP_RGB32,     false, 1 },
+    { RGY_CSP_RGB24R,    RGY_CSP_RGB32,     false, 1 },
+    { RGY_CSP_RGB32,     RGY_CSP_RGB32,     false, 1 },
+    { RGY_CSP_RGB32R,    RGY_CSP_RGB32,     false, 1 },
+    { RGY_CSP_RGB24,     RGY_CSP_RGB24,     false, 1 },
+    { RGY_CSP_RGB24R,    RGY_CSP_RGB24,     false, 1 },
+    { RGY_CSP_YV12,      RGY_CSP_P010,      false, 2 },
+    { RGY_CSP_YV12_16,   RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_YV12_14,   RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_YV12_12,   RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_YV12_10,   RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_YV12_09,   RGY_CSP_NV12,      false, 2 },
+    { RGY_CSP_YV12_16,   RGY_CSP_P010,      false, 2 },
+    { RGY_CSP_YV12_14,   RGY_CSP_P010,      false, 2 },
+    { RGY_CSP_YV12_12,   RGY_CSP_P010,      false, 2 },
+    { RGY_CSP_YV12_10,   RGY_CSP_P010,      false, 2 },
+    { RGY_CSP_YV12_09,   RGY_CSP_P010,      false, 2 },
+    { RGY_CSP_YUV422,    RGY_CSP_P210,      false, 1 },
+    { RGY_CSP_YUV422_16, RGY_CSP_P210,      false, 1 },
+    { RGY_CSP_YUV422_14, RGY_CSP_P210,      false, 1 },
+    { RGY_CSP_YUV422_12, RGY_CSP_P210,      false, 1 },
+    { RGY_CSP_YUV422_10, RGY_CSP_P210,      false, 1 },
+    { RGY_CSP_YUV422_09, RGY_CSP_P210,      false, 1 },
+    { RGY_CSP_YUV444,    RGY_CSP_YUV444,    false, 1 },
+    { RGY_CSP_YUV444_16, RGY_CSP_YUV444_16, false, 1 },
+    { RGY_CSP_YUV444_14, RGY_CSP_YUV444_16, false, 1 },
+    { RGY_CSP_YUV444_12, RGY_CSP_YUV444_16, false, 1 },
+    { RGY_CSP_YUV444_10, RGY_CSP_YUV444_16, false, 1 },
+    { RGY_CSP_YUV444_09, RGY_CSP_YUV444_16, false, 1 },
+    { RGY_CSP_YUV444,    RGY_CSP_YUV444_16, false, 1 },
+    { RGY_CSP_YUV444_16, RGY_CSP_YUV444,    false, 1 },
+    { RGY_CSP_YUV444_14, RGY_CSP_YUV444,    false, 1 },
+    { RGY_CSP_YUV444_12, RGY_CSP_YUV444,    false, 1 },
+    { RGY_CSP_YUV444_10, RGY_CSP_YUV444,    false, 1 },
+    { RGY_CSP_YUV444_09, RGY_CSP_YUV444,    false, 1 },
+};
+
+//先頭アドレスをずらせるよう余裕を持たせたバッファ
+struct PlaneBuffer {
+    std::vector<uint8_t> buf;
+    int offset;
+    uint8_t *ptr() { return buf.data() + offset; }
+};
+
+static const int BUF_GUARD = 256; //行末・バッファ末尾を超えた書き込みの検出用
+
+static int rand_range(std::mt19937& mt, int min, int max) {
+    return std::uniform_int_distribution<int>(min, max)(mt);
+}
+
+//pitchとアドレスのずれ (16bitの形式では2byte単位)
+static int rand_pitch_pad(std::mt19937& mt, bool is16bit) {
+    return rand_range(mt, 0, 70) & (is16bit ? ~1 : ~0);
+}
+
+static std::vector<PlaneBuffer> alloc_planes(std::mt19937& mt, const std::vector<PlaneInfo>& planes, int y_pitch, int uv_pitch, bool is16bit) {
+    std::vector<PlaneBuffer> buffers(planes.size());
+    for (size_t i = 0; i < planes.size(); i++) {
+        const int pitch = (planes[i].uv_pitch) ? uv_pitch : y_pitch;
+        buffers[i].offset = rand_range(mt, 0, 63) & (is16bit ? ~1 : ~0);
+        buffers[i].buf.resize(buffers[i].offset + (size_t)pitch * planes[i].rows + BUF_GUARD);
+    }
+    return buffers;
+}
+
+//入力は有効なビット深度の範囲の値とする
+static void fill_src(std::mt19937& mt, std::vector<PlaneBuffer>& buffers, RGY_CSP csp) {
+    const int bit_depth = RGY_CSP_BIT_DEPTH[csp];
+    const uint32_t mask = (bit_depth > 8 && csp != RGY_CSP_P010) ? (1u << bit_depth) - 1 : 0xffffu;
+    for (auto& b : buffers) {
+        if (is_16bit(csp)) {
+            for (size_t i = 0; i + 1 < b.buf.size(); i += 2) {
+                const uint16_t v = (uint16_t)(mt() & mask);
+                memcpy(&b.buf[i], &v, sizeof(v));
+            }
+        } else {
+            for (auto& v : b.buf) {
+                v = (uint8_t)mt();
+            }
+        }
+    }
+}
+
+struct TestSize {
+    int width, height; //入力の解像度
+    int crop[4];       //left, up, right, bottom
+    int out_width() const { return width - crop[0] - crop[2]; }
+    int out_height() const { return height - crop[1] - crop[3]; }
+};
+
+//出力の解像度を決めてから、その周囲にcropを付け足す (半分はcropなし)
+static TestSize rand_size(std::mt19937& mt, const ConvertTest& test, int height_align, int out_width) {
+    TestSize size = { 0 };
+    const int out_height = rand_range(mt, 1, 48 / height_align) * height_align;
+    if (mt() & 1) {
+        const int crop_x_mask = (is_chroma_subsampled_h(test.csp_from)) ? ~1 : ~0;
+        size.crop[0] = rand_range(mt, 0, 66) & crop_x_mask;
+        size.crop[2] = rand_range(mt, 0, 66) & crop_x_mask;
+        size.crop[1] = rand_range(mt, 0, 8 / height_align) * height_align;
+        size.crop[3] = rand_range(mt, 0, 8 / height_align) * height_align;
+    }
+    size.width = out_width + size.crop[0] + size.crop[2];
+    size.height = out_height + size.crop[1] + size.crop[3];
+    return size;
+}
+
+static bool run_test(std::mt19937& mt, const ConvertTest& test, int interlaced, funcConvertCSP func_avx512, funcConvertCSP func_ref, const TestSize& size, int thread_n) {
+    const bool src16 = is_16bit(test.csp_from);
+    const bool dst16 = is_16bit(test.csp_to);
+    const int width = size.width;
+    const int height = size.height;
+    const auto src_planes = get_planes(test.csp_from, width, height);
+    const auto dst_planes = get_planes(test.csp_to, size.out_width(), size.out_height());
+
+    int src_y_row = 0, src_uv_row = 0, dst_row = 0;
+    for (const auto& p : src_planes) {
+        ((p.uv_pitch) ? src_uv_row : src_y_row) = (std::max)((p.uv_pitch) ? src_uv_row : src_y_row, p.row_bytes);
+    }
+    for (const auto& p : dst_planes) {
+        dst_row = (std::max)(dst_row, p.row_bytes);
+    }
+    const int src_y_pitch  = src_y_row  + rand_pitch_pad(mt, src16);
+    const int src_uv_pitch = src_uv_row + rand_pitch_pad(mt, src16);
+    const int dst_pitch    = dst_row    + rand_pitch_pad(mt, dst16);
+    //AVX2などの関数はベクトル単位で行末を超えて書き込むので、比較対象の出力は十分なpitchを確保する
+    const int dst_ref_pitch = ((dst_row + 255) & ~255) + 256;
+
+    auto src = alloc_planes(mt, src_planes, src_y_pitch, src_uv_pitch, src16);
+    auto dst_init = alloc_planes(mt, dst_planes, dst_pitch, dst_pitch, dst16);
+    auto dst_ref = alloc_planes(mt, dst_planes, dst_ref_pitch, dst_ref_pitch, dst16);
+    fill_src(mt, src, test.csp_from);
+    for (auto& b : dst_init) {
+        for (auto& v : b.buf) {
+            v = (uint8_t)mt();
+        }
+    }
+    auto dst_simd = dst_init;
+    //書き込まれない部分 (uv_onlyの場合の輝度など) も比較できるよう、比較対象にも同じ初期値を設定する
+    for (size_t i = 0; i < dst_planes.size(); i++) {
+        for (int y = 0; y < dst_planes[i].rows; y++) {
+            memcpy(dst_ref[i].ptr() + (size_t)dst_ref_pitch * y, dst_init[i].ptr() + (size_t)dst_pitch * y, dst_planes[i].row_bytes);
+        }
+    }
+
+    const void *src_ptr[3] = { nullptr };
+    void *dst_ref_ptr[3] = { nullptr };
+    void *dst_simd_ptr[3] = { nullptr };
+    for (size_t i = 0; i < src.size(); i++) {
+        src_ptr[i] = src[i].ptr();
+    }
+    for (size_t i = 0; i < dst_ref.size(); i++) {
+        dst_ref_ptr[i] = dst_ref[i].ptr();
+        dst_simd_ptr[i] = dst_simd[i].ptr();
+    }
+    for (int ithread = 0; ithread < thread_n; ithread++) {
+        int crop_ref[4], crop_simd[4];
+        memcpy(crop_ref, size.crop, sizeof(crop_ref));
+        memcpy(crop_simd, size.crop, sizeof(crop_simd));
+        func_ref(dst_ref_ptr, src_ptr, width, src_y_pitch, src_uv_pitch, dst_ref_pitch, height, size.out_height(), ithread, thread_n, crop_ref);
+        func_avx512(dst_simd_ptr, src_ptr, width, src_y_pitch, src_uv_pitch, dst_pitch, height, size.out_height(), ithread, thread_n, crop_simd);
+    }
+
+    //出力範囲内はAVX512を使用しない関数の結果と、範囲外は書き込み前の値と比較する
+    for (size_t i = 0; i < dst_planes.size(); i++) {
+        const auto& plane = dst_planes[i];
+        for (size_t pos = 0; pos < dst_simd[i].buf.size(); pos++) {
+            const int offset = (int)pos - dst_simd[i].offset;
+            const bool in_range = offset >= 0 && offset / dst_pitch < plane.rows && offset % dst_pitch < plane.row_bytes;
+            const uint8_t expected = (in_range)
+                ? dst_ref[i].ptr()[(size_t)dst_ref_pitch * (offset / dst_pitch) + offset % dst_pitch]
+                : dst_init[i].buf[pos];
+            if (dst_simd[i].buf[pos] != expected) {
+                fprintf(stderr, "%s -> %s%s%s: mismatch at plane %d, y=%d, x(byte)=%d: %s=0x%02x, avx512=0x%02x "
+                    "(width=%d, height=%d, crop=%d,%d,%d,%d, src_pitch=%d/%d, dst_pitch=%d, threads=%d)\n",
+                    RGY_CSP_NAMES[test.csp_from], RGY_CSP_NAMES[test.csp_to], (test.uv_only) ? " (uv)" : "", (interlaced) ? " (i)" : "",
+                    (int)i, (offset < 0) ? -1 : offset / dst_pitch, (offset < 0) ? offset : offset % dst_pitch,
+                    (in_range) ? "ref" : "init", expected, dst_simd[i].buf[pos],
+                    width, height, size.crop[0], size.crop[1], size.crop[2], size.crop[3], src_y_pitch, src_uv_pitch, dst_pitch, thread_n);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t simd = get_availableSIMD();
+    if ((simd & SIMD_AVX512) != SIMD_AVX512) {
+        fprintf(stderr, "AVX512 not available, skipped.\n");
+        return 0;
+    }
+    const uint32_t seed = (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 10) : 5489u;
+    std::mt19937 mt(seed);
+
+    //ベクトル長 (64byte) 前後の幅と、ランダムな幅 (奇数を含む)
+    std::vector<int> widths = { 1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 47, 48, 49, 63, 64, 65, 95, 127, 128, 129, 191, 255, 257 };
+    for (int i = 0; i < 40; i++) {
+        widths.push_back(rand_range(mt, 1, 700));
+    }
+    int failed = 0, tested = 0;
+    for (const auto& test : CONVERT_TESTS) {
+        const ConvertCSP *cvt_avx512 = get_convert_csp_func(test.csp_from, test.csp_to, test.uv_only, simd);
+        const ConvertCSP *cvt_ref = get_convert_csp_func(test.csp_from, test.csp_to, test.uv_only, simd & ~SIMD_AVX512);
+        char name[256];
+        snprintf(name, sizeof(name), "%s -> %s%s", RGY_CSP_NAMES[test.csp_from], RGY_CSP_NAMES[test.csp_to], (test.uv_only) ? " (uv)" : "");
+        if (cvt_avx512 == nullptr || (cvt_avx512->simd & SIMD_AVX512) != SIMD_AVX512 || cvt_ref == nullptr) {
+            //この構成では変換テーブルに登録されていない
+            fprintf(stderr, "%-40s skipped\n", name);
+            continue;
+        }
+        //インタレ用の関数が別にあればそれも確認する
+        for (int interlaced = 0; interlaced < ((cvt_avx512->func[1] != cvt_avx512->func[0]) ? 2 : 1); interlaced++) {
+            const int height_align = (interlaced) ? 4 : test.height_align;
+            bool ok = true;
+            for (auto width : widths) {
+                const auto size = rand_size(mt, test, height_align, width);
+                const int thread_n = rand_range(mt, 1, 3);
+                if (!run_test(mt, test, interlaced, cvt_avx512->func[interlaced], cvt_ref->func[interlaced], size, thread_n)) {
+                    ok = false;
+                    break;
+                }
+            }
+            fprintf(stderr, "%-40s %s (vs %s)\n", (std::string(name) + ((interlaced) ? " (i)" : "")).c_str(), (ok) ? "OK" : "NG", get_simd_str(cvt_ref->simd));
+            tested++;
+            if (!ok) {
+                failed++;
+            }
+        }
+    }
+    fprintf(stderr, "%d/%d failed (seed=%u).\n", failed, tested, seed);
+    return (failed) ? 1 : 0;
+}
+
+#else //#if defined(__AVX512BW__)
+
+int main(int argc, char **argv) {
+    fprintf(stderr, "built without AVX512, skipped.\n");
+    return 0;
+}
+
+#endif //#if defined(__AVX512BW__)
@@ -0,0 +1,275 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+//RGYConvertCSP::runのバンド分割の確認とベンチマーク
+//  - 到達可能なすべてのConvertCSPテーブルの関数について、バンド分割した変換結果が
+//    分割しない変換結果とバイト単位で一致するかを確認する (pitchに余裕のない場合・cropありを含む)
+//  - "--bench"を指定すると、1080p/4K/8Kでの1フレームあたりの変換時間を分割なし/ありで測定する
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "rgy_simd.h"
+#include "convert_csp.h"
+#include "rgy_input.h"
+#include "rgy_thread_pool.h"
+
+
+//プレーン0の1画素あたりのバイト数
+static int pixel_bytes(RGY_CSP csp) {
+    switch (csp) {
+    case RGY_CSP_YUY2:
+        return 2;
+    case RGY_CSP_RGB24R:
+    case RGY_CSP_RGB24:
+    case RGY_CSP_BGR24:
+        return 3;
+    case RGY_CSP_RGB32R:
+    case RGY_CSP_RGB32:
+    case RGY_CSP_BGR32:
+        return 4;
+    case RGY_CSP_YC48:
+        return 6;
+    default:
+        return (RGY_CSP_BIT_DEPTH[csp] > 8) ? 2 : 1;
+    }
+}
+
+//SIMD版の関数にはアラインされたstoreを使うものがあるので、バッファの先頭は64byte境界に合わせる
+struct AlignedBuffer {
+    std::vector<uint8_t> buf;
+    uint8_t *ptr;
+    size_t size;
+    AlignedBuffer(size_t size_) : buf(size_ + 64), ptr(nullptr), size(size_) {
+        ptr = buf.data() + ((64 - ((size_t)buf.data() & 63)) & 63);
+    }
+    AlignedBuffer(const AlignedBuffer&) = delete;
+};
+
+static const int BUF_GUARD = 4096; //最終行の行末を超えた読み書き用
+static const int MAX_PLANES = 4;
+
+//C版の関数には色差の位置を輝度の直後と仮定するものがあるので、
+//各プレーンは1つのバッファに (pitch x 高さ) ずつ連続して配置する
+struct Frame {
+    int width, height;
+    int crop[4];
+    int src_pitch, dst_pitch;
+    size_t src_plane_size, dst_plane_size;
+    AlignedBuffer src;
+    AlignedBuffer dst;
+
+    static int calc_src_pitch(const ConvertCSP *csp, int width) {
+        return ALIGN(width * pixel_bytes(csp->csp_from), 64);
+    }
+    //出力側は実際のフレームと同様、pitchは64byte単位で行末の余白は最小限とする
+    static int calc_dst_pitch(const ConvertCSP *csp, int width, const int *crop) {
+        return ALIGN((width - crop[0] - crop[2]) * pixel_bytes(csp->csp_to), 64);
+    }
+
+    Frame(const ConvertCSP *csp, int width_, int height_, const int *crop_) :
+        width(width_), height(height_), crop(),
+        src_pitch(calc_src_pitch(csp, width_)), dst_pitch(calc_dst_pitch(csp, width_, crop_)),
+        src_plane_size((size_t)src_pitch * height_),
+        dst_plane_size((size_t)dst_pitch * (height_ - crop_[1] - crop_[3])),
+        src(src_plane_size * MAX_PLANES + BUF_GUARD),
+        dst(dst_plane_size * MAX_PLANES + BUF_GUARD) {
+        memcpy(crop, crop_, sizeof(crop));
+        //入力は有効なビット深度の範囲の値とする
+        const int bit_depth = RGY_CSP_BIT_DEPTH[csp->csp_from];
+        const uint32_t mask = (bit_depth > 8 && bit_depth < 16) ? ((1u << bit_depth) - 1) : 0xffffu;
+        uint32_t seed = 12345;
+        for (size_t j = 0; j + 1 < src.size; j += 2) {
+            seed = seed * 1664525u + 1013904223u;
+            const uint16_t v = (uint16_t)((seed >> 8) & mask);
+            memcpy(src.ptr + j, &v, sizeof(v));
+        }
+        memset(dst.ptr, 0xA5, dst.size);
+    }
+    void set_ptr(const void **src_ptr, void **dst_ptr) {
+        for (int i = 0; i < MAX_PLANES; i++) {
+            src_ptr[i] = src.ptr + src_plane_size * i;
+            dst_ptr[i] = dst.ptr + dst_plane_size * i;
+        }
+    }
+    void run(RGYConvertCSP& cvt, int interlaced) {
+        const void *src_ptr[MAX_PLANES];
+        void *dst_ptr[MAX_PLANES];
+        set_ptr(src_ptr, dst_ptr);
+        cvt.run(interlaced, dst_ptr, src_ptr, width, src_pitch, src_pitch, dst_pitch, height, height - crop[1] - crop[3], crop);
+    }
+    //スレッドの実行順に依存せず確認できるよう、RGYConvertCSP::runと同じ分割で、バンドを下から順に処理する
+    //(下のバンドを先に処理すると、上のバンドの行末を超えた書き込みが必ず下のバンドの先頭を壊す)
+    int run_bands_reverse(RGYConvertCSP& cvt, int interlaced) {
+        const void *src_ptr[MAX_PLANES];
+        void *dst_ptr[MAX_PLANES];
+        set_ptr(src_ptr, dst_ptr);
+        const int dst_height = height - crop[1] - crop[3];
+        const int bandN = cvt.getBandNum(width, src_pitch, src_pitch, dst_pitch, height, crop);
+        for (int iband = bandN - 1; iband >= 0; iband--) {
+            cvt.getFunc()->func[interlaced](dst_ptr, src_ptr, width, src_pitch, src_pitch, dst_pitch, height, dst_height, iband, bandN, crop);
+        }
+        cvt.repairBands(interlaced, dst_ptr, src_ptr, width, src_pitch, src_pitch, dst_pitch, height, dst_height, bandN, crop);
+        return bandN;
+    }
+};
+
+//cpuの対応するSIMDの範囲で、到達可能なすべての関数を列挙する
+static std::vector<const ConvertCSP *> list_funcs() {
+    static const uint32_t simd_levels[] = {
+        NONE,
+        SSE2,
+        SSE2|SSE3|SSSE3,
+        SSE2|SSE3|SSSE3|SSE41|SSE42|POPCNT,
+        SSE2|SSE3|SSSE3|SSE41|SSE42|POPCNT|AVX,
+        SSE2|SSE3|SSSE3|SSE41|SSE42|POPCNT|AVX|AVX2|FMA3,
+        SSE2|SSE3|SSSE3|SSE41|SSE42|POPCNT|AVX|AVX2|FMA3|AVX512F|AVX512DQ|AVX512BW|AVX512VL,
+    };
+    const uint32_t available = get_availableSIMD();
+    std::vector<const ConvertCSP *> list;
+    for (int from = RGY_CSP_NV12; from <= RGY_CSP_Y16; from++) {
+        for (int to = RGY_CSP_NV12; to <= RGY_CSP_Y16; to++) {
+            for (int uv_only = 0; uv_only < 2; uv_only++) {
+                for (auto simd : simd_levels) {
+                    const auto csp = get_convert_csp_func((RGY_CSP)from, (RGY_CSP)to, uv_only != 0, simd & available);
+                    if (csp != nullptr && std::find(list.begin(), list.end(), csp) == list.end()) {
+                        list.push_back(csp);
+                    }
+                }
+            }
+        }
+    }
+    return list;
+}
+
+static void print_name(const ConvertCSP *csp, FILE *fp) {
+    fprintf(fp, "%-10s -> %-10s %s %-6s", RGY_CSP_NAMES[csp->csp_from], RGY_CSP_NAMES[csp->csp_to], (csp->uv_only) ? "uv" : "  ", get_simd_str(csp->simd));
+}
+
+static bool test_func(const ConvertCSP *csp) {
+    //幅は128byteの倍数にならないもの、cropは左右で異なるもの (インタレ対応のため高さ方向は4の倍数)
+    struct TestCase { int width, height; int crop[4]; };
+    static const TestCase cases[] = {
+        { 1950, 1080, {  0, 0,  0, 0 } },
+        { 1366,  768, {  8, 4, 22, 8 } },
+        { 3832,  360, {  0, 0,  0, 0 } },
+        {  706,  484, { 62, 4,  0, 0 } },
+    };
+    for (const auto& tc : cases) {
+        for (int interlaced = 0; interlaced < 2; interlaced++) {
+            //入力はすべて同じ内容になる
+            Frame ref(csp, tc.width, tc.height, tc.crop);
+            Frame band(csp, tc.width, tc.height, tc.crop);
+            Frame reverse(csp, tc.width, tc.height, tc.crop);
+            RGYConvertCSP cvt_ref(1);
+            RGYConvertCSP cvt_band(4);
+            cvt_ref.getFunc(csp->csp_from, csp->csp_to, csp->uv_only, csp->simd);
+            cvt_band.getFunc(csp->csp_from, csp->csp_to, csp->uv_only, csp->simd);
+            ref.run(cvt_ref, interlaced);
+            band.run(cvt_band, interlaced);
+            const int bandN = reverse.run_bands_reverse(cvt_band, interlaced);
+            for (const auto target : { &band, &reverse }) {
+                if (memcmp(ref.dst.ptr, target->dst.ptr, ref.dst.size) != 0) {
+                    const auto mismatch = std::mismatch(ref.dst.ptr, ref.dst.ptr + ref.dst.size, target->dst.ptr);
+                    const size_t pos = mismatch.first - ref.dst.ptr;
+                    const size_t pos_in_plane = pos % ref.dst_plane_size;
+                    print_name(csp, stderr);
+                    fprintf(stderr, " NG: %s: mismatch at plane %d, y=%d, x(byte)=%d (width=%d, height=%d, crop=%d,%d,%d,%d, dst_pitch=%d, bands=%d, interlaced=%d)\n",
+                        (target == &band) ? "run" : "reverse order",
+                        (int)(pos / ref.dst_plane_size), (int)(pos_in_plane / ref.dst_pitch), (int)(pos_in_plane % ref.dst_pitch),
+                        tc.width, tc.height, tc.crop[0], tc.crop[1], tc.crop[2], tc.crop[3], ref.dst_pitch, bandN, interlaced);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+//1フレームあたりの変換時間 (ms)
+static double bench_func(const ConvertCSP *csp, int width, int height, int threads) {
+    static const int crop[4] = { 0 };
+    Frame frame(csp, width, height, crop);
+    RGYConvertCSP cvt(threads);
+    cvt.getFunc(csp->csp_from, csp->csp_to, csp->uv_only, csp->simd);
+    frame.run(cvt, 0); //ウォームアップ
+    int count = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        frame.run(cvt, 0);
+        count++;
+        elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < 200.0 && count < 1000);
+    return elapsed / count;
+}
+
+int main(int argc, char **argv) {
+    const bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    //テストでは1コアの環境でもバンド分割を行わせる
+    const int threads = std::max(4, (int)std::thread::hardware_concurrency());
+    RGYThreadPool::get().setParam(threads, 0);
+
+    const auto funcs = list_funcs();
+    int failed = 0;
+    for (const auto csp : funcs) {
+        if (!test_func(csp)) {
+            failed++;
+        }
+    }
+    fprintf(stderr, "band split: %d/%d failed.\n", failed, (int)funcs.size());
+    if (failed || !bench) {
+        return (failed) ? 1 : 0;
+    }
+
+    struct BenchSize { const char *name; int width, height; };
+    static const BenchSize sizes[] = {
+        { "1080p", 1920, 1080 },
+        { "4K",    3840, 2160 },
+        { "8K",    7680, 4320 },
+    };
+    fprintf(stdout, "ms/frame (1 thread / %d threads)%*s", threads, threads >= 10 ? 2 : 3, "");
+    for (const auto& size : sizes) {
+        fprintf(stdout, " %20s", size.name);
+    }
+    fprintf(stdout, "\n");
+    for (const auto csp : funcs) {
+        print_name(csp, stdout);
+        for (const auto& size : sizes) {
+            const double t1 = bench_func(csp, size.width, size.height, 1);
+            const double tn = bench_func(csp, size.width, size.height, threads);
+            fprintf(stdout, " %9.3f / %8.3f", t1, tn);
+        }
+        fprintf(stdout, "\n");
+        fflush(stdout);
+    }
+    return 0;
+}
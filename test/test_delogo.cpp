@@ -0,0 +1,385 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2011-2016 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+
+//delogoの確認
+//  - create_delogo_process_dataで作成したロゴデータが、一様なロゴに対して
+//    ロゴの範囲 (色差はロゴに掛かる2x2の範囲) で一様になり、それ以外で0になるか
+//  - ProcessorDelogo::Processについて
+//    - ロゴの範囲外 (pitchの余白を含む) の画素が入力と一致するか
+//    - SSE4.1を基準として、AVX/AVX2が一致し、AVX512が1LSB以内で一致するか (AVX512はrcp14を使用するため)
+//    - ロゴ部分を分割して並列処理した結果が、分割しない結果と一致するか
+//    - P010の結果がNV12の結果の4倍と丸め誤差の範囲で一致するか
+//  ロゴは、フレーム内部・奇数の位置と大きさ・フレームの端 (奇数幅)・フレームからはみ出すものを確認する
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "rgy_simd.h"
+#include "rgy_thread_pool.h"
+#include "delogo/plugin_delogo.h"
+#include "delogo/delogo_process.h"
+
+struct LogoCase {
+    const char *name;
+    int width, height; //フレームサイズ
+    int x, y, w, h;    //ロゴの位置と大きさ
+};
+
+static const LogoCase LOGO_CASES[] = {
+    { "inside",                        1920, 1080, 1504,  48, 320, 120 },
+    { "odd position/size",             1920, 1080,  333,  77, 151,  63 },
+    { "right/bottom edge, odd width",  1366,  768, 1289, 723,  77,  45 },
+    { "crossing right/bottom edge",    1366,  768, 1300, 740, 101,  51 },
+    { "left/top edge",                 1280,  720,    0,   0,  97,  33 },
+    { "large (sliced)",                1920, 1080,  600, 301, 641, 361 },
+};
+
+struct DelogoImpl {
+    const char *name;
+    uint32_t simd; //必要なSIMD
+    std::function<ProcessorDelogo *()> create;
+};
+
+static const DelogoImpl DELOGO_IMPLS[] = {
+    { "SSE4.1", SSE41,              []() -> ProcessorDelogo * { return new DelogoProcessSSE41(false); } },
+    { "AVX",    AVX,                []() -> ProcessorDelogo * { return new DelogoProcessAVX(false); } },
+    { "AVX2",   AVX2 | FMA3,        []() -> ProcessorDelogo * { return new DelogoProcessAVX2(false); } },
+#if defined(_MSC_VER) || defined(__AVX512BW__)
+    { "AVX512", AVX512F | AVX512BW, []() -> ProcessorDelogo * { return new DelogoProcessAVX512(false); } },
+#endif
+};
+
+//SIMD版の関数はアラインされたload/storeを使うので、バッファの先頭は64byte境界に合わせる
+struct AlignedBuffer {
+    std::vector<uint8_t> buf;
+    uint8_t *ptr;
+    AlignedBuffer(size_t size) : buf(size + 64), ptr(nullptr) {
+        ptr = buf.data() + ((64 - ((size_t)buf.data() & 63)) & 63);
+    }
+    AlignedBuffer(const AlignedBuffer&) = delete;
+};
+
+//NV12/P010のフレーム
+//pitchには、ロゴの幅を16byte単位に切り上げた書き込みよりも大きい余白を持たせる
+struct Frame {
+    int width, height, pitch;
+    bool highbit;
+    AlignedBuffer buf;
+    Frame(int width_, int height_, bool highbit_) :
+        width(width_), height(height_), pitch((((width_ << (highbit_ ? 1 : 0)) + 63) & ~63) + 64), highbit(highbit_),
+        buf((size_t)pitch * (height_ + (height_ >> 1))) {
+    }
+    uint8_t *plane(int i) { return buf.ptr + ((i) ? (size_t)pitch * height : 0); }
+    int rows(int i) const { return (i) ? (height >> 1) : height; }
+    int pixel_bytes() const { return (highbit) ? 2 : 1; }
+    //画素値 (P010は10bitの値)
+    int pix(int i, int x_byte, int y) {
+        const uint8_t *ptr = plane(i) + (size_t)y * pitch + x_byte;
+        return (highbit) ? (*(const uint16_t *)ptr >> 6) : *ptr;
+    }
+};
+
+//フレーム内のロゴの範囲 (byte, 行)
+struct LogoBox {
+    int x0, x1, y0, y1;
+    bool inside(int x_byte, int y) const { return x0 <= x_byte && x_byte < x1 && y0 <= y && y < y1; }
+};
+
+static LogoBox logo_box(const LogoCase& lc, int plane, int pixel_bytes) {
+    const int x1 = std::min(lc.x + lc.w, lc.width);
+    const int y1 = std::min(lc.y + lc.h, lc.height);
+    LogoBox box;
+    if (plane == 0) {
+        box.x0 = lc.x * pixel_bytes;
+        box.x1 = x1 * pixel_bytes;
+        box.y0 = lc.y;
+        box.y1 = y1;
+    } else {
+        //色差はロゴに掛かる2x2の範囲
+        box.x0 = (lc.x >> 1) * 2 * pixel_bytes;
+        box.x1 = ((x1 + 1) >> 1) * 2 * pixel_bytes;
+        box.y0 = lc.y >> 1;
+        box.y1 = (y1 + 1) >> 1;
+    }
+    return box;
+}
+
+static int rand_range(std::mt19937& mt, int min, int max) {
+    return std::uniform_int_distribution<int>(min, max)(mt);
+}
+
+static LogoData make_logo(std::mt19937& mt, const LogoCase& lc, bool uniform) {
+    LogoData logo;
+    memset(&logo.header, 0, sizeof(logo.header));
+    strcpy(logo.header.name, lc.name);
+    logo.header.x = (short)lc.x;
+    logo.header.y = (short)lc.y;
+    logo.header.w = (short)lc.w;
+    logo.header.h = (short)lc.h;
+    logo.logoPixel.resize(lc.w * lc.h);
+    if (uniform) {
+        const LOGO_PIXEL pix = { 700, 3000, 600, -1000, 500, 1500 };
+        std::fill(logo.logoPixel.begin(), logo.logoPixel.end(), pix);
+        return logo;
+    }
+    for (auto& pix : logo.logoPixel) {
+        //不透明度は0 (透明)・LOGO_MAX_DP (不透明) を含める
+        auto rand_dp = [&]() {
+            const int r = rand_range(mt, 0, 9);
+            return (short)((r == 0) ? 0 : ((r == 1) ? LOGO_MAX_DP : rand_range(mt, 1, LOGO_MAX_DP)));
+        };
+        pix.dp_y  = rand_dp();
+        pix.y     = (short)rand_range(mt, 0, 4096);
+        pix.dp_cb = rand_dp();
+        pix.cb    = (short)rand_range(mt, -2048, 2048);
+        pix.dp_cr = rand_dp();
+        pix.cr    = (short)rand_range(mt, -2048, 2048);
+    }
+    return logo;
+}
+
+static DelogoParam make_param() {
+    DelogoParam param;
+    param.depth = QSV_DEFAULT_VPP_DELOGO_DEPTH;
+    param.Y  = 2;
+    param.Cb = -1;
+    param.Cr = 1;
+    return param;
+}
+
+//一様なロゴに対して作成したロゴデータが、ロゴの範囲で一様になり、それ以外で0になるかを確認する
+static bool test_logo_data(std::mt19937& mt, const LogoCase& lc) {
+    const auto logo = make_logo(mt, lc, true);
+    const auto param = make_param();
+    ProcessDataDelogo data[2];
+    if (!create_delogo_process_data(data, logo, &param, lc.width, lc.height, false)) {
+        fprintf(stderr, "  logo data: NG: not included in frame.\n");
+        return false;
+    }
+    const LOGO_PIXEL& pix = logo.logoPixel[0];
+    for (int i = 0; i < 2; i++) {
+        const auto box = logo_box(lc, i, 1);
+        const short *ptr = data[i].pLogoPtr.get();
+        //ロゴデータの各行はロゴの行なので、横方向の範囲のみ確認する
+        for (mfxU32 j = 0; j < data[i].height; j++) {
+            const int y = data[i].j_start + j;
+            for (mfxU32 k = 0; k < data[i].pitch; k++) {
+                //輝度は(dp, y)、色差は(dp_cb, cb), (dp_cr, cr)が交互に並ぶ
+                const int x = data[i].i_start + k;
+                const bool inside = box.x0 <= x && x < box.x1;
+                short expected[2] = { 0, 0 };
+                if (inside) {
+                    if (i == 0) {
+                        expected[0] = pix.dp_y, expected[1] = pix.y;
+                    } else if ((k & 1) == 0) {
+                        expected[0] = pix.dp_cb, expected[1] = pix.cb;
+                    } else {
+                        expected[0] = pix.dp_cr, expected[1] = pix.cr;
+                    }
+                }
+                const short *value = ptr + ((size_t)j * data[i].pitch + k) * 2;
+                if (value[0] != expected[0] || value[1] != expected[1]) {
+                    fprintf(stderr, "  logo data: NG: plane %d, x=%d, y=%d: (%d, %d), expected (%d, %d)\n",
+                        i, x, y, value[0], value[1], expected[0], expected[1]);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void fill_frame(std::mt19937& mt, Frame& frame) {
+    for (int i = 0; i < 2; i++) {
+        for (int y = 0; y < frame.rows(i); y++) {
+            uint8_t *ptr = frame.plane(i) + (size_t)y * frame.pitch;
+            for (int x = 0; x < frame.pitch; x += frame.pixel_bytes()) {
+                const int value = rand_range(mt, 0, 255);
+                if (frame.highbit) {
+                    *(uint16_t *)(ptr + x) = (uint16_t)(value << 8);
+                } else {
+                    ptr[x] = (uint8_t)value;
+                }
+            }
+        }
+    }
+}
+
+//P010の入力をNV12の入力の4倍 (10bit) とする
+static void copy_frame_to_p010(Frame& dst, Frame& src) {
+    for (int i = 0; i < 2; i++) {
+        for (int y = 0; y < src.rows(i); y++) {
+            const uint8_t *ptr_src = src.plane(i) + (size_t)y * src.pitch;
+            uint16_t *ptr_dst = (uint16_t *)(dst.plane(i) + (size_t)y * dst.pitch);
+            for (int x = 0; x < dst.pitch / 2; x++) {
+                ptr_dst[x] = (uint16_t)((x < src.pitch ? ptr_src[x] : 0) << 8);
+            }
+        }
+    }
+}
+
+static bool run_delogo(const DelogoImpl& impl, ProcessDataDelogo data[2], Frame& in, Frame& out, int slices) {
+    for (int i = 0; i < 2; i++) {
+        data[i].slices = slices;
+        data[i].buffer_size = data[0].pitch * in.pixel_bytes();
+    }
+    mfxFrameSurface1 surfIn, surfOut;
+    memset(&surfIn, 0, sizeof(surfIn));
+    memset(&surfOut, 0, sizeof(surfOut));
+    for (auto surf : { std::make_pair(&surfIn, &in), std::make_pair(&surfOut, &out) }) {
+        surf.first->Info.FourCC = (in.highbit) ? MFX_FOURCC_P010 : MFX_FOURCC_NV12;
+        surf.first->Info.Width  = (mfxU16)surf.second->width;
+        surf.first->Info.Height = (mfxU16)surf.second->height;
+        surf.first->Info.CropW  = (mfxU16)surf.second->width;
+        surf.first->Info.CropH  = (mfxU16)surf.second->height;
+        surf.first->Data.Pitch  = (mfxU16)surf.second->pitch;
+        surf.first->Data.Y      = surf.second->plane(0);
+        surf.first->Data.UV     = surf.second->plane(1);
+    }
+    AlignedBuffer buffer(data[0].buffer_size * slices);
+    std::unique_ptr<ProcessorDelogo> proc(impl.create());
+    DataChunk chunk = { 0, (uint32_t)in.height };
+    if (proc->Init(&surfIn, &surfOut, data) != MFX_ERR_NONE
+        || proc->Process(&chunk, buffer.ptr) != MFX_ERR_NONE) {
+        fprintf(stderr, "  %s: NG: Process failed.\n", impl.name);
+        return false;
+    }
+    return true;
+}
+
+//ロゴの範囲外がinと一致し、ロゴの範囲内がrefと許容誤差内で一致するかを確認する
+//P010とNV12の比較では、refの値を4倍して比較する
+static bool compare_frame(const char *name, const LogoCase& lc, Frame& out, Frame& in, Frame& ref, int tolerance) {
+    const int ref_mul = (out.highbit && !ref.highbit) ? 4 : 1;
+    const int ref_pixel_bytes = ref.pixel_bytes();
+    for (int i = 0; i < 2; i++) {
+        const auto box = logo_box(lc, i, out.pixel_bytes());
+        for (int y = 0; y < out.rows(i); y++) {
+            for (int x = 0; x < out.pitch; x += out.pixel_bytes()) {
+                const int value = out.pix(i, x, y);
+                if (!box.inside(x, y)) {
+                    const int value_in = in.pix(i, x, y);
+                    if (value != value_in) {
+                        fprintf(stderr, "  %s: NG: plane %d, x(byte)=%d, y=%d outside logo changed: %d -> %d\n",
+                            name, i, x, y, value_in, value);
+                        return false;
+                    }
+                } else {
+                    const int value_ref = ref.pix(i, x / out.pixel_bytes() * ref_pixel_bytes, y) * ref_mul;
+                    if (std::abs(value - value_ref) > tolerance) {
+                        fprintf(stderr, "  %s: NG: plane %d, x(byte)=%d, y=%d: %d, expected %d\n",
+                            name, i, x, y, value, value_ref);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool test_delogo(std::mt19937& mt, const LogoCase& lc, const std::vector<const DelogoImpl *>& impls) {
+    const auto logo = make_logo(mt, lc, false);
+    const auto param = make_param();
+    //P010はNV12の4倍の入力から処理し、NV12の結果の4倍と比較する
+    //YC48へはどちらも同じ値に変換され、YC48からの変換の切り捨ての差で最大3の差が出る
+    Frame in8(lc.width, lc.height, false), in16(lc.width, lc.height, true);
+    fill_frame(mt, in8);
+    copy_frame_to_p010(in16, in8);
+    Frame ref8(lc.width, lc.height, false);
+    bool ok = true;
+    for (int highbit = 0; highbit < 2 && ok; highbit++) {
+        Frame& in = (highbit) ? in16 : in8;
+        ProcessDataDelogo data[2];
+        if (!create_delogo_process_data(data, logo, &param, lc.width, lc.height, highbit != 0)) {
+            fprintf(stderr, "  NG: not included in frame.\n");
+            return false;
+        }
+        //SSE4.1・分割なしを基準とする
+        Frame ref(lc.width, lc.height, highbit != 0);
+        if (!run_delogo(*impls[0], data, in, ref, 1)) {
+            return false;
+        }
+        if (highbit) {
+            ok &= compare_frame("P010 vs NV12x4", lc, ref, in, ref8, 3);
+        } else {
+            memcpy(ref8.buf.ptr, ref.buf.ptr, (size_t)ref.pitch * (ref.height + (ref.height >> 1)));
+        }
+        for (const auto impl : impls) {
+            for (int slices : { 1, 4 }) {
+                Frame out(lc.width, lc.height, highbit != 0);
+                if (!run_delogo(*impl, data, in, out, slices)) {
+                    return false;
+                }
+                char name[256];
+                snprintf(name, sizeof(name), "%s %s, slices=%d", (highbit) ? "P010" : "NV12", impl->name, slices);
+                ok &= compare_frame(name, lc, out, in, ref, ((impl->simd & AVX512F) != 0) ? 1 : 0);
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t simd = get_availableSIMD();
+    std::vector<const DelogoImpl *> impls;
+    for (const auto& impl : DELOGO_IMPLS) {
+        if ((simd & impl.simd) == impl.simd) {
+            impls.push_back(&impl);
+        } else {
+            fprintf(stderr, "%s not available, skipped.\n", impl.name);
+        }
+    }
+    if (impls.empty() || impls[0]->simd != SSE41) {
+        fprintf(stderr, "SSE4.1 not available, skipped.\n");
+        return 0;
+    }
+    const uint32_t seed = (argc > 1) ? (uint32_t)strtoul(argv[1], nullptr, 10) : 5489u;
+    std::mt19937 mt(seed);
+    //テストでは1コアの環境でも分割して並列処理させる
+    RGYThreadPool::get().setParam(std::max(4, (int)std::thread::hardware_concurrency()), 0);
+
+    int failed = 0, tested = 0;
+    for (const auto& lc : LOGO_CASES) {
+        fprintf(stderr, "%-30s (%4dx%4d, logo %d,%d %dx%d)\n", lc.name, lc.width, lc.height, lc.x, lc.y, lc.w, lc.h);
+        for (int itest = 0; itest < 2; itest++) {
+            const bool ok = (itest == 0) ? test_logo_data(mt, lc) : test_delogo(mt, lc, impls);
+            tested++;
+            if (!ok) {
+                failed++;
+            }
+        }
+    }
+    fprintf(stderr, "delogo: %d/%d failed (seed=%u).\n", failed, tested, seed);
+    return (failed) ? 1 : 0;
+}
@@ -0,0 +1,342 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+
+//Linux版のイベント(rgy_event.cpp)の確認とベンチマーク
+//  - 手動/自動リセット、タイムアウト、WaitForMultipleObjectsのwait-any/wait-allの動作を確認する
+//  - 複数のスレッドからのSetEventとwait-allの待機を繰り返し、取りこぼしやデッドロックがないことを確認する
+//    (2つのスレッドが同じイベントの組をwait-allで奪い合う場合を含む)
+//  - "--bench"を指定すると、2スレッド間のSetEvent→待機の往復時間を測定する
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "rgy_event.h"
+
+//デッドロックの検出用、これを超えて待機したら失敗とする
+static const uint32_t STALL_MS = 5000;
+
+static int64_t elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+//シグナル状態かどうか (自動リセットの場合は非シグナル状態になる)
+static bool is_signaled(HANDLE ev) {
+    return WaitForSingleObject(ev, 0) == WAIT_OBJECT_0;
+}
+
+#define CHECK(x) { if (!(x)) { fprintf(stderr, "  %s:%d: check failed: %s\n", __FILE__, __LINE__, #x); ret = false; } }
+
+//単一スレッドでの基本動作
+static bool test_basic() {
+    bool ret = true;
+    HANDLE evManual = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    HANDLE evAuto = CreateEvent(nullptr, FALSE, TRUE, nullptr);
+    CHECK(evManual != NULL && evAuto != NULL);
+    CHECK(GetEventFd(evManual) >= 0);
+
+    //初期状態と、手動リセット/自動リセット
+    CHECK(!is_signaled(evManual));
+    CHECK(is_signaled(evAuto));
+    CHECK(!is_signaled(evAuto));
+    SetEvent(evManual);
+    SetEvent(evManual);
+    CHECK(is_signaled(evManual));
+    CHECK(is_signaled(evManual));
+    ResetEvent(evManual);
+    CHECK(!is_signaled(evManual));
+    SetEvent(evAuto);
+    SetEvent(evAuto);
+    CHECK(is_signaled(evAuto));
+    CHECK(!is_signaled(evAuto));
+
+    //タイムアウトは指定時間より早く戻らない
+    auto start = std::chrono::steady_clock::now();
+    CHECK(WaitForSingleObject(evAuto, 30) == WAIT_TIMEOUT);
+    CHECK(elapsed_ms(start) >= 30);
+
+    //wait-anyは最も小さいindexを返し、そのイベントのみ取得する
+    HANDLE ev[4];
+    for (int i = 0; i < _countof(ev); i++) {
+        ev[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    }
+    SetEvent(ev[3]);
+    SetEvent(ev[1]);
+    CHECK(WaitForMultipleObjects(_countof(ev), ev, FALSE, 0) == WAIT_OBJECT_0 + 1);
+    CHECK(WaitForMultipleObjects(_countof(ev), ev, FALSE, 0) == WAIT_OBJECT_0 + 3);
+    CHECK(WaitForMultipleObjects(_countof(ev), ev, FALSE, 0) == WAIT_TIMEOUT);
+
+    //wait-allは、すべてがシグナル状態になるまで自動リセットのイベントを取得しない
+    SetEvent(ev[0]);
+    SetEvent(ev[2]);
+    SetEvent(ev[3]);
+    start = std::chrono::steady_clock::now();
+    CHECK(WaitForMultipleObjects(_countof(ev), ev, TRUE, 20) == WAIT_TIMEOUT);
+    CHECK(elapsed_ms(start) >= 20);
+    CHECK(is_signaled(ev[0]));
+    CHECK(!is_signaled(ev[1]));
+    CHECK(is_signaled(ev[2]));
+    CHECK(is_signaled(ev[3]));
+    for (int i = 0; i < _countof(ev); i++) {
+        SetEvent(ev[i]);
+    }
+    CHECK(WaitForMultipleObjects(_countof(ev), ev, TRUE, 0) == WAIT_OBJECT_0);
+    for (int i = 0; i < _countof(ev); i++) {
+        CHECK(!is_signaled(ev[i]));
+    }
+    //手動リセットのイベントはwait-allの後もシグナル状態のまま
+    HANDLE evMixed[2] = { evManual, ev[0] };
+    SetEvent(evManual);
+    SetEvent(ev[0]);
+    CHECK(WaitForMultipleObjects(_countof(evMixed), evMixed, TRUE, 0) == WAIT_OBJECT_0);
+    CHECK(is_signaled(evManual));
+    CHECK(!is_signaled(ev[0]));
+
+    //MAXIMUM_WAIT_OBJECTSを超える数のイベント
+    std::vector<HANDLE> evMany(MAXIMUM_WAIT_OBJECTS + 16);
+    for (auto& e : evMany) {
+        e = CreateEvent(nullptr, FALSE, TRUE, nullptr);
+    }
+    CHECK(WaitForMultipleObjects((uint32_t)evMany.size(), evMany.data(), TRUE, 0) == WAIT_OBJECT_0);
+    SetEvent(evMany.back());
+    CHECK(WaitForMultipleObjects((uint32_t)evMany.size(), evMany.data(), FALSE, 0) == WAIT_OBJECT_0 + evMany.size() - 1);
+    for (auto e : evMany) {
+        CloseEvent(e);
+    }
+    for (int i = 0; i < _countof(ev); i++) {
+        CloseEvent(ev[i]);
+    }
+    CloseEvent(evManual);
+    CloseEvent(evAuto);
+    fprintf(stderr, "basic: %s\n", ret ? "OK" : "NG");
+    return ret;
+}
+
+//各スレッドが1つずつイベントをセットし、待機側がwait-allで全スレッドの完了を待つ、を繰り返す
+static bool test_wait_all_workers(int nWorkers, int rounds) {
+    std::vector<HANDLE> evDone(nWorkers), evStart(nWorkers);
+    for (int i = 0; i < nWorkers; i++) {
+        evDone[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        evStart[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    }
+    std::atomic<bool> abort(false);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < nWorkers; i++) {
+        workers.push_back(std::thread([&, i]() {
+            for (int r = 0; r < rounds && !abort; r++) {
+                if (WaitForSingleObject(evStart[i], STALL_MS) != WAIT_OBJECT_0) {
+                    abort = true;
+                    break;
+                }
+                SetEvent(evDone[i]);
+            }
+        }));
+    }
+    bool ret = true;
+    for (int r = 0; r < rounds && ret; r++) {
+        for (int i = 0; i < nWorkers; i++) {
+            SetEvent(evStart[i]);
+        }
+        if (WaitForMultipleObjects(nWorkers, evDone.data(), TRUE, STALL_MS) != WAIT_OBJECT_0) {
+            fprintf(stderr, "  stalled at round %d.\n", r);
+            ret = false;
+        }
+        //wait-allの後は、すべて非シグナル状態になっているはず
+        for (int i = 0; i < nWorkers && ret; i++) {
+            if (is_signaled(evDone[i])) {
+                fprintf(stderr, "  event %d still signaled at round %d.\n", i, r);
+                ret = false;
+            }
+        }
+    }
+    abort = !ret;
+    for (int i = 0; i < nWorkers; i++) {
+        SetEvent(evStart[i]);
+    }
+    for (auto& th : workers) {
+        th.join();
+    }
+    for (int i = 0; i < nWorkers; i++) {
+        CloseEvent(evDone[i]);
+        CloseEvent(evStart[i]);
+    }
+    fprintf(stderr, "wait-all %2d workers x %d rounds: %s\n", nWorkers, rounds, ret ? "OK" : "NG");
+    return ret;
+}
+
+//2つのスレッドが同じイベントの組をwait-allで奪い合う
+//片方には逆順に渡すことで、途中まで取得してから先を越され、取得済みのものを巻き戻す状況を作る
+//セットした回数と、いずれかのスレッドの待機が成功した回数が一致すること (取得の巻き戻しで取りこぼしや二重取得がないこと)
+static bool test_wait_all_contention(int nEvents, int rounds) {
+    std::vector<HANDLE> ev(nEvents);
+    for (auto& e : ev) {
+        e = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    }
+    HANDLE evAck = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    std::atomic<bool> fin(false);
+    std::atomic<int> acquired(0);
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < 2; i++) {
+        waiters.push_back(std::thread([&, i]() {
+            std::vector<HANDLE> evWait = ev;
+            if (i) {
+                std::reverse(evWait.begin(), evWait.end());
+            }
+            while (!fin) {
+                if (WaitForMultipleObjects(nEvents, evWait.data(), TRUE, 10) == WAIT_OBJECT_0) {
+                    acquired++;
+                    SetEvent(evAck);
+                }
+            }
+        }));
+    }
+    bool ret = true;
+    std::mt19937 mt(1234);
+    for (int r = 0; r < rounds; r++) {
+        //セットする順序を変えて、奪い合いの途中状態をばらつかせる
+        std::vector<int> order(nEvents);
+        for (int i = 0; i < nEvents; i++) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), mt);
+        for (auto i : order) {
+            SetEvent(ev[i]);
+        }
+        if (WaitForSingleObject(evAck, STALL_MS) != WAIT_OBJECT_0) {
+            fprintf(stderr, "  stalled at round %d.\n", r);
+            ret = false;
+            break;
+        }
+    }
+    fin = true;
+    for (auto& th : waiters) {
+        th.join();
+    }
+    if (ret && acquired != rounds) {
+        fprintf(stderr, "  acquired %d times for %d rounds.\n", acquired.load(), rounds);
+        ret = false;
+    }
+    for (int i = 0; i < nEvents; i++) {
+        if (is_signaled(ev[i])) {
+            fprintf(stderr, "  event %d left signaled.\n", i);
+            ret = false;
+        }
+    }
+    for (auto& e : ev) {
+        CloseEvent(e);
+    }
+    CloseEvent(evAck);
+    fprintf(stderr, "wait-all contention %d events x %d rounds: %s\n", nEvents, rounds, ret ? "OK" : "NG");
+    return ret;
+}
+
+//別スレッドがイベントをセットし続けて待機が何度も起床しても、タイムアウトは最初の指定時間で判定される
+static bool test_timeout_under_wakeups() {
+    HANDLE ev[2];
+    ev[0] = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    ev[1] = CreateEvent(nullptr, FALSE, FALSE, nullptr); //セットされない
+    std::atomic<bool> fin(false);
+    std::thread toggler([&]() {
+        while (!fin) {
+            SetEvent(ev[0]);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            ResetEvent(ev[0]);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    bool ret = true;
+    const uint32_t timeout = 100;
+    const auto start = std::chrono::steady_clock::now();
+    CHECK(WaitForMultipleObjects(2, ev, TRUE, timeout) == WAIT_TIMEOUT);
+    const auto elapsed = elapsed_ms(start);
+    CHECK(elapsed >= timeout);
+    CHECK(elapsed < timeout * 3);
+    fin = true;
+    toggler.join();
+    CloseEvent(ev[0]);
+    CloseEvent(ev[1]);
+    fprintf(stderr, "timeout under wakeups (%lld ms): %s\n", (long long)elapsed, ret ? "OK" : "NG");
+    return ret;
+}
+
+//2スレッド間でイベントを交互にセットし、1往復あたりの時間(us)を返す
+static double bench_ping_pong(int rounds, bool useMultiple) {
+    HANDLE evPing = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    HANDLE evPong = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    HANDLE evIdle = CreateEvent(nullptr, TRUE, TRUE, nullptr); //wait-allの相手、常にシグナル状態
+    std::thread th([&]() {
+        HANDLE evWait[2] = { evPing, evIdle };
+        for (int i = 0; i < rounds; i++) {
+            if (useMultiple) {
+                WaitForMultipleObjects(2, evWait, TRUE, INFINITE);
+            } else {
+                WaitForSingleObject(evPing, INFINITE);
+            }
+            SetEvent(evPong);
+        }
+    });
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        SetEvent(evPing);
+        WaitForSingleObject(evPong, INFINITE);
+    }
+    const auto fin = std::chrono::steady_clock::now();
+    th.join();
+    CloseEvent(evPing);
+    CloseEvent(evPong);
+    CloseEvent(evIdle);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(fin - start).count() * 1e-3 / rounds;
+}
+
+int main(int argc, char **argv) {
+    const bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    int failed = 0;
+    failed += !test_basic();
+    failed += !test_wait_all_workers(1, 20000);
+    failed += !test_wait_all_workers(4, 20000);
+    failed += !test_wait_all_workers(16, 5000);
+    failed += !test_wait_all_contention(2, 20000);
+    failed += !test_wait_all_contention(8, 5000);
+    failed += !test_timeout_under_wakeups();
+    fprintf(stderr, "event: %d failed.\n", failed);
+    if (failed || !bench) {
+        return (failed) ? 1 : 0;
+    }
+
+    const int rounds = 200000;
+    fprintf(stdout, "ping-pong round trip (us)\n");
+    fprintf(stdout, "  WaitForSingleObject:               %7.2f\n", bench_ping_pong(rounds, false));
+    fprintf(stdout, "  WaitForMultipleObjects (wait-all): %7.2f\n", bench_ping_pong(rounds, true));
+    return 0;
+}
@@ -0,0 +1,308 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+
+//RGYQueueSPSPRingの確認とベンチマーク
+//  - 押し込み/取り出しを別スレッドで行い、順序が保たれること、maxCapacityを超えないことを確認する
+//    (スロット数がmaxCapacity以上の場合と、maxCapacityがスロット数を超えてリングが拡張される場合)
+//  - keep_length、clear(deleter)の動作を確認する
+//  - "--bench"を指定すると、RGYQueueSPSPとRGYQueueSPSPRingについて
+//    スループットと、待機している側が起床するまでの時間を測定する
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <immintrin.h>
+#include "rgy_util.h"
+#include "rgy_queue.h"
+
+//キューに積むデータ (1キャッシュライン)
+struct QueueItem {
+    uint64_t seq;
+    int64_t timestamp; //押し込み/取り出しの時刻 (ns)
+    char pad[48];
+};
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//取り出し側: データが取り出せるまで待機する
+template<typename Queue>
+static void pop_wait(Queue& queue, QueueItem *item) {
+    while (!queue.front_copy_and_pop_no_lock(item)) {
+        queue.wait_for_push();
+    }
+}
+
+//別スレッドからcount個押し込み、順序とmaxCapacityを確認する
+static bool test_order(size_t bufSize, size_t maxCapacity, uint64_t count) {
+    RGYQueueSPSPRing<QueueItem> queue;
+    queue.init(bufSize, maxCapacity);
+    std::atomic<size_t> maxSize(0);
+    std::thread producer([&]() {
+        QueueItem item = { 0 };
+        for (uint64_t i = 0; i < count; i++) {
+            item.seq = i;
+            queue.push(item);
+            //取り出し側はsizeを減らすことしかしないので、押し込み直後のsizeはmaxCapacity以下のはず
+            const size_t size = queue.size();
+            if (size > maxSize) {
+                maxSize = size;
+            }
+        }
+    });
+    bool ret = true;
+    for (uint64_t i = 0; i < count; i++) {
+        QueueItem item = { 0 };
+        pop_wait(queue, &item);
+        if (item.seq != i && ret) {
+            fprintf(stderr, "  order error: bufSize %d, maxCapacity %lld: expected %lld, got %lld.\n",
+                (int)bufSize, (long long)maxCapacity, (long long)i, (long long)item.seq);
+            ret = false;
+        }
+    }
+    producer.join();
+    if (maxSize > maxCapacity) {
+        fprintf(stderr, "  capacity error: bufSize %d, maxCapacity %lld: size reached %lld.\n",
+            (int)bufSize, (long long)maxCapacity, (long long)maxSize.load());
+        ret = false;
+    }
+    if (!queue.empty()) {
+        fprintf(stderr, "  queue not empty: bufSize %d, maxCapacity %lld.\n", (int)bufSize, (long long)maxCapacity);
+        ret = false;
+    }
+    fprintf(stderr, "order bufSize %5d, maxCapacity %20llu: %s\n", (int)bufSize, (unsigned long long)maxCapacity, ret ? "OK" : "NG");
+    return ret;
+}
+
+//リングの拡張: 取り出さずに押し込み続け、拡張の前後でデータが保たれることを確認する
+static bool test_grow() {
+    RGYQueueSPSPRing<QueueItem> queue;
+    queue.init(16);
+    bool ret = true;
+    uint64_t next = 0;
+    //先頭が拡張前のリングの途中にある状態で拡張させる
+    for (uint64_t i = 0; i < 10; i++) {
+        QueueItem item = { 0 };
+        item.seq = i;
+        queue.push(item);
+    }
+    for (int i = 0; i < 7; i++, next++) {
+        QueueItem item = { 0 };
+        if (!queue.front_copy_and_pop_no_lock(&item) || item.seq != next) {
+            ret = false;
+        }
+    }
+    for (uint64_t i = 10; i < 1000; i++) {
+        QueueItem item = { 0 };
+        item.seq = i;
+        queue.push(item);
+    }
+    for (uint32_t i = 0; i < queue.size(); i++) {
+        QueueItem item = { 0 };
+        if (!queue.copy(&item, i) || item.seq != next + i) {
+            ret = false;
+        }
+    }
+    for (; next < 1000; next++) {
+        QueueItem item = { 0 };
+        if (!queue.front_copy_and_pop_no_lock(&item) || item.seq != next) {
+            ret = false;
+        }
+    }
+    ret &= queue.empty();
+    fprintf(stderr, "grow: %s\n", ret ? "OK" : "NG");
+    return ret;
+}
+
+//keep_lengthが設定されている間は、その長さを超えた分しか取り出せないことを確認する
+static bool test_keep_length() {
+    RGYQueueSPSPRing<QueueItem> queue;
+    queue.init(16);
+    queue.set_keep_length(3);
+    bool ret = true;
+    QueueItem item = { 0 };
+    for (uint64_t i = 0; i < 3; i++) {
+        item.seq = i;
+        queue.push(item);
+    }
+    ret &= !queue.front_copy_no_lock(&item);
+    ret &= !queue.front_copy_and_pop_no_lock(&item);
+    ret &= !queue.pop();
+    item.seq = 3;
+    queue.push(item);
+    ret &= queue.front_copy_and_pop_no_lock(&item) && item.seq == 0;
+    ret &= !queue.front_copy_and_pop_no_lock(&item);
+    //keep_lengthを解除すると、待機中の取り出し側が起床する
+    std::thread waiter([&]() {
+        QueueItem item2 = { 0 };
+        pop_wait(queue, &item2);
+        ret &= item2.seq == 1;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    queue.set_keep_length(0);
+    waiter.join();
+    ret &= queue.size() == 2;
+
+    int deleted = 0;
+    queue.clear([&deleted](QueueItem *) { deleted++; });
+    ret &= deleted == 2 && queue.empty();
+    fprintf(stderr, "keep_length/clear: %s\n", ret ? "OK" : "NG");
+    return ret;
+}
+
+//count個を押し込み/取り出す時間を測定し、Mitems/sを返す
+template<typename Queue>
+static double bench_throughput(size_t bufSize, size_t maxCapacity, uint64_t count) {
+    Queue queue;
+    queue.init(bufSize, maxCapacity);
+    const auto start = std::chrono::steady_clock::now();
+    std::thread producer([&]() {
+        QueueItem item = { 0 };
+        for (uint64_t i = 0; i < count; i++) {
+            item.seq = i;
+            queue.push(item);
+        }
+    });
+    QueueItem item = { 0 };
+    for (uint64_t i = 0; i < count; i++) {
+        pop_wait(queue, &item);
+    }
+    producer.join();
+    const auto fin = std::chrono::steady_clock::now();
+    return count / (double)std::chrono::duration_cast<std::chrono::microseconds>(fin - start).count();
+}
+
+struct LatencyResult {
+    double median, p99, max; //us
+};
+
+static LatencyResult summarize(std::vector<int64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    LatencyResult result;
+    result.median = samples[samples.size() / 2] * 1e-3;
+    result.p99    = samples[samples.size() * 99 / 100] * 1e-3;
+    result.max    = samples.back() * 1e-3;
+    return result;
+}
+
+//空のキューで待機している取り出し側が、押し込みから起床するまでの時間
+template<typename Queue>
+static LatencyResult bench_pop_wakeup(int count) {
+    Queue queue;
+    queue.init(16);
+    std::vector<int64_t> samples;
+    samples.reserve(count);
+    std::thread producer([&]() {
+        QueueItem item = { 0 };
+        for (int i = 0; i < count; i++) {
+            //取り出し側が待機に入るのを待つ
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            item.seq = i;
+            item.timestamp = now_ns();
+            queue.push(item);
+        }
+    });
+    for (int i = 0; i < count; i++) {
+        QueueItem item = { 0 };
+        pop_wait(queue, &item);
+        samples.push_back(now_ns() - item.timestamp);
+    }
+    producer.join();
+    return summarize(samples);
+}
+
+//maxCapacityに達して待機している押し込み側が、取り出しから起床するまでの時間
+template<typename Queue>
+static LatencyResult bench_push_wakeup(int count) {
+    Queue queue;
+    queue.init(16, 1);
+    std::vector<int64_t> samples;
+    samples.reserve(count);
+    std::atomic<int64_t> popTime(0);
+    std::thread consumer([&]() {
+        for (int i = 0; i < count + 1; i++) {
+            //押し込み側が待機に入るのを待つ
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            while (queue.size() == 0) {
+                queue.wait_for_push();
+            }
+            popTime = now_ns();
+            queue.pop();
+        }
+    });
+    QueueItem item = { 0 };
+    queue.push(item);
+    for (int i = 0; i < count; i++) {
+        queue.push(item);
+        samples.push_back(now_ns() - popTime.load());
+    }
+    consumer.join();
+    return summarize(samples);
+}
+
+template<typename Queue>
+static void bench_queue(const char *name) {
+    const uint64_t count = 4 * 1000 * 1000;
+    const double tpUnbounded = bench_throughput<Queue>(1024, SIZE_MAX, count);
+    const double tpBounded   = bench_throughput<Queue>(1024, 64, count);
+    const auto popWakeup  = bench_pop_wakeup<Queue>(2000);
+    const auto pushWakeup = bench_push_wakeup<Queue>(2000);
+    fprintf(stdout, "%-16s %9.2f %9.2f   %7.1f %7.1f %8.1f   %7.1f %7.1f %8.1f\n", name,
+        tpUnbounded, tpBounded,
+        popWakeup.median, popWakeup.p99, popWakeup.max,
+        pushWakeup.median, pushWakeup.p99, pushWakeup.max);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    const bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    int failed = 0;
+    failed += !test_order(16, 64, 1000000);
+    failed += !test_order(16, 1, 100000);
+    failed += !test_order(1024, 1024, 1000000);
+    failed += !test_order(16, SIZE_MAX, 1000000);
+    failed += !test_grow();
+    failed += !test_keep_length();
+    fprintf(stderr, "queue ring: %d failed.\n", failed);
+    if (failed || !bench) {
+        return (failed) ? 1 : 0;
+    }
+
+    fprintf(stdout, "                 throughput(Mitems/s)   pop wakeup(us)             push wakeup(us)\n");
+    fprintf(stdout, "                 unbounded   cap=64    median     p99      max   median     p99      max\n");
+    bench_queue<RGYQueueSPSP<QueueItem>>("RGYQueueSPSP");
+    bench_queue<RGYQueueSPSPRing<QueueItem>>("RGYQueueSPSPRing");
+    return 0;
+}
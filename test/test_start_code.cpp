@@ -0,0 +1,293 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+
+//スタートコード探索(find_start_code)とparse_nal_unitの確認とベンチマーク
+//  - C/SSE2/AVX2の各関数の結果が、1byteずつ調べる処理と一致するかをランダムなデータで確認する
+//    (0や1の多いデータ、00 00 03を含むデータ、finの直後にスタートコードがある場合を含む)
+//  - parse_nal_unit_h264/hevcの結果が、以前の1byteずつ調べる実装と一致するかを確認する
+//  - "--bench"を指定すると、各関数の探索速度と、フレームあたりのparse_nal_unitの時間を測定する
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "rgy_simd.h"
+#include "rgy_bitstream.h"
+
+struct StartCodeFunc {
+    const char *name;
+    funcFindStartCode func;
+    uint32_t simd;
+};
+
+static std::vector<StartCodeFunc> list_funcs() {
+    const auto simd = get_availableSIMD();
+    static const StartCodeFunc funcs[] = {
+        { "c",     find_start_code_c,    NONE },
+        { "sse2",  find_start_code_sse2, SSE2 },
+#if defined(_MSC_VER) || defined(__AVX2__)
+        { "avx2",  find_start_code_avx2, AVX2 | AVX },
+#endif
+    };
+    std::vector<StartCodeFunc> list;
+    for (const auto& f : funcs) {
+        if ((simd & f.simd) == f.simd) {
+            list.push_back(f);
+        }
+    }
+    return list;
+}
+
+//1byteずつ調べる
+static const uint8_t *find_start_code_ref(const uint8_t *data, const uint8_t *fin) {
+    for (const uint8_t *ptr = data; ptr + 2 < fin; ptr++) {
+        if (ptr[0] == 0 && ptr[1] == 0 && ptr[2] == 1) {
+            return ptr;
+        }
+    }
+    return fin;
+}
+
+//以前の実装 (1byteずつ調べる)
+static std::vector<nal_info> parse_nal_unit_ref(const uint8_t *data, size_t size, bool hevc) {
+    std::vector<nal_info> nal_list;
+    if (size > 3) {
+        nal_info nal_start = { nullptr, 0, 0 };
+        const auto i_fin = size - 3;
+        for (size_t i = 0; i < i_fin; i++) {
+            if (data[i+0] == 0 && data[i+1] == 0 && data[i+2] == 1) {
+                if (nal_start.ptr) {
+                    nal_list.push_back(nal_start);
+                }
+                nal_start.ptr = data + i - (i > 0 && data[i-1] == 0);
+                nal_start.type = (hevc) ? (data[i+3] & 0x7f) >> 1 : data[i+3] & 0x1f;
+                nal_start.size = data + size - nal_start.ptr;
+                if (nal_list.size()) {
+                    auto prev = nal_list.end()-1;
+                    prev->size = nal_start.ptr - prev->ptr;
+                }
+                i += 3;
+            }
+        }
+        if (nal_start.ptr) {
+            nal_list.push_back(nal_start);
+        }
+    }
+    return nal_list;
+}
+
+//テスト用のデータの種類
+enum DataPattern {
+    PATTERN_RANDOM,    //一様乱数 (スタートコードはほとんど含まれない)
+    PATTERN_DENSE,     //0と1が多く、スタートコードが頻繁に現れる
+    PATTERN_EMULATION, //00 00 03が多く、スタートコードはまれ
+    PATTERN_COUNT
+};
+
+static void fill_data(uint8_t *buf, size_t size, DataPattern pattern, std::mt19937& mt) {
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (size_t i = 0; i < size; i++) {
+        const int r = dist(mt);
+        switch (pattern) {
+        case PATTERN_DENSE:
+            buf[i] = (uint8_t)((r < 96) ? 0 : ((r < 160) ? 1 : r));
+            break;
+        case PATTERN_EMULATION:
+            buf[i] = (uint8_t)((r < 64) ? 0 : ((r < 96) ? 3 : ((r < 98) ? 1 : r)));
+            break;
+        default:
+            buf[i] = (uint8_t)r;
+            break;
+        }
+    }
+}
+
+static const int MAX_LEN = 300;
+static const int GUARD = 64;
+
+//[data, data+len)の直後をスタートコードで埋め、finを超えて読んだ結果を返さないことも確認する
+static bool test_find_start_code(const StartCodeFunc& f, std::mt19937& mt) {
+    std::vector<uint8_t> buf(MAX_LEN + 64 + GUARD);
+    int errors = 0;
+    for (int pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+        for (int len = 0; len <= MAX_LEN; len++) {
+            for (int iter = 0; iter < 20; iter++) {
+                const int offset = mt() & 63;
+                uint8_t *data = buf.data() + offset;
+                fill_data(data, len, (DataPattern)pattern, mt);
+                for (int i = 0; i < GUARD; i++) {
+                    data[len + i] = (uint8_t)((i % 3 == 2) ? 1 : 0);
+                }
+                //見つかった位置から探索を続け、すべてのスタートコードの位置が一致するかを確認する
+                const uint8_t *fin = data + len;
+                const uint8_t *ptrRef = data;
+                const uint8_t *ptr = data;
+                for (;;) {
+                    ptrRef = find_start_code_ref(ptrRef, fin);
+                    ptr = f.func(ptr, fin);
+                    if (ptr != ptrRef) {
+                        if (errors++ < 8) {
+                            fprintf(stderr, "  %s: pattern %d, len %d, offset %d: expected %d, got %d.\n",
+                                f.name, pattern, len, offset, (int)(ptrRef - data), (int)(ptr - data));
+                        }
+                        break;
+                    }
+                    if (ptr == fin) {
+                        break;
+                    }
+                    ptrRef++;
+                    ptr++;
+                }
+            }
+        }
+    }
+    fprintf(stderr, "find_start_code_%-4s: %s\n", f.name, errors ? "NG" : "OK");
+    return errors == 0;
+}
+
+static bool compare_nal_list(const RGYNalList& nal_list, const std::vector<nal_info>& ref) {
+    if (nal_list.size() != ref.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < ref.size(); i++) {
+        if (nal_list[i].ptr != ref[i].ptr || nal_list[i].size != ref[i].size || nal_list[i].type != ref[i].type) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_parse_nal_unit(std::mt19937& mt) {
+    std::vector<uint8_t> buf(4096);
+    RGYNalList nal_list;
+    int errors = 0;
+    for (int pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+        for (int iter = 0; iter < 2000; iter++) {
+            const size_t size = mt() % buf.size();
+            fill_data(buf.data(), size, (DataPattern)pattern, mt);
+            for (int hevc = 0; hevc < 2; hevc++) {
+                const auto ref = parse_nal_unit_ref(buf.data(), size, hevc != 0);
+                if (hevc) {
+                    parse_nal_unit_hevc(buf.data(), size, nal_list);
+                } else {
+                    parse_nal_unit_h264(buf.data(), size, nal_list);
+                }
+                const auto vec = (hevc) ? parse_nal_unit_hevc(buf.data(), size) : parse_nal_unit_h264(buf.data(), size);
+                bool ok = compare_nal_list(nal_list, ref) && vec.size() == ref.size();
+                for (size_t i = 0; ok && i < ref.size(); i++) {
+                    ok = vec[i].ptr == ref[i].ptr && vec[i].size == ref[i].size && vec[i].type == ref[i].type;
+                }
+                if (!ok && errors++ < 8) {
+                    fprintf(stderr, "  parse_nal_unit_%s: pattern %d, size %d: %d NALs, expected %d.\n",
+                        hevc ? "hevc" : "h264", pattern, (int)size, (int)nal_list.size(), (int)ref.size());
+                }
+            }
+        }
+    }
+    //同じリストを使いまわせば、容量が足りている限りヒープ確保は発生しない
+    const int allocCount = nal_list.allocCount();
+    for (int iter = 0; iter < 100; iter++) {
+        const size_t size = 1024;
+        fill_data(buf.data(), size, PATTERN_RANDOM, mt);
+        parse_nal_unit_h264(buf.data(), size, nal_list);
+    }
+    if (nal_list.allocCount() != allocCount) {
+        fprintf(stderr, "  RGYNalList reallocated on reuse.\n");
+        errors++;
+    }
+    fprintf(stderr, "parse_nal_unit: %s\n", errors ? "NG" : "OK");
+    return errors == 0;
+}
+
+//4MB (イントラフレーム相当) のデータを探索する速度 (GB/s)
+static double bench_find_start_code(funcFindStartCode func, const std::vector<uint8_t>& buf) {
+    const int loops = 200;
+    size_t found = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++) {
+        const uint8_t *fin = buf.data() + buf.size();
+        for (const uint8_t *ptr = buf.data(); (ptr = func(ptr, fin)) < fin; ptr += 3) {
+            found++;
+        }
+    }
+    const auto fin = std::chrono::steady_clock::now();
+    const double sec = std::chrono::duration_cast<std::chrono::microseconds>(fin - start).count() * 1e-6;
+    return (found == (size_t)-1) ? 0.0 : buf.size() * (double)loops / sec * 1e-9;
+}
+
+//1フレームあたりのparse_nal_unit_h264の時間 (us)
+template<typename Func>
+static double bench_parse(Func func) {
+    const int loops = 200;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++) {
+        func();
+    }
+    const auto fin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(fin - start).count() / (double)loops;
+}
+
+int main(int argc, char **argv) {
+    const bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+    std::mt19937 mt(5489);
+    const auto funcs = list_funcs();
+    int failed = 0;
+    for (const auto& f : funcs) {
+        failed += !test_find_start_code(f, mt);
+    }
+    failed += !test_parse_nal_unit(mt);
+    fprintf(stderr, "start code: %d failed.\n", failed);
+    if (failed || !bench) {
+        return (failed) ? 1 : 0;
+    }
+
+    //乱数のデータに、64KBおきにスライスNALを置いた4MBのフレーム
+    std::vector<uint8_t> frame(4 * 1024 * 1024);
+    fill_data(frame.data(), frame.size(), PATTERN_RANDOM, mt);
+    for (size_t pos = 0; pos + 5 < frame.size(); pos += 64 * 1024) {
+        frame[pos+0] = 0;
+        frame[pos+1] = 0;
+        frame[pos+2] = 0;
+        frame[pos+3] = 1;
+        frame[pos+4] = 0x65;
+    }
+    fprintf(stdout, "find_start_code, 4MB frame (GB/s)\n");
+    fprintf(stdout, "  %-8s %7.2f\n", "byte", bench_find_start_code(find_start_code_ref, frame));
+    for (const auto& f : funcs) {
+        fprintf(stdout, "  %-8s %7.2f\n", f.name, bench_find_start_code(f.func, frame));
+    }
+    RGYNalList nal_list;
+    fprintf(stdout, "parse_nal_unit_h264, 4MB frame, %d NALs (us/frame)\n", (int)parse_nal_unit_ref(frame.data(), frame.size(), false).size());
+    fprintf(stdout, "  %-8s %9.1f\n", "byte", bench_parse([&]() { parse_nal_unit_ref(frame.data(), frame.size(), false); }));
+    fprintf(stdout, "  %-8s %9.1f\n", "current", bench_parse([&]() { parse_nal_unit_h264(frame.data(), frame.size(), nal_list); }));
+    return 0;
+}
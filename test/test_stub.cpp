@@ -0,0 +1,141 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2019 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+//テスト用の依存関数
+//cpu_info.cpp/rgy_util.cppはQSVのセッションやGPU情報の取得などに依存していて、
+//テストにリンクするとそれらが芋づる式に必要になるので、テストで使用する関数のみをここで定義する
+#include <cstdarg>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cpu_info.h"
+#include "rgy_status.h"
+#include "qsv_util.h"
+
+//コア数のみを返す (キャッシュの情報が必要な側はsysconfなどで代替する)
+cpu_info_t get_cpu_info() {
+    cpu_info_t info = { 0 };
+    info.nodes = 1;
+    info.physical_cores = std::max(1u, std::thread::hardware_concurrency());
+    info.logical_cores = info.physical_cores;
+    return info;
+}
+
+std::string strsprintf(const char *format, ...) {
+    if (format == nullptr) {
+        return "";
+    }
+    va_list args;
+    va_start(args, format);
+    va_list args2;
+    va_copy(args2, args);
+    const int len = vsnprintf(nullptr, 0, format, args);
+    std::vector<char> buffer(std::max(len, 0) + 1, 0);
+    vsnprintf(buffer.data(), buffer.size(), format, args2);
+    va_end(args2);
+    va_end(args);
+    return std::string(buffer.data());
+}
+
+std::vector<std::string> split(const std::string &str, const std::string &delim, bool bTrim) {
+    std::vector<std::string> res;
+    size_t current = 0, found;
+    while (std::string::npos != (found = str.find(delim, current))) {
+        res.push_back(std::string(str, current, found - current));
+        current = found + delim.size();
+    }
+    res.push_back(std::string(str, current, str.size() - current));
+    if (bTrim) {
+        res.erase(std::remove(res.begin(), res.end(), std::string()), res.end());
+    }
+    return res;
+}
+
+std::string tchar_to_string(const TCHAR *tstr, uint32_t codepage) {
+    return (tstr) ? std::string(tstr) : "";
+}
+
+//rgy_status.cppはCPU/GPU情報の取得に依存するので、入力のテストで必要なフレーム数の集計のみを行う
+EncodeStatus::EncodeStatus() :
+    m_inputReadTimeUs(0),
+    m_inputWaitTimeUs(0) {
+    memset(&m_sData, 0, sizeof(m_sData));
+    m_pause = false;
+    m_bStdErrWriteToConsole = false;
+    m_bEncStarted = false;
+}
+EncodeStatus::~EncodeStatus() {
+}
+void EncodeStatus::Init(uint32_t outputFPSRate, uint32_t outputFPSScale,
+    uint32_t totalInputFrames, double totalDuration, const sTrimParam &trim,
+    std::shared_ptr<RGYLog> pRGYLog, std::shared_ptr<CPerfMonitor> pPerfMonitor) {
+    m_sData.outputFPSRate = outputFPSRate;
+    m_sData.outputFPSScale = outputFPSScale;
+    m_sData.frameTotal = totalInputFrames;
+    m_sData.totalDuration = totalDuration;
+    m_pRGYLog = pRGYLog;
+}
+void EncodeStatus::UpdateDisplay(const TCHAR *mes, double progressPercent) {
+}
+RGY_ERR EncodeStatus::UpdateDisplayByCurrentDuration(double currentDuration) {
+    return RGY_ERR_NONE;
+}
+RGY_ERR EncodeStatus::UpdateDisplay(double progressPercent) {
+    return RGY_ERR_NONE;
+}
+void EncodeStatus::SetPrivData(void *pPrivateData) {
+}
+void EncodeStatus::WriteLine(const TCHAR *mes) {
+}
+void EncodeStatus::WriteLineDirect(TCHAR *mes) {
+}
+
+//plugin_delogo.cppが参照する関数 (ロゴファイルの読み込みやプラグインの初期化など、テストで使用しない処理から参照される)
+unsigned int char_to_tstring(tstring& tstr, const char *str, uint32_t codepage) {
+    tstr = (str) ? std::string(str) : _T("");
+    return (unsigned int)tstr.length();
+}
+tstring char_to_tstring(const char *str, uint32_t codepage) {
+    return (str) ? std::string(str) : _T("");
+}
+tstring char_to_tstring(const std::string& str, uint32_t codepage) {
+    return str;
+}
+std::string GetFullPath(const char *path) {
+    return path;
+}
+mfxExtBuffer *GetExtBuffer(mfxExtBuffer **ppExtBuf, int nCount, uint32_t targetBufferId) {
+    return nullptr;
+}
+//AVXが使用可能な場合のみ呼ばれる
+int rgy_avx_dummy_if_avail(int bAVXAvail) {
+    return 1;
+}